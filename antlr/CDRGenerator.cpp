@@ -77,6 +77,21 @@ static int generate_cpp(std::ostream &ostream, CDRBuildTypes &buildTypes, Module
     return 0;
 }
 
+// The C++ serialization code followed by a Google Benchmark
+// program that encodes and decodes each struct and union
+static int generate_benchmark(std::ostream &ostream, CDRBuildTypes &buildTypes, ModuleDecl *moduleDecl) {
+    int rv = generate_cpp(ostream, buildTypes, moduleDecl);
+    if (rv != 0) {
+        return rv;
+    }
+    ostream << std::endl;
+    ostream << "#include <benchmark/benchmark.h>" << std::endl;
+    moduleDecl->cppDeclareBenchmarks(ostream);
+    ostream << std::endl;
+    ostream << "BENCHMARK_MAIN();" << std::endl;
+    return 0;
+}
+
 int parse(std::istream &istream, std::ostream &ostream, std::ostream &estream, target_t target, bool packed) {
     CDRModuleCounter moduleCounter;
     antlr4::tree::ParseTreeWalker moduleWalker;
@@ -133,6 +148,9 @@ int parse(std::istream &istream, std::ostream &ostream, std::ostream &estream, t
         case TargetLanguage::DFDL_LANG:
             rv = generate_dfdl(ostream, buildTypes, moduleDecl);
             break;
+        case TargetLanguage::BENCHMARK_LANG:
+            rv = generate_benchmark(ostream, buildTypes, moduleDecl);
+            break;
         default:
             estream << "unknown target language " << target << std::endl;
             rv = 1;
@@ -151,6 +169,8 @@ std::string target_as_string(TargetLanguage target) {
             return "cpp";
         case DFDL_LANG:
             return "dfdl";
+        case BENCHMARK_LANG:
+            return "benchmark";
         case UNKNOWN:
         default:
             return "unknown";
@@ -21,7 +21,8 @@ typedef enum TargetLanguage {
     UNKNOWN,
     C_LANG,
     CPP_LANG,
-    DFDL_LANG
+    DFDL_LANG,
+    BENCHMARK_LANG
 } target_t;
 
 std::string target_as_string(TargetLanguage target);
@@ -46,6 +46,8 @@ int main(int argc, char* argv[]) {
                     target = TargetLanguage::C_LANG;
                 } else if (strcmp("dfdl", optarg) == 0) {
                     target = TargetLanguage::DFDL_LANG;
+                } else if (strcmp("benchmark", optarg) == 0) {
+                    target = TargetLanguage::BENCHMARK_LANG;
                 } else {
                     std::cerr << "unknown code generation target " << optarg << std::endl;
                     return 1;
@@ -466,6 +466,53 @@ void cppPirateNamespaceFooter(std::ostream &ostream) {
     ostream << "}" << std::endl;
 }
 
+// Google Benchmark functions that measure pirate::Serialization<T>
+// on a zero-filled value of the type. The bytes processed are the
+// length of the encoded buffer so the report includes a rate.
+void cppDeclareBenchmarkFunctions(std::ostream &ostream, std::string namespacePrefix, std::string identifier) {
+    std::string typeName = "struct " + namespacePrefix + identifier;
+    std::string serialization = "pirate::Serialization<" + typeName + ">";
+    std::string encodeName = "BM_Encode_" + identifier;
+    std::string decodeName = "BM_Decode_" + identifier;
+
+    ostream << std::endl;
+    ostream << "static" << " " << "void" << " " << encodeName << "(" << "benchmark::State& state" << ")" << " " << "{" << std::endl;
+    ostream << indent_manip::push;
+    ostream << typeName << " " << "val" << ";" << std::endl;
+    ostream << "std::vector<char>" << " " << "buf" << ";" << std::endl;
+    ostream << "std::memset" << "(" << "&val" << "," << " " << "0" << "," << " " << "sizeof(val)" << ")" << ";" << std::endl;
+    ostream << "for" << " " << "(" << "auto _ : state" << ")" << " " << "{" << std::endl;
+    ostream << indent_manip::push;
+    ostream << serialization << "::" << "toBuffer" << "(" << "val" << "," << " " << "buf" << ")" << ";" << std::endl;
+    ostream << "benchmark::DoNotOptimize" << "(" << "buf.data()" << ")" << ";" << std::endl;
+    ostream << "benchmark::ClobberMemory" << "(" << ")" << ";" << std::endl;
+    ostream << indent_manip::pop;
+    ostream << "}" << std::endl;
+    ostream << "state.SetBytesProcessed" << "(" << "state.iterations()" << " " << "*" << " ";
+    ostream << "buf.size()" << ")" << ";" << std::endl;
+    ostream << indent_manip::pop;
+    ostream << "}" << std::endl;
+    ostream << "BENCHMARK" << "(" << encodeName << ")" << ";" << std::endl;
+    ostream << std::endl;
+    ostream << "static" << " " << "void" << " " << decodeName << "(" << "benchmark::State& state" << ")" << " " << "{" << std::endl;
+    ostream << indent_manip::push;
+    ostream << typeName << " " << "val" << ";" << std::endl;
+    ostream << "std::vector<char>" << " " << "buf" << ";" << std::endl;
+    ostream << "std::memset" << "(" << "&val" << "," << " " << "0" << "," << " " << "sizeof(val)" << ")" << ";" << std::endl;
+    ostream << serialization << "::" << "toBuffer" << "(" << "val" << "," << " " << "buf" << ")" << ";" << std::endl;
+    ostream << "for" << " " << "(" << "auto _ : state" << ")" << " " << "{" << std::endl;
+    ostream << indent_manip::push;
+    ostream << "val" << " " << "=" << " " << serialization << "::" << "fromBuffer" << "(" << "buf" << ")" << ";" << std::endl;
+    ostream << "benchmark::DoNotOptimize" << "(" << "val" << ")" << ";" << std::endl;
+    ostream << indent_manip::pop;
+    ostream << "}" << std::endl;
+    ostream << "state.SetBytesProcessed" << "(" << "state.iterations()" << " " << "*" << " ";
+    ostream << "buf.size()" << ")" << ";" << std::endl;
+    ostream << indent_manip::pop;
+    ostream << "}" << std::endl;
+    ostream << "BENCHMARK" << "(" << decodeName << ")" << ";" << std::endl;
+}
+
 void cDeclareFunctionNested(std::ostream &ostream, TypeSpec* typeSpec, Declarator* declarator,
     CDRFunc functionType, TargetLanguage languageType, std::string remotePrefix) {
 
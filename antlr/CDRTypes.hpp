@@ -85,6 +85,7 @@ public:
     virtual void cppDeclareAsserts(std::ostream &ostream) { }
     virtual void cppDeclareFunctions(std::ostream &ostream) = 0;
     virtual void cppDeclareFooter(std::ostream &ostream) { }
+    virtual void cppDeclareBenchmarks(std::ostream &ostream) { }
     virtual bool singleton() { return false; } // workaround for preventing destruction of singletons
     virtual bool container() { return false; } // structs and unions are containers
     virtual ~TypeSpec() { };
@@ -217,6 +218,7 @@ void cConvertByteOrderArray(std::ostream &ostream, TypeSpec* typeSpec,
 
 void cppPirateNamespaceHeader(std::ostream &ostream);
 void cppPirateNamespaceFooter(std::ostream &ostream);
+void cppDeclareBenchmarkFunctions(std::ostream &ostream, std::string namespacePrefix, std::string identifier);
 
 std::string cCreateFunctionName(CDRFunc functionType, std::string identifier);
 void cDeclareFunctionName(std::ostream &ostream, CDRFunc functionType, std::string identifier);
@@ -86,6 +86,12 @@ void ModuleDecl::cppDeclareFooter(std::ostream &ostream) {
     ostream << "}" << std::endl;
 }
 
+void ModuleDecl::cppDeclareBenchmarks(std::ostream &ostream) {
+    for (TypeSpec* definition : definitions) {
+        definition->cppDeclareBenchmarks(ostream);
+    }
+}
+
 ModuleDecl::~ModuleDecl() {
     for (TypeSpec* definition : definitions) {
         delete definition;
@@ -64,6 +64,9 @@ public:
     virtual void cppTypeDeclWire(std::ostream &ostream) override;
     virtual void cppDeclareAsserts(std::ostream &ostream) override { cDeclareAsserts(ostream); }
     virtual void cppDeclareFunctions(std::ostream &ostream) override;
+    virtual void cppDeclareBenchmarks(std::ostream &ostream) override {
+        cppDeclareBenchmarkFunctions(ostream, namespacePrefix, identifier);
+    }
     virtual bool container() override { return true; }
     void addMember(StructMember* member);
     virtual ~StructTypeSpec();
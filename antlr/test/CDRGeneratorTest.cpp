@@ -78,7 +78,7 @@ struct PrintParamName {
 
 INSTANTIATE_TEST_SUITE_P(RegressionTestSuite,
     RegressionTest, ::testing::Combine(::testing::ValuesIn(filenames),
-        ::testing::Values(TargetLanguage::C_LANG, TargetLanguage::CPP_LANG),
+        ::testing::Values(TargetLanguage::C_LANG, TargetLanguage::CPP_LANG, TargetLanguage::BENCHMARK_LANG),
         ::testing::Values(false, true)),
     PrintParamName());
 
@@ -0,0 +1,947 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+// Userspace emulation of the Mercury ILIP loopback driver
+// (devices/mercury/loopback_ilip). Load with LD_PRELOAD.
+//
+// The library interposes the libc calls that libpirate uses on the
+// /dev/gaps_ilip_* devices and on the generic netlink socket of
+// mercury_cntl.c. Emulated devices are backed by an eventfd so that
+// every emulated file descriptor is a real descriptor. Session state
+// and frame queues live in a POSIX shared memory object so that the
+// reader and the writer may be different processes.
+
+#undef _FORTIFY_SOURCE
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "gaps_ilip.h"
+
+#define ILIP_EMU_DEV_PREFIX     "/dev/gaps_ilip_"
+#define ILIP_EMU_ROOT_DEV       "/dev/gaps_ilip_0_root"
+#define ILIP_EMU_SHM_DEFAULT    "/gaps_ilip_emu"
+#define ILIP_EMU_MAGIC          0x494c4950u
+
+// Mirrors of the driver limits in ilip_base.h
+#define ILIP_EMU_SESSIONS       32u     // GAPS_ILIP_NSESSIONS
+#define ILIP_EMU_MESSAGES       64u     // GAPS_ILIP_MESSAGE_COUNT
+#define ILIP_EMU_BLOCK_SIZE     256u    // GAPS_ILIP_BLOCK_SIZE
+
+// Default sessions 1 and 2 and one slot per hashed session
+#define ILIP_EMU_SLOTS          (ILIP_EMU_SESSIONS + 2u)
+#define ILIP_EMU_MAX_FD         4096
+#define ILIP_EMU_FAMILY_ID      0x30
+#define ILIP_EMU_FAMILY_NAME    "ilip_pf"
+#define ILIP_EMU_HEADER_LEN     36u     // ilip_message_t without payload
+#define ILIP_EMU_SPIN_NS        100000ull
+
+typedef struct {
+    uint64_t deliver_ns;
+    uint32_t len;
+    uint8_t data[ILIP_EMU_BLOCK_SIZE];
+} ilip_emu_frame_t;
+
+typedef struct {
+    uint32_t busy;
+    uint32_t session_id;
+    uint32_t level;
+    uint32_t readers;
+    uint32_t writers;
+    uint32_t send_count;
+    uint32_t receive_count;
+    uint32_t send_reject_count;
+    uint32_t receive_reject_count;
+    uint32_t send_ilip_count;
+    uint32_t receive_ilip_count;
+    uint32_t send_ilip_reject_count;
+    uint32_t receive_ilip_reject_count;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t link_free_ns;
+    uint32_t head;
+    uint32_t count;
+    ilip_emu_frame_t frames[ILIP_EMU_MESSAGES];
+} ilip_emu_session_t;
+
+typedef struct {
+    uint32_t magic;
+    pthread_mutex_t lock;
+    uint32_t root_busy;
+    ilip_emu_session_t sessions[ILIP_EMU_SLOTS];
+} ilip_emu_shm_t;
+
+typedef enum {
+    ILIP_EMU_ROOT = 1,
+    ILIP_EMU_READ,
+    ILIP_EMU_WRITE,
+    ILIP_EMU_NETLINK
+} ilip_emu_kind_t;
+
+typedef struct {
+    ilip_emu_kind_t kind;
+    int nonblock;
+    int peer;
+    ilip_emu_session_t *session;
+    uint32_t message_count;
+    uint32_t cfg[ILIP_EMU_BLOCK_SIZE / sizeof(uint32_t)];
+} ilip_emu_file_t;
+
+static int (*real_open)(const char *, int, ...);
+static int (*real_open64)(const char *, int, ...);
+static int (*real_close)(int);
+static ssize_t (*real_read)(int, void *, size_t);
+static ssize_t (*real_write)(int, const void *, size_t);
+static ssize_t (*real_pread)(int, void *, size_t, off_t);
+static ssize_t (*real_pread64)(int, void *, size_t, off64_t);
+static ssize_t (*real_pwrite)(int, const void *, size_t, off_t);
+static ssize_t (*real_pwrite64)(int, const void *, size_t, off64_t);
+static ssize_t (*real_pwritev)(int, const struct iovec *, int, off_t);
+static ssize_t (*real_pwritev64)(int, const struct iovec *, int, off64_t);
+static int (*real_access)(const char *, int);
+static int (*real_socket)(int, int, int);
+static int (*real_bind)(int, __CONST_SOCKADDR_ARG, socklen_t);
+static ssize_t (*real_sendto)(int, const void *, size_t, int,
+    __CONST_SOCKADDR_ARG, socklen_t);
+
+static pthread_once_t emu_once = PTHREAD_ONCE_INIT;
+static ilip_emu_shm_t *emu_shm;
+static ilip_emu_file_t *emu_files[ILIP_EMU_MAX_FD];
+
+// Timing model
+static uint64_t emu_latency_ns;
+static uint64_t emu_rate;
+static uint64_t emu_write_ns;
+static uint64_t emu_recv_timeout_ns;
+static int emu_block;
+
+static uint64_t emu_env(const char *name) {
+    const char *value = getenv(name);
+    return value != NULL ? strtoull(value, NULL, 10) : 0;
+}
+
+static uint64_t emu_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static struct timespec emu_timespec(uint64_t ns) {
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000ull;
+    ts.tv_nsec = ns % 1000000000ull;
+    return ts;
+}
+
+// Sleeps are too coarse for per-frame link times of a few
+// microseconds. Sleep through most of the wait and spin the rest.
+static void emu_wait_until(uint64_t deadline) {
+    uint64_t now = emu_now();
+    if ((now + ILIP_EMU_SPIN_NS) < deadline) {
+        struct timespec ts = emu_timespec(deadline - ILIP_EMU_SPIN_NS);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+    }
+    while (emu_now() < deadline);
+}
+
+#define EMU_RESOLVE(name) (*(void **) (&real_##name) = dlsym(RTLD_NEXT, #name))
+
+static void emu_init_shm(ilip_emu_shm_t *shm) {
+    pthread_mutexattr_t mattr;
+    pthread_condattr_t cattr;
+
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&shm->lock, &mattr);
+    for (unsigned i = 0; i < ILIP_EMU_SLOTS; i++) {
+        pthread_mutex_init(&shm->sessions[i].lock, &mattr);
+        pthread_cond_init(&shm->sessions[i].cond, &cattr);
+    }
+    pthread_condattr_destroy(&cattr);
+    pthread_mutexattr_destroy(&mattr);
+    __atomic_store_n(&shm->magic, ILIP_EMU_MAGIC, __ATOMIC_RELEASE);
+}
+
+static void emu_init() {
+    const char *name;
+    struct stat st;
+    int creator = 1;
+    int err = errno;
+    int fd;
+    void *addr;
+
+    EMU_RESOLVE(open);
+    EMU_RESOLVE(open64);
+    EMU_RESOLVE(close);
+    EMU_RESOLVE(read);
+    EMU_RESOLVE(write);
+    EMU_RESOLVE(pread);
+    EMU_RESOLVE(pread64);
+    EMU_RESOLVE(pwrite);
+    EMU_RESOLVE(pwrite64);
+    EMU_RESOLVE(pwritev);
+    EMU_RESOLVE(pwritev64);
+    EMU_RESOLVE(access);
+    EMU_RESOLVE(socket);
+    EMU_RESOLVE(bind);
+    EMU_RESOLVE(sendto);
+
+    emu_latency_ns = emu_env("ILIP_EMU_LATENCY_NS");
+    emu_rate = emu_env("ILIP_EMU_RATE");
+    emu_write_ns = emu_env("ILIP_EMU_WRITE_NS");
+    emu_recv_timeout_ns = emu_env("ILIP_EMU_RECV_TIMEOUT_MS") * 1000000ull;
+    emu_block = emu_env("ILIP_EMU_BLOCK") != 0;
+
+    name = getenv("ILIP_EMU_SHM");
+    if (name == NULL) {
+        name = ILIP_EMU_SHM_DEFAULT;
+    }
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0660);
+    if (fd < 0) {
+        creator = 0;
+        fd = shm_open(name, O_RDWR, 0);
+    }
+    if (fd < 0) {
+        errno = err;
+        return;
+    }
+    if (creator) {
+        if (ftruncate(fd, sizeof(ilip_emu_shm_t)) < 0) {
+            real_close(fd);
+            errno = err;
+            return;
+        }
+    } else {
+        // The creator may not have sized the object yet
+        for (int i = 0; i < 1000; i++) {
+            if ((fstat(fd, &st) == 0) && (st.st_size == sizeof(ilip_emu_shm_t))) {
+                break;
+            }
+            usleep(1000);
+        }
+    }
+    addr = mmap(NULL, sizeof(ilip_emu_shm_t), PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    real_close(fd);
+    if (addr == MAP_FAILED) {
+        errno = err;
+        return;
+    }
+    if (creator) {
+        emu_init_shm(addr);
+    } else {
+        for (int i = 0; i < 1000; i++) {
+            if (__atomic_load_n(&((ilip_emu_shm_t *) addr)->magic, __ATOMIC_ACQUIRE) == ILIP_EMU_MAGIC) {
+                break;
+            }
+            usleep(1000);
+        }
+    }
+    emu_shm = addr;
+    errno = err;
+}
+
+static inline ilip_emu_file_t *emu_file(int fd) {
+    pthread_once(&emu_once, emu_init);
+    if ((fd < 0) || (fd >= ILIP_EMU_MAX_FD)) {
+        return NULL;
+    }
+    return emu_files[fd];
+}
+
+static int emu_file_add(ilip_emu_file_t *file) {
+    int fd = eventfd(0, EFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fd >= ILIP_EMU_MAX_FD) {
+        real_close(fd);
+        errno = EMFILE;
+        return -1;
+    }
+    emu_files[fd] = file;
+    return fd;
+}
+
+// Caller holds the global lock
+static ilip_emu_session_t *emu_session_find(uint32_t session_id) {
+    for (unsigned i = 0; i < ILIP_EMU_SLOTS; i++) {
+        ilip_emu_session_t *s = &emu_shm->sessions[i];
+        if (s->busy && (s->session_id == session_id)) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+// Caller holds the global lock
+static ilip_emu_session_t *emu_session_save(uint32_t session_id, uint32_t level) {
+    ilip_emu_session_t *s = emu_session_find(session_id);
+    if (s != NULL) {
+        return s;
+    }
+    for (unsigned i = 0; i < ILIP_EMU_SLOTS; i++) {
+        s = &emu_shm->sessions[i];
+        if (!s->busy) {
+            pthread_mutex_lock(&s->lock);
+            s->busy = 1;
+            s->session_id = session_id;
+            s->level = level;
+            s->readers = 0;
+            s->writers = 0;
+            s->link_free_ns = 0;
+            s->head = 0;
+            s->count = 0;
+            pthread_mutex_unlock(&s->lock);
+            return s;
+        }
+    }
+    errno = ENOSPC;
+    return NULL;
+}
+
+static ilip_emu_session_t *emu_session_get(uint32_t session_id, int create) {
+    ilip_emu_session_t *s;
+    pthread_mutex_lock(&emu_shm->lock);
+    if (create) {
+        s = emu_session_save(session_id, session_id);
+    } else {
+        s = emu_session_find(session_id);
+        if (s == NULL) {
+            errno = ENOENT;
+        }
+    }
+    pthread_mutex_unlock(&emu_shm->lock);
+    return s;
+}
+
+// Returns the kind of device named by path and its session
+static int emu_parse_path(const char *path, uint32_t *session_id) {
+    char side[6];
+    unsigned value;
+
+    if (strcmp(path, ILIP_EMU_ROOT_DEV) == 0) {
+        return ILIP_EMU_ROOT;
+    }
+    if ((sscanf(path, ILIP_EMU_DEV_PREFIX "s_%8x_%5s", &value, side) == 2) ||
+        (sscanf(path, ILIP_EMU_DEV_PREFIX "%u_%5s", &value, side) == 2)) {
+        *session_id = value;
+        if (strcmp(side, "read") == 0) {
+            return ILIP_EMU_READ;
+        }
+        if (strcmp(side, "write") == 0) {
+            return ILIP_EMU_WRITE;
+        }
+    }
+    return 0;
+}
+
+static void emu_stats_clear(ilip_emu_session_t *s, int kind) {
+    if (kind == ILIP_EMU_WRITE) {
+        s->send_count = 0;
+        s->send_reject_count = 0;
+        s->send_ilip_count = 0;
+        s->send_ilip_reject_count = 0;
+    } else {
+        s->receive_count = 0;
+        s->receive_reject_count = 0;
+        s->receive_ilip_count = 0;
+        s->receive_ilip_reject_count = 0;
+    }
+}
+
+static int emu_open(const char *path, int flags) {
+    ilip_emu_file_t *file;
+    ilip_emu_session_t *s = NULL;
+    uint32_t session_id = 0;
+    int kind = emu_parse_path(path, &session_id);
+    int access = flags & O_ACCMODE;
+    int fd;
+
+    if (emu_shm == NULL) {
+        errno = ENODEV;
+        return -1;
+    }
+    if (kind == ILIP_EMU_ROOT) {
+        pthread_mutex_lock(&emu_shm->lock);
+        if (emu_shm->root_busy) {
+            pthread_mutex_unlock(&emu_shm->lock);
+            errno = EBUSY;
+            return -1;
+        }
+        emu_shm->root_busy = 1;
+        pthread_mutex_unlock(&emu_shm->lock);
+    } else if ((kind == ILIP_EMU_READ) || (kind == ILIP_EMU_WRITE)) {
+        if (access != ((kind == ILIP_EMU_READ) ? O_RDONLY : O_WRONLY)) {
+            errno = EACCES;
+            return -1;
+        }
+        // Level devices exist without a root device session read
+        s = emu_session_get(session_id, (session_id == 1) || (session_id == 2));
+        if (s == NULL) {
+            return -1;
+        }
+    } else {
+        errno = ENOENT;
+        return -1;
+    }
+
+    file = calloc(1, sizeof(ilip_emu_file_t));
+    if (file == NULL) {
+        return -1;
+    }
+    file->kind = kind;
+    file->nonblock = (flags & O_NONBLOCK) != 0;
+    file->session = s;
+    if ((fd = emu_file_add(file)) < 0) {
+        int err = errno;
+        free(file);
+        errno = err;
+        return -1;
+    }
+
+    if (s != NULL) {
+        // The driver resets the statistics and the receive queue
+        // on the first open of each side
+        pthread_mutex_lock(&s->lock);
+        if (kind == ILIP_EMU_READ) {
+            if (s->readers++ == 0) {
+                emu_stats_clear(s, kind);
+                s->head = 0;
+                s->count = 0;
+            }
+        } else {
+            if (s->writers++ == 0) {
+                emu_stats_clear(s, kind);
+            }
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+    return fd;
+}
+
+static int emu_close(int fd, ilip_emu_file_t *file) {
+    ilip_emu_session_t *s = file->session;
+
+    emu_files[fd] = NULL;
+    switch (file->kind) {
+    case ILIP_EMU_ROOT:
+        pthread_mutex_lock(&emu_shm->lock);
+        emu_shm->root_busy = 0;
+        pthread_mutex_unlock(&emu_shm->lock);
+        break;
+    case ILIP_EMU_READ:
+        pthread_mutex_lock(&s->lock);
+        s->readers--;
+        pthread_mutex_unlock(&s->lock);
+        break;
+    case ILIP_EMU_WRITE:
+        pthread_mutex_lock(&s->lock);
+        s->writers--;
+        pthread_mutex_unlock(&s->lock);
+        break;
+    case ILIP_EMU_NETLINK:
+        real_close(file->peer);
+        break;
+    }
+    free(file);
+    return real_close(fd);
+}
+
+// Session header checks of the driver write path
+static int emu_frame_valid(const ilip_emu_session_t *s, const uint8_t *buf, size_t len) {
+    uint32_t session_id, count, data_len;
+
+    if (len < ILIP_EMU_HEADER_LEN) {
+        return 0;
+    }
+    memcpy(&session_id, buf, sizeof(uint32_t));
+    memcpy(&count, buf + 8, sizeof(uint32_t));
+    memcpy(&data_len, buf + 32, sizeof(uint32_t));
+    session_id = ntohl(session_id);
+    count = ntohl(count);
+    data_len = ntohl(data_len);
+    if ((session_id != s->session_id) || (count != 1)) {
+        return 0;
+    }
+    return (ILIP_EMU_HEADER_LEN + data_len) <= ILIP_EMU_BLOCK_SIZE;
+}
+
+static ssize_t emu_read(ilip_emu_file_t *file, void *buf, size_t count) {
+    ilip_emu_session_t *s = file->session;
+    ilip_emu_frame_t *frame;
+    uint64_t now, deadline, wake;
+    uint32_t session_id;
+    size_t len;
+
+    if (file->kind != ILIP_EMU_READ) {
+        errno = (file->kind == ILIP_EMU_WRITE) ? EBADF : EPERM;
+        return -1;
+    }
+    now = emu_now();
+    deadline = emu_recv_timeout_ns ? now + emu_recv_timeout_ns : UINT64_MAX;
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        frame = (s->count > 0) ? &s->frames[s->head] : NULL;
+        if ((frame != NULL) && (frame->deliver_ns <= now)) {
+            s->head = (s->head + 1) % ILIP_EMU_MESSAGES;
+            s->count--;
+            s->receive_count++;
+            if (emu_block) {
+                pthread_cond_broadcast(&s->cond);
+            }
+            memcpy(&session_id, frame->data, sizeof(uint32_t));
+            if (ntohl(session_id) != s->session_id) {
+                s->receive_ilip_reject_count++;
+                continue;
+            }
+            break;
+        }
+        if (file->nonblock || (now >= deadline)) {
+            pthread_mutex_unlock(&s->lock);
+            errno = EAGAIN;
+            return -1;
+        }
+        wake = (frame != NULL) && (frame->deliver_ns < deadline) ? frame->deliver_ns : deadline;
+        if (wake == UINT64_MAX) {
+            pthread_cond_wait(&s->cond, &s->lock);
+        } else {
+            struct timespec ts = emu_timespec(wake);
+            pthread_cond_timedwait(&s->cond, &s->lock, &ts);
+        }
+        now = emu_now();
+    }
+    len = count < ILIP_EMU_BLOCK_SIZE ? count : ILIP_EMU_BLOCK_SIZE;
+    memcpy(buf, frame->data, len);
+    s->receive_ilip_count++;
+    pthread_mutex_unlock(&s->lock);
+    return len;
+}
+
+static ssize_t emu_write(ilip_emu_file_t *file, const void *buf, size_t count) {
+    ilip_emu_session_t *s = file->session;
+    ilip_emu_frame_t *frame;
+    uint64_t now, done;
+    size_t len;
+
+    if (file->kind != ILIP_EMU_WRITE) {
+        errno = (file->kind == ILIP_EMU_READ) ? EBADF : EPERM;
+        return -1;
+    }
+    len = count < ILIP_EMU_BLOCK_SIZE ? count : ILIP_EMU_BLOCK_SIZE;
+    pthread_mutex_lock(&s->lock);
+    // Optional backpressure instead of the driver's drop on a full queue
+    while (emu_block && (s->count == ILIP_EMU_MESSAGES) && (s->readers > 0)) {
+        if (file->nonblock) {
+            pthread_mutex_unlock(&s->lock);
+            errno = EAGAIN;
+            return -1;
+        }
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    s->send_count++;
+    if (!emu_frame_valid(s, buf, len)) {
+        s->send_ilip_reject_count++;
+        pthread_mutex_unlock(&s->lock);
+        return len;
+    }
+    // The link carries one frame at a time
+    now = emu_now();
+    done = (s->link_free_ns > now) ? s->link_free_ns : now;
+    done += emu_write_ns;
+    if (emu_rate > 0) {
+        done += (len * 1000000000ull) / emu_rate;
+    }
+    s->link_free_ns = done;
+    if (s->count == ILIP_EMU_MESSAGES) {
+        s->send_ilip_reject_count++;
+    } else {
+        frame = &s->frames[(s->head + s->count) % ILIP_EMU_MESSAGES];
+        frame->deliver_ns = done + emu_latency_ns;
+        frame->len = len;
+        memcpy(frame->data, buf, len);
+        memset(frame->data + len, 0, ILIP_EMU_BLOCK_SIZE - len);
+        s->count++;
+        s->send_ilip_count++;
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+    // Driver writes complete synchronously
+    emu_wait_until(done);
+    return len;
+}
+
+static uint32_t emu_hash_ex(uint32_t hash, const uint8_t *key, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash += key[i];
+        hash += (hash << 10);
+        hash ^= (hash >> 6);
+    }
+    return hash;
+}
+
+// Session ID of the root device configuration, as computed by the driver
+static uint32_t emu_session_id(const ilip_emu_file_t *file) {
+    size_t len = (2 + file->message_count) * sizeof(uint32_t);
+    uint32_t hash = 0xdeadbeef + ((uint32_t) len) + 0xCB2A5AE3;
+
+    if (file->message_count == 0) {
+        return file->cfg[0];
+    }
+    hash = emu_hash_ex(hash, (const uint8_t *) &file->cfg[0], sizeof(uint32_t));
+    hash = emu_hash_ex(hash, (const uint8_t *) &file->cfg[2], len - sizeof(uint32_t));
+    hash += (hash << 3);
+    hash ^= (hash >> 11);
+    hash += (hash << 15);
+    return hash;
+}
+
+static ssize_t emu_pread(ilip_emu_file_t *file, void *buf, size_t count, off_t offset) {
+    uint32_t session_id;
+    ilip_emu_session_t *s;
+
+    if (file->kind != ILIP_EMU_ROOT) {
+        errno = ESPIPE;
+        return -1;
+    }
+    if ((offset != 0) || (count != sizeof(uint32_t)) ||
+        (file->cfg[0] >= ILIP_EMU_SESSIONS) || (file->cfg[2] >= ILIP_EMU_SESSIONS)) {
+        errno = EPERM;
+        return -1;
+    }
+    session_id = emu_session_id(file);
+    pthread_mutex_lock(&emu_shm->lock);
+    s = emu_session_save(session_id, file->message_count ? file->cfg[1] : session_id);
+    pthread_mutex_unlock(&emu_shm->lock);
+    if (s == NULL) {
+        return -1;
+    }
+    memcpy(buf, &session_id, sizeof(uint32_t));
+    return sizeof(uint32_t);
+}
+
+static ssize_t emu_pwrite(ilip_emu_file_t *file, const void *buf, size_t count, off_t offset) {
+    if (file->kind != ILIP_EMU_ROOT) {
+        errno = ESPIPE;
+        return -1;
+    }
+    if ((offset < 0) || (offset % sizeof(uint32_t) != 0) ||
+        ((offset + count) > sizeof(file->cfg))) {
+        errno = EPERM;
+        return -1;
+    }
+    if ((offset == 12) && (count != 0) && (count % sizeof(uint32_t) == 0)) {
+        file->message_count = count / sizeof(uint32_t);
+    }
+    memcpy((uint8_t *) file->cfg + offset, buf, count);
+    return count;
+}
+
+// A driver without write_iter sees one write per segment. The
+// root device has an increment of zero, so every segment is
+// written at the same offset.
+static ssize_t emu_pwritev(ilip_emu_file_t *file, const struct iovec *iov, int iovcnt, off_t offset) {
+    ssize_t total = 0;
+
+    for (int i = 0; i < iovcnt; i++) {
+        ssize_t rv = emu_pwrite(file, iov[i].iov_base, iov[i].iov_len, offset);
+        if (rv < 0) {
+            return (total > 0) ? total : -1;
+        }
+        total += rv;
+    }
+    return total;
+}
+
+static void emu_nl_attr(struct nlmsghdr *n, uint16_t type, const void *data, size_t len) {
+    struct nlattr *attr = (struct nlattr *) ((uint8_t *) n + NLMSG_ALIGN(n->nlmsg_len));
+    attr->nla_type = type;
+    attr->nla_len = NLA_HDRLEN + len;
+    memcpy((uint8_t *) attr + NLA_HDRLEN, data, len);
+    n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + NLA_ALIGN(attr->nla_len);
+}
+
+static void emu_nl_u32(struct nlmsghdr *n, uint16_t type, uint32_t value) {
+    emu_nl_attr(n, type, &value, sizeof(value));
+}
+
+static int emu_nl_find_u32(const struct nlmsghdr *n, uint16_t type, uint32_t *value) {
+    const uint8_t *p = (const uint8_t *) n + NLMSG_LENGTH(GENL_HDRLEN);
+    const uint8_t *end = (const uint8_t *) n + n->nlmsg_len;
+
+    while ((p + NLA_HDRLEN) <= end) {
+        const struct nlattr *attr = (const struct nlattr *) p;
+        if (attr->nla_len < NLA_HDRLEN) {
+            break;
+        }
+        if ((attr->nla_type == type) && (attr->nla_len >= NLA_HDRLEN + sizeof(uint32_t))) {
+            memcpy(value, p + NLA_HDRLEN, sizeof(uint32_t));
+            return 0;
+        }
+        p += NLA_ALIGN(attr->nla_len);
+    }
+    return -1;
+}
+
+static void emu_nl_stat(const struct nlmsghdr *req, struct nlmsghdr *rsp, uint8_t cmd) {
+    ilip_emu_session_t *s = NULL;
+    uint32_t session_id;
+
+    if (emu_nl_find_u32(req, GAPS_ILIP_ATTR_SESSION_ID, &session_id) == 0) {
+        s = emu_session_get(session_id, 0);
+    }
+    if (s == NULL) {
+        emu_nl_u32(rsp, GAPS_ILIP_ATTR_ERROR, ENODEV);
+        return;
+    }
+    pthread_mutex_lock(&s->lock);
+    if (cmd == GAPS_ILIP_CMD_DEV_STAT_CLEAR) {
+        emu_stats_clear(s, ILIP_EMU_WRITE);
+        emu_stats_clear(s, ILIP_EMU_READ);
+    } else {
+        emu_nl_u32(rsp, GAPS_ILIP_ATTR_DEV_STAT_MMH2C_PKTS1, s->send_count);
+        emu_nl_u32(rsp, GAPS_ILIP_ATTR_DEV_STAT_MMH2C_PKTS2, s->receive_count);
+        emu_nl_u32(rsp, GAPS_ILIP_ATTR_DEV_STAT_MMC2H_PKTS1, s->send_reject_count);
+        emu_nl_u32(rsp, GAPS_ILIP_ATTR_DEV_STAT_MMC2H_PKTS2, s->receive_reject_count);
+        emu_nl_u32(rsp, GAPS_ILIP_ATTR_DEV_STAT_STH2C_PKTS1, s->send_ilip_count);
+        emu_nl_u32(rsp, GAPS_ILIP_ATTR_DEV_STAT_STH2C_PKTS2, s->receive_ilip_count);
+        emu_nl_u32(rsp, GAPS_ILIP_ATTR_DEV_STAT_STC2H_PKTS1, s->send_ilip_reject_count);
+        emu_nl_u32(rsp, GAPS_ILIP_ATTR_DEV_STAT_STC2H_PKTS2, s->receive_ilip_reject_count);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+// Answers a generic netlink request on the peer end of the socket pair
+static ssize_t emu_netlink(ilip_emu_file_t *file, const void *buf, size_t len) {
+    const struct nlmsghdr *req = buf;
+    const struct genlmsghdr *greq = (const struct genlmsghdr *) NLMSG_DATA(req);
+    uint8_t out[512] __attribute__((aligned(NLMSG_ALIGNTO)));
+    struct nlmsghdr *rsp = (struct nlmsghdr *) out;
+    struct genlmsghdr *grsp = (struct genlmsghdr *) NLMSG_DATA(rsp);
+
+    if ((len < NLMSG_LENGTH(GENL_HDRLEN)) || (req->nlmsg_len > len)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(out, 0, sizeof(out));
+    rsp->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    rsp->nlmsg_type = req->nlmsg_type;
+    rsp->nlmsg_seq = req->nlmsg_seq;
+    rsp->nlmsg_pid = req->nlmsg_pid;
+    grsp->cmd = greq->cmd;
+    grsp->version = greq->version;
+
+    if ((req->nlmsg_type == GENL_ID_CTRL) && (greq->cmd == CTRL_CMD_GETFAMILY)) {
+        const uint16_t family = ILIP_EMU_FAMILY_ID;
+        emu_nl_attr(rsp, CTRL_ATTR_FAMILY_NAME, ILIP_EMU_FAMILY_NAME,
+            sizeof(ILIP_EMU_FAMILY_NAME));
+        emu_nl_attr(rsp, CTRL_ATTR_FAMILY_ID, &family, sizeof(family));
+    } else if ((req->nlmsg_type == ILIP_EMU_FAMILY_ID) &&
+        ((greq->cmd == GAPS_ILIP_CMD_DEV_STAT) || (greq->cmd == GAPS_ILIP_CMD_DEV_STAT_CLEAR))) {
+        emu_nl_stat(req, rsp, greq->cmd);
+    } else {
+        rsp->nlmsg_type = NLMSG_ERROR;
+    }
+
+    if (send(file->peer, out, rsp->nlmsg_len, 0) < 0) {
+        return -1;
+    }
+    return len;
+}
+
+static int emu_is_device(const char *path) {
+    return (path != NULL) &&
+        (strncmp(path, ILIP_EMU_DEV_PREFIX, sizeof(ILIP_EMU_DEV_PREFIX) - 1) == 0);
+}
+
+static mode_t emu_mode(int flags, va_list ap) {
+    return (flags & (O_CREAT | O_TMPFILE)) ? (mode_t) va_arg(ap, int) : 0;
+}
+
+int open(const char *path, int flags, ...) {
+    va_list ap;
+    mode_t mode;
+
+    pthread_once(&emu_once, emu_init);
+    if (emu_is_device(path)) {
+        return emu_open(path, flags);
+    }
+    va_start(ap, flags);
+    mode = emu_mode(flags, ap);
+    va_end(ap);
+    return real_open(path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...) {
+    va_list ap;
+    mode_t mode;
+
+    pthread_once(&emu_once, emu_init);
+    if (emu_is_device(path)) {
+        return emu_open(path, flags);
+    }
+    va_start(ap, flags);
+    mode = emu_mode(flags, ap);
+    va_end(ap);
+    return real_open64(path, flags, mode);
+}
+
+int close(int fd) {
+    ilip_emu_file_t *file = emu_file(fd);
+    if (file != NULL) {
+        return emu_close(fd, file);
+    }
+    return real_close(fd);
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+    ilip_emu_file_t *file = emu_file(fd);
+    if (file != NULL) {
+        return emu_read(file, buf, count);
+    }
+    return real_read(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    ilip_emu_file_t *file = emu_file(fd);
+    if (file != NULL) {
+        return emu_write(file, buf, count);
+    }
+    return real_write(fd, buf, count);
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+    ilip_emu_file_t *file = emu_file(fd);
+    if (file != NULL) {
+        return emu_pread(file, buf, count, offset);
+    }
+    return real_pread(fd, buf, count, offset);
+}
+
+ssize_t pread64(int fd, void *buf, size_t count, off64_t offset) {
+    ilip_emu_file_t *file = emu_file(fd);
+    if (file != NULL) {
+        return emu_pread(file, buf, count, offset);
+    }
+    return real_pread64(fd, buf, count, offset);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    ilip_emu_file_t *file = emu_file(fd);
+    if (file != NULL) {
+        return emu_pwrite(file, buf, count, offset);
+    }
+    return real_pwrite(fd, buf, count, offset);
+}
+
+ssize_t pwrite64(int fd, const void *buf, size_t count, off64_t offset) {
+    ilip_emu_file_t *file = emu_file(fd);
+    if (file != NULL) {
+        return emu_pwrite(file, buf, count, offset);
+    }
+    return real_pwrite64(fd, buf, count, offset);
+}
+
+ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+    ilip_emu_file_t *file = emu_file(fd);
+    if (file != NULL) {
+        return emu_pwritev(file, iov, iovcnt, offset);
+    }
+    return real_pwritev(fd, iov, iovcnt, offset);
+}
+
+ssize_t pwritev64(int fd, const struct iovec *iov, int iovcnt, off64_t offset) {
+    ilip_emu_file_t *file = emu_file(fd);
+    if (file != NULL) {
+        return emu_pwritev(file, iov, iovcnt, offset);
+    }
+    return real_pwritev64(fd, iov, iovcnt, offset);
+}
+
+int access(const char *path, int mode) {
+    pthread_once(&emu_once, emu_init);
+    if (emu_is_device(path)) {
+        uint32_t session_id;
+        int kind = emu_parse_path(path, &session_id);
+        if ((emu_shm == NULL) || (kind == 0)) {
+            errno = ENOENT;
+            return -1;
+        }
+        if ((kind == ILIP_EMU_ROOT) || (session_id == 1) || (session_id == 2)) {
+            return 0;
+        }
+        return emu_session_get(session_id, 0) != NULL ? 0 : -1;
+    }
+    return real_access(path, mode);
+}
+
+int socket(int domain, int type, int protocol) {
+    ilip_emu_file_t *file;
+    int sv[2];
+
+    pthread_once(&emu_once, emu_init);
+    if ((emu_shm == NULL) || (domain != AF_NETLINK) || (protocol != NETLINK_GENERIC)) {
+        return real_socket(domain, type, protocol);
+    }
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+        return -1;
+    }
+    if ((sv[0] >= ILIP_EMU_MAX_FD) || ((file = calloc(1, sizeof(ilip_emu_file_t))) == NULL)) {
+        real_close(sv[0]);
+        real_close(sv[1]);
+        errno = ENOMEM;
+        return -1;
+    }
+    file->kind = ILIP_EMU_NETLINK;
+    file->peer = sv[1];
+    emu_files[sv[0]] = file;
+    return sv[0];
+}
+
+int bind(int fd, __CONST_SOCKADDR_ARG addr, socklen_t len) {
+    ilip_emu_file_t *file = emu_file(fd);
+    if (file != NULL) {
+        return 0;
+    }
+    return real_bind(fd, addr, len);
+}
+
+ssize_t sendto(int fd, const void *buf, size_t len, int flags,
+    __CONST_SOCKADDR_ARG addr, socklen_t addr_len) {
+    ilip_emu_file_t *file = emu_file(fd);
+    if ((file != NULL) && (file->kind == ILIP_EMU_NETLINK)) {
+        return emu_netlink(file, buf, len);
+    }
+    return real_sendto(fd, buf, len, flags, addr, addr_len);
+}
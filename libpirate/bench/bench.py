@@ -2,6 +2,7 @@
 
 import re
 import sys
+import json
 import subprocess
 import argparse
 
@@ -25,6 +26,36 @@ def extract(out, pattern):
         return None
     return s.group(1)
 
+def extract_json(out):
+    for line in out.decode('utf-8').splitlines():
+        if line.startswith('{'):
+            return json.loads(line)
+    return None
+
+def percentile(buckets, total, p):
+    target = max(1, int(p / 100.0 * total + 0.5))
+    count = 0
+    for value, n in buckets:
+        count += n
+        if count >= target:
+            return value
+    return buckets[-1][0] if buckets else 0
+
+# Histograms are merged by adding bucket counts. Percentiles of
+# separate runs cannot be averaged.
+def merge_histograms(hists):
+    counts = {}
+    for hist in hists:
+        for value, n in hist["buckets"]:
+            counts[value] = counts.get(value, 0) + n
+    buckets = sorted(counts.items())
+    total = sum(n for _, n in buckets)
+    summary = {"iterations": len(hists), "count": total,
+        "min": min(h["min"] for h in hists), "max": max(h["max"] for h in hists)}
+    for name, p in [("p50", 50.0), ("p90", 90.0), ("p99", 99.0), ("p99.9", 99.9)]:
+        summary[name] = min(percentile(buckets, total, p), summary["max"])
+    return summary
+
 def main():
     p = argparse.ArgumentParser(description="GAPS pirate benchmark suite")
     p.add_argument("-t", "--test_type", help="Test suite type", choices=["thr", "lat"], default="thr")
@@ -39,6 +70,8 @@ def main():
     p.add_argument("-d", "--packet_delay", help="Inter-packet delay in nanoseconds", type=float, default=0)
     p.add_argument("-w", "--receive_timeout", help="Receive timeout in seconds", type=int, default=2)
     p.add_argument("-v", "--validate", help="Validate received packets", action="store_true")
+    p.add_argument("-p", "--perf", help="Report hardware performance counters", action="store_true")
+    p.add_argument("-j", "--json", help="Write the merged round trip latency histograms of each message size to a JSON file")
     args = p.parse_args()
 
     if args.message_sizes is None:
@@ -65,6 +98,10 @@ def main():
         pattern2 = None
         if args.iterations is None:
             args.iterations = 32
+        if args.json is not None:
+            channel_args.append("-j")
+
+    results = []
 
     for message_size in args.message_sizes:
         if message_size < 32:
@@ -80,7 +117,10 @@ def main():
 
         if args.validate:
             test_args.append("-v")
+        if args.perf:
+            test_args.append("-p")
 
+        hists = []
         for _ in range(args.iterations):
             if args.role == "both" or args.role == "writer":
                 writer_proc = subprocess.Popen(["./" + writer_app] + test_args)
@@ -100,6 +140,22 @@ def main():
                 if results2 is None:
                     results2 = ""
                 print(args.scenario_name, message_size, results1, results2, flush=True)
+                if args.perf:
+                    for line in out.decode('utf-8').splitlines():
+                        if line.startswith("perf "):
+                            print("   ", line, flush=True)
+                hist = extract_json(out)
+                if hist is not None:
+                    hists.append(hist)
+
+        if hists:
+            summary = merge_histograms(hists)
+            summary["message_size"] = message_size
+            results.append(summary)
+
+    if args.json is not None:
+        with open(args.json, "w") as f:
+            json.dump({"scenario": args.scenario_name, "round_trip_ns": results}, f, indent=2)
 
 if __name__ == "__main__":
     main()
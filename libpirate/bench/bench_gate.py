@@ -0,0 +1,226 @@
+#!/usr/bin/env python3
+
+import sys
+import json
+import math
+import time
+import platform
+import argparse
+import subprocess
+
+# Local channels of the gate. The lossy channels use a writer window
+# so that the throughput does not depend on receive buffer overruns.
+CHANNELS = [
+    ("pipe",           "pipe,/tmp/pirate_gate.pipe",                 0),
+    ("unix_socket",    "unix_socket,/tmp/pirate_gate.sock",          0),
+    ("unix_seqpacket", "unix_seqpacket,/tmp/pirate_gate.seqpacket",  0),
+    ("tcp_socket",     "tcp_socket,127.0.0.1,26610,0.0.0.0,0",       0),
+    ("udp_socket",     "udp_socket,127.0.0.1,26611,0.0.0.0,0",       64),
+    ("shmem",          "shmem,/pirate_gate_shmem",                   0),
+    ("udp_shmem",      "udp_shmem,/pirate_gate_udp_shmem",           64),
+]
+
+THROUGHPUT_SIZES = [64, 4096]
+LATENCY_SIZE = 64
+LATENCY_RATE = 10000
+LATENCY_DURATION_MS = 500
+
+# name, report field, unit, True when higher is better
+METRICS = {
+    "throughput": ("mbytes_per_sec", "MB/s", True),
+    "latency":    ("latency_p99_ns", "p99 ns", False),
+}
+
+def run_pirate_bench(args, extra):
+    cmd = [args.executable, "-f", "json", "-i", str(args.iterations),
+        "-t", str(args.timeout), "-P", args.cpus] + extra
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE)
+    if proc.returncode != 0:
+        print("{} exited with status {}".format(" ".join(cmd), proc.returncode), file=sys.stderr)
+        return []
+    return json.loads(proc.stdout.decode("utf-8"))
+
+# Runs the scenario matrix. Returns a dictionary from the scenario
+# name to the metric and the samples of the repeated runs. A
+# scenario that fails has an error instead of samples.
+def run_matrix(args):
+    results = {}
+    for name, channel, batch in CHANNELS:
+        if args.channels and name not in args.channels:
+            continue
+        sizes = ",".join(str(size) for size in THROUGHPUT_SIZES)
+        rows = run_pirate_bench(args, ["-c", channel, "-m", sizes, "-b", str(batch)])
+        for size in THROUGHPUT_SIZES:
+            collect(results, "{} m={}".format(name, size), "throughput",
+                [row for row in rows if row["message_len"] == size])
+        rows = run_pirate_bench(args, ["-c", channel, "-m", str(LATENCY_SIZE),
+            "-r", str(LATENCY_RATE), "-d", str(LATENCY_DURATION_MS)])
+        collect(results, "{} m={} rate={}".format(name, LATENCY_SIZE, LATENCY_RATE), "latency", rows)
+    return results
+
+def collect(results, scenario, metric, rows):
+    field = METRICS[metric][0]
+    entry = {"metric": metric}
+    if not rows:
+        entry["error"] = "no result"
+    elif all(row["status"] == "skipped" for row in rows):
+        return
+    else:
+        errors = [row["status"] for row in rows if row["status"] != "ok"]
+        if errors:
+            entry["error"] = errors[0]
+        else:
+            entry["samples"] = [row[field] for row in rows]
+    results[scenario] = entry
+    print("{:<40} {}".format(scenario, entry.get("error", format_samples(entry.get("samples")))),
+        file=sys.stderr, flush=True)
+
+def format_samples(samples):
+    return " ".join("{:.1f}".format(s) for s in samples)
+
+def median(samples):
+    s = sorted(samples)
+    n = len(s)
+    return s[n // 2] if n % 2 else (s[n // 2 - 1] + s[n // 2]) / 2.0
+
+# Number of orderings of m values from X and n values from Y in which
+# exactly k (x, y) pairs have x > y.
+def mann_whitney_counts(m, n, cache={}):
+    if (m, n) in cache:
+        return cache[(m, n)]
+    if m == 0 or n == 0:
+        counts = [1]
+    else:
+        # The largest value is either from X and exceeds all of Y,
+        # or it is from Y and exceeds none of X.
+        a = mann_whitney_counts(m - 1, n)
+        b = mann_whitney_counts(m, n - 1)
+        counts = [0] * (m * n + 1)
+        for k, c in enumerate(a):
+            counts[k + n] += c
+        for k, c in enumerate(b):
+            counts[k] += c
+    cache[(m, n)] = counts
+    return counts
+
+# One-sided Mann-Whitney U test. Returns the p-value of the hypothesis
+# that the values of xs tend to be smaller than the values of ys. The
+# distribution is exact for small samples without ties and a normal
+# approximation with a tie correction otherwise.
+def mann_whitney_less(xs, ys):
+    m, n = len(xs), len(ys)
+    if m == 0 or n == 0:
+        return 1.0
+    # pairs where x is greater, ties count half
+    u = sum(1.0 if x > y else 0.5 if x == y else 0.0 for x in xs for y in ys)
+    values = xs + ys
+    if len(set(values)) == len(values) and m * n <= 400:
+        counts = mann_whitney_counts(m, n)
+        return sum(counts[:int(u) + 1]) / float(sum(counts))
+    total = m + n
+    ties = sum(values.count(v) ** 3 - values.count(v) for v in set(values))
+    sigma = math.sqrt(m * n / 12.0 * ((total + 1) - ties / float(total * (total - 1))))
+    if sigma == 0:
+        return 1.0
+    z = (u - m * n / 2.0 + 0.5) / sigma
+    return 0.5 * math.erfc(-z / math.sqrt(2))
+
+def compare(args, baseline, current):
+    regressions = 0
+    rows = []
+    for scenario in sorted(set(baseline) | set(current)):
+        base = baseline.get(scenario)
+        cur = current.get(scenario)
+        if cur is None:
+            # a scenario of the baseline that did not run, for
+            # example a channel that is now skipped, is a failure
+            if args.allow_missing:
+                rows.append((scenario, "", "", "", "", "", "not run"))
+            else:
+                regressions += 1
+                rows.append((scenario, "", "", "", "", "", "MISSING"))
+            continue
+        field, unit, higher = METRICS[cur["metric"]]
+        if "error" in cur:
+            regressions += 1
+            rows.append((scenario, unit, "", "", "", "", "ERROR " + cur["error"]))
+            continue
+        if base is None or "samples" not in base:
+            rows.append((scenario, unit, "", "{:.1f}".format(median(cur["samples"])), "", "", "new"))
+            continue
+        b, c = base["samples"], cur["samples"]
+        change = (median(c) - median(b)) / median(b) * 100.0 if median(b) else 0.0
+        if higher:
+            threshold = args.throughput_threshold
+            worse, p_worse = -change, mann_whitney_less(c, b)
+            p_better = mann_whitney_less(b, c)
+        else:
+            threshold = args.latency_threshold
+            worse, p_worse = change, mann_whitney_less(b, c)
+            p_better = mann_whitney_less(c, b)
+        if worse > threshold and p_worse < args.alpha:
+            result, p = "REGRESSION", p_worse
+            regressions += 1
+        elif -worse > threshold and p_better < args.alpha:
+            result, p = "improved", p_better
+        else:
+            result, p = "ok", min(p_worse, p_better)
+        rows.append((scenario, unit, "{:.1f}".format(median(b)), "{:.1f}".format(median(c)),
+            "{:+.1f}%".format(change), "{:.3f}".format(p), result))
+
+    header = ("scenario", "metric", "baseline", "current", "change", "p-value", "result")
+    widths = [max(len(str(row[i])) for row in rows + [header]) for i in range(len(header))]
+    for row in [header] + rows:
+        print("  ".join(str(v).rjust(w) if 1 < i < 6 else str(v).ljust(w)
+            for i, (v, w) in enumerate(zip(row, widths))).rstrip())
+    return regressions
+
+def main():
+    p = argparse.ArgumentParser(description="GAPS pirate performance regression gate")
+    p.add_argument("action", help="Record a baseline or check against it", choices=["record", "check"])
+    p.add_argument("-b", "--baseline", help="Baseline file", default="perf_baseline.json")
+    p.add_argument("-c", "--channels", help="Comma separated subset of the channels",
+        type=lambda s: s.split(","))
+    p.add_argument("-e", "--executable", help="pirate_bench executable", default="./pirate_bench")
+    p.add_argument("-i", "--iterations", help="Runs for each scenario", type=int, default=5)
+    p.add_argument("-P", "--cpus", help="CPU placement READER:WRITER or none", default="none")
+    p.add_argument("-t", "--timeout", help="Run timeout in seconds", type=int, default=60)
+    p.add_argument("--throughput_threshold", help="Allowed throughput drop in percent",
+        type=float, default=10.0)
+    p.add_argument("--latency_threshold", help="Allowed p99 latency rise in percent",
+        type=float, default=25.0)
+    p.add_argument("--alpha", help="Significance level of the one-sided test", type=float, default=0.05)
+    p.add_argument("--allow_missing", help="Do not fail on baseline scenarios that did not run",
+        action="store_true")
+    args = p.parse_args()
+
+    current = run_matrix(args)
+
+    if args.action == "record":
+        failed = [s for s, entry in current.items() if "error" in entry]
+        for scenario in failed:
+            print("{}: {}, not recorded".format(scenario, current[scenario]["error"]), file=sys.stderr)
+            del current[scenario]
+        baseline = {"created": time.strftime("%Y-%m-%dT%H:%M:%S%z"), "host": platform.node(),
+            "iterations": args.iterations, "cpus": args.cpus, "scenarios": current}
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent=2)
+        print("recorded {} scenarios in {}".format(len(current), args.baseline))
+        return 0
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    if baseline.get("host") != platform.node() or baseline.get("cpus") != args.cpus:
+        print("warning: baseline recorded on {} with cpus {}".format(baseline.get("host"),
+            baseline.get("cpus")), file=sys.stderr)
+    scenarios = baseline["scenarios"]
+    if args.channels:
+        scenarios = {s: e for s, e in scenarios.items() if s.split(" ")[0] in args.channels}
+    regressions = compare(args, scenarios, current)
+    if regressions:
+        print("{} scenario(s) regressed or failed".format(regressions))
+        return 1
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
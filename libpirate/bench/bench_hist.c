@@ -0,0 +1,116 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+#include "bench_hist.h"
+
+static const double bench_hist_percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+static const char *bench_hist_names[] = { "p50", "p90", "p99", "p99.9" };
+
+#ifndef MIN
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
+#endif
+
+#define BENCH_HIST_NPERCENTILES (sizeof(bench_hist_percentiles) / sizeof(bench_hist_percentiles[0]))
+
+static unsigned bench_hist_index(uint64_t value) {
+    unsigned msb, shift;
+
+    if (value < (2 * BENCH_HIST_SUB_COUNT)) {
+        return value;
+    }
+    msb = 63 - __builtin_clzll(value);
+    shift = msb - BENCH_HIST_SUB_BITS;
+    return shift * BENCH_HIST_SUB_COUNT + (value >> shift);
+}
+
+// Highest value that is counted in the bucket
+static uint64_t bench_hist_value(unsigned index) {
+    unsigned shift;
+    uint64_t sub;
+
+    if (index < (2 * BENCH_HIST_SUB_COUNT)) {
+        return index;
+    }
+    shift = index / BENCH_HIST_SUB_COUNT - 1;
+    sub = index % BENCH_HIST_SUB_COUNT + BENCH_HIST_SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+void bench_hist_init(bench_hist_t *hist) {
+    memset(hist, 0, sizeof(bench_hist_t));
+    hist->min = UINT64_MAX;
+}
+
+void bench_hist_record(bench_hist_t *hist, uint64_t value) {
+    hist->counts[bench_hist_index(value)]++;
+    hist->total++;
+    hist->sum += value;
+    if (value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+uint64_t bench_hist_percentile(const bench_hist_t *hist, double percentile) {
+    uint64_t target, count = 0;
+
+    if (hist->total == 0) {
+        return 0;
+    }
+    target = (uint64_t) ((percentile / 100.0) * hist->total + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+    for (unsigned i = 0; i < BENCH_HIST_LEN; i++) {
+        count += hist->counts[i];
+        if (count >= target) {
+            return MIN(bench_hist_value(i), hist->max);
+        }
+    }
+    return hist->max;
+}
+
+void bench_hist_print(const bench_hist_t *hist, const char *name, FILE *out) {
+    for (unsigned i = 0; i < BENCH_HIST_NPERCENTILES; i++) {
+        fprintf(out, "%s %s: %" PRIu64 " ns\n", name, bench_hist_names[i],
+            bench_hist_percentile(hist, bench_hist_percentiles[i]));
+    }
+    fprintf(out, "%s max: %" PRIu64 " ns\n", name, hist->max);
+}
+
+void bench_hist_json(const bench_hist_t *hist, FILE *out) {
+    int first = 1;
+
+    fprintf(out, "{\"count\": %" PRIu64 ", \"min\": %" PRIu64 ", \"max\": %" PRIu64
+        ", \"mean\": %.1f", hist->total, hist->total ? hist->min : 0, hist->max,
+        hist->total ? ((double) hist->sum) / hist->total : 0.0);
+    for (unsigned i = 0; i < BENCH_HIST_NPERCENTILES; i++) {
+        fprintf(out, ", \"%s\": %" PRIu64, bench_hist_names[i],
+            bench_hist_percentile(hist, bench_hist_percentiles[i]));
+    }
+    fprintf(out, ", \"buckets\": [");
+    for (unsigned i = 0; i < BENCH_HIST_LEN; i++) {
+        if (hist->counts[i] > 0) {
+            fprintf(out, "%s[%" PRIu64 ", %" PRIu64 "]", first ? "" : ", ",
+                bench_hist_value(i), hist->counts[i]);
+            first = 0;
+        }
+    }
+    fprintf(out, "]}\n");
+}
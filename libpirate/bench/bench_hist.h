@@ -0,0 +1,53 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef _PIRATE_BENCH_HIST_H
+#define _PIRATE_BENCH_HIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Log-linear histogram in the style of HdrHistogram. Values below
+// 128 are counted exactly. Larger values fall in one of 64 linear
+// sub-buckets of their power of two, so a recorded value is within
+// 1/64 of the true value.
+
+#define BENCH_HIST_SUB_BITS     6
+#define BENCH_HIST_SUB_COUNT    (1u << BENCH_HIST_SUB_BITS)
+#define BENCH_HIST_LEN          (2 * BENCH_HIST_SUB_COUNT + \
+                                 (63 - BENCH_HIST_SUB_BITS) * BENCH_HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t counts[BENCH_HIST_LEN];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+} bench_hist_t;
+
+void bench_hist_init(bench_hist_t *hist);
+void bench_hist_record(bench_hist_t *hist, uint64_t value);
+
+// Highest value of the bucket that holds the given percentile
+uint64_t bench_hist_percentile(const bench_hist_t *hist, double percentile);
+
+// Percentile summary, one line per percentile
+void bench_hist_print(const bench_hist_t *hist, const char *name, FILE *out);
+
+// One line JSON object with the summary and the non-empty buckets
+// as [value, count] pairs
+void bench_hist_json(const bench_hist_t *hist, FILE *out);
+
+#endif /* _PIRATE_BENCH_HIST_H */
@@ -42,6 +42,8 @@ typedef struct {
     size_t message_len;
     uint64_t tx_delay_ns;
     uint32_t rx_timeout_s;
+    int json;
+    int perf;
     uint8_t *read_buffer;
     uint8_t *write_buffer;
     char err_msg[256];
@@ -19,11 +19,13 @@
 #include <string.h>
 #include <time.h>
 #include "bench_lat.h"
+#include "bench_perf.h"
 
 int run(bench_lat_t *bench) {
     ssize_t rv;
     const uint32_t iter = bench->nbytes / bench->message_len;
     uint8_t signal = 1;
+    bench_perf_t perf;
     const struct timespec ts = {
         .tv_sec = bench->tx_delay_ns / 1000000000,
         .tv_nsec = (bench->tx_delay_ns % 1000000000)
@@ -34,6 +36,10 @@ int run(bench_lat_t *bench) {
         return -1;
     }
 
+    if (bench->perf) {
+        bench_perf_open(&perf);
+    }
+
     rv = pirate_read(bench->sync_ch2.gd, &signal, sizeof(signal));
     if (rv < 0) {
         perror("Sync channel 2 initial read error");
@@ -46,6 +52,10 @@ int run(bench_lat_t *bench) {
         return -1;
     }
 
+    if (bench->perf) {
+        bench_perf_start(&perf);
+    }
+
     for (uint64_t i = 0; i < iter; i++) {
         size_t count;
 
@@ -84,12 +94,21 @@ int run(bench_lat_t *bench) {
         }
     }
 
+    if (bench->perf) {
+        bench_perf_stop(&perf);
+    }
+
     rv = pirate_read(bench->sync_ch2.gd, &signal, sizeof(signal));
     if (rv < 0) {
         perror("Sync channel 2 terminating read error");
         return -1;
     }
 
+    if (bench->perf) {
+        bench_perf_print(&perf, iter, (uint64_t) iter * bench->message_len, stdout);
+        bench_perf_close(&perf);
+    }
+
     return 0;
 }
 
@@ -20,14 +20,25 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include "bench_hist.h"
 #include "bench_lat.h"
+#include "bench_perf.h"
+
+static bench_hist_t rtt_hist;
+
+static uint64_t bench_lat_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
 int run(bench_lat_t *bench) {
     ssize_t rv;
     const uint32_t iter = bench->nbytes / bench->message_len;
-    uint64_t delta;
+    uint64_t delta, sent;
     struct timespec start, stop;
     uint8_t signal = 1;
+    bench_perf_t perf;
     const struct timespec ts = {
         .tv_sec = bench->tx_delay_ns / 1000000000,
         .tv_nsec = (bench->tx_delay_ns % 1000000000)
@@ -38,6 +49,10 @@ int run(bench_lat_t *bench) {
         return -1;
     }
 
+    if (bench->perf) {
+        bench_perf_open(&perf);
+    }
+
     rv = pirate_write(bench->sync_ch2.gd, &signal, sizeof(signal));
     if (rv < 0) {
         perror("Sync channel 2 initial write error");
@@ -50,6 +65,12 @@ int run(bench_lat_t *bench) {
         return -1;
     }
 
+    bench_hist_init(&rtt_hist);
+
+    if (bench->perf) {
+        bench_perf_start(&perf);
+    }
+
     if (clock_gettime(CLOCK_MONOTONIC, &start) < 0) {
         perror("clock_gettime start");
         return -1;
@@ -58,6 +79,7 @@ int run(bench_lat_t *bench) {
     for (uint64_t i = 0; i < iter; i++) {
         size_t count;
 
+        sent = 0;
         count = bench->message_len;
         while (count > 0) {
             // Sleep must happen before the write
@@ -70,6 +92,9 @@ int run(bench_lat_t *bench) {
             } else if (bench->tx_delay_ns > 0) {
                 bench_lat_busysleep(bench->tx_delay_ns);
             }
+            if (sent == 0) {
+                sent = bench_lat_now();
+            }
             rv = pirate_write(bench->test_ch2.gd, bench->write_buffer, count);
             if (rv < 0) {
                 perror("Test channel 2 write error");
@@ -91,6 +116,8 @@ int run(bench_lat_t *bench) {
             }
             count -= rv;
         }
+
+        bench_hist_record(&rtt_hist, bench_lat_now() - sent);
     }
 
     if (clock_gettime(CLOCK_MONOTONIC, &stop) < 0) {
@@ -98,6 +125,10 @@ int run(bench_lat_t *bench) {
         return -1;
     }
 
+    if (bench->perf) {
+        bench_perf_stop(&perf);
+    }
+
     rv = pirate_write(bench->sync_ch2.gd, &signal, sizeof(signal));
     if (rv < 0) {
         perror("Sync channel 2 terminating write error");
@@ -108,6 +139,14 @@ int run(bench_lat_t *bench) {
              (stop.tv_nsec - start.tv_nsec));
 
     printf("average latency: %li ns\n", delta / (iter * 2));
+    bench_hist_print(&rtt_hist, "round trip", stdout);
+    if (bench->json) {
+        bench_hist_json(&rtt_hist, stdout);
+    }
+    if (bench->perf) {
+        bench_perf_print(&perf, iter, (uint64_t) iter * bench->message_len, stdout);
+        bench_perf_close(&perf);
+    }
 
     return 0;
 }
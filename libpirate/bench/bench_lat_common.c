@@ -35,6 +35,8 @@ static struct argp_option options[] = {
     { "message_len", 'm', "BYTES",  0, "Transfer message size",         0 },
     { "tx_delay",    'd', "NSEC",   0, "Inter-message delay",           0 },
     { "rx_timeout",  'w', "SEC",    0, "Message receive timeout",       0 },
+    { "json",        'j', NULL,     0, "Print the latency histogram as JSON", 0 },
+    { "perf",        'p', NULL,     0, "Report hardware performance counters", 0 },
     { NULL,           0,  NULL,     0, GAPS_CHANNEL_OPTIONS,            2 },
     { NULL,           0,  NULL,     0, 0,                               0 }
 };
@@ -89,6 +91,14 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         }
         break;
 
+    case 'j':
+        bench->json = 1;
+        break;
+
+    case 'p':
+        bench->perf = 1;
+        break;
+
     case ARGP_KEY_END:
         if (bench->test_ch1.config == NULL) {
             argp_error(state, "Test channel 1 configuration is not specified");
@@ -138,6 +148,8 @@ void parse_args(int argc, char *argv[], bench_lat_t *bench) {
     bench->message_len     = 128;
     bench->tx_delay_ns     = 0;
     bench->rx_timeout_s    = 2;
+    bench->json            = 0;
+    bench->perf            = 0;
 
     struct argp argp = {
         .options = options,
@@ -0,0 +1,151 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "bench_perf.h"
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+} bench_perf_events[BENCH_PERF_COUNT] = {
+    [BENCH_PERF_CYCLES]           = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,       "cycles" },
+    [BENCH_PERF_INSTRUCTIONS]     = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,     "instructions" },
+    [BENCH_PERF_CACHE_REFERENCES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, "cache-references" },
+    [BENCH_PERF_CACHE_MISSES]     = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,     "cache-misses" },
+    [BENCH_PERF_BRANCH_MISSES]    = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,    "branch-misses" },
+    [BENCH_PERF_CONTEXT_SWITCHES] = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context-switches" },
+    [BENCH_PERF_CPU_MIGRATIONS]   = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS,   "cpu-migrations" },
+};
+
+static int bench_perf_event_open(unsigned index, int exclude_kernel) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = bench_perf_events[index].type;
+    attr.config = bench_perf_events[index].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int bench_perf_open(bench_perf_t *perf) {
+    int err = 0;
+
+    memset(perf, 0, sizeof(bench_perf_t));
+    for (unsigned i = 0; i < BENCH_PERF_COUNT; i++) {
+        perf->fds[i] = bench_perf_event_open(i, perf->user_only);
+        if ((perf->fds[i] < 0) && ((errno == EACCES) || (errno == EPERM)) && !perf->user_only) {
+            // perf_event_paranoid >= 2 allows user space counting only
+            perf->user_only = 1;
+            for (unsigned j = 0; j < i; j++) {
+                close(perf->fds[j]);
+                perf->fds[j] = bench_perf_event_open(j, 1);
+            }
+            perf->fds[i] = bench_perf_event_open(i, 1);
+        }
+        if (perf->fds[i] < 0) {
+            err = errno;
+        }
+    }
+    for (unsigned i = 0; i < BENCH_PERF_COUNT; i++) {
+        if (perf->fds[i] >= 0) {
+            perf->count++;
+        }
+    }
+    if (perf->count == 0) {
+        fprintf(stderr, "Performance counters are unavailable: %s\n", strerror(err));
+    } else if (perf->count < BENCH_PERF_COUNT) {
+        fprintf(stderr, "Performance counters unavailable:");
+        for (unsigned i = 0; i < BENCH_PERF_COUNT; i++) {
+            if (perf->fds[i] < 0) {
+                fprintf(stderr, " %s", bench_perf_events[i].name);
+            }
+        }
+        fprintf(stderr, "\n");
+    }
+    return perf->count;
+}
+
+void bench_perf_start(bench_perf_t *perf) {
+    for (unsigned i = 0; i < BENCH_PERF_COUNT; i++) {
+        if (perf->fds[i] >= 0) {
+            ioctl(perf->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(perf->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void bench_perf_stop(bench_perf_t *perf) {
+    for (unsigned i = 0; i < BENCH_PERF_COUNT; i++) {
+        if (perf->fds[i] >= 0) {
+            ioctl(perf->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (unsigned i = 0; i < BENCH_PERF_COUNT; i++) {
+        // value, time enabled, time running
+        uint64_t data[3];
+
+        perf->values[i] = 0;
+        if ((perf->fds[i] < 0) || (read(perf->fds[i], data, sizeof(data)) != sizeof(data))) {
+            continue;
+        }
+        if ((data[2] > 0) && (data[2] < data[1])) {
+            data[0] = (uint64_t) ((double) data[0] * data[1] / data[2]);
+        }
+        perf->values[i] = data[0];
+    }
+}
+
+void bench_perf_close(bench_perf_t *perf) {
+    for (unsigned i = 0; i < BENCH_PERF_COUNT; i++) {
+        if (perf->fds[i] >= 0) {
+            close(perf->fds[i]);
+            perf->fds[i] = -1;
+        }
+    }
+    perf->count = 0;
+}
+
+void bench_perf_print(const bench_perf_t *perf, uint64_t messages, uint64_t bytes, FILE *out) {
+    const uint64_t *values = perf->values;
+
+    for (unsigned i = 0; i < BENCH_PERF_COUNT; i++) {
+        if (perf->fds[i] < 0) {
+            continue;
+        }
+        fprintf(out, "perf %s: %" PRIu64 " (%.3f per message, %.5f per byte)%s\n",
+            bench_perf_events[i].name, values[i],
+            messages ? (double) values[i] / messages : 0.0,
+            bytes ? (double) values[i] / bytes : 0.0,
+            (perf->user_only && (bench_perf_events[i].type == PERF_TYPE_HARDWARE)) ? " user" : "");
+    }
+    if ((perf->fds[BENCH_PERF_CYCLES] >= 0) && (perf->fds[BENCH_PERF_INSTRUCTIONS] >= 0) &&
+        (values[BENCH_PERF_CYCLES] > 0)) {
+        fprintf(out, "perf instructions per cycle: %.3f\n",
+            (double) values[BENCH_PERF_INSTRUCTIONS] / values[BENCH_PERF_CYCLES]);
+    }
+}
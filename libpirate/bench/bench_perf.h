@@ -0,0 +1,56 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef _PIRATE_BENCH_PERF_H
+#define _PIRATE_BENCH_PERF_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Hardware and software counters of the calling thread from
+// perf_event_open(2). Each counter is opened on its own, so a
+// counter that the kernel or the container does not provide is
+// skipped. The kernel is excluded when perf_event_paranoid does
+// not allow counting it. Counts are scaled when the kernel
+// multiplexes the counters.
+
+enum {
+    BENCH_PERF_CYCLES = 0,
+    BENCH_PERF_INSTRUCTIONS,
+    BENCH_PERF_CACHE_REFERENCES,
+    BENCH_PERF_CACHE_MISSES,
+    BENCH_PERF_BRANCH_MISSES,
+    BENCH_PERF_CONTEXT_SWITCHES,
+    BENCH_PERF_CPU_MIGRATIONS,
+    BENCH_PERF_COUNT
+};
+
+typedef struct {
+    int fds[BENCH_PERF_COUNT];
+    uint64_t values[BENCH_PERF_COUNT];
+    int user_only;
+    int count;
+} bench_perf_t;
+
+// Returns the number of counters that are available
+int bench_perf_open(bench_perf_t *perf);
+void bench_perf_start(bench_perf_t *perf);
+void bench_perf_stop(bench_perf_t *perf);
+void bench_perf_close(bench_perf_t *perf);
+
+// One line per counter with the count per message and per byte
+void bench_perf_print(const bench_perf_t *perf, uint64_t messages, uint64_t bytes, FILE *out);
+
+#endif /* _PIRATE_BENCH_PERF_H */
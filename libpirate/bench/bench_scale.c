@@ -0,0 +1,751 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#define _GNU_SOURCE
+
+#include <argp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libpirate.h"
+
+// Multi-channel scaling benchmark. A reader process and a writer
+// process each open the same N channels and drive them with M
+// threads. Thread t of each process owns the channels k with
+// k % M == t and visits them round robin, one message per channel
+// per round. A writer thread only stops at the end of a round, so
+// a blocking reader never waits on a channel that the writer has
+// skipped. The CPU time and context switches of each process are
+// collected with wait4().
+
+#define BENCH_SCALE_MAX_LIST        32
+#define BENCH_SCALE_MAX_CHANNELS    256
+#define BENCH_SCALE_DRAIN_NS        100000000ull
+
+#ifndef MAX
+#define MAX(X, Y) (((X) > (Y)) ? (X) : (Y))
+#endif
+
+typedef struct {
+    const char *config;
+    unsigned channels[BENCH_SCALE_MAX_LIST];
+    unsigned nchannels;
+    unsigned threads[BENCH_SCALE_MAX_LIST];
+    unsigned nthreads;
+    size_t message_len;
+    uint64_t duration_ms;
+    unsigned iterations;
+    unsigned timeout_s;
+    int pin;
+    int json;
+    const char *output;
+} bench_scale_opts_t;
+
+typedef struct {
+    uint64_t sent;
+    uint64_t received;
+} bench_scale_count_t;
+
+// Mapped MAP_SHARED between the parent, the reader and the writer
+typedef struct {
+    int ready;
+    int failed;
+    int stop;
+    int writers_done;
+    uint64_t start_ns;
+    uint64_t stop_ns;
+    int reader_err;
+    int writer_err;
+    bench_scale_count_t counts[BENCH_SCALE_MAX_CHANNELS];
+} bench_scale_shared_t;
+
+typedef struct {
+    const char *config;
+    unsigned nchannels;
+    unsigned nthreads;
+    size_t message_len;
+    int pin;
+    int access;
+    int lossy;
+    int gds[BENCH_SCALE_MAX_CHANNELS];
+    bench_scale_shared_t *shared;
+} bench_scale_run_t;
+
+typedef struct {
+    bench_scale_run_t *run;
+    unsigned id;
+    pthread_t thread;
+} bench_scale_thread_t;
+
+static struct argp_option options[] = {
+    { "channel",     'c', "CONFIG", 0, "Channel configuration, instance k adds k to the ports or appends .k to the path", 0 },
+    { "channels",    'N', "LIST",   0, "Comma separated channel counts (default 1,2,4,8,16)", 0 },
+    { "threads",     'M', "LIST",   0, "Comma separated thread counts of each process (default 1,2,4)", 0 },
+    { "message_len", 'm', "BYTES",  0, "Transfer message size (default 64)", 0 },
+    { "duration",    'd', "MSEC",   0, "Duration of a run (default 1000)", 0 },
+    { "iterations",  'i', "COUNT",  0, "Runs for each combination (default 1)", 0 },
+    { "timeout",     't', "SEC",    0, "Run timeout (default 60)", 0 },
+    { "pin",         'p', NULL,     0, "Pin the threads to CPUs round robin", 0 },
+    { "format",      'f', "FORMAT", 0, "Report format csv or json (default csv)", 0 },
+    { "output",      'o', "FILE",   0, "Report file (default stdout)", 0 },
+    { NULL,           0,  NULL,     0, GAPS_CHANNEL_OPTIONS, 2 },
+    { NULL,           0,  NULL,     0, 0, 0 }
+};
+
+static unsigned parse_list(struct argp_state *state, char *arg, unsigned *values, unsigned max) {
+    unsigned count = 0;
+    char *saveptr = NULL, *endptr = NULL;
+
+    for (char *token = strtok_r(arg, ",", &saveptr); token != NULL;
+            token = strtok_r(NULL, ",", &saveptr)) {
+        if (count == BENCH_SCALE_MAX_LIST) {
+            argp_error(state, "At most %d values are allowed", BENCH_SCALE_MAX_LIST);
+        }
+        values[count] = strtoul(token, &endptr, 10);
+        if ((*endptr != '\0') || (values[count] == 0) || (values[count] > max)) {
+            argp_error(state, "Value \"%s\" must be between 1 and %u", token, max);
+        }
+        count++;
+    }
+    return count;
+}
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    bench_scale_opts_t *opts = (bench_scale_opts_t *) state->input;
+    char *endptr = NULL;
+
+    switch (key) {
+
+    case 'c':
+        opts->config = arg;
+        break;
+
+    case 'N':
+        opts->nchannels = parse_list(state, arg, opts->channels, BENCH_SCALE_MAX_CHANNELS);
+        break;
+
+    case 'M':
+        opts->nthreads = parse_list(state, arg, opts->threads, BENCH_SCALE_MAX_CHANNELS);
+        break;
+
+    case 'm':
+        opts->message_len = strtoul(arg, &endptr, 10);
+        if ((*endptr != '\0') || (opts->message_len == 0)) {
+            argp_error(state, "Unable to parse numeric value from \"%s\"\n", arg);
+        }
+        break;
+
+    case 'd':
+        opts->duration_ms = strtoull(arg, &endptr, 10);
+        if ((*endptr != '\0') || (opts->duration_ms == 0)) {
+            argp_error(state, "Unable to parse numeric value from \"%s\"\n", arg);
+        }
+        break;
+
+    case 'i':
+        opts->iterations = strtoul(arg, &endptr, 10);
+        if ((*endptr != '\0') || (opts->iterations == 0)) {
+            argp_error(state, "Unable to parse numeric value from \"%s\"\n", arg);
+        }
+        break;
+
+    case 't':
+        opts->timeout_s = strtoul(arg, &endptr, 10);
+        if ((*endptr != '\0') || (opts->timeout_s == 0)) {
+            argp_error(state, "Unable to parse numeric value from \"%s\"\n", arg);
+        }
+        break;
+
+    case 'p':
+        opts->pin = 1;
+        break;
+
+    case 'f':
+        if (strcmp(arg, "csv") == 0) {
+            opts->json = 0;
+        } else if (strcmp(arg, "json") == 0) {
+            opts->json = 1;
+        } else {
+            argp_error(state, "Unknown report format \"%s\"", arg);
+        }
+        break;
+
+    case 'o':
+        opts->output = arg;
+        break;
+
+    case ARGP_KEY_END:
+        if (opts->config == NULL) {
+            argp_error(state, "Channel configuration is not specified");
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+static void parse_args(int argc, char *argv[], bench_scale_opts_t *opts) {
+    static const unsigned channels[] = { 1, 2, 4, 8, 16 };
+    static const unsigned threads[] = { 1, 2, 4 };
+
+    memset(opts, 0, sizeof(bench_scale_opts_t));
+    memcpy(opts->channels, channels, sizeof(channels));
+    opts->nchannels = sizeof(channels) / sizeof(channels[0]);
+    memcpy(opts->threads, threads, sizeof(threads));
+    opts->nthreads = sizeof(threads) / sizeof(threads[0]);
+    opts->message_len = 64;
+    opts->duration_ms = 1000;
+    opts->iterations = 1;
+    opts->timeout_s = 60;
+
+    struct argp argp = {
+        .options = options,
+        .parser = parse_opt,
+        .args_doc = NULL,
+        .doc = "PIRATE multi-channel scaling benchmark",
+        .children = NULL,
+        .help_filter = NULL,
+        .argp_domain = NULL
+    };
+
+    argp_parse(&argp, argc, argv, 0, 0, opts);
+}
+
+static uint64_t bench_scale_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int bench_scale_append(char *path, unsigned index) {
+    size_t len = strnlen(path, PIRATE_LEN_NAME);
+    int rv = snprintf(path + len, PIRATE_LEN_NAME - len, ".%u", index);
+    if ((rv < 0) || ((size_t) rv >= (PIRATE_LEN_NAME - len))) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+static void bench_scale_ports(uint16_t *reader_port, uint16_t *writer_port, unsigned index) {
+    *reader_port += index;
+    if (*writer_port != 0) {
+        *writer_port += index;
+    }
+}
+
+// Derives the configuration of instance index from the template
+static int bench_scale_instance(pirate_channel_param_t *param, unsigned index) {
+    __typeof__(param->channel) *channel = &param->channel;
+
+    if (index == 0) {
+        return 0;
+    }
+    switch (param->channel_type) {
+        case PIPE:
+            return bench_scale_append(channel->pipe.path, index);
+        case UNIX_SOCKET:
+            return bench_scale_append(channel->unix_socket.path, index);
+        case UNIX_SEQPACKET:
+            return bench_scale_append(channel->unix_seqpacket.path, index);
+        case SHMEM:
+            return bench_scale_append(channel->shmem.path, index);
+        case UDP_SHMEM:
+            return bench_scale_append(channel->udp_shmem.path, index);
+        case TCP_SOCKET:
+            bench_scale_ports(&channel->tcp_socket.reader_port, &channel->tcp_socket.writer_port, index);
+            return 0;
+        case UDP_SOCKET:
+            bench_scale_ports(&channel->udp_socket.reader_port, &channel->udp_socket.writer_port, index);
+            return 0;
+        case GE_ETH:
+            bench_scale_ports(&channel->ge_eth.reader_port, &channel->ge_eth.writer_port, index);
+            return 0;
+        default:
+            errno = ESOCKTNOSUPPORT;
+            return -1;
+    }
+}
+
+static int bench_scale_lossy(const char *config) {
+    pirate_channel_param_t param;
+
+    if (pirate_parse_channel_param(config, &param) != 0) {
+        return 0;
+    }
+    return (param.channel_type == UDP_SOCKET) || (param.channel_type == GE_ETH);
+}
+
+static int bench_scale_open(bench_scale_run_t *run, unsigned index) {
+    pirate_channel_param_t param;
+    int flags = run->access;
+
+    if (pirate_parse_channel_param(run->config, &param) != 0) {
+        return -1;
+    }
+    if (bench_scale_instance(&param, index) != 0) {
+        return -1;
+    }
+    if ((param.channel_type == UDP_SHMEM) && (param.channel.udp_shmem.packet_size == 0)) {
+        param.channel.udp_shmem.packet_size = MAX(run->message_len, 64);
+    }
+    // a lossy reader moves on to the next channel instead of waiting
+    if (run->lossy && (run->access == O_RDONLY)) {
+        flags |= O_NONBLOCK;
+    }
+    return pirate_open_param(&param, flags);
+}
+
+static int bench_scale_read(int gd, uint8_t *buf, size_t count, int nonblock) {
+    size_t off = 0;
+
+    while (off < count) {
+        ssize_t rv = pirate_read(gd, buf + off, count - off);
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (nonblock && (off == 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+                return 0;
+            }
+            return -1;
+        } else if (rv == 0) {
+            errno = EPIPE;
+            return -1;
+        }
+        off += rv;
+        if (nonblock) {
+            break;
+        }
+    }
+    return 1;
+}
+
+static int bench_scale_write(int gd, const uint8_t *buf, size_t count) {
+    size_t off = 0;
+
+    while (off < count) {
+        ssize_t rv = pirate_write(gd, buf + off, count - off);
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        off += rv;
+    }
+    return 0;
+}
+
+static void bench_scale_fail(bench_scale_shared_t *shared, int *err) {
+    *err = errno ? errno : EIO;
+    __atomic_store_n(&shared->failed, 1, __ATOMIC_RELEASE);
+}
+
+static void bench_scale_reader(bench_scale_run_t *run, unsigned id, uint8_t *buf) {
+    bench_scale_shared_t *shared = run->shared;
+    uint64_t drain_ns = 0, last_ns = 0;
+
+    for (;;) {
+        int done = (__atomic_load_n(&shared->writers_done, __ATOMIC_ACQUIRE) == (int) run->nthreads);
+        unsigned pending = 0, progress = 0;
+
+        for (unsigned k = id; k < run->nchannels; k += run->nthreads) {
+            bench_scale_count_t *count = &shared->counts[k];
+            int rv;
+
+            if (done && (count->received >= __atomic_load_n(&count->sent, __ATOMIC_ACQUIRE))) {
+                continue;
+            }
+            pending++;
+            rv = bench_scale_read(run->gds[k], buf, run->message_len, run->lossy);
+            // the writer may stop after this round started
+            if ((rv < 0) && (errno == EPIPE) &&
+                (__atomic_load_n(&shared->writers_done, __ATOMIC_ACQUIRE) == (int) run->nthreads) &&
+                (count->received >= __atomic_load_n(&count->sent, __ATOMIC_ACQUIRE))) {
+                continue;
+            }
+            if (rv < 0) {
+                bench_scale_fail(shared, &shared->reader_err);
+                goto end;
+            } else if (rv > 0) {
+                count->received++;
+                progress++;
+            }
+        }
+        if (progress > 0) {
+            last_ns = bench_scale_now();
+        }
+        if ((pending == 0) || __atomic_load_n(&shared->failed, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        // lost messages are never received
+        if (done && (progress == 0)) {
+            if (drain_ns == 0) {
+                drain_ns = bench_scale_now() + BENCH_SCALE_DRAIN_NS;
+            } else if (bench_scale_now() > drain_ns) {
+                break;
+            }
+            sched_yield();
+        } else {
+            drain_ns = 0;
+        }
+    }
+end:
+    // the end of the run is the last message of any reader thread
+    for (uint64_t prev = __atomic_load_n(&shared->stop_ns, __ATOMIC_ACQUIRE); prev < last_ns;) {
+        if (__atomic_compare_exchange_n(&shared->stop_ns, &prev, last_ns, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+    }
+}
+
+static void bench_scale_writer(bench_scale_run_t *run, unsigned id, uint8_t *buf) {
+    bench_scale_shared_t *shared = run->shared;
+
+    // stop only at the end of a round
+    while (!__atomic_load_n(&shared->stop, __ATOMIC_ACQUIRE) &&
+            !__atomic_load_n(&shared->failed, __ATOMIC_ACQUIRE)) {
+        for (unsigned k = id; k < run->nchannels; k += run->nthreads) {
+            bench_scale_count_t *count = &shared->counts[k];
+
+            if (bench_scale_write(run->gds[k], buf, run->message_len) < 0) {
+                if (run->lossy && ((errno == ENOBUFS) || (errno == ECONNREFUSED))) {
+                    continue;
+                }
+                bench_scale_fail(shared, &shared->writer_err);
+                break;
+            }
+            __atomic_store_n(&count->sent, count->sent + 1, __ATOMIC_RELEASE);
+        }
+    }
+    __atomic_add_fetch(&shared->writers_done, 1, __ATOMIC_ACQ_REL);
+}
+
+static void *bench_scale_thread(void *arg) {
+    bench_scale_thread_t *thread = (bench_scale_thread_t *) arg;
+    bench_scale_run_t *run = thread->run;
+    bench_scale_shared_t *shared = run->shared;
+    uint8_t *buf;
+
+    if (run->pin) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((2 * thread->id + (run->access == O_WRONLY)) % MAX(ncpus, 1), &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    if ((buf = calloc(run->message_len, 1)) == NULL) {
+        bench_scale_fail(shared, (run->access == O_RDONLY) ? &shared->reader_err : &shared->writer_err);
+        if (run->access == O_WRONLY) {
+            __atomic_add_fetch(&shared->writers_done, 1, __ATOMIC_ACQ_REL);
+        }
+        return NULL;
+    }
+    __atomic_add_fetch(&shared->ready, 1, __ATOMIC_ACQ_REL);
+    while (!__atomic_load_n(&shared->start_ns, __ATOMIC_ACQUIRE)) {
+        if (__atomic_load_n(&shared->failed, __ATOMIC_ACQUIRE)) {
+            if (run->access == O_WRONLY) {
+                __atomic_add_fetch(&shared->writers_done, 1, __ATOMIC_ACQ_REL);
+            }
+            free(buf);
+            return NULL;
+        }
+        usleep(100);
+    }
+    if (run->access == O_RDONLY) {
+        bench_scale_reader(run, thread->id, buf);
+    } else {
+        bench_scale_writer(run, thread->id, buf);
+    }
+    free(buf);
+    return NULL;
+}
+
+static void bench_scale_child(bench_scale_run_t *run) {
+    bench_scale_shared_t *shared = run->shared;
+    int *err = (run->access == O_RDONLY) ? &shared->reader_err : &shared->writer_err;
+    bench_scale_thread_t *threads;
+    unsigned opened, started = 0;
+
+    // both processes open the channels in the same order
+    for (opened = 0; opened < run->nchannels; opened++) {
+        if ((run->gds[opened] = bench_scale_open(run, opened)) == -1) {
+            bench_scale_fail(shared, err);
+            goto end;
+        }
+    }
+    if ((threads = calloc(run->nthreads, sizeof(bench_scale_thread_t))) == NULL) {
+        bench_scale_fail(shared, err);
+        goto end;
+    }
+    for (started = 0; started < run->nthreads; started++) {
+        threads[started].run = run;
+        threads[started].id = started;
+        if ((errno = pthread_create(&threads[started].thread, NULL,
+                bench_scale_thread, &threads[started])) != 0) {
+            bench_scale_fail(shared, err);
+            break;
+        }
+    }
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    free(threads);
+end:
+    for (unsigned k = 0; k < opened; k++) {
+        pirate_close(run->gds[k]);
+    }
+}
+
+typedef struct {
+    struct rusage reader;
+    struct rusage writer;
+} bench_scale_usage_t;
+
+static int bench_scale_run(bench_scale_run_t *run, const bench_scale_opts_t *opts,
+    bench_scale_usage_t *usage) {
+    bench_scale_shared_t *shared = run->shared;
+    uint64_t deadline;
+    pid_t pids[2];
+    struct rusage *rusage[2] = { &usage->reader, &usage->writer };
+    int remaining = 2, rv = 0;
+
+    memset(usage, 0, sizeof(bench_scale_usage_t));
+    fflush(NULL);
+    for (int i = 0; i < 2; i++) {
+        if ((pids[i] = fork()) < 0) {
+            __atomic_store_n(&shared->failed, 1, __ATOMIC_RELEASE);
+            if (i == 1) {
+                kill(pids[0], SIGKILL);
+                waitpid(pids[0], NULL, 0);
+            }
+            return -1;
+        } else if (pids[i] == 0) {
+            run->access = (i == 0) ? O_RDONLY : O_WRONLY;
+            bench_scale_child(run);
+            _exit(0);
+        }
+    }
+
+    deadline = bench_scale_now() + opts->timeout_s * 1000000000ull;
+    while (__atomic_load_n(&shared->ready, __ATOMIC_ACQUIRE) < (int) (2 * run->nthreads)) {
+        if (__atomic_load_n(&shared->failed, __ATOMIC_ACQUIRE) || (bench_scale_now() > deadline)) {
+            break;
+        }
+        usleep(1000);
+    }
+    if (!__atomic_load_n(&shared->failed, __ATOMIC_ACQUIRE) && (bench_scale_now() <= deadline)) {
+        __atomic_store_n(&shared->start_ns, bench_scale_now(), __ATOMIC_RELEASE);
+        usleep(opts->duration_ms * 1000);
+    }
+    __atomic_store_n(&shared->stop, 1, __ATOMIC_RELEASE);
+
+    while (remaining > 0) {
+        for (int i = 0; i < 2; i++) {
+            if ((pids[i] > 0) && (wait4(pids[i], NULL, WNOHANG, rusage[i]) == pids[i])) {
+                pids[i] = -1;
+                remaining--;
+            }
+        }
+        if ((remaining > 0) && (bench_scale_now() > deadline)) {
+            __atomic_store_n(&shared->failed, 1, __ATOMIC_RELEASE);
+            for (int i = 0; i < 2; i++) {
+                if (pids[i] > 0) {
+                    kill(pids[i], SIGKILL);
+                    wait4(pids[i], NULL, 0, rusage[i]);
+                }
+            }
+            rv = -1;
+            break;
+        }
+        usleep(1000);
+    }
+    return rv;
+}
+
+static double bench_scale_ms(const struct timeval *tv) {
+    return tv->tv_sec * 1e3 + tv->tv_usec / 1e3;
+}
+
+static void bench_scale_report_header(const bench_scale_opts_t *opts, FILE *out) {
+    if (opts->json) {
+        fprintf(out, "[\n");
+    } else {
+        fprintf(out, "channel,channels,threads,pinned,message_len,iteration,sent,received,"
+            "elapsed_ns,mbytes_per_sec,msgs_per_sec,channel_min_mbytes_per_sec,"
+            "channel_max_mbytes_per_sec,fairness,reader_user_ms,reader_sys_ms,reader_vcsw,"
+            "reader_ivcsw,writer_user_ms,writer_sys_ms,writer_vcsw,writer_ivcsw,status\n");
+    }
+}
+
+static void bench_scale_report_footer(const bench_scale_opts_t *opts, FILE *out) {
+    if (opts->json) {
+        fprintf(out, "\n]\n");
+    }
+}
+
+static void bench_scale_report(const bench_scale_opts_t *opts, FILE *out, unsigned row,
+    const bench_scale_run_t *run, unsigned iteration, const bench_scale_usage_t *usage,
+    const char *status) {
+    const bench_scale_shared_t *shared = run->shared;
+    uint64_t sent = 0, received = 0, elapsed = 0, min = UINT64_MAX, max = 0;
+    double sum = 0.0, sum_squares = 0.0, fairness = 0.0;
+    double mbps = 0.0, mps = 0.0, min_mbps = 0.0, max_mbps = 0.0;
+
+    for (unsigned k = 0; k < run->nchannels; k++) {
+        uint64_t count = shared->counts[k].received;
+        sent += shared->counts[k].sent;
+        received += count;
+        min = (count < min) ? count : min;
+        max = (count > max) ? count : max;
+        sum += count;
+        sum_squares += (double) count * count;
+    }
+    // Jain's fairness index, 1.0 when every channel has the same share
+    if (sum_squares > 0.0) {
+        fairness = (sum * sum) / (run->nchannels * sum_squares);
+    }
+    if ((received > 0) && (shared->stop_ns > shared->start_ns)) {
+        elapsed = shared->stop_ns - shared->start_ns;
+        mbps = (received * run->message_len * 1e3) / elapsed;
+        mps = (received * 1e9) / elapsed;
+        min_mbps = (min * run->message_len * 1e3) / elapsed;
+        max_mbps = (max * run->message_len * 1e3) / elapsed;
+    }
+
+    if (opts->json) {
+        fprintf(out, "%s  {\"channel\": \"%s\", \"channels\": %u, \"threads\": %u, "
+            "\"pinned\": %d, \"message_len\": %zu, \"iteration\": %u, \"sent\": %" PRIu64
+            ", \"received\": %" PRIu64 ", \"elapsed_ns\": %" PRIu64 ", \"mbytes_per_sec\": %.3f"
+            ", \"msgs_per_sec\": %.1f, \"channel_min_mbytes_per_sec\": %.3f"
+            ", \"channel_max_mbytes_per_sec\": %.3f, \"fairness\": %.4f"
+            ", \"reader_user_ms\": %.1f, \"reader_sys_ms\": %.1f, \"reader_vcsw\": %ld"
+            ", \"reader_ivcsw\": %ld, \"writer_user_ms\": %.1f, \"writer_sys_ms\": %.1f"
+            ", \"writer_vcsw\": %ld, \"writer_ivcsw\": %ld, \"status\": \"%s\"}",
+            row ? ",\n" : "", run->config, run->nchannels, run->nthreads, run->pin,
+            run->message_len, iteration, sent, received, elapsed, mbps, mps, min_mbps,
+            max_mbps, fairness, bench_scale_ms(&usage->reader.ru_utime),
+            bench_scale_ms(&usage->reader.ru_stime), usage->reader.ru_nvcsw,
+            usage->reader.ru_nivcsw, bench_scale_ms(&usage->writer.ru_utime),
+            bench_scale_ms(&usage->writer.ru_stime), usage->writer.ru_nvcsw,
+            usage->writer.ru_nivcsw, status);
+    } else {
+        // channel configurations have commas
+        fprintf(out, "\"%s\",%u,%u,%d,%zu,%u,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.3f,%.1f"
+            ",%.3f,%.3f,%.4f,%.1f,%.1f,%ld,%ld,%.1f,%.1f,%ld,%ld,%s\n",
+            run->config, run->nchannels, run->nthreads, run->pin, run->message_len,
+            iteration, sent, received, elapsed, mbps, mps, min_mbps, max_mbps, fairness,
+            bench_scale_ms(&usage->reader.ru_utime), bench_scale_ms(&usage->reader.ru_stime),
+            usage->reader.ru_nvcsw, usage->reader.ru_nivcsw,
+            bench_scale_ms(&usage->writer.ru_utime), bench_scale_ms(&usage->writer.ru_stime),
+            usage->writer.ru_nvcsw, usage->writer.ru_nivcsw, status);
+    }
+    fflush(out);
+}
+
+static const char *bench_scale_status(const bench_scale_shared_t *shared, int rv,
+    char *buf, size_t len) {
+    if ((shared->reader_err != 0) && (shared->writer_err != 0)) {
+        snprintf(buf, len, "reader: %s writer: %s", strerror(shared->reader_err),
+            strerror(shared->writer_err));
+        return buf;
+    } else if (shared->reader_err != 0) {
+        snprintf(buf, len, "reader: %s", strerror(shared->reader_err));
+        return buf;
+    } else if (shared->writer_err != 0) {
+        snprintf(buf, len, "writer: %s", strerror(shared->writer_err));
+        return buf;
+    } else if (rv != 0) {
+        return "timeout";
+    }
+    return "ok";
+}
+
+int main(int argc, char *argv[]) {
+    bench_scale_opts_t opts;
+    bench_scale_shared_t *shared;
+    FILE *out = stdout;
+    unsigned row = 0;
+    char status[128];
+
+    parse_args(argc, argv, &opts);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    shared = mmap(NULL, sizeof(bench_scale_shared_t), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("Unable to map shared state");
+        return -1;
+    }
+
+    if ((opts.output != NULL) && ((out = fopen(opts.output, "w")) == NULL)) {
+        perror("Unable to open the report file");
+        return -1;
+    }
+
+    bench_scale_report_header(&opts, out);
+    for (unsigned n = 0; n < opts.nchannels; n++)
+    for (unsigned m = 0; m < opts.nthreads; m++)
+    for (unsigned i = 0; i < opts.iterations; i++) {
+        bench_scale_run_t run;
+        bench_scale_usage_t usage;
+        int rv;
+
+        // every thread drives at least one channel
+        if (opts.threads[m] > opts.channels[n]) {
+            continue;
+        }
+        memset(&run, 0, sizeof(run));
+        memset(shared, 0, sizeof(bench_scale_shared_t));
+        run.config = opts.config;
+        run.nchannels = opts.channels[n];
+        run.nthreads = opts.threads[m];
+        run.message_len = opts.message_len;
+        run.pin = opts.pin;
+        run.lossy = bench_scale_lossy(opts.config);
+        run.shared = shared;
+
+        rv = bench_scale_run(&run, &opts, &usage);
+        bench_scale_report(&opts, out, row++, &run, i, &usage,
+            bench_scale_status(shared, rv, status, sizeof(status)));
+    }
+    bench_scale_report_footer(&opts, out);
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    munmap(shared, sizeof(bench_scale_shared_t));
+    return 0;
+}
@@ -42,6 +42,7 @@ typedef struct {
     int validate;
     uint64_t tx_delay_ns;
     uint32_t rx_timeout_s;
+    int perf;
     uint8_t *buffer;
     uint8_t *bitvector;
     char err_msg[256];
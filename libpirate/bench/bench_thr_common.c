@@ -34,6 +34,7 @@ static struct argp_option options[] = {
     { "validate",    'v', NULL,     0, "Validate received data",        0 },
     { "tx_delay",    'd', "NSEC",   0, "Inter-message delay",           0 },
     { "rx_timeout",  'w', "SEC",    0, "Message receive timeout",       0 },
+    { "perf",        'p', NULL,     0, "Report hardware performance counters", 0 },
     { NULL,           0,  NULL,     0, GAPS_CHANNEL_OPTIONS,            2 },
     { NULL,           0,  NULL,     0, 0,                               0 }
 };
@@ -74,6 +75,10 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         bench->validate = 1;
         break;
 
+    case 'p':
+        bench->perf = 1;
+        break;
+
     case 'd':
         bench->tx_delay_ns = strtoull(arg, &endptr, 10);
         if (*endptr != '\0') {
@@ -132,6 +137,7 @@ void parse_args(int argc, char *argv[], bench_thr_t *bench) {
     bench->validate        = 0;
     bench->tx_delay_ns     = 0;
     bench->rx_timeout_s    = 2;
+    bench->perf            = 0;
 
     struct argp argp = {
         .options = options,
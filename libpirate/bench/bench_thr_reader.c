@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include "bench_perf.h"
 #include "bench_thr.h"
 
 int run(bench_thr_t *bench) {
@@ -30,12 +31,17 @@ int run(bench_thr_t *bench) {
     uint64_t delta;
     int timeout = 0;
     uint8_t signal = 1;
+    bench_perf_t perf;
 
     /* Open and configure synchronization and test channels */
     if (bench_thr_setup(bench, O_RDONLY, O_RDONLY, O_WRONLY)) {
         return -1;
     }
 
+    if (bench->perf) {
+        bench_perf_open(&perf);
+    }
+
     rv = pirate_write(bench->sync_ch2.gd, &signal, sizeof(signal));
     if (rv < 0) {
         perror("Sync channel 2 initial write error");
@@ -48,6 +54,10 @@ int run(bench_thr_t *bench) {
         return -1;
     }
 
+    if (bench->perf) {
+        bench_perf_start(&perf);
+    }
+
     if (clock_gettime(CLOCK_MONOTONIC, &start) < 0) {
         perror("clock_gettime start");
         return -1;
@@ -76,6 +86,10 @@ int run(bench_thr_t *bench) {
         return -1;
     }
 
+    if (bench->perf) {
+        bench_perf_stop(&perf);
+    }
+
     /* Tell the writer that we are done */
     rv = pirate_write(bench->sync_ch2.gd, &signal, sizeof(signal));
     if (rv < 0) {
@@ -139,6 +153,10 @@ int run(bench_thr_t *bench) {
            ((1e9 / 1e6) * read_off) / delta);
     printf("drop rate: %f %%\n",
         ((bench->nbytes - read_off) / ((float) (bench->nbytes))) * 100.0);
+    if (bench->perf) {
+        bench_perf_print(&perf, read_off / bench->message_len, read_off, stdout);
+        bench_perf_close(&perf);
+    }
 
     return 0;
 }
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "bench_perf.h"
 #include "bench_thr.h"
 
 #define tscmp(a, b, CMP)                             \
@@ -63,6 +64,7 @@ int run(bench_thr_t *bench) {
     const uint32_t iter = bench->nbytes / bench->message_len;
     uint64_t write_off = 0;
     uint8_t signal = 1;
+    bench_perf_t perf;
 
     const struct timespec ts = {
         .tv_sec = bench->tx_delay_ns / 1000000000,
@@ -93,6 +95,10 @@ int run(bench_thr_t *bench) {
         }
     }
 
+    if (bench->perf) {
+        bench_perf_open(&perf);
+    }
+
     rv = pirate_read(bench->sync_ch2.gd, &signal, sizeof(signal));
     if (rv < 0) {
         perror("Sync channel 2 initial read error");
@@ -105,6 +111,10 @@ int run(bench_thr_t *bench) {
         return -1;
     }
 
+    if (bench->perf) {
+        bench_perf_start(&perf);
+    }
+
     for (uint32_t i = 0; i < iter; i++) {
         size_t count = bench->message_len;
         while (count > 0) {
@@ -123,6 +133,10 @@ int run(bench_thr_t *bench) {
         }
     }
 
+    if (bench->perf) {
+        bench_perf_stop(&perf);
+    }
+
     /* Read sync from the reader */
     rv = pirate_read(bench->sync_ch2.gd, &signal, sizeof(signal));
     if (rv < 0) {
@@ -130,6 +144,11 @@ int run(bench_thr_t *bench) {
         return -1;
     }
 
+    if (bench->perf) {
+        bench_perf_print(&perf, write_off / bench->message_len, write_off, stdout);
+        bench_perf_close(&perf);
+    }
+
     return 0;
 }
 
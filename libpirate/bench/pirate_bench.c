@@ -0,0 +1,1048 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#define _GNU_SOURCE
+
+#include <argp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libpirate.h"
+#include "bench_hist.h"
+
+// Single process throughput benchmark. Each run opens the reader
+// and the writer of one channel in two threads (or two forked
+// children) and measures the messages that reach the reader.
+// The sweep is channel x message size x batch x CPU placement
+// x offered rate.
+//
+// Each message starts with a sequence number and the time it was
+// scheduled to be sent. With an offered rate the writer runs open
+// loop. It sends on a fixed schedule of constant or exponential
+// (Poisson) interarrival times and never waits for the reader. A
+// message that is sent late keeps its scheduled time, so the
+// one-way latency includes the time that the writer fell behind.
+
+#define BENCH_MAX_LIST          32
+#define BENCH_END_MARK          0xFFFFFFFFu
+#define BENCH_WINDOW_WAIT_NS    10000000ull
+#define BENCH_END_INTERVAL_NS   1000000ull
+#define BENCH_PTY_CONFIG        "serial,pty"
+#define BENCH_HEADER_LEN        (sizeof(uint32_t) + sizeof(uint64_t))
+#define BENCH_SPIN_NS           100000ull
+
+#ifndef MIN
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
+#endif
+
+#ifndef MAX
+#define MAX(X, Y) (((X) > (Y)) ? (X) : (Y))
+#endif
+
+static const char *bench_default_channels[] = {
+    "pipe,/tmp/pirate_bench.pipe",
+    "unix_socket,/tmp/pirate_bench.sock",
+    "unix_seqpacket,/tmp/pirate_bench.seqpacket",
+    "tcp_socket,127.0.0.1,26600,0.0.0.0,0",
+    "udp_socket,127.0.0.1,26601,0.0.0.0,0",
+    "shmem,/pirate_bench_shmem",
+    "udp_shmem,/pirate_bench_udp_shmem",
+    "ge_eth,127.0.0.1,26602,0.0.0.0,0,1",
+    BENCH_PTY_CONFIG,
+};
+
+typedef struct {
+    int reader;
+    int writer;
+} bench_cpus_t;
+
+typedef struct {
+    const char *channels[BENCH_MAX_LIST];
+    unsigned nchannels;
+    size_t sizes[BENCH_MAX_LIST];
+    unsigned nsizes;
+    unsigned batches[BENCH_MAX_LIST];
+    unsigned nbatches;
+    bench_cpus_t cpus[BENCH_MAX_LIST];
+    unsigned ncpus;
+    uint64_t rates[BENCH_MAX_LIST];
+    unsigned nrates;
+    int poisson;
+    uint64_t duration_ms;
+    size_t nbytes;
+    unsigned iterations;
+    unsigned timeout_s;
+    int fork;
+    int json;
+    const char *output;
+} bench_opts_t;
+
+// Mapped MAP_SHARED so that forked children can update it
+typedef struct {
+    int opened;
+    int failed;
+    int writer_done;
+    int reader_done;
+    uint64_t received;
+    uint64_t start_ns;
+    uint64_t stop_ns;
+    uint64_t sent;
+    uint64_t reordered;
+    int reader_err;
+    int writer_err;
+    int skipped;
+    bench_hist_t latency;
+} bench_shared_t;
+
+typedef struct {
+    char reader_config[256];
+    char writer_config[256];
+    size_t message_len;
+    unsigned batch;
+    bench_cpus_t cpus;
+    uint64_t rate;
+    int poisson;
+    uint64_t count;
+    int lossy;
+    bench_shared_t *shared;
+} bench_run_t;
+
+typedef struct {
+    int master_in;
+    int master_out;
+    int slave_in;
+    int slave_out;
+    int stop[2];
+    pthread_t thread;
+} bench_pty_t;
+
+static struct argp_option options[] = {
+    { "channel",    'c', "CONFIG", 0, "Channel configuration (repeatable, default all local channels)", 0 },
+    { "message_len",'m', "LIST",   0, "Comma separated message sizes (default 64,1024,16384)", 0 },
+    { "batch",      'b', "LIST",   0, "Comma separated writer windows in messages, 0 for unbounded (default 0)", 0 },
+    { "cpus",       'P', "LIST",   0, "Comma separated CPU placements READER:WRITER or none (default none)", 0 },
+    { "rate",       'r', "LIST",   0, "Comma separated offered rates in messages/sec, 0 for unpaced (default 0)", 0 },
+    { "arrivals",   'a', "TYPE",   0, "Arrivals at an offered rate constant or poisson (default constant)", 0 },
+    { "duration",   'd', "MSEC",   0, "Duration of a run at an offered rate (default 1000)", 0 },
+    { "nbytes",     'n', "BYTES",  0, "Bytes to transfer in an unpaced run (default 8388608)", 0 },
+    { "iterations", 'i', "COUNT",  0, "Runs for each combination (default 1)", 0 },
+    { "timeout",    't', "SEC",    0, "Run timeout (default 60)", 0 },
+    { "fork",       'F', NULL,     0, "Run the reader and writer in forked children instead of threads", 0 },
+    { "format",     'f', "FORMAT", 0, "Report format csv or json (default csv)", 0 },
+    { "output",     'o', "FILE",   0, "Report file (default stdout)", 0 },
+    { NULL,          0,  NULL,     0, GAPS_CHANNEL_OPTIONS, 2 },
+    { NULL,          0,  NULL,     0, 0, 0 }
+};
+
+static unsigned parse_list(struct argp_state *state, char *arg,
+    unsigned long long *values, int allow_zero) {
+    unsigned count = 0;
+    char *saveptr = NULL, *endptr = NULL;
+
+    for (char *token = strtok_r(arg, ",", &saveptr); token != NULL;
+            token = strtok_r(NULL, ",", &saveptr)) {
+        if (count == BENCH_MAX_LIST) {
+            argp_error(state, "At most %d values are allowed", BENCH_MAX_LIST);
+        }
+        values[count] = strtoull(token, &endptr, 10);
+        if ((*endptr != '\0') || (!allow_zero && (values[count] == 0))) {
+            argp_error(state, "Unable to parse numeric value from \"%s\"", token);
+        }
+        count++;
+    }
+    return count;
+}
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    bench_opts_t *opts = (bench_opts_t *) state->input;
+    unsigned long long values[BENCH_MAX_LIST];
+    char *saveptr = NULL, *endptr = NULL;
+
+    switch (key) {
+
+    case 'c':
+        if (opts->nchannels == BENCH_MAX_LIST) {
+            argp_error(state, "At most %d channels are allowed", BENCH_MAX_LIST);
+        }
+        opts->channels[opts->nchannels++] = arg;
+        break;
+
+    case 'm':
+        opts->nsizes = parse_list(state, arg, values, 0);
+        for (unsigned i = 0; i < opts->nsizes; i++) {
+            if (values[i] < BENCH_HEADER_LEN) {
+                argp_error(state, "Message size must be at least %zu bytes", BENCH_HEADER_LEN);
+            }
+            opts->sizes[i] = values[i];
+        }
+        break;
+
+    case 'b':
+        opts->nbatches = parse_list(state, arg, values, 1);
+        for (unsigned i = 0; i < opts->nbatches; i++) {
+            opts->batches[i] = values[i];
+        }
+        break;
+
+    case 'P':
+        opts->ncpus = 0;
+        for (char *token = strtok_r(arg, ",", &saveptr); token != NULL;
+                token = strtok_r(NULL, ",", &saveptr)) {
+            bench_cpus_t *cpus = &opts->cpus[opts->ncpus];
+            if (opts->ncpus == BENCH_MAX_LIST) {
+                argp_error(state, "At most %d placements are allowed", BENCH_MAX_LIST);
+            }
+            if (strcmp(token, "none") == 0) {
+                cpus->reader = -1;
+                cpus->writer = -1;
+            } else {
+                cpus->reader = strtol(token, &endptr, 10);
+                if ((*endptr != ':') || (cpus->reader < 0)) {
+                    argp_error(state, "Unable to parse CPU placement \"%s\"", token);
+                }
+                cpus->writer = strtol(endptr + 1, &endptr, 10);
+                if ((*endptr != '\0') || (cpus->writer < 0)) {
+                    argp_error(state, "Unable to parse CPU placement \"%s\"", token);
+                }
+            }
+            opts->ncpus++;
+        }
+        break;
+
+    case 'r':
+        opts->nrates = parse_list(state, arg, values, 1);
+        for (unsigned i = 0; i < opts->nrates; i++) {
+            opts->rates[i] = values[i];
+        }
+        break;
+
+    case 'a':
+        if (strcmp(arg, "constant") == 0) {
+            opts->poisson = 0;
+        } else if (strcmp(arg, "poisson") == 0) {
+            opts->poisson = 1;
+        } else {
+            argp_error(state, "Unknown arrivals \"%s\"", arg);
+        }
+        break;
+
+    case 'd':
+        opts->duration_ms = strtoull(arg, &endptr, 10);
+        if ((*endptr != '\0') || (opts->duration_ms == 0)) {
+            argp_error(state, "Unable to parse numeric value from \"%s\"\n", arg);
+        }
+        break;
+
+    case 'n':
+        opts->nbytes = strtoull(arg, &endptr, 10);
+        if (*endptr != '\0') {
+            argp_error(state, "Unable to parse numeric value from \"%s\"\n", arg);
+        }
+        break;
+
+    case 'i':
+        opts->iterations = strtoul(arg, &endptr, 10);
+        if ((*endptr != '\0') || (opts->iterations == 0)) {
+            argp_error(state, "Unable to parse numeric value from \"%s\"\n", arg);
+        }
+        break;
+
+    case 't':
+        opts->timeout_s = strtoul(arg, &endptr, 10);
+        if ((*endptr != '\0') || (opts->timeout_s == 0)) {
+            argp_error(state, "Unable to parse numeric value from \"%s\"\n", arg);
+        }
+        break;
+
+    case 'F':
+        opts->fork = 1;
+        break;
+
+    case 'f':
+        if (strcmp(arg, "csv") == 0) {
+            opts->json = 0;
+        } else if (strcmp(arg, "json") == 0) {
+            opts->json = 1;
+        } else {
+            argp_error(state, "Unknown report format \"%s\"", arg);
+        }
+        break;
+
+    case 'o':
+        opts->output = arg;
+        break;
+
+    case ARGP_KEY_END:
+        if (opts->nchannels == 0) {
+            opts->nchannels = sizeof(bench_default_channels) / sizeof(bench_default_channels[0]);
+            memcpy(opts->channels, bench_default_channels, sizeof(bench_default_channels));
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+static void parse_args(int argc, char *argv[], bench_opts_t *opts) {
+    memset(opts, 0, sizeof(bench_opts_t));
+    opts->sizes[0] = 64;
+    opts->sizes[1] = 1024;
+    opts->sizes[2] = 16384;
+    opts->nsizes = 3;
+    opts->batches[0] = 0;
+    opts->nbatches = 1;
+    opts->cpus[0].reader = -1;
+    opts->cpus[0].writer = -1;
+    opts->ncpus = 1;
+    opts->rates[0] = 0;
+    opts->nrates = 1;
+    opts->duration_ms = 1000;
+    opts->nbytes = 8388608;
+    opts->iterations = 1;
+    opts->timeout_s = 60;
+
+    struct argp argp = {
+        .options = options,
+        .parser = parse_opt,
+        .args_doc = NULL,
+        .doc = "PIRATE single process throughput benchmark",
+        .children = NULL,
+        .help_filter = NULL,
+        .argp_domain = NULL
+    };
+
+    argp_parse(&argp, argc, argv, 0, 0, opts);
+}
+
+static uint64_t bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Sleeps until shortly before the deadline and spins for the rest
+static void bench_wait_until(uint64_t deadline) {
+    for (;;) {
+        uint64_t now = bench_now();
+        if (now >= deadline) {
+            return;
+        }
+        if ((deadline - now) > BENCH_SPIN_NS) {
+            struct timespec ts;
+            uint64_t delay = deadline - now - BENCH_SPIN_NS;
+            ts.tv_sec = delay / 1000000000ull;
+            ts.tv_nsec = delay % 1000000000ull;
+            nanosleep(&ts, NULL);
+        } else {
+            // lets the reader run when both share a CPU
+            sched_yield();
+        }
+    }
+}
+
+static void bench_set_cpu(int cpu) {
+    cpu_set_t set;
+
+    if (cpu < 0) {
+        return;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        fprintf(stderr, "Unable to set affinity to CPU %d\n", cpu);
+    }
+}
+
+// Same buffer tuning as bench_thr_common.c
+static int bench_open(const bench_run_t *run, const char *config, int flags) {
+    pirate_channel_param_t param;
+    size_t bufsize = 8 * run->message_len;
+    int gd;
+
+    if (pirate_parse_channel_param(config, &param) != 0) {
+        return -1;
+    }
+
+    switch (param.channel_type) {
+        case SHMEM:
+            if ((bufsize > PIRATE_DEFAULT_SMEM_BUF_LEN) && (param.channel.shmem.buffer_size == 0)) {
+                param.channel.shmem.buffer_size = MIN(bufsize, 524288);
+            }
+            break;
+        case UNIX_SOCKET:
+            if ((bufsize > 212992) && (param.channel.unix_socket.buffer_size == 0)) {
+                param.channel.unix_socket.buffer_size = bufsize;
+            }
+            break;
+        case UDP_SHMEM:
+            if (param.channel.udp_shmem.packet_size == 0) {
+                param.channel.udp_shmem.packet_size = MAX(run->message_len, 64);
+            }
+            break;
+        default:
+            break;
+    }
+
+    gd = pirate_open_param(&param, flags);
+    if (gd == -1) {
+        return -1;
+    }
+
+    switch (param.channel_type) {
+        case PIPE:
+            // best effort, the default pipe size is used otherwise
+            (void) fcntl(gd, F_SETPIPE_SZ, bufsize);
+            break;
+        case UDP_SOCKET:
+        case GE_ETH: {
+            // the reader polls the writer state between timeouts
+            struct timeval tv = { 0, 100000 };
+            if ((flags == O_RDONLY) && (setsockopt(gd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)) {
+                pirate_close(gd);
+                return -1;
+            }
+            break;
+        }
+        case TCP_SOCKET: {
+            struct linger socket_reset = { 1, 0 };
+            if (setsockopt(gd, SOL_SOCKET, SO_LINGER, &socket_reset, sizeof(socket_reset)) < 0) {
+                pirate_close(gd);
+                return -1;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return gd;
+}
+
+// Both sides wait until the other side has opened the channel
+static int bench_rendezvous(bench_shared_t *shared) {
+    __atomic_add_fetch(&shared->opened, 1, __ATOMIC_ACQ_REL);
+    while (__atomic_load_n(&shared->opened, __ATOMIC_ACQUIRE) < 2) {
+        if (__atomic_load_n(&shared->failed, __ATOMIC_ACQUIRE)) {
+            return -1;
+        }
+        usleep(100);
+    }
+    return 0;
+}
+
+static void bench_fail(bench_shared_t *shared, int *err) {
+    *err = errno ? errno : EIO;
+    __atomic_store_n(&shared->failed, 1, __ATOMIC_RELEASE);
+}
+
+static void bench_reader(bench_run_t *run) {
+    bench_shared_t *shared = run->shared;
+    uint64_t received = 0, timeout_ns = 0, next_seq = 0;
+    uint8_t *buf = NULL;
+    int gd;
+
+    bench_set_cpu(run->cpus.reader);
+    gd = bench_open(run, run->reader_config, O_RDONLY);
+    if (gd == -1) {
+        bench_fail(shared, &shared->reader_err);
+        return;
+    }
+    if ((buf = malloc(run->message_len)) == NULL) {
+        bench_fail(shared, &shared->reader_err);
+        pirate_close(gd);
+        return;
+    }
+    if (bench_rendezvous(shared) < 0) {
+        goto end;
+    }
+
+    while (received < run->count) {
+        size_t off = 0;
+        uint64_t now, send_ns;
+        uint32_t seq;
+
+        while (off < run->message_len) {
+            ssize_t rv = pirate_read(gd, buf + off, run->message_len - off);
+            if (rv < 0) {
+                if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+                    if (!__atomic_load_n(&shared->writer_done, __ATOMIC_ACQUIRE)) {
+                        continue;
+                    }
+                    // the writer is gone and its end markers are lost
+                    if (timeout_ns == 0) {
+                        timeout_ns = bench_now() + BENCH_WINDOW_WAIT_NS * 100;
+                    } else if (bench_now() > timeout_ns) {
+                        shared->reader_err = ETIMEDOUT;
+                        goto end;
+                    }
+                    continue;
+                }
+                shared->reader_err = errno;
+                goto end;
+            } else if (rv == 0) {
+                // the writer closed a stream channel
+                goto end;
+            }
+            if ((off == 0) && ((size_t) rv >= sizeof(seq))) {
+                memcpy(&seq, buf, sizeof(seq));
+                if (seq == BENCH_END_MARK) {
+                    goto end;
+                }
+            }
+            off += rv;
+        }
+        now = bench_now();
+        memcpy(&seq, buf, sizeof(seq));
+        memcpy(&send_ns, buf + sizeof(seq), sizeof(send_ns));
+        bench_hist_record(&shared->latency, now - MIN(now, send_ns));
+        if (seq < next_seq) {
+            shared->reordered++;
+        } else {
+            next_seq = (uint64_t) seq + 1;
+        }
+        received++;
+        __atomic_store_n(&shared->received, received, __ATOMIC_RELEASE);
+        shared->stop_ns = now;
+    }
+end:
+    shared->received = received;
+    __atomic_store_n(&shared->reader_done, 1, __ATOMIC_RELEASE);
+    free(buf);
+    pirate_close(gd);
+}
+
+static int bench_write(int gd, const uint8_t *buf, size_t count, int message) {
+    size_t off = 0;
+
+    while (off < count) {
+        ssize_t rv = pirate_write(gd, buf + off, count - off);
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (message) {
+            break;
+        }
+        off += rv;
+    }
+    return 0;
+}
+
+static void bench_writer(bench_run_t *run) {
+    bench_shared_t *shared = run->shared;
+    uint32_t end_mark = BENCH_END_MARK;
+    uint8_t *buf = NULL;
+    uint64_t sent = 0;
+    double interval = 0.0, offset = 0.0;
+    unsigned short xsubi[3] = { 0x330e, 0xabcd, 0x1234 };
+    ssize_t mtu;
+    int gd, message;
+
+    bench_set_cpu(run->cpus.writer);
+    gd = bench_open(run, run->writer_config, O_WRONLY);
+    if (gd == -1) {
+        bench_fail(shared, &shared->writer_err);
+        return;
+    }
+    if ((buf = calloc(run->message_len, 1)) == NULL) {
+        bench_fail(shared, &shared->writer_err);
+        pirate_close(gd);
+        return;
+    }
+    if (bench_rendezvous(shared) < 0) {
+        goto end;
+    }
+    mtu = pirate_write_mtu(gd);
+    if (mtu < 0) {
+        shared->writer_err = errno;
+        goto end;
+    }
+    // channels with an mtu deliver one message per read
+    message = (mtu > 0);
+    if (message && (run->message_len > (size_t) mtu)) {
+        shared->skipped = 1;
+        // a short end marker wakes up the reader
+        bench_write(gd, (uint8_t *) &end_mark, sizeof(end_mark), 1);
+        goto done;
+    }
+
+    if (run->rate > 0) {
+        interval = 1e9 / run->rate;
+    }
+    shared->start_ns = bench_now();
+    for (sent = 0; sent < run->count; sent++) {
+        uint32_t seq = sent;
+        uint64_t send_ns = 0;
+
+        if (run->rate > 0) {
+            send_ns = shared->start_ns + (uint64_t) offset;
+            bench_wait_until(send_ns);
+            if (run->poisson) {
+                offset += -log(1.0 - erand48(xsubi)) * interval;
+            } else {
+                offset += interval;
+            }
+        } else if (run->batch > 0) {
+            uint64_t deadline = 0;
+            // at most batch messages are in flight. Lost messages are
+            // never acknowledged so the wait is bounded.
+            while ((sent - __atomic_load_n(&shared->received, __ATOMIC_ACQUIRE)) >= run->batch) {
+                if (deadline == 0) {
+                    deadline = bench_now() + BENCH_WINDOW_WAIT_NS;
+                } else if (bench_now() > deadline) {
+                    break;
+                }
+                if (__atomic_load_n(&shared->reader_done, __ATOMIC_ACQUIRE)) {
+                    goto done;
+                }
+                sched_yield();
+            }
+        }
+        if (run->rate == 0) {
+            send_ns = bench_now();
+        }
+        memcpy(buf, &seq, sizeof(seq));
+        memcpy(buf + sizeof(seq), &send_ns, sizeof(send_ns));
+        if (bench_write(gd, buf, run->message_len, message) < 0) {
+            shared->writer_err = errno;
+            break;
+        }
+    }
+done:
+    shared->sent = sent;
+    __atomic_store_n(&shared->writer_done, 1, __ATOMIC_RELEASE);
+    if (run->lossy || shared->skipped) {
+        // repeat the end marker until the reader sees one
+        while (!__atomic_load_n(&shared->reader_done, __ATOMIC_ACQUIRE) &&
+                !__atomic_load_n(&shared->failed, __ATOMIC_ACQUIRE)) {
+            memcpy(buf, &end_mark, sizeof(end_mark));
+            if (bench_write(gd, buf, shared->skipped ? sizeof(end_mark) : run->message_len, 1) < 0) {
+                break;
+            }
+            usleep(BENCH_END_INTERVAL_NS / 1000);
+        }
+    } else {
+        // the reader closes first so that the last messages are not reset
+        while (!__atomic_load_n(&shared->reader_done, __ATOMIC_ACQUIRE) &&
+                !__atomic_load_n(&shared->failed, __ATOMIC_ACQUIRE)) {
+            usleep(1000);
+        }
+    }
+end:
+    __atomic_store_n(&shared->writer_done, 1, __ATOMIC_RELEASE);
+    free(buf);
+    pirate_close(gd);
+}
+
+static void *bench_reader_thread(void *arg) {
+    bench_reader((bench_run_t *) arg);
+    return NULL;
+}
+
+static void *bench_writer_thread(void *arg) {
+    bench_writer((bench_run_t *) arg);
+    return NULL;
+}
+
+// Copies the bytes from the writer's pty to the reader's pty
+static void *bench_pty_bridge(void *arg) {
+    bench_pty_t *pty = (bench_pty_t *) arg;
+    uint8_t buf[65536];
+
+    for (;;) {
+        struct pollfd fds[2] = {
+            { pty->master_in, POLLIN, 0 },
+            { pty->stop[0], POLLIN, 0 },
+        };
+        ssize_t rv;
+
+        if ((poll(fds, 2, -1) < 0) && (errno != EINTR)) {
+            return NULL;
+        }
+        if (fds[1].revents) {
+            return NULL;
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+        if ((rv = read(pty->master_in, buf, sizeof(buf))) <= 0) {
+            continue;
+        }
+        for (ssize_t off = 0; off < rv;) {
+            ssize_t wr;
+            fds[0].fd = pty->master_out;
+            fds[0].events = POLLOUT;
+            if ((poll(fds, 2, -1) < 0) && (errno != EINTR)) {
+                return NULL;
+            }
+            if (fds[1].revents) {
+                return NULL;
+            }
+            wr = write(pty->master_out, buf + off, rv - off);
+            if (wr > 0) {
+                off += wr;
+            }
+        }
+    }
+}
+
+static int bench_pty_open(int *master, int *slave, char *path, size_t len) {
+    struct termios attr;
+
+    if ((*master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0) {
+        return -1;
+    }
+    if ((grantpt(*master) != 0) || (unlockpt(*master) != 0) ||
+        (ptsname_r(*master, path, len) != 0)) {
+        return -1;
+    }
+    // the slave stays open so that the master does not see a hangup
+    // between the runs. Raw mode disables the echo.
+    if ((*slave = open(path, O_RDWR | O_NOCTTY)) < 0) {
+        return -1;
+    }
+    if (tcgetattr(*slave, &attr) != 0) {
+        return -1;
+    }
+    cfmakeraw(&attr);
+    return tcsetattr(*slave, TCSANOW, &attr);
+}
+
+static void bench_pty_close(bench_pty_t *pty) {
+    int fds[] = { pty->master_in, pty->master_out, pty->slave_in, pty->slave_out,
+        pty->stop[0], pty->stop[1] };
+
+    for (unsigned i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+}
+
+static int bench_pty_start(bench_pty_t *pty, bench_run_t *run, const char *options) {
+    char writer_path[64], reader_path[64];
+
+    pty->master_in = pty->master_out = pty->slave_in = pty->slave_out = -1;
+    pty->stop[0] = pty->stop[1] = -1;
+    if ((bench_pty_open(&pty->master_in, &pty->slave_in, writer_path, sizeof(writer_path)) != 0) ||
+        (bench_pty_open(&pty->master_out, &pty->slave_out, reader_path, sizeof(reader_path)) != 0) ||
+        (pipe(pty->stop) != 0)) {
+        bench_pty_close(pty);
+        return -1;
+    }
+    snprintf(run->writer_config, sizeof(run->writer_config), "serial,%s%s", writer_path, options);
+    snprintf(run->reader_config, sizeof(run->reader_config), "serial,%s%s", reader_path, options);
+    if ((errno = pthread_create(&pty->thread, NULL, bench_pty_bridge, pty)) != 0) {
+        bench_pty_close(pty);
+        return -1;
+    }
+    return 0;
+}
+
+static void bench_pty_stop(bench_pty_t *pty) {
+    char c = 0;
+
+    if (write(pty->stop[1], &c, 1) == 1) {
+        pthread_join(pty->thread, NULL);
+    }
+    bench_pty_close(pty);
+}
+
+static int bench_lossy(const char *config) {
+    pirate_channel_param_t param;
+
+    if (pirate_parse_channel_param(config, &param) != 0) {
+        return 0;
+    }
+    switch (param.channel_type) {
+        case UDP_SOCKET:
+        case UDP_SHMEM:
+        case GE_ETH:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int bench_run_threads(bench_run_t *run, unsigned timeout_s) {
+    pthread_t reader, writer;
+    struct timespec deadline;
+    int rv = 0;
+
+    if ((errno = pthread_create(&reader, NULL, bench_reader_thread, run)) != 0) {
+        return -1;
+    }
+    if ((errno = pthread_create(&writer, NULL, bench_writer_thread, run)) != 0) {
+        __atomic_store_n(&run->shared->failed, 1, __ATOMIC_RELEASE);
+        pthread_cancel(reader);
+        pthread_join(reader, NULL);
+        return -1;
+    }
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_s;
+    if (pthread_timedjoin_np(reader, NULL, &deadline) != 0) {
+        // the reader is blocked in a read that will not complete
+        __atomic_store_n(&run->shared->failed, 1, __ATOMIC_RELEASE);
+        pthread_cancel(reader);
+        pthread_join(reader, NULL);
+        rv = -1;
+    }
+    if (pthread_timedjoin_np(writer, NULL, &deadline) != 0) {
+        __atomic_store_n(&run->shared->failed, 1, __ATOMIC_RELEASE);
+        pthread_cancel(writer);
+        pthread_join(writer, NULL);
+        rv = -1;
+    }
+    return rv;
+}
+
+static int bench_run_fork(bench_run_t *run, unsigned timeout_s) {
+    pid_t pids[2];
+    uint64_t deadline = bench_now() + timeout_s * 1000000000ull;
+    int remaining = 2, rv = 0;
+
+    fflush(NULL);
+    for (int i = 0; i < 2; i++) {
+        if ((pids[i] = fork()) < 0) {
+            __atomic_store_n(&run->shared->failed, 1, __ATOMIC_RELEASE);
+            if (i == 1) {
+                kill(pids[0], SIGKILL);
+                waitpid(pids[0], NULL, 0);
+            }
+            return -1;
+        } else if (pids[i] == 0) {
+            if (i == 0) {
+                bench_reader(run);
+            } else {
+                bench_writer(run);
+            }
+            _exit(0);
+        }
+    }
+    while (remaining > 0) {
+        for (int i = 0; i < 2; i++) {
+            if ((pids[i] > 0) && (waitpid(pids[i], NULL, WNOHANG) == pids[i])) {
+                pids[i] = -1;
+                remaining--;
+            }
+        }
+        if ((remaining > 0) && (bench_now() > deadline)) {
+            __atomic_store_n(&run->shared->failed, 1, __ATOMIC_RELEASE);
+            for (int i = 0; i < 2; i++) {
+                if (pids[i] > 0) {
+                    kill(pids[i], SIGKILL);
+                    waitpid(pids[i], NULL, 0);
+                }
+            }
+            rv = -1;
+            break;
+        }
+        usleep(1000);
+    }
+    return rv;
+}
+
+static void bench_report_header(const bench_opts_t *opts, FILE *out) {
+    if (opts->json) {
+        fprintf(out, "[\n");
+    } else {
+        fprintf(out, "channel,message_len,batch,rate,arrivals,cpus,mode,iteration,sent,received,"
+            "elapsed_ns,mbytes_per_sec,msgs_per_sec,drop_pct,reordered,"
+            "latency_p50_ns,latency_p99_ns,latency_p999_ns,latency_max_ns,status\n");
+    }
+}
+
+static void bench_report_footer(const bench_opts_t *opts, FILE *out) {
+    if (opts->json) {
+        fprintf(out, "\n]\n");
+    }
+}
+
+static void bench_report(const bench_opts_t *opts, FILE *out, unsigned row,
+    const char *channel, const bench_run_t *run, unsigned iteration, const char *status) {
+    const bench_shared_t *shared = run->shared;
+    const char *arrivals = (run->rate == 0) ? "none" : (run->poisson ? "poisson" : "constant");
+    uint64_t elapsed = 0, p50, p99, p999;
+    double mbps = 0.0, mps = 0.0, drop = 0.0;
+    char cpus[32];
+
+    p50 = bench_hist_percentile(&shared->latency, 50.0);
+    p99 = bench_hist_percentile(&shared->latency, 99.0);
+    p999 = bench_hist_percentile(&shared->latency, 99.9);
+
+    if ((shared->received > 0) && (shared->stop_ns > shared->start_ns)) {
+        elapsed = shared->stop_ns - shared->start_ns;
+        mbps = (shared->received * run->message_len * 1e3) / elapsed;
+        mps = (shared->received * 1e9) / elapsed;
+    }
+    if (shared->sent > 0) {
+        drop = (100.0 * (shared->sent - MIN(shared->sent, shared->received))) / shared->sent;
+    }
+    if (run->cpus.reader < 0) {
+        snprintf(cpus, sizeof(cpus), "none");
+    } else {
+        snprintf(cpus, sizeof(cpus), "%d:%d", run->cpus.reader, run->cpus.writer);
+    }
+
+    if (opts->json) {
+        fprintf(out, "%s  {\"channel\": \"%s\", \"message_len\": %zu, \"batch\": %u, "
+            "\"rate\": %" PRIu64 ", \"arrivals\": \"%s\", "
+            "\"cpus\": \"%s\", \"mode\": \"%s\", \"iteration\": %u, \"sent\": %" PRIu64
+            ", \"received\": %" PRIu64 ", \"elapsed_ns\": %" PRIu64 ", \"mbytes_per_sec\": %.3f"
+            ", \"msgs_per_sec\": %.1f, \"drop_pct\": %.3f, \"reordered\": %" PRIu64
+            ", \"latency_p50_ns\": %" PRIu64 ", \"latency_p99_ns\": %" PRIu64
+            ", \"latency_p999_ns\": %" PRIu64 ", \"latency_max_ns\": %" PRIu64
+            ", \"status\": \"%s\"}",
+            row ? ",\n" : "", channel, run->message_len, run->batch, run->rate, arrivals, cpus,
+            opts->fork ? "fork" : "thread", iteration, shared->sent, shared->received,
+            elapsed, mbps, mps, drop, shared->reordered, p50, p99, p999,
+            shared->latency.max, status);
+    } else {
+        // channel configurations have commas
+        fprintf(out, "\"%s\",%zu,%u,%" PRIu64 ",%s,%s,%s,%u,%" PRIu64 ",%" PRIu64 ",%" PRIu64
+            ",%.3f,%.1f,%.3f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%s\n",
+            channel, run->message_len, run->batch, run->rate, arrivals, cpus,
+            opts->fork ? "fork" : "thread", iteration, shared->sent, shared->received,
+            elapsed, mbps, mps, drop, shared->reordered, p50, p99, p999,
+            shared->latency.max, status);
+    }
+    fflush(out);
+}
+
+static const char *bench_status(const bench_shared_t *shared, int rv, char *buf, size_t len) {
+    if (rv != 0) {
+        return "timeout";
+    } else if (shared->skipped) {
+        return "skipped";
+    } else if (shared->writer_err != 0) {
+        snprintf(buf, len, "writer: %s", strerror(shared->writer_err));
+        return buf;
+    } else if (shared->reader_err != 0) {
+        snprintf(buf, len, "reader: %s", strerror(shared->reader_err));
+        return buf;
+    }
+    return "ok";
+}
+
+int main(int argc, char *argv[]) {
+    bench_opts_t opts;
+    bench_shared_t *shared;
+    FILE *out = stdout;
+    unsigned row = 0;
+    char status[128];
+
+    parse_args(argc, argv, &opts);
+
+    // a stream reader that closes early must not kill the writer
+    signal(SIGPIPE, SIG_IGN);
+
+    shared = mmap(NULL, sizeof(bench_shared_t), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("Unable to map shared state");
+        return -1;
+    }
+
+    if ((opts.output != NULL) && ((out = fopen(opts.output, "w")) == NULL)) {
+        perror("Unable to open the report file");
+        return -1;
+    }
+
+    bench_report_header(&opts, out);
+    for (unsigned c = 0; c < opts.nchannels; c++) {
+        const char *channel = opts.channels[c];
+        int pty = (strncmp(channel, BENCH_PTY_CONFIG, strlen(BENCH_PTY_CONFIG)) == 0);
+
+        for (unsigned m = 0; m < opts.nsizes; m++)
+        for (unsigned b = 0; b < opts.nbatches; b++)
+        for (unsigned r = 0; r < opts.nrates; r++)
+        for (unsigned p = 0; p < opts.ncpus; p++)
+        for (unsigned i = 0; i < opts.iterations; i++) {
+            bench_run_t run;
+            bench_pty_t bridge;
+            int rv;
+
+            // the batch does not apply to an open loop writer
+            if ((opts.rates[r] > 0) && (b > 0)) {
+                continue;
+            }
+            memset(&run, 0, sizeof(run));
+            memset(shared, 0, sizeof(bench_shared_t));
+            bench_hist_init(&shared->latency);
+            run.message_len = opts.sizes[m];
+            run.rate = opts.rates[r];
+            run.poisson = opts.poisson;
+            run.batch = (run.rate > 0) ? 0 : opts.batches[b];
+            run.cpus = opts.cpus[p];
+            if (run.rate > 0) {
+                run.count = MAX(run.rate * opts.duration_ms / 1000, 1);
+            } else {
+                run.count = MAX(opts.nbytes / run.message_len, 1);
+            }
+            run.shared = shared;
+            if (pty) {
+                if (bench_pty_start(&bridge, &run, channel + strlen(BENCH_PTY_CONFIG)) != 0) {
+                    shared->writer_err = errno;
+                    bench_report(&opts, out, row++, channel, &run, i,
+                        bench_status(shared, 0, status, sizeof(status)));
+                    continue;
+                }
+            } else {
+                snprintf(run.reader_config, sizeof(run.reader_config), "%s", channel);
+                snprintf(run.writer_config, sizeof(run.writer_config), "%s", channel);
+            }
+            run.lossy = bench_lossy(run.writer_config);
+
+            if (opts.fork) {
+                rv = bench_run_fork(&run, opts.timeout_s);
+            } else {
+                rv = bench_run_threads(&run, opts.timeout_s);
+            }
+            if (pty) {
+                bench_pty_stop(&bridge);
+            }
+            bench_report(&opts, out, row++, channel, &run, i,
+                bench_status(shared, rv, status, sizeof(status)));
+        }
+    }
+    bench_report_footer(&opts, out);
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    munmap(shared, sizeof(bench_shared_t));
+    return 0;
+}
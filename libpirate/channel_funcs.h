@@ -16,6 +16,8 @@
 #ifndef __PIRATE_CHANNEL_FUNCS_H
 #define __PIRATE_CHANNEL_FUNCS_H
 
+struct iovec;
+
 typedef int (*pirate_parse_param_t)(char *str, void *_param);
 typedef int (*pirate_get_channel_description_t)(const void *_param, char *desc, int len);
 typedef int (*pirate_open_t)(void *_param, void *ctx);
@@ -24,6 +26,23 @@ typedef ssize_t (*pirate_read_t)(const void *_param, void *_ctx, void *buf, size
 typedef ssize_t (*pirate_write_t)(const void *_param, void *_ctx, const void *buf, size_t count);
 typedef ssize_t (*pirate_write_mtu_t)(const void *_param, void *_ctx);
 
+// Optional. Writes count messages. Message i is described by
+// the iovlen entries of iov starting at iov[i * iovlen].
+// Returns the number of messages written.
+typedef ssize_t (*pirate_write_batch_t)(const void *_param, void *_ctx, const struct iovec *iov, size_t iovlen, size_t count);
+
+// Optional. Returns the number of messages the reader
+// has discarded after a checksum or framing error.
+typedef uint64_t (*pirate_dropped_t)(const void *_ctx);
+
+// Optional. Stores the number of bytes or messages in the
+// shared memory ring of the channel and the size of the ring.
+typedef void (*pirate_occupancy_t)(const void *_ctx, uint64_t *queued, uint64_t *capacity);
+
+// Optional. Copies the occupancy and the backpressure
+// counters of the shared memory ring of the channel.
+typedef void (*pirate_get_ring_stats_t)(const void *_ctx, pirate_ring_stats_t *stats);
+
 typedef struct {
     pirate_parse_param_t parse_param;
     pirate_get_channel_description_t get_channel_description;
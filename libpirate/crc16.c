@@ -0,0 +1,153 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC16_CLMUL 1
+#endif
+#include "crc16.h"
+
+#define CRC16_POLY 0x1021u
+#define CRC16_POLY_REFLECTED 0x8408u
+
+// Slicing-by-8 tables. crc16_table[0] is the classic
+// byte-at-a-time table. crc16_table[k][b] is the crc of byte b
+// followed by k zero bytes.
+static uint16_t crc16_table[8][256];
+static pthread_once_t crc16_once = PTHREAD_ONCE_INIT;
+
+#ifdef CRC16_CLMUL
+static int crc16_clmul_supported;
+// Fold constants in bit-reflected form.
+// Low: x^(128+63) mod P, high: x^(128-1) mod P
+static uint64_t crc16_fold_k[2];
+
+// x^n mod P as a 64-bit reflected value
+static uint64_t crc16_xpow_reflected(unsigned n) {
+    uint32_t r = 1;
+    uint64_t v = 0;
+    for (unsigned i = 0; i < n; i++) {
+        r <<= 1;
+        if (r & 0x10000) {
+            r ^= 0x10000 | CRC16_POLY;
+        }
+    }
+    for (int d = 0; d < 16; d++) {
+        if (r & (1u << d)) {
+            v |= 1ull << (63 - d);
+        }
+    }
+    return v;
+}
+#endif
+
+static void crc16_init_tables() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC16_POLY_REFLECTED : 0);
+        }
+        crc16_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            uint16_t prev = crc16_table[k - 1][i];
+            crc16_table[k][i] = (prev >> 8) ^ crc16_table[0][prev & 0xFF];
+        }
+    }
+#ifdef CRC16_CLMUL
+    __builtin_cpu_init();
+    crc16_clmul_supported = __builtin_cpu_supports("pclmul");
+    crc16_fold_k[0] = crc16_xpow_reflected(128 + 63);
+    crc16_fold_k[1] = crc16_xpow_reflected(128 - 1);
+#endif
+}
+
+// Updates a crc without the initial value and final xor
+static uint16_t crc16_slice8(uint16_t crc, const uint8_t *p, size_t len) {
+    while ((len > 0) && (((uintptr_t) p) & 7)) {
+        crc = (crc >> 8) ^ crc16_table[0][(crc ^ *p++) & 0xFF];
+        len--;
+    }
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, sizeof(lo));
+        memcpy(&hi, p + 4, sizeof(hi));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+        crc = crc16_table[7][lo & 0xFF] ^
+            crc16_table[6][(lo >> 8) & 0xFF] ^
+            crc16_table[5][(lo >> 16) & 0xFF] ^
+            crc16_table[4][lo >> 24] ^
+            crc16_table[3][hi & 0xFF] ^
+            crc16_table[2][(hi >> 8) & 0xFF] ^
+            crc16_table[1][(hi >> 16) & 0xFF] ^
+            crc16_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        crc = (crc >> 8) ^ crc16_table[0][(crc ^ *p++) & 0xFF];
+        len--;
+    }
+    return crc;
+}
+
+#ifdef CRC16_CLMUL
+// Folds 16 byte blocks into a single block that has the same
+// remainder, then finishes with the tables. Each fold multiplies
+// the two halves of the accumulator by x^(128+64) and x^128
+// modulo P, which moves them forward by one block. The products
+// have at most 80 bits so no reduction is needed until the end.
+__attribute__((target("pclmul")))
+static uint16_t crc16_clmul(uint16_t crc, const uint8_t *p, size_t len) {
+    const __m128i k = _mm_set_epi64x(crc16_fold_k[1], crc16_fold_k[0]);
+    uint8_t block[16];
+    __m128i x;
+
+    x = _mm_loadu_si128((const __m128i *) p);
+    x = _mm_xor_si128(x, _mm_cvtsi32_si128(crc));
+    p += 16;
+    len -= 16;
+    while (len >= 16) {
+        __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+        __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+        x = _mm_xor_si128(_mm_xor_si128(lo, hi), _mm_loadu_si128((const __m128i *) p));
+        p += 16;
+        len -= 16;
+    }
+    _mm_storeu_si128((__m128i *) block, x);
+    crc = crc16_slice8(0, block, sizeof(block));
+    return crc16_slice8(crc, p, len);
+}
+#endif
+
+uint16_t pirate_crc16(uint16_t crc, const void *buf, size_t len) {
+    const uint8_t *p = (const uint8_t *) buf;
+
+    pthread_once(&crc16_once, crc16_init_tables);
+    crc = ~crc;
+#ifdef CRC16_CLMUL
+    if ((len >= 64) && crc16_clmul_supported) {
+        return ~crc16_clmul(crc, p, len);
+    }
+#endif
+    return ~crc16_slice8(crc, p, len);
+}
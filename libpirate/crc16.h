@@ -0,0 +1,39 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_CRC16_H
+#define __PIRATE_CRC16_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CRC-16/X-25 (reflected CCITT), initial value and final xor 0xFFFF.
+// Pass 0 as the crc of the first buffer. The result of one call
+// may be passed as the crc of the next to checksum discontiguous data.
+//
+// Buffers of 64 bytes or more are folded with carry-less
+// multiplication when the processor supports PCLMULQDQ.
+// Otherwise the slicing-by-8 tables are used.
+uint16_t pirate_crc16(uint16_t crc, const void *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIRATE_CRC16_H */
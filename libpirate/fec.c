@@ -0,0 +1,377 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include "pirate_common.h"
+#include "gf256.h"
+#include "fec.h"
+
+#define FEC_HEADER_LEN sizeof(pirate_fec_header_t)
+
+pirate_fec_ctx_t *pirate_fec_create(unsigned k, unsigned m, size_t mtu, int access) {
+    pirate_fec_ctx_t *fec;
+    size_t nsymbols;
+
+    if ((k == 0) || (m == 0) || ((k + m) > PIRATE_FEC_MAX_SYMBOLS) ||
+        (mtu <= PIRATE_FEC_OVERHEAD) || (mtu > (UINT16_MAX + FEC_HEADER_LEN))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((fec = calloc(1, sizeof(pirate_fec_ctx_t))) == NULL) {
+        return NULL;
+    }
+    fec->k = k;
+    fec->m = m;
+    fec->stride = mtu;
+    fec->symbol_len = mtu - FEC_HEADER_LEN;
+
+    // Cauchy matrix with x_j = k + j and y_i = i.
+    // Every square submatrix is invertible.
+    pirate_gf256_init();
+    for (unsigned j = 0; j < m; j++) {
+        for (unsigned i = 0; i < k; i++) {
+            fec->coef[j][i] = pirate_gf256_inv((k + j) ^ i);
+        }
+    }
+
+    nsymbols = k + m;
+    if (access == O_RDONLY) {
+        nsymbols *= PIRATE_FEC_BLOCK_SLOTS;
+        if ((fec->rx_buf = malloc(fec->stride)) == NULL) {
+            pirate_fec_destroy(fec);
+            return NULL;
+        }
+    }
+    if ((fec->symbols = malloc(nsymbols * fec->stride)) == NULL) {
+        pirate_fec_destroy(fec);
+        return NULL;
+    }
+    return fec;
+}
+
+void pirate_fec_destroy(pirate_fec_ctx_t *fec) {
+    if (fec == NULL) {
+        return;
+    }
+    free(fec->symbols);
+    free(fec->rx_buf);
+    free(fec);
+}
+
+size_t pirate_fec_write_mtu(const pirate_fec_ctx_t *fec) {
+    return fec->symbol_len - sizeof(uint16_t);
+}
+
+static void fec_header(uint8_t *dst, const pirate_fec_ctx_t *fec, uint32_t block_id, unsigned index) {
+    pirate_fec_header_t header;
+    header.block_id = htonl(block_id);
+    header.index = index;
+    header.k = fec->k;
+    header.m = fec->m;
+    header.reserved = 0;
+    memcpy(dst, &header, FEC_HEADER_LEN);
+}
+
+static void fec_send_parity(pirate_fec_ctx_t *fec,
+    pirate_write_t write_func, pirate_write_batch_t write_batch,
+    const void *param, void *ctx) {
+    const size_t *len = fec->blocks[0].len;
+    const size_t parity_len = fec->block_symbol_len;
+    struct iovec iov[PIRATE_FEC_MAX_SYMBOLS];
+    size_t sent = 0;
+    ssize_t rv;
+
+    for (unsigned j = 0; j < fec->m; j++) {
+        uint8_t *parity = fec->symbols + ((fec->k + j) * fec->stride);
+        fec_header(parity, fec, fec->block_id, fec->k + j);
+        memset(parity + FEC_HEADER_LEN, 0, parity_len);
+        for (unsigned i = 0; i < fec->k; i++) {
+            const uint8_t *data = fec->symbols + (i * fec->stride) + FEC_HEADER_LEN;
+            pirate_gf256_mul_add_region(parity + FEC_HEADER_LEN, data, fec->coef[j][i], len[i]);
+        }
+        iov[j].iov_base = parity;
+        iov[j].iov_len = FEC_HEADER_LEN + parity_len;
+    }
+
+    // The data symbols have been delivered to the channel. A parity
+    // symbol that cannot be sent only reduces the protection of the block.
+    int err = errno;
+    if (write_batch != NULL) {
+        while (sent < fec->m) {
+            rv = write_batch(param, ctx, iov + sent, 1, fec->m - sent);
+            if (rv <= 0) {
+                break;
+            }
+            sent += rv;
+        }
+    } else {
+        for (unsigned j = 0; j < fec->m; j++) {
+            write_func(param, ctx, iov[j].iov_base, iov[j].iov_len);
+        }
+    }
+    errno = err;
+}
+
+ssize_t pirate_fec_write(pirate_fec_ctx_t *fec,
+    pirate_write_t write_func, pirate_write_batch_t write_batch,
+    const void *param, void *ctx, const void *buf, size_t count) {
+    uint8_t *symbol;
+    size_t len;
+    ssize_t rv;
+
+    if (count > pirate_fec_write_mtu(fec)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    symbol = fec->symbols + (fec->index * fec->stride);
+    fec_header(symbol, fec, fec->block_id, fec->index);
+    symbol[FEC_HEADER_LEN] = (count >> 8) & 0xFF;
+    symbol[FEC_HEADER_LEN + 1] = count & 0xFF;
+    memcpy(symbol + PIRATE_FEC_OVERHEAD, buf, count);
+    len = count + sizeof(uint16_t);
+
+    rv = write_func(param, ctx, symbol, FEC_HEADER_LEN + len);
+    if (rv < 0) {
+        return rv;
+    }
+
+    fec->blocks[0].len[fec->index] = len;
+    fec->block_symbol_len = MAX(fec->block_symbol_len, len);
+    if (++fec->index == fec->k) {
+        fec_send_parity(fec, write_func, write_batch, param, ctx);
+        fec->block_id++;
+        fec->index = 0;
+        fec->block_symbol_len = 0;
+    }
+    return count;
+}
+
+static inline uint8_t *fec_symbol(pirate_fec_ctx_t *fec, pirate_fec_block_t *block, unsigned index) {
+    size_t slot = block - fec->blocks;
+    return fec->symbols + (((slot * (fec->k + fec->m)) + index) * fec->stride);
+}
+
+static pirate_fec_block_t *fec_block(pirate_fec_ctx_t *fec, uint32_t block_id) {
+    pirate_fec_block_t *block = NULL;
+
+    for (unsigned i = 0; i < PIRATE_FEC_BLOCK_SLOTS; i++) {
+        pirate_fec_block_t *cur = &fec->blocks[i];
+        if (cur->busy && (cur->block_id == block_id)) {
+            return cur;
+        }
+    }
+    for (unsigned i = 0; i < PIRATE_FEC_BLOCK_SLOTS; i++) {
+        pirate_fec_block_t *cur = &fec->blocks[i];
+        if (!cur->busy) {
+            block = cur;
+            break;
+        } else if ((block == NULL) || ((int32_t) (cur->block_id - block->block_id) < 0)) {
+            block = cur;
+        }
+    }
+    if (block->busy) {
+        fec->lost += fec->k - block->data_count;
+    }
+    memset(block, 0, sizeof(pirate_fec_block_t));
+    block->busy = 1;
+    block->block_id = block_id;
+    return block;
+}
+
+// Gauss-Jordan elimination of [a | inv] where a is n x n
+static void fec_invert(uint8_t *a, uint8_t *inv, unsigned n) {
+    memset(inv, 0, n * n);
+    for (unsigned i = 0; i < n; i++) {
+        inv[(i * n) + i] = 1;
+    }
+    for (unsigned c = 0; c < n; c++) {
+        unsigned p = c;
+        while (a[(p * n) + c] == 0) {
+            p++;
+        }
+        if (p != c) {
+            for (unsigned j = 0; j < n; j++) {
+                uint8_t t = a[(c * n) + j];
+                a[(c * n) + j] = a[(p * n) + j];
+                a[(p * n) + j] = t;
+                t = inv[(c * n) + j];
+                inv[(c * n) + j] = inv[(p * n) + j];
+                inv[(p * n) + j] = t;
+            }
+        }
+        uint8_t scale = pirate_gf256_inv(a[(c * n) + c]);
+        pirate_gf256_mul_region(a + (c * n), scale, n);
+        pirate_gf256_mul_region(inv + (c * n), scale, n);
+        for (unsigned r = 0; r < n; r++) {
+            uint8_t f = a[(r * n) + c];
+            if ((r != c) && (f != 0)) {
+                pirate_gf256_mul_add_region(a + (r * n), a + (c * n), f, n);
+                pirate_gf256_mul_add_region(inv + (r * n), inv + (c * n), f, n);
+            }
+        }
+    }
+}
+
+// Recovers the missing data symbols of a block that has
+// received at least k symbols. The symbols are decoded into
+// scratch space and stored only if every recovered length is
+// valid, so the parity symbols stay intact for a later attempt.
+static void fec_decode(pirate_fec_ctx_t *fec, pirate_fec_block_t *block) {
+    unsigned missing[PIRATE_FEC_MAX_SYMBOLS], rows[PIRATE_FEC_MAX_SYMBOLS];
+    unsigned e = 0, n = 0;
+    size_t parity_len = 0;
+    uint8_t *a, *inv, *parity, *data;
+
+    for (unsigned i = 0; i < fec->k; i++) {
+        if (!block->present[i]) {
+            missing[e++] = i;
+        }
+    }
+    for (unsigned j = fec->k; (j < (fec->k + fec->m)) && (n < e); j++) {
+        if (block->present[j]) {
+            rows[n++] = j;
+            parity_len = block->len[j];
+        }
+    }
+    if ((e == 0) || (n < e)) {
+        return;
+    }
+    if ((a = malloc((2 * e * e) + (2 * e * parity_len))) == NULL) {
+        return;
+    }
+    inv = a + (e * e);
+    parity = inv + (e * e);
+    data = parity + (e * parity_len);
+
+    // Remove the contribution of the received data symbols
+    // from a copy of the parity symbols.
+    for (unsigned r = 0; r < e; r++) {
+        uint8_t *p = parity + (r * parity_len);
+        const uint8_t *coef = fec->coef[rows[r] - fec->k];
+        memcpy(p, fec_symbol(fec, block, rows[r]) + FEC_HEADER_LEN, parity_len);
+        for (unsigned i = 0; i < fec->k; i++) {
+            if (block->present[i]) {
+                const uint8_t *d = fec_symbol(fec, block, i) + FEC_HEADER_LEN;
+                pirate_gf256_mul_add_region(p, d, coef[i], MIN(block->len[i], parity_len));
+            }
+        }
+        for (unsigned c = 0; c < e; c++) {
+            a[(r * e) + c] = coef[missing[c]];
+        }
+    }
+    fec_invert(a, inv, e);
+
+    for (unsigned c = 0; c < e; c++) {
+        uint8_t *d = data + (c * parity_len);
+        memset(d, 0, parity_len);
+        for (unsigned r = 0; r < e; r++) {
+            pirate_gf256_mul_add_region(d, parity + (r * parity_len), inv[(c * e) + r], parity_len);
+        }
+        if ((((d[0] << 8) | d[1]) + sizeof(uint16_t)) > parity_len) {
+            // a corrupt symbol, the missing symbols are
+            // counted as lost when the block is evicted
+            goto out;
+        }
+    }
+
+    for (unsigned c = 0; c < e; c++) {
+        const uint8_t *d = data + (c * parity_len);
+        memcpy(fec_symbol(fec, block, missing[c]) + FEC_HEADER_LEN, d, parity_len);
+        block->present[missing[c]] = 1;
+        block->len[missing[c]] = ((d[0] << 8) | d[1]) + sizeof(uint16_t);
+        block->data_count++;
+        fec->recovered++;
+    }
+out:
+    free(a);
+}
+
+static ssize_t fec_deliver(pirate_fec_ctx_t *fec, pirate_fec_block_t *block,
+    unsigned index, void *buf, size_t count) {
+    const uint8_t *data = fec_symbol(fec, block, index) + PIRATE_FEC_OVERHEAD;
+    count = MIN(count, block->len[index] - sizeof(uint16_t));
+    memcpy(buf, data, count);
+    block->delivered[index] = 1;
+    return count;
+}
+
+ssize_t pirate_fec_read(pirate_fec_ctx_t *fec, pirate_read_t read_func,
+    const void *param, void *ctx, void *buf, size_t count) {
+    pirate_fec_header_t header;
+    pirate_fec_block_t *block;
+    size_t len;
+    ssize_t rv;
+
+    // Recovered messages are returned before new messages
+    for (unsigned b = 0; b < PIRATE_FEC_BLOCK_SLOTS; b++) {
+        block = &fec->blocks[b];
+        for (unsigned i = 0; block->busy && (i < fec->k); i++) {
+            if (block->present[i] && !block->delivered[i]) {
+                return fec_deliver(fec, block, i, buf, count);
+            }
+        }
+    }
+
+    for (;;) {
+        rv = read_func(param, ctx, fec->rx_buf, fec->stride);
+        if (rv <= 0) {
+            return rv;
+        }
+        if ((size_t) rv < PIRATE_FEC_OVERHEAD) {
+            continue;
+        }
+        memcpy(&header, fec->rx_buf, FEC_HEADER_LEN);
+        if ((header.k != fec->k) || (header.m != fec->m) || (header.index >= (fec->k + fec->m))) {
+            continue;
+        }
+        len = rv - FEC_HEADER_LEN;
+        if ((header.index < fec->k) &&
+            ((size_t) ((fec->rx_buf[FEC_HEADER_LEN] << 8) | fec->rx_buf[FEC_HEADER_LEN + 1]) != (len - sizeof(uint16_t)))) {
+            continue;
+        }
+        block = fec_block(fec, ntohl(header.block_id));
+        if (block->present[header.index]) {
+            // duplicate symbol or a data symbol that was recovered
+            continue;
+        }
+        memcpy(fec_symbol(fec, block, header.index), fec->rx_buf, rv);
+        block->present[header.index] = 1;
+        block->len[header.index] = len;
+        if (header.index < fec->k) {
+            block->data_count++;
+            rv = fec_deliver(fec, block, header.index, buf, count);
+        } else {
+            block->parity_count++;
+            rv = -1;
+        }
+        if ((block->data_count < fec->k) && ((block->data_count + block->parity_count) >= fec->k)) {
+            fec_decode(fec, block);
+        }
+        if (rv >= 0) {
+            return rv;
+        }
+        for (unsigned i = 0; i < fec->k; i++) {
+            if (block->present[i] && !block->delivered[i]) {
+                return fec_deliver(fec, block, i, buf, count);
+            }
+        }
+    }
+}
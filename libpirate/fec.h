@@ -0,0 +1,97 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_FEC_H
+#define __PIRATE_FEC_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "channel_funcs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Systematic Reed-Solomon erasure code over GF(2^8) using a
+// Cauchy matrix. Every k messages form a block. The k data symbols
+// are sent as soon as they are written. After the last data symbol
+// of a block the writer sends m parity symbols. The reader can
+// recover up to m lost messages of each block.
+//
+// A symbol is a 2 byte big-endian message length followed by the
+// message. Symbols shorter than the longest symbol in the block are
+// padded with zeros for the parity computation. Each symbol is
+// transmitted with a pirate_fec_header_t.
+
+#define PIRATE_FEC_MAX_SYMBOLS  255u
+#define PIRATE_FEC_BLOCK_SLOTS  2u
+
+typedef struct {
+    uint32_t block_id;
+    uint8_t index;
+    uint8_t k;
+    uint8_t m;
+    uint8_t reserved;
+} pirate_fec_header_t;
+
+#define PIRATE_FEC_OVERHEAD (sizeof(pirate_fec_header_t) + sizeof(uint16_t))
+
+typedef struct {
+    int busy;
+    uint32_t block_id;
+    unsigned data_count;
+    unsigned parity_count;
+    uint8_t present[PIRATE_FEC_MAX_SYMBOLS];
+    uint8_t delivered[PIRATE_FEC_MAX_SYMBOLS];
+    size_t len[PIRATE_FEC_MAX_SYMBOLS];
+} pirate_fec_block_t;
+
+typedef struct {
+    unsigned k;
+    unsigned m;
+    size_t symbol_len;      // largest symbol
+    size_t stride;          // header and largest symbol
+    uint8_t coef[PIRATE_FEC_MAX_SYMBOLS][PIRATE_FEC_MAX_SYMBOLS];
+    // writer
+    uint32_t block_id;
+    unsigned index;
+    size_t block_symbol_len;
+    // reader
+    uint8_t *rx_buf;
+    pirate_fec_block_t blocks[PIRATE_FEC_BLOCK_SLOTS];
+    uint64_t recovered;
+    uint64_t lost;
+    // writer: k + m symbols, reader: k + m symbols per block slot
+    uint8_t *symbols;
+} pirate_fec_ctx_t;
+
+pirate_fec_ctx_t *pirate_fec_create(unsigned k, unsigned m, size_t mtu, int access);
+void pirate_fec_destroy(pirate_fec_ctx_t *fec);
+
+// Largest message that can be written
+size_t pirate_fec_write_mtu(const pirate_fec_ctx_t *fec);
+
+ssize_t pirate_fec_write(pirate_fec_ctx_t *fec,
+    pirate_write_t write_func, pirate_write_batch_t write_batch,
+    const void *param, void *ctx, const void *buf, size_t count);
+
+ssize_t pirate_fec_read(pirate_fec_ctx_t *fec, pirate_read_t read_func,
+    const void *param, void *ctx, void *buf, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIRATE_FEC_H */
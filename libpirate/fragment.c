@@ -0,0 +1,238 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "pirate_common.h"
+#include "fragment.h"
+
+pirate_fragment_ctx_t *pirate_fragment_create(size_t max_len, size_t mtu, int access) {
+    const size_t header_len = sizeof(pirate_fragment_header_t);
+    pirate_fragment_ctx_t *frag;
+
+    if ((max_len == 0) || (max_len > UINT32_MAX) || ((mtu > 0) && (mtu <= header_len))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((frag = calloc(1, sizeof(pirate_fragment_ctx_t))) == NULL) {
+        return NULL;
+    }
+    frag->max_len = max_len;
+    frag->payload_len = (mtu > 0) ? MIN(mtu - header_len, max_len) : max_len;
+    frag->frag_max = (max_len + frag->payload_len - 1) / frag->payload_len;
+    if (frag->frag_max > PIRATE_FRAGMENT_MAX_COUNT) {
+        free(frag);
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((frag->frag_buf = malloc(header_len + frag->payload_len)) == NULL) {
+        goto error;
+    }
+    if (access == O_WRONLY) {
+        frag->headers = calloc(frag->frag_max, sizeof(pirate_fragment_header_t));
+        frag->iov = calloc(2 * frag->frag_max, sizeof(struct iovec));
+        if ((frag->headers == NULL) || (frag->iov == NULL)) {
+            goto error;
+        }
+    } else {
+        for (unsigned i = 0; i < PIRATE_FRAGMENT_SLOTS; i++) {
+            pirate_fragment_slot_t *slot = &frag->slots[i];
+            slot->buf = malloc(max_len);
+            // the writer may use a smaller mtu than the reader
+            slot->bitmap = malloc((PIRATE_FRAGMENT_MAX_COUNT + 7) / 8);
+            if ((slot->buf == NULL) || (slot->bitmap == NULL)) {
+                goto error;
+            }
+        }
+    }
+    return frag;
+error:
+    pirate_fragment_destroy(frag);
+    errno = ENOMEM;
+    return NULL;
+}
+
+void pirate_fragment_destroy(pirate_fragment_ctx_t *frag) {
+    if (frag == NULL) {
+        return;
+    }
+    for (unsigned i = 0; i < PIRATE_FRAGMENT_SLOTS; i++) {
+        free(frag->slots[i].buf);
+        free(frag->slots[i].bitmap);
+    }
+    free(frag->iov);
+    free(frag->headers);
+    free(frag->frag_buf);
+    free(frag);
+}
+
+ssize_t pirate_fragment_write(pirate_fragment_ctx_t *frag,
+    pirate_write_t write_func, pirate_write_batch_t write_batch,
+    const void *param, void *ctx, const void *buf, size_t count) {
+    const size_t header_len = sizeof(pirate_fragment_header_t);
+    const uint8_t *src = (const uint8_t*) buf;
+    size_t nfrag, i;
+    uint32_t msg_id;
+    ssize_t rv;
+
+    if (count > frag->max_len) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    nfrag = MAX(1, (count + frag->payload_len - 1) / frag->payload_len);
+    msg_id = frag->next_msg_id++;
+
+    for (i = 0; i < nfrag; i++) {
+        pirate_fragment_header_t *header = &frag->headers[i];
+        size_t offset = i * frag->payload_len;
+        header->msg_id = htonl(msg_id);
+        header->total_len = htonl(count);
+        header->offset = htonl(offset);
+        header->index = htons(i);
+        header->count = htons(nfrag);
+    }
+
+    if (write_batch != NULL) {
+        size_t sent = 0;
+        for (i = 0; i < nfrag; i++) {
+            size_t offset = i * frag->payload_len;
+            frag->iov[2 * i].iov_base = &frag->headers[i];
+            frag->iov[2 * i].iov_len = header_len;
+            frag->iov[2 * i + 1].iov_base = (void*) (src + offset);
+            frag->iov[2 * i + 1].iov_len = MIN(count - offset, frag->payload_len);
+        }
+        while (sent < nfrag) {
+            rv = write_batch(param, ctx, frag->iov + (2 * sent), 2, nfrag - sent);
+            if (rv < 0) {
+                return rv;
+            }
+            sent += rv;
+        }
+        return count;
+    }
+
+    for (i = 0; i < nfrag; i++) {
+        size_t offset = i * frag->payload_len;
+        size_t len = MIN(count - offset, frag->payload_len);
+        memcpy(frag->frag_buf, &frag->headers[i], header_len);
+        memcpy(frag->frag_buf + header_len, src + offset, len);
+        rv = write_func(param, ctx, frag->frag_buf, header_len + len);
+        if (rv < 0) {
+            return rv;
+        }
+    }
+    return count;
+}
+
+static int64_t fragment_elapsed_ms(const struct timespec *start, const struct timespec *now) {
+    return ((now->tv_sec - start->tv_sec) * 1000) +
+        ((now->tv_nsec - start->tv_nsec) / 1000000);
+}
+
+static pirate_fragment_slot_t *fragment_slot(pirate_fragment_ctx_t *frag,
+    const pirate_fragment_header_t *header, const struct timespec *now) {
+    pirate_fragment_slot_t *slot = NULL, *oldest = NULL;
+
+    for (unsigned i = 0; i < PIRATE_FRAGMENT_SLOTS; i++) {
+        pirate_fragment_slot_t *cur = &frag->slots[i];
+        if (cur->busy && (cur->msg_id == header->msg_id)) {
+            return cur;
+        }
+    }
+    for (unsigned i = 0; i < PIRATE_FRAGMENT_SLOTS; i++) {
+        pirate_fragment_slot_t *cur = &frag->slots[i];
+        if (cur->busy && (fragment_elapsed_ms(&cur->start, now) > PIRATE_FRAGMENT_TIMEOUT_MS)) {
+            cur->busy = 0;
+            frag->dropped++;
+        }
+        if (!cur->busy) {
+            slot = cur;
+        } else if ((oldest == NULL) || (fragment_elapsed_ms(&oldest->start, &cur->start) < 0)) {
+            oldest = cur;
+        }
+    }
+    if (slot == NULL) {
+        slot = oldest;
+        frag->dropped++;
+    }
+    slot->busy = 1;
+    slot->msg_id = header->msg_id;
+    slot->total_len = header->total_len;
+    slot->count = header->count;
+    slot->received = 0;
+    slot->start = *now;
+    memset(slot->bitmap, 0, (header->count + 7) / 8);
+    return slot;
+}
+
+ssize_t pirate_fragment_read(pirate_fragment_ctx_t *frag, pirate_read_t read_func,
+    const void *param, void *ctx, void *buf, size_t count) {
+    const size_t header_len = sizeof(pirate_fragment_header_t);
+    pirate_fragment_header_t header;
+    pirate_fragment_slot_t *slot;
+    struct timespec now;
+    size_t len;
+    ssize_t rv;
+
+    for (;;) {
+        rv = read_func(param, ctx, frag->frag_buf, header_len + frag->payload_len);
+        if (rv <= 0) {
+            return rv;
+        }
+        if ((size_t) rv < header_len) {
+            frag->dropped++;
+            continue;
+        }
+        memcpy(&header, frag->frag_buf, header_len);
+        header.msg_id = ntohl(header.msg_id);
+        header.total_len = ntohl(header.total_len);
+        header.offset = ntohl(header.offset);
+        header.index = ntohs(header.index);
+        header.count = ntohs(header.count);
+        len = rv - header_len;
+        if ((header.count == 0) || (header.index >= header.count) ||
+            (header.count > MAX(1, header.total_len)) || (header.total_len > frag->max_len) ||
+            (header.offset > header.total_len) || (len > (header.total_len - header.offset))) {
+            frag->dropped++;
+            continue;
+        }
+        if (header.count == 1) {
+            count = MIN(count, len);
+            memcpy(buf, frag->frag_buf + header_len, count);
+            return count;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        slot = fragment_slot(frag, &header, &now);
+        if ((slot->total_len != header.total_len) || (slot->count != header.count)) {
+            frag->dropped++;
+            continue;
+        }
+        if (slot->bitmap[header.index / 8] & (1u << (header.index % 8))) {
+            // duplicate fragment
+            continue;
+        }
+        slot->bitmap[header.index / 8] |= (1u << (header.index % 8));
+        memcpy(slot->buf + header.offset, frag->frag_buf + header_len, len);
+        if (++slot->received == slot->count) {
+            slot->busy = 0;
+            count = MIN(count, slot->total_len);
+            memcpy(buf, slot->buf, count);
+            return count;
+        }
+    }
+}
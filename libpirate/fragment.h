@@ -0,0 +1,87 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_FRAGMENT_H
+#define __PIRATE_FRAGMENT_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "channel_funcs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Messages larger than the channel mtu are split into fragments.
+// Each fragment is sent as one channel message with a header.
+// The reader reassembles up to PIRATE_FRAGMENT_SLOTS messages at
+// a time. Incomplete messages are discarded after
+// PIRATE_FRAGMENT_TIMEOUT_MS or when a slot is needed for a
+// newer message.
+
+#define PIRATE_FRAGMENT_SLOTS       4u
+#define PIRATE_FRAGMENT_TIMEOUT_MS  1000u
+#define PIRATE_FRAGMENT_MAX_COUNT   UINT16_MAX
+
+typedef struct {
+    uint32_t msg_id;
+    uint32_t total_len;
+    uint32_t offset;
+    uint16_t index;
+    uint16_t count;
+} pirate_fragment_header_t;
+
+typedef struct {
+    int busy;
+    uint32_t msg_id;
+    uint32_t total_len;
+    uint16_t count;
+    uint16_t received;
+    struct timespec start;
+    uint8_t *bitmap;
+    uint8_t *buf;
+} pirate_fragment_slot_t;
+
+typedef struct {
+    size_t max_len;         // largest message
+    size_t payload_len;     // largest fragment payload
+    size_t frag_max;        // largest number of fragments in a message
+    uint32_t next_msg_id;
+    uint8_t *frag_buf;      // one fragment with its header
+    pirate_fragment_header_t *headers;
+    struct iovec *iov;
+    pirate_fragment_slot_t slots[PIRATE_FRAGMENT_SLOTS];
+    uint64_t dropped;
+} pirate_fragment_ctx_t;
+
+pirate_fragment_ctx_t *pirate_fragment_create(size_t max_len, size_t mtu, int access);
+void pirate_fragment_destroy(pirate_fragment_ctx_t *frag);
+
+// When write_batch is not NULL then all fragments of a message
+// are passed to the channel in a single call.
+ssize_t pirate_fragment_write(pirate_fragment_ctx_t *frag,
+    pirate_write_t write_func, pirate_write_batch_t write_batch,
+    const void *param, void *ctx, const void *buf, size_t count);
+
+ssize_t pirate_fragment_read(pirate_fragment_ctx_t *frag, pirate_read_t read_func,
+    const void *param, void *ctx, void *buf, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIRATE_FRAGMENT_H */
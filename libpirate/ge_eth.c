@@ -23,11 +23,13 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "pirate_common.h"
 #include "ge_eth.h"
 #include "udp_socket.h"
+#include "crc16.h"
 
 #pragma pack(1)
 typedef struct {
@@ -37,65 +39,13 @@ typedef struct {
 } ge_header_t;
 #pragma pack()
 
-static const unsigned int crc16_ccitt_table_reverse[256] =
-{
- 0x0000, 0x1189, 0x2312, 0x329B, 0x4624, 0x57AD, 0x6536, 0x74BF,
- 0x8C48, 0x9DC1, 0xAF5A, 0xBED3, 0xCA6C, 0xDBE5, 0xE97E, 0xF8F7,
- 0x1081, 0x0108, 0x3393, 0x221A, 0x56A5, 0x472C, 0x75B7, 0x643E,
- 0x9CC9, 0x8D40, 0xBFDB, 0xAE52, 0xDAED, 0xCB64, 0xF9FF, 0xE876,
- 0x2102, 0x308B, 0x0210, 0x1399, 0x6726, 0x76AF, 0x4434, 0x55BD,
- 0xAD4A, 0xBCC3, 0x8E58, 0x9FD1, 0xEB6E, 0xFAE7, 0xC87C, 0xD9F5,
- 0x3183, 0x200A, 0x1291, 0x0318, 0x77A7, 0x662E, 0x54B5, 0x453C,
- 0xBDCB, 0xAC42, 0x9ED9, 0x8F50, 0xFBEF, 0xEA66, 0xD8FD, 0xC974,
- 0x4204, 0x538D, 0x6116, 0x709F, 0x0420, 0x15A9, 0x2732, 0x36BB,
- 0xCE4C, 0xDFC5, 0xED5E, 0xFCD7, 0x8868, 0x99E1, 0xAB7A, 0xBAF3,
- 0x5285, 0x430C, 0x7197, 0x601E, 0x14A1, 0x0528, 0x37B3, 0x263A,
- 0xDECD, 0xCF44, 0xFDDF, 0xEC56, 0x98E9, 0x8960, 0xBBFB, 0xAA72,
- 0x6306, 0x728F, 0x4014, 0x519D, 0x2522, 0x34AB, 0x0630, 0x17B9,
- 0xEF4E, 0xFEC7, 0xCC5C, 0xDDD5, 0xA96A, 0xB8E3, 0x8A78, 0x9BF1,
- 0x7387, 0x620E, 0x5095, 0x411C, 0x35A3, 0x242A, 0x16B1, 0x0738,
- 0xFFCF, 0xEE46, 0xDCDD, 0xCD54, 0xB9EB, 0xA862, 0x9AF9, 0x8B70,
- 0x8408, 0x9581, 0xA71A, 0xB693, 0xC22C, 0xD3A5, 0xE13E, 0xF0B7,
- 0x0840, 0x19C9, 0x2B52, 0x3ADB, 0x4E64, 0x5FED, 0x6D76, 0x7CFF,
- 0x9489, 0x8500, 0xB79B, 0xA612, 0xD2AD, 0xC324, 0xF1BF, 0xE036,
- 0x18C1, 0x0948, 0x3BD3, 0x2A5A, 0x5EE5, 0x4F6C, 0x7DF7, 0x6C7E,
- 0xA50A, 0xB483, 0x8618, 0x9791, 0xE32E, 0xF2A7, 0xC03C, 0xD1B5,
- 0x2942, 0x38CB, 0x0A50, 0x1BD9, 0x6F66, 0x7EEF, 0x4C74, 0x5DFD,
- 0xB58B, 0xA402, 0x9699, 0x8710, 0xF3AF, 0xE226, 0xD0BD, 0xC134,
- 0x39C3, 0x284A, 0x1AD1, 0x0B58, 0x7FE7, 0x6E6E, 0x5CF5, 0x4D7C,
- 0xC60C, 0xD785, 0xE51E, 0xF497, 0x8028, 0x91A1, 0xA33A, 0xB2B3,
- 0x4A44, 0x5BCD, 0x6956, 0x78DF, 0x0C60, 0x1DE9, 0x2F72, 0x3EFB,
- 0xD68D, 0xC704, 0xF59F, 0xE416, 0x90A9, 0x8120, 0xB3BB, 0xA232,
- 0x5AC5, 0x4B4C, 0x79D7, 0x685E, 0x1CE1, 0x0D68, 0x3FF3, 0x2E7A,
- 0xE70E, 0xF687, 0xC41C, 0xD595, 0xA12A, 0xB0A3, 0x8238, 0x93B1,
- 0x6B46, 0x7ACF, 0x4854, 0x59DD, 0x2D62, 0x3CEB, 0x0E70, 0x1FF9,
- 0xF78F, 0xE606, 0xD49D, 0xC514, 0xB1AB, 0xA022, 0x92B9, 0x8330,
- 0x7BC7, 0x6A4E, 0x58D5, 0x495C, 0x3DE3, 0x2C6A, 0x1EF1, 0x0F78
-};
-
-static uint16_t crc16_reflected(const uint8_t *buf, uint16_t len,
-                            uint16_t crc_in, const unsigned int table[])
-{
-    unsigned int crc16 = (unsigned int) crc_in;
-
-    while( len-- != 0 )
-       crc16 = table[(crc16 ^ *buf++) & 0xff] ^ (crc16 >> 8);
-
-    return (uint16_t) crc16;
-}
-
-static const uint16_t crc16_ccitt_start = 0xFFFF;
-static const uint16_t crc16_ccitt_xorout = 0xFFFF;
-
 uint16_t pirate_ge_eth_crc16(const uint8_t *data, uint16_t len) {
-    return crc16_reflected(data, len, crc16_ccitt_start, crc16_ccitt_table_reverse)
-        ^ crc16_ccitt_xorout;
+    return pirate_crc16(0, data, len);
 }
 
-static ssize_t ge_message_pack(void *buf, const void *data, uint32_t count,
+static int ge_message_header(void *buf, size_t count,
     const pirate_ge_eth_param_t *param) {
     ge_header_t *msg_hdr = (ge_header_t *)buf;
-    uint8_t *msg_data = (uint8_t *)buf + sizeof(ge_header_t);
 
     if (count > (param->mtu - sizeof(ge_header_t))) {
         errno = EMSGSIZE;
@@ -104,22 +54,78 @@ static ssize_t ge_message_pack(void *buf, const void *data, uint32_t count,
 
     msg_hdr->message_id = htobe32(param->message_id);
     msg_hdr->data_len = htobe16(count);
-    msg_hdr->crc16 = htobe16(pirate_ge_eth_crc16(buf, sizeof(ge_header_t)-sizeof(uint16_t)));
+    return 0;
+}
+
+// The crc covers the message id and length, and the
+// data when the payload_crc parameter is set
+static uint16_t ge_message_crc(const void *buf, size_t count,
+    const pirate_ge_eth_param_t *param) {
+    uint16_t crc = pirate_ge_eth_crc16(buf, sizeof(ge_header_t)-sizeof(uint16_t));
+    if (param->payload_crc) {
+        crc = pirate_crc16(crc, (const uint8_t *)buf + sizeof(ge_header_t), count);
+    }
+    return crc;
+}
+
+static ssize_t ge_message_pack(void *buf, const void *data, uint32_t count,
+    const pirate_ge_eth_param_t *param) {
+    ge_header_t *msg_hdr = (ge_header_t *)buf;
+    uint8_t *msg_data = (uint8_t *)buf + sizeof(ge_header_t);
+
+    if (ge_message_header(buf, count, param) < 0) {
+        return -1;
+    }
 
     memcpy(msg_data, data, count);
+    msg_hdr->crc16 = htobe16(ge_message_crc(buf, count, param));
+    return sizeof(ge_header_t) + count;
+}
+
+static ssize_t ge_message_pack_iov(void *buf, const struct iovec *iov, size_t iovlen,
+    const pirate_ge_eth_param_t *param) {
+    ge_header_t *msg_hdr = (ge_header_t *)buf;
+    uint8_t *msg_data = (uint8_t *)buf + sizeof(ge_header_t);
+    size_t count = 0;
+
+    for (size_t i = 0; i < iovlen; i++) {
+        count += iov[i].iov_len;
+    }
+    if (ge_message_header(buf, count, param) < 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < iovlen; i++) {
+        memcpy(msg_data, iov[i].iov_base, iov[i].iov_len);
+        msg_data += iov[i].iov_len;
+    }
+    msg_hdr->crc16 = htobe16(ge_message_crc(buf, count, param));
     return sizeof(ge_header_t) + count;
 }
 
-static ssize_t ge_message_unpack(const void *buf, void *data,
-                                size_t data_buf_len, ge_header_t *hdr) {
+// Returns -1 with errno set to EBADMSG if the message is
+// truncated or the crc does not match
+static ssize_t ge_message_unpack(const void *buf, size_t buf_len, void *data,
+                                size_t data_buf_len, ge_header_t *hdr,
+                                const pirate_ge_eth_param_t *param) {
     const ge_header_t *msg_hdr = (ge_header_t *)buf;
     const uint8_t *msg_data = (uint8_t *)buf + sizeof(ge_header_t);
     size_t copy_len;
 
+    if (buf_len < sizeof(ge_header_t)) {
+        errno = EBADMSG;
+        return -1;
+    }
+
     hdr->message_id = be32toh(msg_hdr->message_id);
     hdr->data_len   = be16toh(msg_hdr->data_len);
     hdr->crc16      = be16toh(msg_hdr->crc16);
 
+    if ((hdr->data_len > (buf_len - sizeof(ge_header_t))) ||
+        (hdr->crc16 != ge_message_crc(buf, hdr->data_len, param))) {
+        errno = EBADMSG;
+        return -1;
+    }
+
     copy_len = MIN(hdr->data_len, data_buf_len);
 
     memcpy(data, msg_data, copy_len);
@@ -187,6 +193,20 @@ int pirate_ge_eth_parse_param(char *str, void *_param) {
         }
         if (strncmp("mtu", key, strlen("mtu")) == 0) {
             param->mtu = strtol(val, NULL, 10);
+        } else if (strncmp("rate", key, strlen("rate")) == 0) {
+            if (pirate_parse_rate(val, &param->rate) < 0) {
+                return -1;
+            }
+        } else if (strncmp("burst", key, strlen("burst")) == 0) {
+            if (pirate_parse_size(val, &param->burst) < 0) {
+                return -1;
+            }
+        } else if (strncmp("gso", key, strlen("gso")) == 0) {
+            param->gso = strtol(val, NULL, 10);
+        } else if (strncmp("payload_crc", key, strlen("payload_crc")) == 0) {
+            param->payload_crc = strtol(val, NULL, 10);
+        } else if (strncmp("demux", key, strlen("demux")) == 0) {
+            param->demux = strtol(val, NULL, 10);
         } else {
             errno = EINVAL;
             return -1;
@@ -198,15 +218,25 @@ int pirate_ge_eth_parse_param(char *str, void *_param) {
 int pirate_ge_eth_get_channel_description(const void *_param, char *desc, int len) {
     const pirate_ge_eth_param_t *param = (const pirate_ge_eth_param_t *)_param;
     char mtu_str[32];
+    char rate_str[64];
 
     mtu_str[0] = 0;
+    rate_str[0] = 0;
     if (param->mtu != 0) {
         snprintf(mtu_str, 32, ",mtu=%u", param->mtu);
     }
-    return snprintf(desc, len, "ge_eth,%s,%u,%s,%u,%u%s",
+    if (param->rate != 0) {
+        char rate[32];
+        pirate_unparse_rate(rate, sizeof(rate), param->rate);
+        snprintf(rate_str, 64, ",rate=%s,burst=%u", rate, param->burst);
+    }
+    return snprintf(desc, len, "ge_eth,%s,%u,%s,%u,%u%s%s%s%s%s",
         param->reader_addr, param->reader_port,
         param->writer_addr, param->writer_port,
-        param->message_id, mtu_str);
+        param->message_id, mtu_str, rate_str,
+        param->gso ? ",gso=1" : "",
+        param->payload_crc ? ",payload_crc=1" : "",
+        param->demux ? ",demux=1" : "");
 }
 
 int pirate_ge_eth_open(void *_param, void *_ctx) {
@@ -226,21 +256,60 @@ int pirate_ge_eth_open(void *_param, void *_ctx) {
         errno = EINVAL;
         return -1;
     }
+    memset(&ctx->gro, 0, sizeof(ctx->gro));
+    ctx->gso_buf = NULL;
+    ctx->dropped = 0;
+    ctx->endpoint = NULL;
+    ctx->queue = NULL;
     ctx->buf = (uint8_t *) malloc(param->mtu);
     if (ctx->buf == NULL) {
         return -1;
     }
 
+    if (param->demux) {
+        pirate_pacer_init(&ctx->pacer, param->rate, param->burst);
+        rv = pirate_ge_eth_demux_open(param, access, &ctx->endpoint, &ctx->queue);
+        if (rv < 0) {
+            free(ctx->buf);
+            ctx->buf = NULL;
+            return -1;
+        }
+        ctx->sock = rv;
+        // the receive thread does not use receive offload
+        if ((access == O_WRONLY) && param->gso &&
+            (pirate_udp_gso_open(ctx->sock, access, &ctx->gro) < 0)) {
+            int err = errno;
+            pirate_ge_eth_close(ctx);
+            errno = err;
+            return -1;
+        }
+        // the socket is not a gaps descriptor
+        return pirate_next_gd();
+    }
+
+    memset(&udp_param, 0, sizeof(udp_param));
     memcpy(udp_param.reader_addr, param->reader_addr, sizeof(udp_param.reader_addr));
     memcpy(udp_param.writer_addr, param->writer_addr, sizeof(udp_param.writer_addr));
     udp_param.reader_port = param->reader_port;
     udp_param.writer_port = param->writer_port;
     udp_param.buffer_size = 0;
     udp_param.mtu = 0;
+    pirate_pacer_init(&ctx->pacer, param->rate, param->burst);
     if (access == O_RDONLY) {
         rv = pirate_udp_socket_reader_open(&udp_param, (common_ctx*) ctx);
     } else if (access == O_WRONLY) {
         rv = pirate_udp_socket_writer_open(&udp_param, (common_ctx*) ctx);
+        if (rv >= 0) {
+            pirate_pacer_socket(&ctx->pacer, ctx->sock);
+        }
+    }
+    if ((rv >= 0) && param->gso) {
+        if (pirate_udp_gso_open(ctx->sock, access, &ctx->gro) < 0) {
+            int err = errno;
+            pirate_ge_eth_close(ctx);
+            errno = err;
+            return -1;
+        }
     }
 
     return rv;
@@ -248,12 +317,29 @@ int pirate_ge_eth_open(void *_param, void *_ctx) {
 
 int pirate_ge_eth_close(void *_ctx) {
     ge_eth_ctx *ctx = (ge_eth_ctx *)_ctx;
-    int err, rv = -1;
+    int err, rv = -1, demux = 0;
+
+    // readers blocked on the receive queue return before
+    // the receive buffer is freed
+    if (ctx->endpoint != NULL) {
+        rv = pirate_ge_eth_demux_close(ctx->endpoint, ctx->queue);
+        ctx->endpoint = NULL;
+        ctx->queue = NULL;
+        ctx->sock = -1;
+        demux = 1;
+    }
 
     if (ctx->buf != NULL) {
         free(ctx->buf);
         ctx->buf = NULL;
     }
+    free(ctx->gso_buf);
+    ctx->gso_buf = NULL;
+    pirate_udp_gro_close(&ctx->gro);
+
+    if (demux) {
+        return rv;
+    }
 
     if (ctx->sock <= 0) {
         errno = ENODEV;
@@ -273,7 +359,7 @@ int pirate_ge_eth_close(void *_ctx) {
 ssize_t pirate_ge_eth_read(const void *_param, void *_ctx, void *buf, size_t count) {
     const pirate_ge_eth_param_t *param = (const pirate_ge_eth_param_t *)_param;
     ge_eth_ctx *ctx = (ge_eth_ctx *)_ctx;
-    ssize_t rd_size;
+    ssize_t rd_size, rv;
     ge_header_t hdr = { 0, 0, 0 };
 
     if (ctx->sock <= 0) {
@@ -281,12 +367,40 @@ ssize_t pirate_ge_eth_read(const void *_param, void *_ctx, void *buf, size_t cou
         return -1;
     }
 
-    rd_size = recv(ctx->sock, ctx->buf, param->mtu, 0);
-    if (rd_size <= 0) {
-        return rd_size;
+    for (;;) {
+        if (ctx->queue != NULL) {
+            rd_size = pirate_ge_eth_demux_recv(ctx->queue, ctx->buf, param->mtu,
+                ctx->flags & O_NONBLOCK);
+        } else if (ctx->gro.buf != NULL) {
+            rd_size = pirate_udp_gro_read(&ctx->gro, ctx->sock, ctx->buf, param->mtu);
+        } else {
+            rd_size = recv(ctx->sock, ctx->buf, param->mtu, 0);
+        }
+        if (rd_size <= 0) {
+            return rd_size;
+        }
+
+        int err = errno;
+        rv = ge_message_unpack(ctx->buf, rd_size, buf, count, &hdr, param);
+        if ((rv < 0) && (errno == EBADMSG)) {
+            // discard the message and read the next one
+            ctx->dropped++;
+            errno = err;
+            continue;
+        }
+        return rv;
     }
+}
 
-    return ge_message_unpack(ctx->buf, buf, count, &hdr);
+uint64_t pirate_ge_eth_dropped(const void *_ctx) {
+    const ge_eth_ctx *ctx = (const ge_eth_ctx *)_ctx;
+    uint64_t dropped = ctx->dropped;
+    if (ctx->queue != NULL) {
+        pthread_mutex_lock(&ctx->queue->lock);
+        dropped += ctx->queue->dropped;
+        pthread_mutex_unlock(&ctx->queue->lock);
+    }
+    return dropped;
 }
 
 ssize_t pirate_ge_eth_write_mtu(const void *_param, void *_ctx) {
@@ -306,6 +420,8 @@ ssize_t pirate_ge_eth_write_mtu(const void *_param, void *_ctx) {
 ssize_t pirate_ge_eth_write(const void *_param, void *_ctx, const void *buf, size_t count) {
     const pirate_ge_eth_param_t *param = (const pirate_ge_eth_param_t *)_param;
     ge_eth_ctx *ctx = (ge_eth_ctx *)_ctx;
+    // demux channels share a blocking socket
+    const int send_flags = (ctx->flags & O_NONBLOCK) ? MSG_DONTWAIT : 0;
     ssize_t rv, wr_len;
     int err;
 
@@ -313,12 +429,17 @@ ssize_t pirate_ge_eth_write(const void *_param, void *_ctx, const void *buf, siz
         return -1;
     }
 
+    // 8 byte UDP header and 20 byte IP header
+    if (pirate_pacer_wait(&ctx->pacer, wr_len + 28, ctx->flags & O_NONBLOCK) < 0) {
+        return -1;
+    }
+
     err = errno;
-    rv = send(ctx->sock, ctx->buf, wr_len, 0);
+    rv = send(ctx->sock, ctx->buf, wr_len, send_flags);
     if ((rv < 0) && (errno == ECONNREFUSED)) {
         // TODO create a counter of undelivered messages
         errno = err;
-        rv = send(ctx->sock, ctx->buf, wr_len, 0);
+        rv = send(ctx->sock, ctx->buf, wr_len, send_flags);
     }
 
     if (rv != wr_len) {
@@ -327,3 +448,91 @@ ssize_t pirate_ge_eth_write(const void *_param, void *_ctx, const void *buf, siz
 
     return count;
 }
+
+static ssize_t ge_eth_send_batch(int sock, uint8_t *buf, const size_t *lens, size_t count, int flags) {
+    struct mmsghdr msgs[PIRATE_UDP_BATCH_LEN];
+    struct iovec iov[PIRATE_UDP_BATCH_LEN];
+    size_t offset = 0;
+
+    memset(msgs, 0, count * sizeof(struct mmsghdr));
+    for (size_t i = 0; i < count; i++) {
+        iov[i].iov_base = buf + offset;
+        iov[i].iov_len = lens[i];
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        offset += lens[i];
+    }
+    return sendmmsg(sock, msgs, count, flags);
+}
+
+ssize_t pirate_ge_eth_write_batch(const void *_param, void *_ctx, const struct iovec *iov, size_t iovlen, size_t count) {
+    const pirate_ge_eth_param_t *param = (const pirate_ge_eth_param_t *)_param;
+    ge_eth_ctx *ctx = (ge_eth_ctx *)_ctx;
+    const int nonblock = ctx->flags & O_NONBLOCK;
+    const int send_flags = nonblock ? MSG_DONTWAIT : 0;
+    size_t lens[PIRATE_UDP_BATCH_LEN];
+    size_t segment = 0, prev = 0, offset = 0, n;
+    struct iovec gso_iov;
+    ssize_t rv;
+    int err;
+
+    if ((ctx->gso_buf == NULL) &&
+        ((ctx->gso_buf = malloc(PIRATE_UDP_GSO_MAX_LEN)) == NULL)) {
+        return -1;
+    }
+
+    // Pack the messages. With segmentation offload pack a run
+    // of equal length messages. The last may be shorter.
+    count = MIN(count, PIRATE_UDP_BATCH_LEN);
+    for (n = 0; n < count; n++) {
+        size_t len = sizeof(ge_header_t);
+        for (size_t j = 0; j < iovlen; j++) {
+            len += iov[n * iovlen + j].iov_len;
+        }
+        if (len > param->mtu) {
+            if (n == 0) {
+                errno = EMSGSIZE;
+                return -1;
+            }
+            break;
+        }
+        if ((offset + len) > PIRATE_UDP_GSO_MAX_LEN) {
+            break;
+        }
+        if (n == 0) {
+            segment = len;
+        } else if (param->gso && ((len > segment) || (prev != segment))) {
+            break;
+        }
+        if (n == 0) {
+            if (pirate_pacer_wait(&ctx->pacer, len + 28, nonblock) < 0) {
+                return -1;
+            }
+        } else if (!pirate_pacer_try(&ctx->pacer, len + 28)) {
+            break;
+        }
+        ge_message_pack_iov(ctx->gso_buf + offset, &iov[n * iovlen], iovlen, param);
+        lens[n] = len;
+        prev = len;
+        offset += len;
+    }
+
+    err = errno;
+    if (!param->gso) {
+        rv = ge_eth_send_batch(ctx->sock, ctx->gso_buf, lens, n, send_flags);
+        if ((rv < 0) && (errno == ECONNREFUSED)) {
+            errno = err;
+            rv = ge_eth_send_batch(ctx->sock, ctx->gso_buf, lens, n, send_flags);
+        }
+        return rv;
+    }
+
+    gso_iov.iov_base = ctx->gso_buf;
+    gso_iov.iov_len = offset;
+    rv = pirate_udp_gso_send(ctx->sock, &gso_iov, 1, segment, send_flags);
+    if ((rv < 0) && (errno == ECONNREFUSED)) {
+        errno = err;
+        rv = pirate_udp_gso_send(ctx->sock, &gso_iov, 1, segment, send_flags);
+    }
+    return (rv < 0) ? rv : (ssize_t) n;
+}
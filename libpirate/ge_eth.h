@@ -17,11 +17,22 @@
 #define __PIRATE_CHANNEL_GE_ETH_H
 
 #include "libpirate.h"
+#include "ge_eth_demux.h"
+#include "pacing.h"
+#include "udp_socket.h"
 
 typedef struct {
     int flags;
     int sock;
     uint8_t *buf;
+    pirate_pacer_t pacer;
+    pirate_udp_gro_t gro;
+    // messages of a batched send
+    uint8_t *gso_buf;
+    uint64_t dropped;
+    // shared socket of demux channels
+    pirate_ge_eth_endpoint_t *endpoint;
+    pirate_ge_eth_queue_t *queue;
 } ge_eth_ctx;
 
 int pirate_ge_eth_parse_param(char *str, void *_param);
@@ -31,6 +42,8 @@ int pirate_ge_eth_close(void *_ctx);
 ssize_t pirate_ge_eth_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t pirate_ge_eth_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t pirate_ge_eth_write_mtu(const void *_param, void *_ctx);
+uint64_t pirate_ge_eth_dropped(const void *_ctx);
+ssize_t pirate_ge_eth_write_batch(const void *_param, void *_ctx, const struct iovec *iov, size_t iovlen, size_t count);
 
 #define PIRATE_GE_ETH_CHANNEL_FUNCS { pirate_ge_eth_parse_param, pirate_ge_eth_get_channel_description, pirate_ge_eth_open, pirate_ge_eth_close, pirate_ge_eth_read, pirate_ge_eth_write, pirate_ge_eth_write_mtu }
 
@@ -0,0 +1,377 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#define _GNU_SOURCE
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "pirate_common.h"
+#include "ge_eth_demux.h"
+#include "udp_socket.h"
+
+struct pirate_ge_eth_endpoint {
+    struct pirate_ge_eth_endpoint *next;
+    int access;
+    char reader_addr[INET6_ADDRSTRLEN];
+    char writer_addr[INET6_ADDRSTRLEN];
+    uint16_t reader_port;
+    uint16_t writer_port;
+    unsigned refcount;
+    int sock;
+    size_t mtu;
+    // reader
+    int closing;
+    int running;
+    int error;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pirate_ge_eth_queue_t *buckets[PIRATE_GE_ETH_DEMUX_BUCKETS];
+    uint8_t *rx_buf;
+};
+
+static pirate_ge_eth_endpoint_t *ge_eth_endpoints = NULL;
+static pthread_mutex_t ge_eth_endpoints_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void ge_eth_queue_push(pirate_ge_eth_queue_t *queue, const uint8_t *buf, size_t len) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == PIRATE_GE_ETH_DEMUX_QUEUE_LEN) {
+        queue->dropped++;
+    } else {
+        unsigned slot = (queue->head + queue->count) % PIRATE_GE_ETH_DEMUX_QUEUE_LEN;
+        memcpy(queue->frames + (slot * queue->mtu), buf, len);
+        queue->lens[slot] = len;
+        queue->count++;
+        pthread_cond_signal(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Called with the endpoint lock held
+static void ge_eth_queue_fail(pirate_ge_eth_queue_t *queue, int err) {
+    pthread_mutex_lock(&queue->lock);
+    queue->error = err;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Called with the endpoint lock held
+static pirate_ge_eth_queue_t *ge_eth_queue_lookup(pirate_ge_eth_endpoint_t *endpoint, uint32_t message_id) {
+    pirate_ge_eth_queue_t *queue = endpoint->buckets[message_id % PIRATE_GE_ETH_DEMUX_BUCKETS];
+    while ((queue != NULL) && (queue->message_id != message_id)) {
+        queue = queue->next;
+    }
+    return queue;
+}
+
+static void *ge_eth_demux_thread(void *arg) {
+    pirate_ge_eth_endpoint_t *endpoint = (pirate_ge_eth_endpoint_t *) arg;
+    struct mmsghdr msgs[PIRATE_UDP_BATCH_LEN];
+    struct iovec iov[PIRATE_UDP_BATCH_LEN];
+    int rv;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (unsigned i = 0; i < PIRATE_UDP_BATCH_LEN; i++) {
+        iov[i].iov_base = endpoint->rx_buf + (i * endpoint->mtu);
+        iov[i].iov_len = endpoint->mtu;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    for (;;) {
+        rv = recvmmsg(endpoint->sock, msgs, PIRATE_UDP_BATCH_LEN, MSG_WAITFORONE, NULL);
+        if (__atomic_load_n(&endpoint->closing, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        if (rv < 0) {
+            // ECONNREFUSED is reported on connected sockets
+            // while the writer is not running
+            if ((errno == EINTR) || (errno == EAGAIN) || (errno == ECONNREFUSED)) {
+                continue;
+            }
+            // the socket cannot be read anymore
+            pthread_mutex_lock(&endpoint->lock);
+            endpoint->error = errno;
+            for (unsigned i = 0; i < PIRATE_GE_ETH_DEMUX_BUCKETS; i++) {
+                for (pirate_ge_eth_queue_t *q = endpoint->buckets[i]; q != NULL; q = q->next) {
+                    ge_eth_queue_fail(q, endpoint->error);
+                }
+            }
+            pthread_mutex_unlock(&endpoint->lock);
+            break;
+        }
+        pthread_mutex_lock(&endpoint->lock);
+        for (int i = 0; i < rv; i++) {
+            const uint8_t *frame = (const uint8_t *) iov[i].iov_base;
+            size_t len = msgs[i].msg_len;
+            pirate_ge_eth_queue_t *queue = NULL;
+            uint32_t message_id;
+
+            if (len >= sizeof(message_id)) {
+                memcpy(&message_id, frame, sizeof(message_id));
+                queue = ge_eth_queue_lookup(endpoint, be32toh(message_id));
+            }
+            if (queue != NULL) {
+                ge_eth_queue_push(queue, frame, len);
+            }
+        }
+        pthread_mutex_unlock(&endpoint->lock);
+    }
+    return NULL;
+}
+
+static void ge_eth_endpoint_destroy(pirate_ge_eth_endpoint_t *endpoint) {
+    int err = errno;
+    if (endpoint->running) {
+        __atomic_store_n(&endpoint->closing, 1, __ATOMIC_RELEASE);
+        // wakes the receive thread
+        shutdown(endpoint->sock, SHUT_RDWR);
+        pthread_join(endpoint->thread, NULL);
+    }
+    if (endpoint->sock >= 0) {
+        close(endpoint->sock);
+    }
+    pthread_mutex_destroy(&endpoint->lock);
+    free(endpoint->rx_buf);
+    free(endpoint);
+    errno = err;
+}
+
+static pirate_ge_eth_endpoint_t *ge_eth_endpoint_create(const pirate_ge_eth_param_t *param, int access) {
+    pirate_udp_socket_param_t udp_param;
+    pirate_ge_eth_endpoint_t *endpoint;
+    common_ctx sock_ctx;
+    int rv;
+
+    if ((endpoint = calloc(1, sizeof(pirate_ge_eth_endpoint_t))) == NULL) {
+        return NULL;
+    }
+    endpoint->access = access;
+    memcpy(endpoint->reader_addr, param->reader_addr, sizeof(endpoint->reader_addr));
+    memcpy(endpoint->writer_addr, param->writer_addr, sizeof(endpoint->writer_addr));
+    endpoint->reader_port = param->reader_port;
+    endpoint->writer_port = param->writer_port;
+    endpoint->mtu = param->mtu;
+    endpoint->sock = -1;
+    pthread_mutex_init(&endpoint->lock, NULL);
+
+    memset(&udp_param, 0, sizeof(udp_param));
+    memcpy(udp_param.reader_addr, param->reader_addr, sizeof(udp_param.reader_addr));
+    memcpy(udp_param.writer_addr, param->writer_addr, sizeof(udp_param.writer_addr));
+    udp_param.reader_port = param->reader_port;
+    udp_param.writer_port = param->writer_port;
+    // the socket is shared so nonblocking is applied to each call
+    memset(&sock_ctx, 0, sizeof(sock_ctx));
+    sock_ctx.flags = access;
+    if (access == O_RDONLY) {
+        rv = pirate_udp_socket_reader_open(&udp_param, &sock_ctx);
+    } else {
+        rv = pirate_udp_socket_writer_open(&udp_param, &sock_ctx);
+    }
+    if (rv < 0) {
+        goto error;
+    }
+    endpoint->sock = sock_ctx.fd;
+
+    if (access == O_RDONLY) {
+        endpoint->rx_buf = malloc(PIRATE_UDP_BATCH_LEN * endpoint->mtu);
+        if (endpoint->rx_buf == NULL) {
+            goto error;
+        }
+        rv = pthread_create(&endpoint->thread, NULL, ge_eth_demux_thread, endpoint);
+        if (rv != 0) {
+            errno = rv;
+            goto error;
+        }
+        endpoint->running = 1;
+    }
+    return endpoint;
+error:
+    ge_eth_endpoint_destroy(endpoint);
+    return NULL;
+}
+
+static pirate_ge_eth_endpoint_t *ge_eth_endpoint_find(const pirate_ge_eth_param_t *param, int access) {
+    pirate_ge_eth_endpoint_t *endpoint;
+
+    for (endpoint = ge_eth_endpoints; endpoint != NULL; endpoint = endpoint->next) {
+        if ((endpoint->access == access) &&
+            (endpoint->reader_port == param->reader_port) &&
+            (endpoint->writer_port == param->writer_port) &&
+            (strncmp(endpoint->reader_addr, param->reader_addr, sizeof(endpoint->reader_addr)) == 0) &&
+            (strncmp(endpoint->writer_addr, param->writer_addr, sizeof(endpoint->writer_addr)) == 0)) {
+            return endpoint;
+        }
+    }
+    return NULL;
+}
+
+static pirate_ge_eth_queue_t *ge_eth_queue_create(uint32_t message_id, size_t mtu) {
+    pirate_ge_eth_queue_t *queue;
+
+    if ((queue = calloc(1, sizeof(pirate_ge_eth_queue_t))) == NULL) {
+        return NULL;
+    }
+    if ((queue->frames = malloc(PIRATE_GE_ETH_DEMUX_QUEUE_LEN * mtu)) == NULL) {
+        free(queue);
+        return NULL;
+    }
+    queue->message_id = message_id;
+    queue->mtu = mtu;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    return queue;
+}
+
+static void ge_eth_queue_destroy(pirate_ge_eth_queue_t *queue) {
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->frames);
+    free(queue);
+}
+
+static void ge_eth_endpoint_release(pirate_ge_eth_endpoint_t *endpoint) {
+    pirate_ge_eth_endpoint_t **prev;
+
+    if (--endpoint->refcount > 0) {
+        return;
+    }
+    for (prev = &ge_eth_endpoints; *prev != NULL; prev = &(*prev)->next) {
+        if (*prev == endpoint) {
+            *prev = endpoint->next;
+            break;
+        }
+    }
+    ge_eth_endpoint_destroy(endpoint);
+}
+
+int pirate_ge_eth_demux_open(const pirate_ge_eth_param_t *param, int access,
+    pirate_ge_eth_endpoint_t **endpoint_out, pirate_ge_eth_queue_t **queue_out) {
+    pirate_ge_eth_endpoint_t *endpoint;
+    pirate_ge_eth_queue_t *queue = NULL;
+    int rv = -1;
+
+    pthread_mutex_lock(&ge_eth_endpoints_lock);
+    endpoint = ge_eth_endpoint_find(param, access);
+    if (endpoint == NULL) {
+        if ((endpoint = ge_eth_endpoint_create(param, access)) == NULL) {
+            goto end;
+        }
+        endpoint->next = ge_eth_endpoints;
+        ge_eth_endpoints = endpoint;
+    }
+    endpoint->refcount++;
+
+    if (access == O_RDONLY) {
+        // frames are received into buffers of the endpoint mtu
+        if (param->mtu != endpoint->mtu) {
+            errno = EINVAL;
+            goto error;
+        }
+        pthread_mutex_lock(&endpoint->lock);
+        if (ge_eth_queue_lookup(endpoint, param->message_id) != NULL) {
+            pthread_mutex_unlock(&endpoint->lock);
+            errno = EADDRINUSE;
+            goto error;
+        }
+        if ((queue = ge_eth_queue_create(param->message_id, endpoint->mtu)) == NULL) {
+            pthread_mutex_unlock(&endpoint->lock);
+            goto error;
+        }
+        queue->error = endpoint->error;
+        queue->next = endpoint->buckets[param->message_id % PIRATE_GE_ETH_DEMUX_BUCKETS];
+        endpoint->buckets[param->message_id % PIRATE_GE_ETH_DEMUX_BUCKETS] = queue;
+        pthread_mutex_unlock(&endpoint->lock);
+    }
+
+    *endpoint_out = endpoint;
+    *queue_out = queue;
+    rv = endpoint->sock;
+    goto end;
+error:
+    ge_eth_endpoint_release(endpoint);
+end:
+    pthread_mutex_unlock(&ge_eth_endpoints_lock);
+    return rv;
+}
+
+int pirate_ge_eth_demux_close(pirate_ge_eth_endpoint_t *endpoint,
+    pirate_ge_eth_queue_t *queue) {
+    pthread_mutex_lock(&ge_eth_endpoints_lock);
+    if (queue != NULL) {
+        pirate_ge_eth_queue_t **prev;
+        pthread_mutex_lock(&endpoint->lock);
+        prev = &endpoint->buckets[queue->message_id % PIRATE_GE_ETH_DEMUX_BUCKETS];
+        for (; *prev != NULL; prev = &(*prev)->next) {
+            if (*prev == queue) {
+                *prev = queue->next;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&endpoint->lock);
+        // wakes the blocked readers and waits for them to leave
+        pthread_mutex_lock(&queue->lock);
+        queue->closed = 1;
+        pthread_cond_broadcast(&queue->cond);
+        while (queue->waiters > 0) {
+            pthread_cond_wait(&queue->cond, &queue->lock);
+        }
+        pthread_mutex_unlock(&queue->lock);
+        ge_eth_queue_destroy(queue);
+    }
+    ge_eth_endpoint_release(endpoint);
+    pthread_mutex_unlock(&ge_eth_endpoints_lock);
+    return 0;
+}
+
+ssize_t pirate_ge_eth_demux_recv(pirate_ge_eth_queue_t *queue,
+    void *buf, size_t count, int nonblock) {
+    size_t len;
+
+    pthread_mutex_lock(&queue->lock);
+    while ((queue->count == 0) && !queue->closed) {
+        if (queue->error != 0) {
+            errno = queue->error;
+            pthread_mutex_unlock(&queue->lock);
+            return -1;
+        }
+        if (nonblock) {
+            pthread_mutex_unlock(&queue->lock);
+            errno = EAGAIN;
+            return -1;
+        }
+        queue->waiters++;
+        pthread_cond_wait(&queue->cond, &queue->lock);
+        queue->waiters--;
+    }
+    if (queue->closed) {
+        if (queue->waiters == 0) {
+            pthread_cond_broadcast(&queue->cond);
+        }
+        pthread_mutex_unlock(&queue->lock);
+        errno = EBADF;
+        return -1;
+    }
+    len = MIN(count, queue->lens[queue->head]);
+    memcpy(buf, queue->frames + (queue->head * queue->mtu), len);
+    queue->head = (queue->head + 1) % PIRATE_GE_ETH_DEMUX_QUEUE_LEN;
+    queue->count--;
+    pthread_mutex_unlock(&queue->lock);
+    return len;
+}
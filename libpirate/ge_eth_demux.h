@@ -0,0 +1,81 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_CHANNEL_GE_ETH_DEMUX_H
+#define __PIRATE_CHANNEL_GE_ETH_DEMUX_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "libpirate.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// GE_ETH channels opened with demux=1 that have the same addresses,
+// ports and access mode share one UDP socket (an endpoint).
+//
+// The reader endpoint owns a receive thread. The thread reads
+// batches of frames with recvmmsg() and routes each frame by its
+// message_id to the receive queue of the channel that opened that
+// message_id. Frames with an unknown message_id and frames that
+// arrive at a full queue are dropped. The channel verifies the
+// frame when it is read from the queue.
+//
+// The thread retries a receive that was interrupted and exits
+// on any other error. Readers then get the error once their
+// queue is empty. Closing a channel wakes its blocked readers,
+// which fail with EBADF.
+//
+// Writer endpoints share the socket only. Each writer channel
+// keeps its own pacing and batching state.
+
+#define PIRATE_GE_ETH_DEMUX_QUEUE_LEN   256u
+#define PIRATE_GE_ETH_DEMUX_BUCKETS     64u
+
+typedef struct pirate_ge_eth_queue {
+    struct pirate_ge_eth_queue *next;
+    uint32_t message_id;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t mtu;
+    uint8_t *frames;
+    size_t lens[PIRATE_GE_ETH_DEMUX_QUEUE_LEN];
+    unsigned head;
+    unsigned count;
+    uint64_t dropped;
+    int error;                  // errno of the receive thread once it stops
+    int closed;
+    unsigned waiters;           // readers blocked in pirate_ge_eth_demux_recv()
+} pirate_ge_eth_queue_t;
+
+typedef struct pirate_ge_eth_endpoint pirate_ge_eth_endpoint_t;
+
+// Returns the shared socket. Readers are given a receive queue.
+int pirate_ge_eth_demux_open(const pirate_ge_eth_param_t *param, int access,
+    pirate_ge_eth_endpoint_t **endpoint, pirate_ge_eth_queue_t **queue);
+int pirate_ge_eth_demux_close(pirate_ge_eth_endpoint_t *endpoint,
+    pirate_ge_eth_queue_t *queue);
+
+// Copies the oldest frame of the queue into buf
+ssize_t pirate_ge_eth_demux_recv(pirate_ge_eth_queue_t *queue,
+    void *buf, size_t count, int nonblock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIRATE_CHANNEL_GE_ETH_DEMUX_H */
@@ -0,0 +1,194 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GF256_SIMD 1
+#endif
+#include "gf256.h"
+
+#define GF256_POLY 0x11D
+
+static uint8_t gf256_exp[512];
+static uint8_t gf256_log[256];
+static pthread_once_t gf256_once = PTHREAD_ONCE_INIT;
+#ifdef GF256_SIMD
+// The kernels are compiled for their instruction set and
+// selected at run time, so the default build uses them
+static int gf256_avx2_supported;
+static int gf256_ssse3_supported;
+#endif
+
+static void gf256_init_tables() {
+    unsigned x = 1;
+    for (int i = 0; i < 255; i++) {
+        gf256_exp[i] = x;
+        gf256_log[x] = i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= GF256_POLY;
+        }
+    }
+    for (int i = 255; i < 512; i++) {
+        gf256_exp[i] = gf256_exp[i - 255];
+    }
+#ifdef GF256_SIMD
+    __builtin_cpu_init();
+    gf256_avx2_supported = __builtin_cpu_supports("avx2");
+    gf256_ssse3_supported = __builtin_cpu_supports("ssse3");
+#endif
+}
+
+void pirate_gf256_init() {
+    pthread_once(&gf256_once, gf256_init_tables);
+}
+
+uint8_t pirate_gf256_mul(uint8_t a, uint8_t b) {
+    if ((a == 0) || (b == 0)) {
+        return 0;
+    }
+    return gf256_exp[gf256_log[a] + gf256_log[b]];
+}
+
+uint8_t pirate_gf256_inv(uint8_t a) {
+    if (a == 0) {
+        return 0;
+    }
+    return gf256_exp[255 - gf256_log[a]];
+}
+
+#ifdef GF256_SIMD
+// Products of c with every low nibble and every high nibble.
+// c * x == lo[x & 0xF] ^ hi[x >> 4]
+static void gf256_nibble_tables(uint8_t c, uint8_t lo[16], uint8_t hi[16]) {
+    for (int i = 0; i < 16; i++) {
+        lo[i] = pirate_gf256_mul(c, i);
+        hi[i] = pirate_gf256_mul(c, i << 4);
+    }
+}
+
+__attribute__((target("avx2")))
+static size_t gf256_mul_avx2(uint8_t *dst, const uint8_t *src, const uint8_t lo[16],
+    const uint8_t hi[16], size_t len, int add) {
+    const __m256i lo256 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) lo));
+    const __m256i hi256 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) hi));
+    const __m256i mask256 = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+
+    for (; (i + 32) <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i l = _mm256_and_si256(x, mask256);
+        __m256i h = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask256);
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(lo256, l), _mm256_shuffle_epi8(hi256, h));
+        if (add) {
+            p = _mm256_xor_si256(p, _mm256_loadu_si256((const __m256i*) (dst + i)));
+        }
+        _mm256_storeu_si256((__m256i*) (dst + i), p);
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static size_t gf256_mul_ssse3(uint8_t *dst, const uint8_t *src, const uint8_t lo[16],
+    const uint8_t hi[16], size_t i, size_t len, int add) {
+    const __m128i lo128 = _mm_loadu_si128((const __m128i*) lo);
+    const __m128i hi128 = _mm_loadu_si128((const __m128i*) hi);
+    const __m128i mask128 = _mm_set1_epi8(0x0F);
+
+    for (; (i + 16) <= len; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i l = _mm_and_si128(x, mask128);
+        __m128i h = _mm_and_si128(_mm_srli_epi64(x, 4), mask128);
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo128, l), _mm_shuffle_epi8(hi128, h));
+        if (add) {
+            p = _mm_xor_si128(p, _mm_loadu_si128((const __m128i*) (dst + i)));
+        }
+        _mm_storeu_si128((__m128i*) (dst + i), p);
+    }
+    return i;
+}
+#endif
+
+// Returns the number of bytes that were multiplied
+static size_t gf256_mul_simd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len, int add) {
+    size_t i = 0;
+#ifdef GF256_SIMD
+    uint8_t lo[16], hi[16];
+
+    if ((len < 16) || !gf256_ssse3_supported) {
+        return 0;
+    }
+    gf256_nibble_tables(c, lo, hi);
+    if (gf256_avx2_supported) {
+        i = gf256_mul_avx2(dst, src, lo, hi, len, add);
+    }
+    i = gf256_mul_ssse3(dst, src, lo, hi, i, len, add);
+#else
+    (void) dst;
+    (void) src;
+    (void) c;
+    (void) len;
+    (void) add;
+#endif
+    return i;
+}
+
+void pirate_gf256_mul_add_region(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len) {
+    size_t i;
+
+    if (c == 0) {
+        return;
+    }
+    pirate_gf256_init();
+    if (c == 1) {
+        for (i = 0; i < len; i++) {
+            dst[i] ^= src[i];
+        }
+        return;
+    }
+    i = gf256_mul_simd(dst, src, c, len, 1);
+    if (i < len) {
+        const unsigned log_c = gf256_log[c];
+        for (; i < len; i++) {
+            if (src[i] != 0) {
+                dst[i] ^= gf256_exp[log_c + gf256_log[src[i]]];
+            }
+        }
+    }
+}
+
+void pirate_gf256_mul_region(uint8_t *dst, uint8_t c, size_t len) {
+    size_t i;
+
+    if (c == 1) {
+        return;
+    }
+    if (c == 0) {
+        memset(dst, 0, len);
+        return;
+    }
+    pirate_gf256_init();
+    i = gf256_mul_simd(dst, dst, c, len, 0);
+    if (i < len) {
+        const unsigned log_c = gf256_log[c];
+        for (; i < len; i++) {
+            if (dst[i] != 0) {
+                dst[i] = gf256_exp[log_c + gf256_log[dst[i]]];
+            }
+        }
+    }
+}
@@ -0,0 +1,44 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_GF256_H
+#define __PIRATE_GF256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Arithmetic in GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1.
+// Region operations use AVX2 or SSSE3 byte shuffles when the
+// compiler targets them and fall back to table lookups otherwise.
+
+void pirate_gf256_init();
+uint8_t pirate_gf256_mul(uint8_t a, uint8_t b);
+uint8_t pirate_gf256_inv(uint8_t a);
+
+// dst[i] ^= c * src[i]
+void pirate_gf256_mul_add_region(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+// dst[i] = c * dst[i]
+void pirate_gf256_mul_region(uint8_t *dst, uint8_t c, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIRATE_GF256_H */
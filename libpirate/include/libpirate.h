@@ -56,12 +56,14 @@ typedef enum {
     //  - path        - file path to unix socket
     //  - buffer_size - unix socket buffer size
     //  - min_tx_size - minimum transmit size (bytes)
+    //  - memfd_threshold - send messages of at least this size in a memfd
     UNIX_SOCKET,
 
     // The gaps channel is implemented using a Unix domain socket with SOCK_SEQPACKET semantics.
     //  - path        - file path to unix socket
     //  - buffer_size - unix socket buffer size
     //  - min_tx_size - minimum transmit size (bytes)
+    //  - memfd_threshold - send messages of at least this size in a memfd
     UNIX_SEQPACKET,
 
     // The gaps channel is implemented by using TCP sockets.
@@ -81,6 +83,11 @@ typedef enum {
     //  - writer_addr  - IP address on write end (or 0.0.0.0)
     //  - writer_port  - IP port on write end (or 0)
     //  - buffer_size - UDP socket buffer size
+    //  - rate         - writer pacing rate in bits per second
+    //  - burst        - writer pacing burst in bytes
+    //  - gso          - UDP segmentation and receive offload
+    //  - shards       - number of readers that share the reader port
+    //  - steer        - shard selection, flow (default) or msg_id
     UDP_SOCKET,
 
     // The gaps channel is implemented using shared memory.
@@ -112,9 +119,11 @@ typedef enum {
     // The gaps channel is implemented over a /dev/tty* interface
     // Default baud 30400, no error detection or correction
     // Configuration parameters - pirate_serial_param_t
-    //  - path - device path
-    //  - buad - baud rate, default 230400
-    //  - mtu  - max transmit chunk, 1024
+    //  - path  - device path
+    //  - buad  - baud rate, default 230400
+    //  - mtu   - max transmit chunk, 1024
+    //  - drain - wait for the transmitter to drain after each message
+    //  - cobs  - COBS framing with CRC-32C and resynchronization
     SERIAL,
 
     // The gaps channel for Mercury System PCI-E device
@@ -123,6 +132,10 @@ typedef enum {
     //  - Source ID      - Source ID, required
     //  - Destination ID - Destination ID, required
     //  - Messages       - Message IDs, optional
+    //  - mtu            - maximum ILIP frame length, default 256
+    //  - batch          - maximum messages packed in one ILIP frame,
+    //                     set on both ends
+    //  - flush          - microseconds before a partial frame is sent
     MERCURY,
 
     // The gaps channel for GRC Ethernet devices
@@ -133,8 +146,27 @@ typedef enum {
     //  - writer_port  - IP port on write end (or 0)
     //  - message_id - send/receive message ID
     //  - mtu        - maximum frame length, default 1454
+    //  - rate       - writer pacing rate in bits per second
+    //  - burst      - writer pacing burst in bytes
+    //  - gso        - UDP segmentation and receive offload
+    //  - payload_crc - crc covers the data as well as the header
+    //  - demux      - share one socket between channels with the same
+    //                 addresses and ports, dispatch by message ID
     GE_ETH,
 
+    // The gaps channel is implemented by copying directly from the
+    // address space of the writer with process_vm_readv(). The writer
+    // publishes message descriptors on a ring in shared memory.
+    // The channels that a process writes must all be read by one
+    // process, or opening the writer fails with EBUSY.
+    // This feature is disabled by default. It must be enabled
+    // by setting PIRATE_SHMEM_FEATURE to ON
+    // Configuration parameters - pirate_process_vm_param_t
+    //  - path     - location of the shared memory control ring
+    //  - ring_len - number of entries in the control ring
+    //  - mtu      - maximum message length
+    PROCESS_VM,
+
    // Number of GAPS channel types
     PIRATE_CHANNEL_TYPE_COUNT
 } channel_enum_t;
@@ -159,6 +191,7 @@ typedef struct {
     unsigned buffer_size;
     unsigned mtu;
     unsigned min_tx;
+    unsigned memfd_threshold;
 } pirate_unix_socket_param_t;
 
 // UNIX_SEQPACKET parameters
@@ -167,6 +200,7 @@ typedef struct {
     unsigned buffer_size;
     unsigned mtu;
     unsigned min_tx;
+    unsigned memfd_threshold;
 } pirate_unix_seqpacket_param_t;
 
 // TCP_SOCKET parameters
@@ -182,6 +216,16 @@ typedef struct {
 
 // UDP_SOCKET parameters
 #define PIRATE_DEFAULT_UDP_PACKET_SIZE             65535u
+
+// Selects the reader of a SO_REUSEPORT group that receives a datagram
+typedef enum {
+    // Hash of the source and destination address and port
+    PIRATE_UDP_STEER_FLOW = 0,
+    // First 32-bit big-endian word of the datagram modulo the
+    // number of shards, such as the GE_ETH message id
+    PIRATE_UDP_STEER_MSG_ID
+} pirate_udp_steer_t;
+
 typedef struct {
     char reader_addr[INET6_ADDRSTRLEN];
     char writer_addr[INET6_ADDRSTRLEN];
@@ -189,6 +233,11 @@ typedef struct {
     uint16_t writer_port;
     unsigned buffer_size;
     unsigned mtu;
+    uint64_t rate;
+    uint32_t burst;
+    unsigned gso;
+    unsigned shards;
+    pirate_udp_steer_t steer;
 } pirate_udp_socket_param_t;
 
 // SHMEM parameters
@@ -225,17 +274,22 @@ typedef struct {
 // SERIAL parameters
 #define PIRATE_SERIAL_DEFAULT_BAUD     B230400
 #define PIRATE_SERIAL_DEFAULT_MAX_TX   1024u
+#define PIRATE_SERIAL_COBS_DEFAULT_MTU 65536u
 typedef struct {
     char path[PIRATE_LEN_NAME];
     speed_t baud;
     unsigned mtu;
     unsigned max_tx;
+    unsigned drain;
+    unsigned cobs;
 } pirate_serial_param_t;
 
 // MERCURY parameters
 #define PIRATE_MERCURY_ROOT_DEV             "/dev/gaps_ilip_0_root"
 #define PIRATE_MERCURY_DEFAULT_MTU          256u
 #define PIRATE_MERCURY_MESSAGE_TABLE_LEN    16u
+#define PIRATE_MERCURY_MAX_BATCH            64u
+#define PIRATE_MERCURY_DEFAULT_FLUSH_US     1000u
 typedef struct {
     struct {
         uint32_t level;
@@ -247,6 +301,8 @@ typedef struct {
     } session;
 
     uint32_t mtu;
+    uint32_t batch;
+    uint32_t flush;
 } pirate_mercury_param_t;
 
 // GE_ETH parameters
@@ -258,11 +314,35 @@ typedef struct {
     uint16_t writer_port;
     uint32_t message_id;
     uint32_t mtu;
+    uint64_t rate;
+    uint32_t burst;
+    unsigned gso;
+    unsigned payload_crc;
+    unsigned demux;
 } pirate_ge_eth_param_t;
 
+// PROCESS_VM parameters
+#define PIRATE_DEFAULT_PROCESS_VM_RING_LEN         64u
+typedef struct {
+    char path[PIRATE_LEN_NAME];
+    unsigned ring_len;
+    unsigned mtu;
+} pirate_process_vm_param_t;
+
 typedef struct {
     channel_enum_t channel_type;
     uint8_t drop;
+    // Split messages larger than the channel mtu into fragments.
+    // Largest message length in bytes, or 0 to disable.
+    uint32_t fragment;
+    // Reed-Solomon forward error correction. After every fec_k
+    // messages fec_m parity messages are sent. Up to fec_m lost
+    // messages of each block can be recovered. 0 to disable.
+    // fec_k + fec_m is at most 255. Only for channels that keep
+    // message boundaries: UDP_SOCKET, UDP_SHMEM, GE_ETH,
+    // UNIX_SEQPACKET, MERCURY and SERIAL with cobs.
+    uint8_t fec_k;
+    uint8_t fec_m;
     union {
         pirate_device_param_t           device;
         pirate_pipe_param_t             pipe;
@@ -276,6 +356,7 @@ typedef struct {
         pirate_serial_param_t           serial;
         pirate_mercury_param_t          mercury;
         pirate_ge_eth_param_t           ge_eth;
+        pirate_process_vm_param_t       process_vm;
     } channel;
 } pirate_channel_param_t;
 
@@ -285,8 +366,30 @@ typedef struct {
     uint64_t errs; // EAGAIN and EWOULDBLOCK are not errors
     uint64_t fuzzed;
     uint64_t bytes; // bytes is incremented only on successful requests
+    uint64_t dropped; // messages discarded by the reader after a checksum or framing error
 } pirate_stats_t;
 
+// Backpressure counters of one end of a shared memory ring.
+// The reader waits while the ring is empty and the writer
+// waits while the ring is full.
+typedef struct {
+    uint64_t operations; // successful reads or writes
+    uint64_t spins; // polls of the ring that found it not ready
+    uint64_t sleeps; // waits on the condition variable
+    uint64_t blocked_ns; // time spent waiting for the ring
+    uint64_t wakeups; // condition variable signals sent to the other end
+} pirate_ring_side_stats_t;
+
+// Occupancy is in bytes for SHMEM and UIO_DEVICE channels
+// and in packets for UDP_SHMEM channels
+typedef struct {
+    uint64_t capacity;
+    uint64_t queued;
+    uint64_t high_water; // highest occupancy after a write
+    pirate_ring_side_stats_t reader;
+    pirate_ring_side_stats_t writer;
+} pirate_ring_stats_t;
+
 //
 // API
 //
@@ -338,15 +441,16 @@ int pirate_unparse_channel_param(const pirate_channel_param_t *param, char *str,
     "Supported channels:\n"                                                                    \
     "  DEVICE        device,path[,min_tx_size=N,mtu=N]\n"                                      \
     "  PIPE          pipe,path[,min_tx_size=N,mtu=N]\n"                                        \
-    "  UNIX SOCKET   unix_socket,path[,buffer_size=N,min_tx_size=N,mtu=N]\n"                   \
+    "  UNIX SOCKET   unix_socket,path[,buffer_size=N,min_tx_size=N,mtu=N,memfd_threshold=N]\n" \
     "  TCP SOCKET    tcp_socket,reader addr,reader port,writer addr,writer port[,buffer_size=N,min_tx_size=N,mtu=N]\n" \
-    "  UDP SOCKET    udp_socket,reader addr,reader port,writer addr,writer port[,buffer_size=N,mtu=N]\n"               \
+    "  UDP SOCKET    udp_socket,reader addr,reader port,writer addr,writer port[,buffer_size=N,mtu=N,rate=N,burst=N,gso=N,shards=N,steer=S]\n" \
     "  SHMEM         shmem,path[,buffer_size=N,max_tx_size=N,mtu=N]\n"                         \
     "  UDP_SHMEM     udp_shmem,path[,buffer_size=N,packet_size=N,packet_count=N,mtu=N]\n"      \
     "  UIO           uio[,path=N,max_tx_size=N,mtu=N]\n"                                       \
-    "  SERIAL        serial,path[,baud=N,max_tx_size=N,mtu=N]\n"                               \
-    "  MERCURY       mercury,level,src_id,dst_id[,msg_id_1,...,mtu=N]\n"                       \
-    "  GE_ETH        ge_eth,reader addr,reader port,writer addr,writer port,msg_id[,mtu=N]\n"
+    "  SERIAL        serial,path[,baud=N,max_tx_size=N,mtu=N,drain=N,cobs=N]\n"                \
+    "  MERCURY       mercury,level,src_id,dst_id[,msg_id_1,...,mtu=N,batch=N,flush=N]\n"       \
+    "  GE_ETH        ge_eth,reader addr,reader port,writer addr,writer port,msg_id[,mtu=N,rate=N,burst=N,gso=N,payload_crc=N,demux=N]\n" \
+    "  PROCESS_VM    process_vm,path[,ring_len=N,mtu=N]\n"
 
 // Copies channel parameters from configuration into param argument.
 //
@@ -417,6 +521,56 @@ int pirate_open_parse(const char *param, int flags);
 
 int pirate_open_param(pirate_channel_param_t *param, int flags);
 
+// Opens count gaps channels concurrently. The rendezvous of
+// every channel with its peer (connect, accept, session setup)
+// proceeds in parallel and the call returns when all channels
+// are ready or at least one channel has failed. After a failure
+// the channels that are still waiting for their peer give up
+// within 100 milliseconds, except for a pipe channel, which
+// waits in open() until its peer opens the pipe.
+//
+// The channels within a single call may be opened in any order
+// relative to other processes. Both ends of a channel may be
+// opened by the same call.
+//
+// Parameters
+//  params       - channel parameters, one per channel
+//  flags        - access mode and flags, one per channel
+//  gds          - on success contains the gaps descriptors
+//  count        - number of channels, at most 2 * PIRATE_NUM_CHANNELS
+//
+// Return:
+//  0 on success
+// -1 on failure, errno is set from the first channel that failed.
+//    All channels that were opened by the call are closed and
+//    every element of gds is set to -1.
+
+int pirate_open_param_all(pirate_channel_param_t *params, const int *flags, int *gds, int count);
+
+// Opens count gaps channels concurrently. The channels are
+// specified by parameter strings. See pirate_open_param_all().
+
+int pirate_open_parse_all(const char **params, const int *flags, int *gds, int count);
+
+// Opens a reader group of count UDP_SOCKET readers that share
+// the reader address and port with SO_REUSEPORT. The kernel
+// delivers each datagram to one shard, selected by the steer
+// parameter. Shard i is gds[i]. Each shard is drained
+// independently, for example by one thread per shard, and has
+// its own statistics.
+//
+// Parameters
+//  param        - UDP_SOCKET channel parameter string
+//  gds          - on success contains the gaps descriptors
+//  count        - number of shards
+//
+// Return:
+//  0 on success
+// -1 on failure, errno is set appropriately. All shards
+//    that were opened are closed and every element of gds
+//    is set to -1.
+int pirate_open_parse_reader_group(const char *param, int *gds, int count);
+
 // Returns 1 if the channel type supports the
 // O_NONBLOCK flag to pirate_open(). Otherwise return 0.
 
@@ -430,6 +584,32 @@ int pirate_nonblock_channel_type(channel_enum_t channel_type, size_t mtu);
 
 const pirate_stats_t *pirate_get_stats(int gd);
 
+// Returns the effective utilization of the link of a SERIAL
+// channel that was opened with access mode O_WRONLY. The
+// utilization is the number of bits that have left the
+// transmit queue since the first write, divided by the number
+// of bits the baud rate allows in the same interval. Each byte
+// is counted as 10 bits (8N1 framing). Pseudoterminals are not
+// rate limited and may report a utilization above 1.
+//
+// On success, the utilization is returned. On error,
+// -1 is returned, and errno is set appropriately.
+
+double pirate_serial_link_utilization(int gd);
+
+// Copies the occupancy and the backpressure counters of the
+// ring of a SHMEM, UDP_SHMEM or UIO_DEVICE channel. The counters
+// are kept in the shared header of the ring, so either end
+// reports the counters of both ends. A reader that spends its
+// time blocked on an empty ring is waiting for the writer, and
+// a writer that spends its time blocked on a full ring is
+// waiting for the reader.
+//
+// On success, zero is returned. On error, -1 is returned,
+// and errno is set appropriately.
+
+int pirate_get_ring_stats(int gd, pirate_ring_stats_t *stats);
+
 // pirate_read() attempts to read the next packet of up
 // to count bytes from gaps descriptor gd to the buffer
 // starting at buf.
@@ -468,6 +648,57 @@ ssize_t pirate_write_mtu(int gd);
 
 int pirate_close(int gd);
 
+// Enables tracing of pirate_open(), pirate_read() and
+// pirate_write(). Each thread records its calls into a ring
+// of the newest events (rounded up to a power of two, 0 for
+// the default of 65536). The rings are written in the Chrome
+// trace event format to <prefix>.<pid>.json at exit and by
+// pirate_trace_dump(). A NULL prefix disables tracing.
+//
+// Tracing is also enabled by the environment variable
+// PIRATE_TRACE=<prefix>, with PIRATE_TRACE_EVENTS as the ring
+// size. PIRATE_TRACE_SIGNAL=<signum> installs a handler that
+// dumps the trace when the process receives the signal.
+//
+// On success, zero is returned. On error, -1 is returned,
+// and errno is set appropriately.
+
+int pirate_trace_enable(const char *prefix, uint32_t events);
+
+// Writes the trace of the calling process to <prefix>.<pid>.json.
+// The function is async-signal-safe.
+//
+// On success, zero is returned. On error, -1 is returned,
+// and errno is set appropriately.
+
+int pirate_trace_dump(void);
+
+// Publishes the statistics of every channel of the calling
+// process into the shared memory segment /pirate_stats.<pid>,
+// which other users can read but not modify. The counters
+// are updated in place without locks and the segment also
+// describes each open channel and the fill level of shared
+// memory rings. pirate-top displays the segments of all
+// processes. The segment is removed at exit and a child
+// process publishes its own copy on its first call into the
+// library after fork().
+//
+// The statistics move into a new segment each time publishing
+// is turned on. When enable is zero the name of the segment
+// is removed, but the counters stay in the mapping, which
+// remains valid until the process exits. Publishing may be
+// turned on and off while other threads read or write
+// channels. Pointers returned by pirate_get_stats() before
+// the statistics move are not updated afterwards.
+//
+// Publishing is also enabled by the environment variable
+// PIRATE_STATS_PUBLISH=1.
+//
+// On success, zero is returned. On error, -1 is returned,
+// and errno is set appropriately.
+
+int pirate_stats_publish(int enable);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,247 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "memfd.h"
+#include "pirate_common.h"
+
+// The size of a memfd is sealed so that the reader can trust
+// the length of the region. The contents are not sealed
+// because the writer reuses the memfd once it is released.
+#define PIRATE_MEMFD_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+typedef union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+} pirate_memfd_control_t;
+
+pirate_memfd_pool_t *pirate_memfd_pool_create() {
+    pirate_memfd_pool_t *pool;
+
+    if ((pool = calloc(1, sizeof(pirate_memfd_pool_t))) == NULL) {
+        return NULL;
+    }
+    for (unsigned i = 0; i < PIRATE_MEMFD_POOL_LEN; i++) {
+        pool->slots[i].fd = -1;
+    }
+    return pool;
+}
+
+static void pirate_memfd_slot_free(pirate_memfd_slot_t *slot) {
+    if (slot->addr != NULL) {
+        munmap(slot->addr, slot->len);
+        slot->addr = NULL;
+    }
+    if (slot->fd >= 0) {
+        close(slot->fd);
+        slot->fd = -1;
+    }
+    slot->len = 0;
+}
+
+void pirate_memfd_pool_destroy(pirate_memfd_pool_t *pool) {
+    int err = errno;
+
+    if (pool == NULL) {
+        return;
+    }
+    for (unsigned i = 0; i < PIRATE_MEMFD_POOL_LEN; i++) {
+        pirate_memfd_slot_free(&pool->slots[i]);
+    }
+    free(pool);
+    errno = err;
+}
+
+// Collects the release tokens that have been returned by the reader.
+// Blocks until at least one memfd is available, unless the socket
+// is nonblocking in which case EAGAIN is returned.
+static int pirate_memfd_pool_reclaim(pirate_memfd_pool_t *pool, int sock) {
+    uint8_t tokens[PIRATE_MEMFD_POOL_LEN];
+    ssize_t rv;
+    int err;
+
+    err = errno;
+    while (pool->inflight > 0) {
+        rv = recv(sock, tokens, pool->inflight, MSG_DONTWAIT);
+        if (rv < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                errno = err;
+                break;
+            }
+            return -1;
+        } else if (rv == 0) {
+            errno = EPIPE;
+            return -1;
+        }
+        pool->inflight -= rv;
+    }
+    while (pool->inflight == PIRATE_MEMFD_POOL_LEN) {
+        rv = recv(sock, tokens, 1, 0);
+        if (rv < 0) {
+            return -1;
+        } else if (rv == 0) {
+            errno = EPIPE;
+            return -1;
+        }
+        pool->inflight -= rv;
+    }
+    return 0;
+}
+
+static int pirate_memfd_slot_alloc(pirate_memfd_slot_t *slot, size_t count) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t len = MAX(count, 2 * slot->len);
+    int err;
+
+    len = (len + page - 1) & ~(page - 1);
+    pirate_memfd_slot_free(slot);
+
+    slot->fd = memfd_create("libpirate", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (slot->fd < 0) {
+        return -1;
+    }
+    if (ftruncate(slot->fd, len) < 0) {
+        goto error;
+    }
+    slot->addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, slot->fd, 0);
+    if (slot->addr == MAP_FAILED) {
+        slot->addr = NULL;
+        goto error;
+    }
+    slot->len = len;
+    if (fcntl(slot->fd, F_ADD_SEALS, PIRATE_MEMFD_SEALS) < 0) {
+        goto error;
+    }
+    return 0;
+error:
+    err = errno;
+    pirate_memfd_slot_free(slot);
+    errno = err;
+    return -1;
+}
+
+pirate_memfd_slot_t *pirate_memfd_pool_acquire(pirate_memfd_pool_t *pool, int sock, size_t count) {
+    pirate_memfd_slot_t *slot;
+
+    if (pirate_memfd_pool_reclaim(pool, sock) < 0) {
+        return NULL;
+    }
+    slot = &pool->slots[pool->head];
+    if ((slot->fd < 0) || (slot->len < count)) {
+        if (pirate_memfd_slot_alloc(slot, count) < 0) {
+            return NULL;
+        }
+    }
+    return slot;
+}
+
+void pirate_memfd_pool_commit(pirate_memfd_pool_t *pool) {
+    pool->head = (pool->head + 1) % PIRATE_MEMFD_POOL_LEN;
+    pool->inflight++;
+}
+
+ssize_t pirate_memfd_sendmsg(int sock, const void *buf, size_t len, int fd) {
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    pirate_memfd_control_t control;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    iov.iov_base = (void*) buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    return sendmsg(sock, &msg, 0);
+}
+
+// Receives a message. If a file descriptor is attached to the
+// message then it is stored in fd. Otherwise fd is unmodified.
+ssize_t pirate_memfd_recvmsg(int sock, struct iovec *iov, int iovcnt, int *fd) {
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    pirate_memfd_control_t control;
+    ssize_t rv;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    rv = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (rv < 0) {
+        return rv;
+    }
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS) &&
+            (cmsg->cmsg_len == CMSG_LEN(sizeof(int)))) {
+            if (*fd >= 0) {
+                close(*fd);
+            }
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    return rv;
+}
+
+// Copies the first count bytes of a message out of the memfd,
+// closes the memfd, and returns the release token to the writer.
+ssize_t pirate_memfd_consume(int sock, int fd, void *buf, size_t count) {
+    uint8_t token = 0;
+    size_t rx = 0;
+    ssize_t rv;
+    int err, seals;
+
+    seals = fcntl(fd, F_GET_SEALS);
+    if ((seals < 0) || ((seals & PIRATE_MEMFD_SEALS) != PIRATE_MEMFD_SEALS)) {
+        close(fd);
+        errno = EBADMSG;
+        return -1;
+    }
+    while (rx < count) {
+        rv = pread(fd, ((uint8_t*) buf) + rx, count - rx, rx);
+        if (rv <= 0) {
+            err = (rv == 0) ? EBADMSG : errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        rx += rv;
+    }
+    close(fd);
+    rv = send(sock, &token, sizeof(token), 0);
+    if (rv < 0) {
+        return rv;
+    }
+    return count;
+}
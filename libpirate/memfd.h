@@ -0,0 +1,63 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_MEMFD_H
+#define __PIRATE_MEMFD_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Large messages on Unix domain socket channels are placed
+// in a memfd and only the descriptor is sent using SCM_RIGHTS.
+// The writer reuses a ring of memfds. The reader returns a
+// one byte release token on the socket after it has consumed
+// a memfd. Tokens arrive in the order the memfds were sent.
+
+#define PIRATE_MEMFD_POOL_LEN   4u
+
+// Set in the length of a message that is carried in a memfd
+#define PIRATE_MEMFD_FLAG       0x80000000u
+
+typedef struct {
+    int fd;
+    uint8_t *addr;
+    size_t len;
+} pirate_memfd_slot_t;
+
+typedef struct {
+    pirate_memfd_slot_t slots[PIRATE_MEMFD_POOL_LEN];
+    unsigned head;
+    unsigned inflight;
+} pirate_memfd_pool_t;
+
+pirate_memfd_pool_t *pirate_memfd_pool_create();
+void pirate_memfd_pool_destroy(pirate_memfd_pool_t *pool);
+pirate_memfd_slot_t *pirate_memfd_pool_acquire(pirate_memfd_pool_t *pool, int sock, size_t count);
+void pirate_memfd_pool_commit(pirate_memfd_pool_t *pool);
+
+ssize_t pirate_memfd_sendmsg(int sock, const void *buf, size_t len, int fd);
+ssize_t pirate_memfd_recvmsg(int sock, struct iovec *iov, int iovcnt, int *fd);
+ssize_t pirate_memfd_consume(int sock, int fd, void *buf, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIRATE_MEMFD_H */
@@ -15,6 +15,7 @@
 
 #include <time.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <stdlib.h>
@@ -42,6 +43,20 @@ typedef enum {
 #define PIRATE_MERCURY_DEFAULT_FMT  "/dev/gaps_ilip_%d_%s"
 #define PIRATE_MERCURY_SESSION_FMT  "/dev/gaps_ilip_s_%08x_%s"
 
+// The driver keeps a session until it is unloaded, so the ID of a
+// session configuration does not change. Each process negotiates
+// a configuration on the root device once.
+#define MERCURY_SESSION_CACHE_LEN       32u
+#define MERCURY_ROOT_TIMEOUT_S          1
+#define MERCURY_ROOT_MIN_BACKOFF_US     10u
+#define MERCURY_ROOT_MAX_BACKOFF_US     1000u
+
+typedef __typeof__(((pirate_mercury_param_t *) NULL)->session) mercury_session_t;
+
+static mercury_session_t mercury_sessions[MERCURY_SESSION_CACHE_LEN];
+static unsigned mercury_sessions_count = 0;
+static pthread_mutex_t mercury_sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+
 #pragma pack(4)
 typedef struct {
     uint32_t session;
@@ -62,26 +77,32 @@ typedef struct ilip_message {
 } ilip_message_t;
 #pragma pack()
 
-static ssize_t mercury_message_pack(void *buf, const void *data,
-        uint32_t data_len, const pirate_mercury_param_t *param) {
-    ilip_message_t *msg_hdr = (ilip_message_t *)buf;
-    uint8_t *msg_data = (uint8_t *)buf + sizeof(ilip_message_t);
-    const size_t msg_len = data_len + sizeof(ilip_message_t);
+// In batch mode the payload of a frame is a sequence of messages,
+// each with a 4 byte big-endian length prefix. The header count
+// stays one, the only count the driver accepts.
+#define MERCURY_RECORD_LEN sizeof(uint32_t)
+
+// The coarse clock is the time of the last kernel tick. It is
+// read from the vDSO without reading the hardware counter.
+static int mercury_linux_time(uint64_t *linux_time) {
     struct timespec tv;
-    uint64_t linux_time;
 
-    if (msg_len > param->mtu) {
-        errno = EMSGSIZE;
+    if (clock_gettime(CLOCK_REALTIME_COARSE, &tv) != 0) {
         return -1;
     }
+    *linux_time = tv.tv_sec * 1000000000ul + tv.tv_nsec;
+    return 0;
+}
+
+static int mercury_message_header(ilip_message_t *msg_hdr, uint32_t count,
+        uint32_t data_len, const pirate_mercury_param_t *param) {
+    uint64_t linux_time;
 
-    if(clock_gettime(CLOCK_REALTIME, &tv) != 0 ) {
+    if (mercury_linux_time(&linux_time) != 0) {
         return -1;
     }
-    linux_time = tv.tv_sec * 1000000000ul + tv.tv_nsec;
 
-    // Count is always 1 for now
-    msg_hdr->header.count = htobe32(1u);
+    msg_hdr->header.count = htobe32(count);
 
     // Session
     msg_hdr->header.session = htobe32(param->session.id);
@@ -186,19 +207,60 @@ static ssize_t mercury_message_pack(void *buf, const void *data,
     }
 
     msg_hdr->time.ilip_time  = 0ul;
-    msg_hdr->time.linux_time = tv.tv_sec * 1000000000ul + tv.tv_nsec;
-    
+    msg_hdr->time.linux_time = linux_time;
+
     msg_hdr->data_length     = htobe32(data_len);
+    return 0;
+}
+
+static ssize_t mercury_message_pack(void *buf, const void *data,
+        uint32_t data_len, const pirate_mercury_param_t *param) {
+    ilip_message_t *msg_hdr = (ilip_message_t *)buf;
+    uint8_t *msg_data = (uint8_t *)buf + sizeof(ilip_message_t);
+    const size_t msg_len = data_len + sizeof(ilip_message_t);
+
+    if (msg_len > param->mtu) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    if (mercury_message_header(msg_hdr, 1u, data_len, param) != 0) {
+        return -1;
+    }
     memcpy(msg_data, data, data_len);
     return ((ssize_t) msg_len);
 }
 
 
-static ssize_t mercury_message_unpack(const void *buf, size_t buf_len,
+// Returns the next message of the frame in ctx->buf
+static ssize_t mercury_record_unpack(mercury_ctx *ctx, void *data, size_t count) {
+    uint32_t record_len;
+
+    if ((ctx->rd_offset + MERCURY_RECORD_LEN) > ctx->rd_end) {
+        goto error;
+    }
+    memcpy(&record_len, ctx->buf + ctx->rd_offset, MERCURY_RECORD_LEN);
+    record_len = be32toh(record_len);
+    ctx->rd_offset += MERCURY_RECORD_LEN;
+    if (record_len > (ctx->rd_end - ctx->rd_offset)) {
+        goto error;
+    }
+
+    count = MIN(record_len, count);
+    memcpy(data, ctx->buf + ctx->rd_offset, count);
+    ctx->rd_offset += record_len;
+    return count;
+error:
+    ctx->rd_offset = ctx->rd_end;
+    errno = EIO;
+    return -1;
+}
+
+static ssize_t mercury_message_unpack(mercury_ctx *ctx, size_t buf_len,
                                         void *data, ssize_t count,
                                         const pirate_mercury_param_t *param) {
-    const ilip_message_t *msg_hdr = (const ilip_message_t *)buf;
-    const uint8_t *msg_data = (const uint8_t *)buf + sizeof(ilip_message_t);
+    const ilip_message_t *msg_hdr = (const ilip_message_t *)ctx->buf;
+    const uint8_t *msg_data = ctx->buf + sizeof(ilip_message_t);
     ssize_t payload_len;
 
     if ((be32toh(msg_hdr->header.session) != param->session.id) ||
@@ -212,11 +274,162 @@ static ssize_t mercury_message_unpack(const void *buf, size_t buf_len,
         return -1;
     }
 
+    if (param->batch > 1) {
+        ctx->rd_offset = sizeof(ilip_message_t);
+        ctx->rd_end = sizeof(ilip_message_t) + payload_len;
+        return mercury_record_unpack(ctx, data, count);
+    }
+
     count = MIN(payload_len, count);
     memcpy(data, msg_data, count);
     return count;
 }
 
+// Called with the batch lock held
+static int mercury_batch_flush(mercury_batch_t *batch) {
+    ilip_message_t *msg_hdr = (ilip_message_t *)batch->buf;
+    size_t data_len = batch->len - sizeof(ilip_message_t);
+    ssize_t rv;
+
+    if (batch->count == 0) {
+        return 0;
+    }
+    rv = mercury_message_header(msg_hdr, 1u, data_len, &batch->param);
+    batch->count = 0;
+    batch->len = 0;
+    if (rv != 0) {
+        return -1;
+    }
+    rv = write(batch->fd, batch->buf, sizeof(ilip_message_t) + data_len);
+    if (rv < 0) {
+        return -1;
+    }
+    if (((size_t) rv) != (sizeof(ilip_message_t) + data_len)) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static void *mercury_flush_thread(void *arg) {
+    mercury_batch_t *batch = (mercury_batch_t *) arg;
+    struct timespec now;
+
+    pthread_mutex_lock(&batch->lock);
+    while (!batch->closing) {
+        if (batch->count == 0) {
+            pthread_cond_wait(&batch->cond, &batch->lock);
+            continue;
+        }
+        pthread_cond_timedwait(&batch->cond, &batch->lock, &batch->deadline);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((batch->count > 0) && ((now.tv_sec > batch->deadline.tv_sec) ||
+            ((now.tv_sec == batch->deadline.tv_sec) && (now.tv_nsec >= batch->deadline.tv_nsec)))) {
+            if (mercury_batch_flush(batch) < 0) {
+                batch->error = errno;
+            }
+        }
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return NULL;
+}
+
+static mercury_batch_t *mercury_batch_create(const pirate_mercury_param_t *param, int fd) {
+    mercury_batch_t *batch;
+    pthread_condattr_t attr;
+    int rv;
+
+    if ((batch = calloc(1, sizeof(mercury_batch_t))) == NULL) {
+        return NULL;
+    }
+    if ((batch->buf = malloc(param->mtu)) == NULL) {
+        free(batch);
+        return NULL;
+    }
+    memcpy(&batch->param, param, sizeof(pirate_mercury_param_t));
+    batch->fd = fd;
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&batch->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    rv = pthread_create(&batch->thread, NULL, mercury_flush_thread, batch);
+    if (rv != 0) {
+        pthread_cond_destroy(&batch->cond);
+        pthread_mutex_destroy(&batch->lock);
+        free(batch->buf);
+        free(batch);
+        errno = rv;
+        return NULL;
+    }
+    return batch;
+}
+
+static int mercury_batch_destroy(mercury_batch_t *batch) {
+    int rv;
+
+    pthread_mutex_lock(&batch->lock);
+    batch->closing = 1;
+    pthread_cond_signal(&batch->cond);
+    pthread_mutex_unlock(&batch->lock);
+    pthread_join(batch->thread, NULL);
+
+    rv = mercury_batch_flush(batch);
+    pthread_cond_destroy(&batch->cond);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch->buf);
+    free(batch);
+    return rv;
+}
+
+static ssize_t mercury_batch_write(mercury_batch_t *batch, const void *buf, size_t count) {
+    const size_t record_len = MERCURY_RECORD_LEN + count;
+    uint32_t len_be = htobe32(count);
+
+    if ((sizeof(ilip_message_t) + record_len) > batch->param.mtu) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    if (batch->error != 0) {
+        errno = batch->error;
+        batch->error = 0;
+        goto error;
+    }
+    if ((batch->count > 0) && ((batch->len + record_len) > batch->param.mtu)) {
+        if (mercury_batch_flush(batch) < 0) {
+            goto error;
+        }
+    }
+    if (batch->count == 0) {
+        const uint64_t flush_ns = batch->param.flush * 1000ul;
+        clock_gettime(CLOCK_MONOTONIC, &batch->deadline);
+        batch->deadline.tv_sec += flush_ns / 1000000000ul;
+        batch->deadline.tv_nsec += flush_ns % 1000000000ul;
+        if (batch->deadline.tv_nsec >= 1000000000l) {
+            batch->deadline.tv_sec++;
+            batch->deadline.tv_nsec -= 1000000000l;
+        }
+        batch->len = sizeof(ilip_message_t);
+        pthread_cond_signal(&batch->cond);
+    }
+    memcpy(batch->buf + batch->len, &len_be, MERCURY_RECORD_LEN);
+    memcpy(batch->buf + batch->len + MERCURY_RECORD_LEN, buf, count);
+    batch->len += record_len;
+    batch->count++;
+    if (batch->count == batch->param.batch) {
+        if (mercury_batch_flush(batch) < 0) {
+            goto error;
+        }
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return count;
+error:
+    pthread_mutex_unlock(&batch->lock);
+    return -1;
+}
+
 static void pirate_mercury_init_param(pirate_mercury_param_t *param) {
     if (param->session.level == 0) {
         param->session.level = 1;
@@ -225,6 +438,10 @@ static void pirate_mercury_init_param(pirate_mercury_param_t *param) {
     if (param->mtu == 0) {
         param->mtu = PIRATE_MERCURY_DEFAULT_MTU;
     }
+
+    if ((param->batch > 1) && (param->flush == 0)) {
+        param->flush = PIRATE_MERCURY_DEFAULT_FLUSH_US;
+    }
 }
 
 int pirate_mercury_parse_param(char *str, void *_param) {
@@ -271,6 +488,10 @@ int pirate_mercury_parse_param(char *str, void *_param) {
             continue;
         } else if (strncmp("mtu", key, strlen("mtu")) == 0) {
             param->mtu = strtol(val, NULL, 10);
+        } else if (strncmp("batch", key, strlen("batch")) == 0) {
+            param->batch = strtol(val, NULL, 10);
+        } else if (strncmp("flush", key, strlen("flush")) == 0) {
+            param->flush = strtol(val, NULL, 10);
         } else {
             errno = EINVAL;
             return -1;
@@ -286,17 +507,22 @@ int pirate_mercury_get_channel_description(const void *_param, char *desc, int l
     int ret_sz = 0;
 
     char mtu_str[32];
+    char batch_str[48];
 
     mtu_str[0] = 0;
+    batch_str[0] = 0;
     if (param->mtu != 0) {
         snprintf(mtu_str, 32, ",mtu=%u", param->mtu);
     }
+    if (param->batch != 0) {
+        snprintf(batch_str, 48, ",batch=%u,flush=%u", param->batch, param->flush);
+    }
 
-    wr_sz = snprintf(wr, len, "mercury,%u,%u,%u%s",
+    wr_sz = snprintf(wr, len, "mercury,%u,%u,%u%s%s",
                         param->session.level,
                         param->session.source_id,
                         param->session.destination_id,
-                        mtu_str);
+                        mtu_str, batch_str);
     ret_sz += wr_sz;
 
     for (uint32_t i = 0; i < param->session.message_count; ++i) {
@@ -309,86 +535,141 @@ int pirate_mercury_get_channel_description(const void *_param, char *desc, int l
     return ret_sz;
 }
 
-int pirate_mercury_open(void *_param, void *_ctx) {
-    pirate_mercury_param_t *param = (pirate_mercury_param_t *)_param;
-    mercury_ctx *ctx = (mercury_ctx *)_ctx;
+// Configures a session on the root device and reads back its ID.
+// Each field is written at its own offset, since the root device
+// does not advance the offset within a vector write.
+static int mercury_session_negotiate(mercury_session_t *session) {
     const uint32_t cfg_len = sizeof(uint32_t);
+    struct timespec now, deadline;
+    unsigned backoff_us = MERCURY_ROOT_MIN_BACKOFF_US;
     ssize_t sz;
-    int fd_root = -1;
-    unsigned wait_counter = 0;
-    int access = ctx->flags & O_ACCMODE;
-    const mode_t mode = access == O_RDONLY ? S_IRUSR : S_IWUSR;
+    int fd_root;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &deadline) != 0) {
+        return -1;
+    }
+    deadline.tv_sec += MERCURY_ROOT_TIMEOUT_S;
 
-    /* Open the root device to configure and establish a session */
-    pirate_mercury_init_param(param);
     /* Root device enforces single open */
-    for(;;) {
+    for (;;) {
         int err = errno;
         fd_root = open(PIRATE_MERCURY_ROOT_DEV, O_RDWR, S_IRUSR | S_IWUSR);
         if (fd_root != -1) {
             break;
         }
-    
-        if (errno != EBUSY) {
+        if ((errno != EBUSY) || pirate_open_aborted()) {
             return -1;
-        } else {
-            usleep(100);
-            /* Timeout 1 second */
-            if (++wait_counter >= 10 * 1000) {
-                errno = ETIME;
-                return -1;
-            }
-            errno = err;
         }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec > deadline.tv_sec) ||
+            ((now.tv_sec == deadline.tv_sec) && (now.tv_nsec >= deadline.tv_nsec))) {
+            errno = ETIME;
+            return -1;
+        }
+        errno = err;
+        usleep(backoff_us);
+        backoff_us = MIN(2 * backoff_us, MERCURY_ROOT_MAX_BACKOFF_US);
     }
 
-    if (param->session.message_count > 0) {
-        const uint32_t msg_cfg_len = param->session.message_count * cfg_len;
+    if (session->message_count > 0) {
+        const ssize_t msg_cfg_len = session->message_count * cfg_len;
 
         // Level
-        sz = pwrite(fd_root, &param->session.level, cfg_len, 
-                    MERCURY_CFG_OFF_LEVEL);
+        sz = pwrite(fd_root, &session->level, cfg_len, MERCURY_CFG_OFF_LEVEL);
         if (sz != cfg_len) {
             goto error;
         }
 
         // Destination ID
-        sz = pwrite(fd_root, &param->session.destination_id, cfg_len,
+        sz = pwrite(fd_root, &session->destination_id, cfg_len,
                     MERCURY_CFG_OFF_DESTINATION_ID);
         if (sz != cfg_len) {
             goto error;
         }
 
         // Message tags
-        sz = pwrite(fd_root, param->session.messages, msg_cfg_len,
-                    MERCURY_CFG_OFF_MESSAGES);
-        if ((sz < 0) || (((size_t) sz) != msg_cfg_len)) {
+        sz = pwrite(fd_root, session->messages, msg_cfg_len, MERCURY_CFG_OFF_MESSAGES);
+        if (sz != msg_cfg_len) {
             goto error;
         }
 
-        sz = pwrite(fd_root, &param->session.source_id, cfg_len,
-                    MERCURY_CFG_OFF_SOURCE_ID);
+        sz = pwrite(fd_root, &session->source_id, cfg_len, MERCURY_CFG_OFF_SOURCE_ID);
         if (sz != cfg_len) {
             goto error;
         }
     } else {
-        sz = pwrite(fd_root, &param->session.level, cfg_len,
-                    MERCURY_CFG_OFF_SOURCE_ID);
+        sz = pwrite(fd_root, &session->level, cfg_len, MERCURY_CFG_OFF_SOURCE_ID);
         if (sz != cfg_len) {
             goto error;
         }
     }
 
-    sz = pread(fd_root, &param->session.id, cfg_len, MERCURY_CFG_OFF_SESSION_ID);
-    if (sz != sizeof(param->session.id)) {
+    sz = pread(fd_root, &session->id, cfg_len, MERCURY_CFG_OFF_SESSION_ID);
+    if (sz != cfg_len) {
         goto error;
     }
 
     /* Must close the root device as only one open() at a time is allowed */
-    if (close(fd_root) != 0) {
+    return close(fd_root);
+error:
+    close(fd_root);
+    return -1;
+}
+
+static int mercury_session_equal(const mercury_session_t *a, const mercury_session_t *b) {
+    return (a->level == b->level) &&
+        (a->source_id == b->source_id) &&
+        (a->destination_id == b->destination_id) &&
+        (a->message_count == b->message_count) &&
+        (memcmp(a->messages, b->messages, a->message_count * sizeof(uint32_t)) == 0);
+}
+
+// Sets the session ID from the cache of this process or from
+// the root device. Threads of the process wait on the cache lock
+// rather than poll the root device.
+static int mercury_session_get(mercury_session_t *session) {
+    int rv = 0;
+
+    if (session->message_count > PIRATE_MERCURY_MESSAGE_TABLE_LEN) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&mercury_sessions_lock);
+    for (unsigned i = 0; i < mercury_sessions_count; i++) {
+        if (mercury_session_equal(&mercury_sessions[i], session)) {
+            session->id = mercury_sessions[i].id;
+            goto out;
+        }
+    }
+    rv = mercury_session_negotiate(session);
+    if ((rv == 0) && (mercury_sessions_count < MERCURY_SESSION_CACHE_LEN)) {
+        mercury_sessions[mercury_sessions_count++] = *session;
+    }
+out:
+    pthread_mutex_unlock(&mercury_sessions_lock);
+    return rv;
+}
+
+int pirate_mercury_open(void *_param, void *_ctx) {
+    pirate_mercury_param_t *param = (pirate_mercury_param_t *)_param;
+    mercury_ctx *ctx = (mercury_ctx *)_ctx;
+    int access = ctx->flags & O_ACCMODE;
+    const mode_t mode = access == O_RDONLY ? S_IRUSR : S_IWUSR;
+
+    ctx->fd = -1;
+    ctx->buf = NULL;
+    ctx->batch = NULL;
+    ctx->rd_offset = 0;
+    ctx->rd_end = 0;
+
+    pirate_mercury_init_param(param);
+    if (param->batch > PIRATE_MERCURY_MAX_BATCH) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (mercury_session_get(&param->session) != 0) {
         goto error;
     }
-    fd_root = -1;
 
     if (param->session.message_count == 0) {
         if (param->session.level != param->session.id) {
@@ -414,13 +695,15 @@ int pirate_mercury_open(void *_param, void *_ctx) {
         goto error;
     }
 
-    return ctx->fd;
-error:
-    if (fd_root > 0) {
-        close(fd_root);
-        fd_root = -1;
+    if ((access == O_WRONLY) && (param->batch > 1)) {
+        ctx->batch = mercury_batch_create(param, ctx->fd);
+        if (ctx->batch == NULL) {
+            goto error;
+        }
     }
 
+    return ctx->fd;
+error:
     if (ctx->fd > 0) {
         close(ctx->fd);
         ctx->fd = -1;
@@ -436,7 +719,13 @@ error:
 
 int pirate_mercury_close(void *_ctx) {
     mercury_ctx *ctx = (mercury_ctx *)_ctx;
-    int rv = -1;
+    int err, rv = -1, flush_rv = 0;
+
+    if (ctx->batch != NULL) {
+        // send the pending frame
+        flush_rv = mercury_batch_destroy(ctx->batch);
+        ctx->batch = NULL;
+    }
 
     if (ctx->buf != NULL) {
         free(ctx->buf);
@@ -448,8 +737,13 @@ int pirate_mercury_close(void *_ctx) {
         return -1;
     }
 
+    err = errno;
     rv = close(ctx->fd);
     ctx->fd = -1;
+    if ((flush_rv < 0) && (rv == 0)) {
+        errno = err;
+        rv = -1;
+    }
     return rv;
 }
 
@@ -463,12 +757,16 @@ ssize_t pirate_mercury_read(const void *_param, void *_ctx, void *buf, size_t co
         return -1;
     }
 
+    if (ctx->rd_offset < ctx->rd_end) {
+        return mercury_record_unpack(ctx, buf, count);
+    }
+
     rd_len = read(ctx->fd, ctx->buf, param->mtu);
     if (rd_len < 0) {
         return -1;
     }
 
-    return mercury_message_unpack(ctx->buf, (size_t) rd_len, buf, count, param);
+    return mercury_message_unpack(ctx, (size_t) rd_len, buf, count, param);
 }
 
 ssize_t pirate_mercury_write_mtu(const void *_param, void *_ctx) {
@@ -478,6 +776,13 @@ ssize_t pirate_mercury_write_mtu(const void *_param, void *_ctx) {
     if (mtu == 0) {
         mtu = PIRATE_MERCURY_DEFAULT_MTU;
     }
+    if (param->batch > 1) {
+        if (mtu < (sizeof(ilip_message_t) + MERCURY_RECORD_LEN)) {
+            errno = EINVAL;
+            return -1;
+        }
+        return mtu - sizeof(ilip_message_t) - MERCURY_RECORD_LEN;
+    }
     if (mtu < sizeof(ilip_message_t)) {
         errno = EINVAL;
         return -1;
@@ -495,6 +800,10 @@ ssize_t pirate_mercury_write(const void *_param, void *_ctx, const void *buf, si
         return -1;
     }
 
+    if (ctx->batch != NULL) {
+        return mercury_batch_write(ctx->batch, buf, count);
+    }
+
     if ((wr_len = mercury_message_pack(ctx->buf, buf, count, param)) < 0) {
         return -1;
     }
@@ -16,13 +16,37 @@
 #ifndef __PIRATE_CHANNEL_MERCURY_H
 #define __PIRATE_CHANNEL_MERCURY_H
 
+#include <pthread.h>
+#include <time.h>
 #include "libpirate.h"
 
+// Pending ILIP frame of a writer in batch mode. The frame is
+// sent when it is full, when it holds the maximum number of
+// messages, or by the flush thread at the flush deadline.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    pirate_mercury_param_t param;
+    int fd;
+    uint8_t *buf;
+    size_t len;
+    uint32_t count;
+    struct timespec deadline;
+    // errno of a send from the flush thread
+    int error;
+    int closing;
+} mercury_batch_t;
+
 typedef struct {
     int flags;
     int fd;
     uint8_t *buf;
     char path[PIRATE_LEN_NAME];
+    mercury_batch_t *batch;
+    // messages of a received frame that have not been read
+    size_t rd_offset;
+    size_t rd_end;
 } mercury_ctx;
 
 int pirate_mercury_parse_param(char *str, void *_param);
@@ -0,0 +1,190 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include "pirate_common.h"
+#include "pacing.h"
+
+#define NSEC_PER_SEC 1000000000ull
+
+static uint64_t pacer_prefix(char c) {
+    switch (c) {
+        case 'k':
+        case 'K':
+            return 1000ull;
+        case 'M':
+            return 1000000ull;
+        case 'G':
+            return 1000000000ull;
+        default:
+            return 1;
+    }
+}
+
+int pirate_parse_rate(const char *val, uint64_t *rate) {
+    char *end;
+    uint64_t value = strtoull(val, &end, 10);
+    uint64_t prefix = pacer_prefix(*end);
+
+    if (end == val) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (prefix > 1) {
+        end++;
+    }
+    if ((*end == 0) || (strcmp(end, "bps") == 0)) {
+        *rate = value * prefix;
+    } else if (strcmp(end, "Bps") == 0) {
+        *rate = value * prefix * 8;
+    } else {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int pirate_parse_size(const char *val, uint32_t *size) {
+    char *end;
+    uint64_t value = strtoull(val, &end, 10);
+    uint64_t prefix = pacer_prefix(*end);
+
+    if (end == val) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (prefix > 1) {
+        end++;
+        if (strcmp(end, "iB") == 0) {
+            prefix = (prefix == 1000ull) ? (1ull << 10) : (prefix == 1000000ull) ? (1ull << 20) : (1ull << 30);
+            end += 2;
+        } else if (*end == 'B') {
+            end++;
+        }
+    } else if (*end == 'B') {
+        end++;
+    }
+    if ((*end != 0) || ((value * prefix) > UINT32_MAX)) {
+        errno = EINVAL;
+        return -1;
+    }
+    *size = value * prefix;
+    return 0;
+}
+
+int pirate_unparse_rate(char *buf, int len, uint64_t rate) {
+    if ((rate % UINT64_C(1000000000)) == 0) {
+        return snprintf(buf, len, "%" PRIu64 "Gbps", rate / UINT64_C(1000000000));
+    } else if ((rate % UINT64_C(1000000)) == 0) {
+        return snprintf(buf, len, "%" PRIu64 "Mbps", rate / UINT64_C(1000000));
+    } else if ((rate % UINT64_C(1000)) == 0) {
+        return snprintf(buf, len, "%" PRIu64 "Kbps", rate / UINT64_C(1000));
+    }
+    return snprintf(buf, len, "%" PRIu64 "bps", rate);
+}
+
+static uint64_t pacer_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec * NSEC_PER_SEC) + now.tv_nsec;
+}
+
+static uint64_t pacer_cost_ns(const pirate_pacer_t *pacer, size_t len) {
+    return (len * NSEC_PER_SEC) / pacer->rate;
+}
+
+void pirate_pacer_init(pirate_pacer_t *pacer, uint64_t rate, uint32_t burst) {
+    int slack;
+
+    memset(pacer, 0, sizeof(pirate_pacer_t));
+    pacer->rate = rate / 8;
+    if (pacer->rate == 0) {
+        return;
+    }
+    pacer->burst_ns = pacer_cost_ns(pacer, burst);
+    slack = prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0);
+    pacer->slack_ns = (slack > 0) ? slack : 0;
+}
+
+void pirate_pacer_socket(const pirate_pacer_t *pacer, int sock) {
+    unsigned rate;
+    int err = errno;
+
+    if (pacer->rate == 0) {
+        return;
+    }
+    rate = MIN(pacer->rate, UINT32_MAX - 1);
+    setsockopt(sock, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate));
+    errno = err;
+}
+
+// Returns the time at which len bytes may be sent
+static uint64_t pacer_deadline(pirate_pacer_t *pacer, uint64_t now, size_t len, uint64_t *cost) {
+    *cost = pacer_cost_ns(pacer, len);
+    if (pacer->next_ns < now) {
+        pacer->next_ns = now;
+    }
+    // a datagram larger than the burst is sent on an empty bucket
+    return pacer->next_ns + *cost - MAX(pacer->burst_ns, *cost);
+}
+
+int pirate_pacer_wait(pirate_pacer_t *pacer, size_t len, int nonblock) {
+    uint64_t now, deadline, cost;
+
+    if (pacer->rate == 0) {
+        return 0;
+    }
+    now = pacer_now_ns();
+    deadline = pacer_deadline(pacer, now, len, &cost);
+    if (deadline > now) {
+        if (nonblock) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if ((deadline - now) > (pacer->slack_ns + PIRATE_PACER_SPIN_NS)) {
+            uint64_t wake = deadline - pacer->slack_ns - PIRATE_PACER_SPIN_NS;
+            struct timespec ts = { wake / NSEC_PER_SEC, wake % NSEC_PER_SEC };
+            int err = errno;
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+            errno = err;
+        }
+        while (pacer_now_ns() < deadline);
+    }
+    pacer->next_ns += cost;
+    return 0;
+}
+
+int pirate_pacer_try(pirate_pacer_t *pacer, size_t len) {
+    uint64_t now, deadline, cost;
+
+    if (pacer->rate == 0) {
+        return 1;
+    }
+    now = pacer_now_ns();
+    deadline = pacer_deadline(pacer, now, len, &cost);
+    if (deadline > now) {
+        return 0;
+    }
+    pacer->next_ns += cost;
+    return 1;
+}
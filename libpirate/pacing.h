@@ -0,0 +1,70 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_PACING_H
+#define __PIRATE_PACING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Token bucket rate limiter for datagram writers. The bucket is
+// tracked as the theoretical transmission time of the next byte.
+// A datagram is sent when it fits in the burst allowance, otherwise
+// the writer sleeps until it does. The sleep ends early by the
+// thread timer slack and the remainder is spent spinning.
+
+// Waits shorter than this are spun instead of slept
+#define PIRATE_PACER_SPIN_NS 20000ull
+
+typedef struct {
+    uint64_t rate;          // bytes per second, 0 disables pacing
+    uint64_t burst_ns;      // burst allowance in nanoseconds
+    uint64_t next_ns;       // theoretical departure time of the next byte
+    uint64_t slack_ns;      // timer slack of the writer thread
+} pirate_pacer_t;
+
+// Parses a rate such as 800Mbps or 100MBps into bits per second.
+// The K, M and G prefixes are decimal. Bps is bytes per second.
+int pirate_parse_rate(const char *val, uint64_t *rate);
+
+// Parses a size such as 64KiB or 1500 into bytes
+int pirate_parse_size(const char *val, uint32_t *size);
+
+// Formats a rate in bits per second
+int pirate_unparse_rate(char *buf, int len, uint64_t rate);
+
+void pirate_pacer_init(pirate_pacer_t *pacer, uint64_t rate, uint32_t burst);
+
+// Sets SO_MAX_PACING_RATE on the socket so that a fair queue
+// qdisc can pace in the kernel. Failure is not an error.
+void pirate_pacer_socket(const pirate_pacer_t *pacer, int sock);
+
+// Waits until len bytes may be sent. Returns -1 with errno
+// set to EAGAIN if nonblock is set and a wait is required.
+int pirate_pacer_wait(pirate_pacer_t *pacer, size_t len, int nonblock);
+
+// Returns 1 and accounts for len bytes if they may be sent
+// without waiting, otherwise returns 0
+int pirate_pacer_try(pirate_pacer_t *pacer, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIRATE_PACING_H */
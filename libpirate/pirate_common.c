@@ -13,10 +13,19 @@
  * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
  */
 
+#define _GNU_SOURCE
+
 #include <errno.h>
+#include <libgen.h>
+#include <limits.h>
+#include <poll.h>
+#include <semaphore.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
 #include <sys/uio.h>
 #include "libpirate.h"
 #include "pirate_common.h"
@@ -35,10 +44,7 @@ static ssize_t pirate_stream_do_read(int fd, uint8_t *buf, size_t count) {
 }
 
 ssize_t pirate_stream_read(common_ctx *ctx, size_t min_tx, void *buf, size_t count) {
-    pirate_header_t *header = (pirate_header_t*) ctx->min_tx_buf;
     int fd = ctx->fd;
-    uint32_t packet_count;
-    size_t rx;
     ssize_t rv;
 
     if (fd < 0) {
@@ -50,6 +56,18 @@ ssize_t pirate_stream_read(common_ctx *ctx, size_t min_tx, void *buf, size_t cou
     if (rv <= 0) {
         return rv;
     }
+    return pirate_stream_read_body(ctx, min_tx, buf, count);
+}
+
+// Reads the remainder of a packet whose first min_tx bytes
+// have been read into ctx->min_tx_buf.
+ssize_t pirate_stream_read_body(common_ctx *ctx, size_t min_tx, void *buf, size_t count) {
+    pirate_header_t *header = (pirate_header_t*) ctx->min_tx_buf;
+    int fd = ctx->fd;
+    uint32_t packet_count;
+    size_t rx;
+    ssize_t rv;
+
     packet_count = ntohl(header->count);
     count = MIN(count, packet_count);
     size_t min_tx_data = MIN(count, min_tx - sizeof(pirate_header_t));
@@ -128,3 +146,145 @@ int pirate_parse_key_value(char **key, char **val, char *ptr, char **saveptr) {
     }
     return 1;
 }
+
+// Abort flag of the pirate_open_param_all() call that
+// is opening a channel on this thread, or NULL
+static __thread const int *pirate_open_abort_flag = NULL;
+
+void pirate_open_set_abort(const int *abort_flag) {
+    pirate_open_abort_flag = abort_flag;
+}
+
+int pirate_open_aborted(void) {
+    const int *abort_flag = pirate_open_abort_flag;
+
+    if ((abort_flag != NULL) && __atomic_load_n(abort_flag, __ATOMIC_ACQUIRE)) {
+        errno = ECANCELED;
+        return 1;
+    }
+    return 0;
+}
+
+// Sleeps for the current backoff interval and doubles the
+// interval for the next attempt. When jitter is nonzero the
+// sleep is drawn uniformly from [delay / 2, delay] so that
+// peers retrying in lockstep spread out.
+int pirate_open_backoff(long *delay_ns, int jitter) {
+    struct timespec req;
+    long delay = MAX(*delay_ns, PIRATE_OPEN_BACKOFF_MIN_NS);
+    long sleep_ns = delay;
+
+    if (pirate_open_aborted()) {
+        return -1;
+    }
+    if (jitter) {
+        sleep_ns = (delay / 2) + (rand() % ((delay / 2) + 1));
+    }
+    *delay_ns = MIN(delay * 2, PIRATE_OPEN_BACKOFF_MAX_NS);
+    req.tv_sec = sleep_ns / 1000000000L;
+    req.tv_nsec = sleep_ns % 1000000000L;
+    return nanosleep(&req, NULL);
+}
+
+// Waits for a file to be created at path. Returns when
+// an entry is created in the parent directory or when the
+// maximum backoff interval has elapsed, whichever comes first.
+// The caller is expected to retry its operation afterwards.
+// Falls back to pirate_open_backoff() if inotify is unavailable.
+int pirate_open_wait_path(const char *path, long *delay_ns) {
+    char dir[PATH_MAX];
+    struct pollfd pfd;
+    int err, fd, rv;
+
+    if (pirate_open_aborted()) {
+        return -1;
+    }
+    err = errno;
+    strncpy(dir, path, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = 0;
+
+    fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (fd < 0) {
+        errno = err;
+        return pirate_open_backoff(delay_ns, 0);
+    }
+    if (inotify_add_watch(fd, dirname(dir), IN_CREATE | IN_MOVED_TO) < 0) {
+        close(fd);
+        errno = err;
+        return pirate_open_backoff(delay_ns, 0);
+    }
+    // the path may have been created before the watch was added
+    if (access(path, F_OK) == 0) {
+        close(fd);
+        errno = err;
+        return 0;
+    }
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    rv = poll(&pfd, 1, PIRATE_OPEN_BACKOFF_MAX_NS / 1000000L);
+    if (rv < 0) {
+        err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    close(fd);
+    errno = err;
+    return 0;
+}
+
+int pirate_open_accept(int server_fd, struct sockaddr *addr, socklen_t *addrlen, int flags) {
+    struct pollfd pfd;
+    int rv;
+
+    if (pirate_open_abort_flag == NULL) {
+        return accept4(server_fd, addr, addrlen, flags);
+    }
+    pfd.fd = server_fd;
+    pfd.events = POLLIN;
+    for (;;) {
+        if (pirate_open_aborted()) {
+            return -1;
+        }
+        pfd.revents = 0;
+        rv = poll(&pfd, 1, PIRATE_OPEN_BACKOFF_MAX_NS / 1000000L);
+        if (rv > 0) {
+            return accept4(server_fd, addr, addrlen, flags);
+        } else if ((rv < 0) && (errno != EINTR)) {
+            return -1;
+        }
+    }
+}
+
+int pirate_open_sem_wait(sem_t *sem) {
+    struct timespec deadline;
+    int err = errno;
+
+    if (pirate_open_abort_flag == NULL) {
+        return sem_wait(sem);
+    }
+    for (;;) {
+        if (pirate_open_aborted()) {
+            return -1;
+        }
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += PIRATE_OPEN_BACKOFF_MAX_NS;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (sem_timedwait(sem, &deadline) == 0) {
+            errno = err;
+            return 0;
+        } else if ((errno != ETIMEDOUT) && (errno != EINTR)) {
+            return -1;
+        }
+    }
+}
+
+uint64_t pirate_monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
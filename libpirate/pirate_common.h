@@ -18,6 +18,8 @@
 
 #include "libpirate.h"
 
+#include <semaphore.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 
 #ifndef MIN
@@ -36,6 +38,11 @@ typedef struct {
     uint32_t count;
 } pirate_header_t;
 
+// Bounds of the exponential backoff used while waiting
+// for the other end of a channel to become available
+#define PIRATE_OPEN_BACKOFF_MIN_NS  1000000L
+#define PIRATE_OPEN_BACKOFF_MAX_NS  100000000L
+
 typedef struct {
     int flags;
     // exists for file descriptor channel types
@@ -45,10 +52,23 @@ typedef struct {
 } common_ctx;
 
 ssize_t pirate_stream_read(common_ctx *ctx, size_t min_tx, void *buf, size_t count);
+ssize_t pirate_stream_read_body(common_ctx *ctx, size_t min_tx, void *buf, size_t count);
 ssize_t pirate_stream_write(common_ctx *ctx, size_t min_tx, size_t write_mtu, const void *buf, size_t count);
 int pirate_parse_is_common_key(const char *key);
 int pirate_parse_key_value(char **key, char **val, char *ptr, char **saveptr);
 int pirate_next_gd();
+int pirate_open_backoff(long *delay_ns, int jitter);
+int pirate_open_wait_path(const char *path, long *delay_ns);
+
+// pirate_open_param_all() sets an abort flag for the threads that
+// open its channels and raises it when one of them fails. The waits
+// for a peer below then fail with ECANCELED instead of blocking on
+// a peer that will never arrive. Without a flag they block as usual.
+void pirate_open_set_abort(const int *abort_flag);
+int pirate_open_aborted(void);
+int pirate_open_accept(int server_fd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+int pirate_open_sem_wait(sem_t *sem);
+uint64_t pirate_monotonic_ns(void);
 
 #ifdef __cplusplus
 }
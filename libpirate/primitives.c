@@ -15,6 +15,7 @@
 
 #include <errno.h>
 #include <linux/limits.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -29,10 +30,12 @@
 #if HAVE_STD_ATOMIC
 #include <stdatomic.h>
 typedef atomic_int pirate_atomic_int;
-#define ATOMIC_DEC(PTR) atomic_fetch_sub(PTR, 1)
+#define ATOMIC_CAS(PTR, EXP, DES) atomic_compare_exchange_strong(PTR, EXP, DES)
+#define ATOMIC_STORE(PTR, VAL) atomic_store(PTR, VAL)
 #else
 typedef int pirate_atomic_int;
-#define ATOMIC_DEC(PTR) __atomic_fetch_sub(PTR, 1, __ATOMIC_SEQ_CST)
+#define ATOMIC_CAS(PTR, EXP, DES) __atomic_compare_exchange_n(PTR, EXP, DES, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(PTR, VAL) __atomic_store_n(PTR, VAL, __ATOMIC_SEQ_CST)
 #endif
 
 #include "libpirate.h"
@@ -49,8 +52,13 @@ typedef int pirate_atomic_int;
 #include "serial.h"
 #include "mercury.h"
 #include "ge_eth.h"
+#include "process_vm.h"
 #include "pirate_common.h"
 #include "channel_funcs.h"
+#include "fragment.h"
+#include "fec.h"
+#include "trace.h"
+#include "stats_segment.h"
 
 typedef union {
     common_ctx         common;
@@ -66,18 +74,30 @@ typedef union {
     serial_ctx         serial;
     mercury_ctx        mercury;
     ge_eth_ctx         ge_eth;
+    process_vm_ctx     process_vm;
 } pirate_channel_ctx_t;
 
 typedef struct {
     pirate_channel_param_t param;
     pirate_channel_ctx_t ctx;
+    pirate_fragment_ctx_t *fragment;
+    pirate_fec_ctx_t *fec;
 } pirate_channel_t;
 
 static pirate_channel_t gaps_channels[PIRATE_NUM_CHANNELS];
-static pirate_stats_t gaps_stats[PIRATE_NUM_CHANNELS];
-
 static pirate_channel_t gaps_nofd_channels[PIRATE_NUM_CHANNELS];
-static pirate_stats_t gaps_nofd_stats[PIRATE_NUM_CHANNELS];
+
+// Statistics of the channels with a file descriptor followed by the
+// channels without one. gaps_stats points into the shared memory
+// segment once the statistics have been published. Segments are never
+// unmapped, since calls in progress may still update them.
+static pirate_stats_t gaps_stats_local[PIRATE_STATS_SEGMENT_SLOTS];
+static pirate_stats_t *gaps_stats = gaps_stats_local;
+static pirate_stats_segment_t *gaps_stats_segment = NULL;
+static int gaps_stats_fd = -1;
+static int gaps_stats_forked = 0;
+static pthread_once_t gaps_stats_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t gaps_stats_lock = PTHREAD_MUTEX_INITIALIZER;
 
 #define PIRATE_NOFD_CHANNELS_LIMIT (-PIRATE_NUM_CHANNELS - 2)
 
@@ -94,7 +114,37 @@ static const pirate_channel_funcs_t gaps_channel_funcs[PIRATE_CHANNEL_TYPE_COUNT
     PIRATE_UIO_CHANNEL_FUNCS,
     PIRATE_SERIAL_CHANNEL_FUNCS,
     PIRATE_MERCURY_CHANNEL_FUNCS,
-    PIRATE_GE_ETH_CHANNEL_FUNCS
+    PIRATE_GE_ETH_CHANNEL_FUNCS,
+    PIRATE_PROCESS_VM_CHANNEL_FUNCS
+};
+
+// Channel types that can write several messages in one call
+static const pirate_write_batch_t gaps_channel_write_batch[PIRATE_CHANNEL_TYPE_COUNT] = {
+    [UDP_SOCKET] = pirate_udp_socket_write_batch,
+    [GE_ETH] = pirate_ge_eth_write_batch,
+};
+
+// Channel types that verify the integrity of received messages
+static const pirate_dropped_t gaps_channel_dropped[PIRATE_CHANNEL_TYPE_COUNT] = {
+    [SERIAL] = pirate_serial_dropped,
+    [GE_ETH] = pirate_ge_eth_dropped,
+};
+
+// Channel types with a shared memory ring
+static const pirate_occupancy_t gaps_channel_occupancy[PIRATE_CHANNEL_TYPE_COUNT] = {
+#ifdef PIRATE_SHMEM_FEATURE
+    [SHMEM] = shmem_buffer_occupancy,
+    [UDP_SHMEM] = udp_shmem_buffer_occupancy,
+    [UIO_DEVICE] = pirate_internal_uio_occupancy,
+#endif
+};
+
+static const pirate_get_ring_stats_t gaps_channel_ring_stats[PIRATE_CHANNEL_TYPE_COUNT] = {
+#ifdef PIRATE_SHMEM_FEATURE
+    [SHMEM] = shmem_buffer_ring_stats,
+    [UDP_SHMEM] = udp_shmem_buffer_ring_stats,
+    [UIO_DEVICE] = pirate_internal_uio_ring_stats,
+#endif
 };
 
 int pirate_close_channel(pirate_channel_t *channel);
@@ -133,7 +183,7 @@ void pirate_init_channel_param(channel_enum_t channel_type, pirate_channel_param
     param->channel_type = channel_type;
 }
 
-static const char* pirate_common_keys[] = {"drop", NULL};
+static const char* pirate_common_keys[] = {"drop", "fragment", "fec_k", "fec_m", NULL};
 
 int pirate_parse_is_common_key(const char *key) {
     for (int i = 0; pirate_common_keys[i] != NULL; i++) {
@@ -147,6 +197,22 @@ int pirate_parse_is_common_key(const char *key) {
 static int pirate_parse_common_kv(const char *key, const char *val, pirate_channel_param_t *param) {
     if (strncmp("drop", key, strlen("drop")) == 0) {
         param->drop = atoi(val);
+    } else if (strncmp("fragment", key, strlen("fragment")) == 0) {
+        param->fragment = strtoul(val, NULL, 10);
+    } else if (strncmp("fec_k", key, strlen("fec_k")) == 0) {
+        unsigned long fec_k = strtoul(val, NULL, 10);
+        if (fec_k > PIRATE_FEC_MAX_SYMBOLS) {
+            errno = EINVAL;
+            return -1;
+        }
+        param->fec_k = fec_k;
+    } else if (strncmp("fec_m", key, strlen("fec_m")) == 0) {
+        unsigned long fec_m = strtoul(val, NULL, 10);
+        if (fec_m > PIRATE_FEC_MAX_SYMBOLS) {
+            errno = EINVAL;
+            return -1;
+        }
+        param->fec_m = fec_m;
     }
     return 0;
 }
@@ -227,6 +293,8 @@ int pirate_parse_channel_param(const char *str, pirate_channel_param_t *param) {
         param->channel_type = MERCURY;
     } else if (strncmp("ge_eth", opt, strlen("ge_eth")) == 0) {
         param->channel_type = GE_ETH;
+    } else if (strncmp("process_vm", opt, strlen("process_vm")) == 0) {
+        param->channel_type = PROCESS_VM;
     }
 
     if (pirate_channel_type_valid(param->channel_type) != 0) {
@@ -254,11 +322,8 @@ int pirate_get_channel_param(int gd, pirate_channel_param_t *param) {
 }
 
 pirate_stats_t *pirate_get_stats_internal(int gd) {
-    if (gd >= 0) {
-        return &gaps_stats[gd];
-    } else {
-        return &gaps_nofd_stats[-gd - 2];
-    }
+    pirate_stats_t *stats = __atomic_load_n(&gaps_stats, __ATOMIC_RELAXED);
+    return &stats[pirate_stats_segment_index(gd)];
 }
 
 const pirate_stats_t *pirate_get_stats(int gd) {
@@ -295,17 +360,220 @@ int pirate_get_channel_description(int gd, char *desc, int len) {
     return pirate_unparse_channel_param(&channel->param, desc, len);
 }
 
-static pirate_atomic_int next_gd = -2;
+// Clears the statistics of a gaps descriptor that is being reused
+static void pirate_stats_reset(int gd) {
+    memset(pirate_get_stats_internal(gd), 0, sizeof(pirate_stats_t));
+}
+
+// gaps descriptors of channels without a file descriptor
+// are reused after they are closed
+static pirate_atomic_int gaps_nofd_busy[PIRATE_NUM_CHANNELS];
 
 int pirate_next_gd() {
-    int next = ATOMIC_DEC(&next_gd);
-    return next;
+    for (int i = 0; i < PIRATE_NUM_CHANNELS; i++) {
+        int expected = 0;
+        if (ATOMIC_CAS(&gaps_nofd_busy[i], &expected, 1)) {
+            // clear what the previous channel left in the slot
+            memset(&gaps_nofd_channels[i], 0, sizeof(pirate_channel_t));
+            pirate_stats_reset(-i - 2);
+            return -i - 2;
+        }
+    }
+    return PIRATE_NOFD_CHANNELS_LIMIT;
+}
+
+static void pirate_release_gd(int gd) {
+    if ((gd < -1) && (gd > PIRATE_NOFD_CHANNELS_LIMIT)) {
+        ATOMIC_STORE(&gaps_nofd_busy[-gd - 2], 0);
+    }
 }
 
 // Declared in libpirate_internal.h for testing purposes only
 void pirate_reset_stats() {
-    memset(gaps_stats, 0, sizeof(gaps_stats));
-    memset(gaps_nofd_stats, 0, sizeof(gaps_nofd_stats));
+    memset(gaps_stats, 0, sizeof(gaps_stats_local));
+}
+
+static void pirate_stats_describe(pirate_stats_segment_t *segment, int gd,
+    const pirate_channel_t *channel) {
+    char desc[PIRATE_STATS_DESCRIPTION_LEN];
+
+    if (pirate_unparse_channel_param(&channel->param, desc, sizeof(desc)) < 0) {
+        desc[0] = '\0';
+    }
+    pirate_stats_segment_update(segment, gd, channel->ctx.common.flags, desc);
+}
+
+// Must be called with gaps_stats_lock held
+static int pirate_stats_start(void) {
+    pirate_stats_segment_t *segment;
+    int fd;
+
+    if (gaps_stats_segment != NULL) {
+        return 0;
+    }
+    segment = pirate_stats_segment_create(gaps_stats, &fd);
+    if (segment == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < PIRATE_NUM_CHANNELS; i++) {
+        if (gaps_channels[i].param.channel_type != INVALID) {
+            pirate_stats_describe(segment, i, &gaps_channels[i]);
+        }
+        if (gaps_nofd_channels[i].param.channel_type != INVALID) {
+            pirate_stats_describe(segment, -i - 2, &gaps_nofd_channels[i]);
+        }
+    }
+    gaps_stats_fd = fd;
+    __atomic_store_n(&gaps_stats_segment, segment, __ATOMIC_RELEASE);
+    __atomic_store_n(&gaps_stats, segment->stats, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Must be called with gaps_stats_lock held. The statistics
+// stay in the unlinked segment.
+static void pirate_stats_stop(void) {
+    pirate_stats_segment_t *segment = gaps_stats_segment;
+
+    if (segment == NULL) {
+        return;
+    }
+    __atomic_store_n(&gaps_stats_segment, NULL, __ATOMIC_RELEASE);
+    pirate_stats_segment_unlink(segment);
+    close(gaps_stats_fd);
+    gaps_stats_fd = -1;
+}
+
+// The child publishes its own segment on its next call into
+// the library, since the fork handler must be async-signal-safe.
+// Must be called with gaps_stats_lock held.
+static void pirate_stats_refork(void) {
+    if (gaps_stats_forked) {
+        __atomic_store_n(&gaps_stats_forked, 0, __ATOMIC_RELAXED);
+        pirate_stats_start();
+    }
+}
+
+static void pirate_stats_atexit(void) {
+    pthread_mutex_lock(&gaps_stats_lock);
+    if (gaps_stats_segment != NULL) {
+        pirate_stats_segment_unlink(gaps_stats_segment);
+    }
+    pthread_mutex_unlock(&gaps_stats_lock);
+}
+
+// The child stops updating the segment of the parent
+static void pirate_stats_atfork_child(void) {
+    pthread_mutex_init(&gaps_stats_lock, NULL);
+    if (gaps_stats != gaps_stats_local) {
+        memcpy(gaps_stats_local, gaps_stats, sizeof(gaps_stats_local));
+        gaps_stats = gaps_stats_local;
+    }
+    if (gaps_stats_segment != NULL) {
+        // the inherited descriptor shares the lock of the parent
+        close(gaps_stats_fd);
+        gaps_stats_fd = -1;
+        gaps_stats_segment = NULL;
+        gaps_stats_forked = 1;
+    }
+}
+
+static int gaps_stats_registered = 0;
+
+static int pirate_stats_register(void) {
+    if (!gaps_stats_registered) {
+        if ((atexit(pirate_stats_atexit) != 0) ||
+            (pthread_atfork(NULL, NULL, pirate_stats_atfork_child) != 0)) {
+            errno = ENOMEM;
+            return -1;
+        }
+        gaps_stats_registered = 1;
+    }
+    return 0;
+}
+
+static void pirate_stats_env(void) {
+    const char *publish = getenv("PIRATE_STATS_PUBLISH");
+
+    if ((publish == NULL) || (*publish == '\0') || (strcmp(publish, "0") == 0)) {
+        return;
+    }
+    pthread_mutex_lock(&gaps_stats_lock);
+    if (pirate_stats_register() == 0) {
+        pirate_stats_start();
+    }
+    pthread_mutex_unlock(&gaps_stats_lock);
+}
+
+int pirate_stats_publish(int enable) {
+    int rv = 0;
+
+    pthread_once(&gaps_stats_once, pirate_stats_env);
+    pthread_mutex_lock(&gaps_stats_lock);
+    __atomic_store_n(&gaps_stats_forked, 0, __ATOMIC_RELAXED);
+    if (!enable) {
+        pirate_stats_stop();
+    } else if ((rv = pirate_stats_register()) == 0) {
+        rv = pirate_stats_start();
+    }
+    pthread_mutex_unlock(&gaps_stats_lock);
+    return rv;
+}
+
+static void pirate_stats_open(int gd, const pirate_channel_t *channel) {
+    pirate_stats_segment_t *segment;
+
+    pthread_once(&gaps_stats_once, pirate_stats_env);
+    pthread_mutex_lock(&gaps_stats_lock);
+    pirate_stats_refork();
+    if ((segment = gaps_stats_segment) != NULL) {
+        pirate_stats_describe(segment, gd, channel);
+    }
+    pthread_mutex_unlock(&gaps_stats_lock);
+}
+
+static void pirate_stats_close(int gd) {
+    pirate_stats_segment_t *segment;
+
+    pthread_mutex_lock(&gaps_stats_lock);
+    pirate_stats_refork();
+    if ((segment = gaps_stats_segment) != NULL) {
+        pirate_stats_segment_update(segment, gd, 0, NULL);
+    }
+    pthread_mutex_unlock(&gaps_stats_lock);
+}
+
+// Refreshes the fill level of a shared memory ring in the segment
+static inline void pirate_stats_occupancy(int gd, pirate_channel_t *channel) {
+    pirate_stats_segment_t *segment;
+    pirate_occupancy_t occupancy_func = gaps_channel_occupancy[channel->param.channel_type];
+
+    if (__builtin_expect(__atomic_load_n(&gaps_stats_forked, __ATOMIC_RELAXED), 0)) {
+        pthread_mutex_lock(&gaps_stats_lock);
+        pirate_stats_refork();
+        pthread_mutex_unlock(&gaps_stats_lock);
+    }
+    segment = __atomic_load_n(&gaps_stats_segment, __ATOMIC_ACQUIRE);
+    if ((segment != NULL) && (occupancy_func != NULL)) {
+        pirate_stats_slot_t *slot = &segment->slot[pirate_stats_segment_index(gd)];
+        occupancy_func(&channel->ctx, &slot->queued, &slot->capacity);
+    }
+}
+
+// Forward error correction needs channels that keep the message
+// boundaries of each symbol. Lost symbols are what it recovers.
+static int pirate_datagram_channel(const pirate_channel_param_t *param) {
+    switch (param->channel_type) {
+    case UDP_SOCKET:
+    case UDP_SHMEM:
+    case GE_ETH:
+    case UNIX_SEQPACKET:
+    case MERCURY:
+        return 1;
+    case SERIAL:
+        return param->channel.serial.cobs != 0;
+    default:
+        return 0;
+    }
 }
 
 static int pirate_open(pirate_channel_t *channel) {
@@ -315,6 +583,10 @@ static int pirate_open(pirate_channel_t *channel) {
     int nonblock = channel->ctx.common.flags & O_NONBLOCK;
     ssize_t mtu;
     pirate_open_t open_func;
+    int gd;
+
+    channel->fragment = NULL;
+    channel->fec = NULL;
 
     if ((access != O_RDONLY) && (access != O_WRONLY)) {
         errno = EINVAL;
@@ -335,26 +607,53 @@ static int pirate_open(pirate_channel_t *channel) {
         return -1;
     }
 
+    if (((param->fec_k > 0) || (param->fec_m > 0)) &&
+        ((param->fec_k == 0) || (param->fec_m == 0) ||
+        ((param->fec_k + param->fec_m) > PIRATE_FEC_MAX_SYMBOLS) ||
+        !pirate_datagram_channel(param))) {
+        errno = EINVAL;
+        return -1;
+    }
+
     open_func = gaps_channel_funcs[param->channel_type].open;
     if (open_func == NULL) {
         errno = ESOCKTNOSUPPORT;
         return -1;
     }
 
-    return open_func(&param->channel, ctx);
-}
+    gd = open_func(&param->channel, ctx);
+    if (gd == -1) {
+        return gd;
+    }
 
-// gaps descriptors must be opened from smallest to largest
-int pirate_open_param(pirate_channel_param_t *param, int flags) {
-    pirate_channel_t channel;
-    int gd;
+    if ((param->fec_k > 0) || (param->fec_m > 0)) {
+        channel->fec = pirate_fec_create(param->fec_k, param->fec_m, mtu, access);
+        if (channel->fec == NULL) {
+            goto error;
+        }
+        mtu = pirate_fec_write_mtu(channel->fec);
+    }
 
-    memcpy(&channel.param, param, sizeof(pirate_channel_param_t));
-    channel.ctx.common.flags = flags;
+    if (param->fragment > 0) {
+        channel->fragment = pirate_fragment_create(param->fragment, mtu, access);
+        if (channel->fragment == NULL) {
+            goto error;
+        }
+    }
+    return gd;
+error:
+    {
+        int err = errno;
+        pirate_close_channel(channel);
+        pirate_release_gd(gd);
+        errno = err;
+    }
+    return -1;
+}
 
-    gd = pirate_open(&channel);
+static int pirate_register_channel(pirate_channel_t *channel, int gd) {
     if ((gd >= PIRATE_NUM_CHANNELS) || (gd <= PIRATE_NOFD_CHANNELS_LIMIT)) {
-        pirate_close_channel(&channel);
+        pirate_close_channel(channel);
         errno = EMFILE;
         return -1;
     }
@@ -363,13 +662,28 @@ int pirate_open_param(pirate_channel_param_t *param, int flags) {
     }
 
     if (gd >= 0) {
-        memcpy(&gaps_channels[gd], &channel, sizeof(pirate_channel_t));
+        // the kernel reuses the numbers of closed file descriptors
+        pirate_stats_reset(gd);
+        memcpy(&gaps_channels[gd], channel, sizeof(pirate_channel_t));
     } else {
-        memcpy(&gaps_nofd_channels[-gd - 2], &channel, sizeof(pirate_channel_t));
+        memcpy(&gaps_nofd_channels[-gd - 2], channel, sizeof(pirate_channel_t));
     }
+    pirate_trace_open(gd, &channel->param);
+    pirate_stats_open(gd, channel);
     return gd;
 }
 
+int pirate_open_param(pirate_channel_param_t *param, int flags) {
+    pirate_channel_t channel;
+    int gd;
+
+    memcpy(&channel.param, param, sizeof(pirate_channel_param_t));
+    channel.ctx.common.flags = flags;
+
+    gd = pirate_open(&channel);
+    return pirate_register_channel(&channel, gd);
+}
+
 int pirate_open_parse(const char *param, int flags) {
     pirate_channel_param_t vals;
 
@@ -380,6 +694,167 @@ int pirate_open_parse(const char *param, int flags) {
     return pirate_open_param(&vals, flags);
 }
 
+typedef struct {
+    pirate_channel_t channel;
+    pthread_t thread;
+    int *abort_flag;
+    int started;
+    int gd;
+    int err;
+} pirate_open_job_t;
+
+// A failed open raises the abort flag so that the other jobs
+// stop waiting for peers that may never be opened.
+static void *pirate_open_job(void *arg) {
+    pirate_open_job_t *job = (pirate_open_job_t *) arg;
+
+    errno = 0;
+    pirate_open_set_abort(job->abort_flag);
+    job->gd = pirate_open(&job->channel);
+    job->err = errno;
+    pirate_open_set_abort(NULL);
+    if (job->gd == -1) {
+        __atomic_store_n(job->abort_flag, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+int pirate_open_param_all(pirate_channel_param_t *params, const int *flags, int *gds, int count) {
+    pirate_open_job_t *jobs;
+    int i, err = 0, abort_flag = 0;
+
+    if ((count < 0) || (count > (2 * PIRATE_NUM_CHANNELS))) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        gds[i] = -1;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    if ((jobs = calloc(count, sizeof(pirate_open_job_t))) == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        memcpy(&jobs[i].channel.param, &params[i], sizeof(pirate_channel_param_t));
+        jobs[i].channel.ctx.common.flags = flags[i];
+        jobs[i].abort_flag = &abort_flag;
+        jobs[i].gd = -1;
+    }
+    for (i = 0; i < count; i++) {
+        if (pthread_create(&jobs[i].thread, NULL, pirate_open_job, &jobs[i]) == 0) {
+            jobs[i].started = 1;
+        } else {
+            // Opening inline preserves progress as long as the
+            // peer of this channel was started on its own thread.
+            pirate_open_job(&jobs[i]);
+        }
+    }
+    for (i = 0; i < count; i++) {
+        if (jobs[i].started) {
+            pthread_join(jobs[i].thread, NULL);
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (jobs[i].gd == -1) {
+            // report the failure that aborted the other jobs
+            if ((err == 0) || (err == ECANCELED)) {
+                err = jobs[i].err;
+            }
+            continue;
+        }
+        gds[i] = pirate_register_channel(&jobs[i].channel, jobs[i].gd);
+        if ((gds[i] == -1) && (err == 0)) {
+            err = errno;
+        }
+    }
+
+    if (err != 0) {
+        for (i = 0; i < count; i++) {
+            if (gds[i] != -1) {
+                pirate_close(gds[i]);
+                gds[i] = -1;
+            }
+        }
+    }
+
+    free(jobs);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int pirate_open_parse_all(const char **params, const int *flags, int *gds, int count) {
+    pirate_channel_param_t *vals;
+    int i, rv;
+
+    if ((count < 0) || (count > (2 * PIRATE_NUM_CHANNELS))) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        gds[i] = -1;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    if ((vals = calloc(count, sizeof(pirate_channel_param_t))) == NULL) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if (pirate_parse_channel_param(params[i], &vals[i]) < 0) {
+            free(vals);
+            return -1;
+        }
+    }
+
+    rv = pirate_open_param_all(vals, flags, gds, count);
+    free(vals);
+    return rv;
+}
+
+int pirate_open_parse_reader_group(const char *param, int *gds, int count) {
+    pirate_channel_param_t vals;
+    int i, err;
+
+    if ((count <= 0) || (count > PIRATE_NUM_CHANNELS)) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        gds[i] = -1;
+    }
+    if (pirate_parse_channel_param(param, &vals) < 0) {
+        return -1;
+    }
+    if (vals.channel_type != UDP_SOCKET) {
+        errno = EINVAL;
+        return -1;
+    }
+    vals.channel.udp_socket.shards = count;
+    // Shards are opened in order. The kernel numbers the
+    // sockets of a reuseport group in the order they bind.
+    for (i = 0; i < count; i++) {
+        pirate_channel_param_t shard = vals;
+        if ((gds[i] = pirate_open_param(&shard, O_RDONLY)) < 0) {
+            err = errno;
+            for (int j = 0; j < i; j++) {
+                pirate_close(gds[j]);
+                gds[j] = -1;
+            }
+            gds[i] = -1;
+            errno = err;
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int pirate_nonblock_channel_type(channel_enum_t channel_type, size_t mtu) {
     switch (channel_type) {
     case UDP_SOCKET:
@@ -396,10 +871,17 @@ int pirate_nonblock_channel_type(channel_enum_t channel_type, size_t mtu) {
 int pirate_close(int gd) {
     pirate_channel_t *channel;
 
+    int rv;
+
     if ((channel = pirate_get_channel(gd)) == NULL) {
         return -1;
     }
-    return pirate_close_channel(channel);
+    rv = pirate_close_channel(channel);
+    if (rv >= 0) {
+        pirate_stats_close(gd);
+        pirate_release_gd(gd);
+    }
+    return rv;
 }
 
 int pirate_close_channel(pirate_channel_t *channel) {
@@ -421,11 +903,34 @@ int pirate_close_channel(pirate_channel_t *channel) {
     if (rv < 0) {
         return rv;
     }
+    pirate_fragment_destroy(channel->fragment);
+    channel->fragment = NULL;
+    pirate_fec_destroy(channel->fec);
+    channel->fec = NULL;
     channel->param.channel_type = INVALID;
     return rv;
 }
 
-ssize_t pirate_read(int gd, void *buf, size_t count) {
+// Adaptors that let the fragment layer write and read through
+// the forward error correction layer. The context is the channel.
+static ssize_t pirate_fec_channel_read(const void *param, void *ctx, void *buf, size_t count) {
+    pirate_channel_t *channel = (pirate_channel_t*) ctx;
+    (void) param;
+    return pirate_fec_read(channel->fec,
+        gaps_channel_funcs[channel->param.channel_type].read,
+        &channel->param.channel, &channel->ctx, buf, count);
+}
+
+static ssize_t pirate_fec_channel_write(const void *param, void *ctx, const void *buf, size_t count) {
+    pirate_channel_t *channel = (pirate_channel_t*) ctx;
+    (void) param;
+    return pirate_fec_write(channel->fec,
+        gaps_channel_funcs[channel->param.channel_type].write,
+        gaps_channel_write_batch[channel->param.channel_type],
+        &channel->param.channel, &channel->ctx, buf, count);
+}
+
+static ssize_t pirate_read_channel(int gd, void *buf, size_t count) {
     pirate_channel_t *channel = NULL;
     ssize_t rv;
     pirate_read_t read_func;
@@ -455,7 +960,22 @@ ssize_t pirate_read(int gd, void *buf, size_t count) {
 
     stats->requests += 1;
 
-    rv = read_func(&param->channel, &channel->ctx, buf, count);
+    if (channel->fec != NULL) {
+        if (channel->fragment != NULL) {
+            rv = pirate_fragment_read(channel->fragment, pirate_fec_channel_read,
+                NULL, channel, buf, count);
+        } else {
+            rv = pirate_fec_channel_read(NULL, channel, buf, count);
+        }
+    } else if (channel->fragment != NULL) {
+        rv = pirate_fragment_read(channel->fragment, read_func,
+            &param->channel, &channel->ctx, buf, count);
+    } else {
+        rv = read_func(&param->channel, &channel->ctx, buf, count);
+    }
+    if (gaps_channel_dropped[param->channel_type] != NULL) {
+        stats->dropped = gaps_channel_dropped[param->channel_type](&channel->ctx);
+    }
     if (rv < 0) {
         if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
             stats->errs += 1;
@@ -464,10 +984,11 @@ ssize_t pirate_read(int gd, void *buf, size_t count) {
         stats->success += 1;
         stats->bytes += rv;
     }
+    pirate_stats_occupancy(gd, channel);
     return rv;
 }
 
-ssize_t pirate_write(int gd, const void *buf, size_t count) {
+static ssize_t pirate_write_channel(int gd, const void *buf, size_t count) {
     pirate_channel_t *channel = NULL;
     ssize_t rv;
     pirate_write_t write_func;
@@ -502,7 +1023,20 @@ ssize_t pirate_write(int gd, const void *buf, size_t count) {
         stats->requests += 1;
     }
 
-    rv = write_func(&param->channel, &channel->ctx, buf, count);
+    if (channel->fec != NULL) {
+        if (channel->fragment != NULL) {
+            rv = pirate_fragment_write(channel->fragment, pirate_fec_channel_write,
+                NULL, NULL, channel, buf, count);
+        } else {
+            rv = pirate_fec_channel_write(NULL, channel, buf, count);
+        }
+    } else if (channel->fragment != NULL) {
+        rv = pirate_fragment_write(channel->fragment, write_func,
+            gaps_channel_write_batch[param->channel_type],
+            &param->channel, &channel->ctx, buf, count);
+    } else {
+        rv = write_func(&param->channel, &channel->ctx, buf, count);
+    }
 
     if (rv < 0) {
         if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
@@ -512,10 +1046,66 @@ ssize_t pirate_write(int gd, const void *buf, size_t count) {
         stats->success += 1;
         stats->bytes += rv;
     }
+    pirate_stats_occupancy(gd, channel);
 
     return rv;
 }
 
+ssize_t pirate_read(int gd, void *buf, size_t count) {
+    uint64_t start;
+    ssize_t rv;
+
+    if (!pirate_trace_active()) {
+        return pirate_read_channel(gd, buf, count);
+    }
+    start = pirate_trace_clock();
+    rv = pirate_read_channel(gd, buf, count);
+    pirate_trace_record(PIRATE_TRACE_READ, gd, count, rv, start);
+    return rv;
+}
+
+ssize_t pirate_write(int gd, const void *buf, size_t count) {
+    uint64_t start;
+    ssize_t rv;
+
+    if (!pirate_trace_active()) {
+        return pirate_write_channel(gd, buf, count);
+    }
+    start = pirate_trace_clock();
+    rv = pirate_write_channel(gd, buf, count);
+    pirate_trace_record(PIRATE_TRACE_WRITE, gd, count, rv, start);
+    return rv;
+}
+
+double pirate_serial_link_utilization(int gd) {
+    pirate_channel_t *channel = NULL;
+
+    if ((channel = pirate_get_channel(gd)) == NULL) {
+        return -1;
+    }
+    if (channel->param.channel_type != SERIAL) {
+        errno = EINVAL;
+        return -1;
+    }
+    return pirate_serial_utilization(&channel->param.channel.serial, &channel->ctx.serial);
+}
+
+int pirate_get_ring_stats(int gd, pirate_ring_stats_t *stats) {
+    pirate_channel_t *channel = NULL;
+    pirate_get_ring_stats_t ring_stats_func;
+
+    if ((channel = pirate_get_channel(gd)) == NULL) {
+        return -1;
+    }
+    ring_stats_func = gaps_channel_ring_stats[channel->param.channel_type];
+    if (ring_stats_func == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    ring_stats_func(&channel->ctx, stats);
+    return 0;
+}
+
 ssize_t pirate_write_mtu_estimate(const pirate_channel_param_t *param) {
     pirate_write_mtu_t write_mtu_func;
     if (pirate_channel_type_valid(param->channel_type) != 0) {
@@ -543,6 +1133,14 @@ ssize_t pirate_write_mtu(int gd) {
 
     param = &channel->param;
 
+    if (channel->fragment != NULL) {
+        return channel->fragment->max_len;
+    }
+
+    if (channel->fec != NULL) {
+        return pirate_fec_write_mtu(channel->fec);
+    }
+
     if (pirate_channel_type_valid(param->channel_type) != 0) {
         return -1;
     }
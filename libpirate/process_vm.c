@@ -0,0 +1,547 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "pirate_common.h"
+#include "process_vm.h"
+
+#define SPIN_ITERATIONS 100000
+
+// PR_SET_PTRACER names one process for the whole calling process
+// and each call replaces the previous one. The writers of a process
+// therefore serve at most one reader process at a time. Readers in
+// the writer's own process need no permission.
+static pthread_mutex_t process_vm_ptracer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pid_t process_vm_ptracer = 0;
+static unsigned process_vm_ptracer_refs = 0;
+
+static int process_vm_ptracer_get(pid_t reader_pid) {
+    int err, rv = 0;
+
+    if (reader_pid == getpid()) {
+        return 0;
+    }
+    pthread_mutex_lock(&process_vm_ptracer_lock);
+    if (process_vm_ptracer_refs == 0) {
+        // Allow the reader to use process_vm_readv() when
+        // the Yama ptrace scope is restricted. Fails with
+        // EINVAL when Yama is not enabled.
+        err = errno;
+        prctl(PR_SET_PTRACER, (unsigned long) reader_pid, 0, 0, 0);
+        errno = err;
+        process_vm_ptracer = reader_pid;
+    } else if (process_vm_ptracer != reader_pid) {
+        errno = EBUSY;
+        rv = -1;
+    }
+    if (rv == 0) {
+        process_vm_ptracer_refs++;
+    }
+    pthread_mutex_unlock(&process_vm_ptracer_lock);
+    return rv;
+}
+
+static void process_vm_ptracer_put(pid_t reader_pid) {
+    int err;
+
+    if ((reader_pid == 0) || (reader_pid == getpid())) {
+        return;
+    }
+    pthread_mutex_lock(&process_vm_ptracer_lock);
+    if (--process_vm_ptracer_refs == 0) {
+        err = errno;
+        prctl(PR_SET_PTRACER, 0, 0, 0, 0);
+        errno = err;
+        process_vm_ptracer = 0;
+    }
+    pthread_mutex_unlock(&process_vm_ptracer_lock);
+}
+
+static inline process_vm_entry_t *ring_entries(process_vm_ring_t *ring) {
+    return (process_vm_entry_t*)(ring + 1);
+}
+
+static inline size_t ring_alloc_size(unsigned ring_len) {
+    return sizeof(process_vm_ring_t) + ring_len * sizeof(process_vm_entry_t);
+}
+
+static process_vm_ring_t *process_vm_ring_init(int fd, unsigned ring_len) {
+    int err, rv;
+    int success = 0;
+    process_vm_ring_t *ring = NULL;
+    pthread_mutexattr_t mutex_attr;
+    pthread_condattr_t cond_attr;
+
+    const size_t alloc_size = ring_alloc_size(ring_len);
+    if ((rv = ftruncate(fd, alloc_size)) != 0) {
+        err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+
+    ring = (process_vm_ring_t *)mmap(NULL, alloc_size,
+        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (ring == MAP_FAILED) {
+        err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+
+    close(fd);
+    fd = -1;
+
+    while (!success) {
+        uint64_t init = atomic_load(&ring->init);
+        switch (init) {
+
+        case 0:
+            if (atomic_compare_exchange_weak(&ring->init, &init, 1)) {
+                success = 1;
+            }
+            break;
+
+        case 1:
+            // wait for initialization
+            break;
+
+        case 2:
+            return ring;
+
+        default:
+            munmap(ring, alloc_size);
+            return NULL;
+        }
+    }
+
+    ring->ring_len = ring_len;
+
+    if ((rv = sem_init(&ring->reader_open_wait, 1, 0)) != 0) {
+        goto error;
+    }
+
+    if ((rv = sem_init(&ring->writer_open_wait, 1, 0)) != 0) {
+        goto error;
+    }
+
+    if ((rv = pthread_mutexattr_init(&mutex_attr)) != 0) {
+        errno = rv;
+        goto error;
+    }
+
+    if ((rv = pthread_mutexattr_setpshared(&mutex_attr,
+                                         PTHREAD_PROCESS_SHARED)) != 0) {
+        errno = rv;
+        goto error;
+    }
+
+    if ((rv = pthread_mutex_init(&ring->mutex, &mutex_attr)) != 0) {
+        errno = rv;
+        goto error;
+    }
+
+    if ((rv = pthread_condattr_init(&cond_attr)) != 0) {
+        errno = rv;
+        goto error;
+    }
+
+    if ((rv = pthread_condattr_setpshared(&cond_attr,
+                                        PTHREAD_PROCESS_SHARED)) != 0) {
+        errno = rv;
+        goto error;
+    }
+
+    if ((rv = pthread_cond_init(&ring->is_not_empty, &cond_attr)) != 0) {
+        errno = rv;
+        goto error;
+    }
+
+    if ((rv = pthread_cond_init(&ring->is_not_full, &cond_attr)) != 0) {
+        errno = rv;
+        goto error;
+    }
+
+    atomic_store(&ring->init, 2);
+    return ring;
+error:
+    err = errno;
+    atomic_store(&ring->init, 0);
+    munmap(ring, alloc_size);
+    errno = err;
+    return NULL;
+}
+
+static void pirate_process_vm_init_param(pirate_process_vm_param_t *param) {
+    if (param->ring_len == 0) {
+        param->ring_len = PIRATE_DEFAULT_PROCESS_VM_RING_LEN;
+    }
+}
+
+int pirate_process_vm_parse_param(char *str, void *_param) {
+    pirate_process_vm_param_t *param = (pirate_process_vm_param_t *)_param;
+    char *ptr = NULL, *key, *val;
+    char *saveptr1, *saveptr2;
+
+    if (((ptr = strtok_r(str, OPT_DELIM, &saveptr1)) == NULL) ||
+        (strcmp(ptr, "process_vm") != 0)) {
+        return -1;
+    }
+
+    if ((ptr = strtok_r(NULL, OPT_DELIM, &saveptr1)) == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    strncpy(param->path, ptr, sizeof(param->path) - 1);
+
+    while ((ptr = strtok_r(NULL, OPT_DELIM, &saveptr1)) != NULL) {
+        int rv = pirate_parse_key_value(&key, &val, ptr, &saveptr2);
+        if (rv < 0) {
+            return rv;
+        } else if (rv == 0) {
+            continue;
+        }
+        if (strncmp("ring_len", key, strlen("ring_len")) == 0) {
+            param->ring_len = strtol(val, NULL, 10);
+        } else if (strncmp("mtu", key, strlen("mtu")) == 0) {
+            param->mtu = strtol(val, NULL, 10);
+        } else {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int pirate_process_vm_get_channel_description(const void *_param, char *desc, int len) {
+    const pirate_process_vm_param_t *param = (const pirate_process_vm_param_t *)_param;
+    char ring_len_str[32];
+    char mtu_str[32];
+
+    ring_len_str[0] = 0;
+    mtu_str[0] = 0;
+    if ((param->ring_len != 0) && (param->ring_len != PIRATE_DEFAULT_PROCESS_VM_RING_LEN)) {
+        snprintf(ring_len_str, 32, ",ring_len=%u", param->ring_len);
+    }
+    if (param->mtu != 0) {
+        snprintf(mtu_str, 32, ",mtu=%u", param->mtu);
+    }
+
+    return snprintf(desc, len, "process_vm,%s%s%s", param->path, ring_len_str, mtu_str);
+}
+
+int pirate_process_vm_open(void *_param, void *_ctx) {
+    pirate_process_vm_param_t *param = (pirate_process_vm_param_t *)_param;
+    process_vm_ctx *ctx = (process_vm_ctx *)_ctx;
+    int err;
+    uint_fast64_t init_pid = 0;
+    process_vm_ring_t *ring;
+    int access = ctx->flags & O_ACCMODE;
+
+    pirate_process_vm_init_param(param);
+    ctx->ptracer = 0;
+    // on successful shm_open (fd > 0) we must shm_unlink before exiting
+    // this function
+    int fd = shm_open(param->path, O_RDWR | O_CREAT, 0660);
+    if (fd < 0) {
+        ctx->ring = NULL;
+        return -1;
+    }
+
+    ring = process_vm_ring_init(fd, param->ring_len);
+    ctx->ring = ring;
+    if (ctx->ring == NULL) {
+        goto error;
+    }
+
+    if (access == O_RDONLY) {
+        if (!atomic_compare_exchange_strong(&ring->reader_pid,
+                                            &init_pid, (uint64_t)getpid())) {
+            errno = EBUSY;
+            goto error;
+        }
+
+        if (sem_post(&ring->writer_open_wait) < 0) {
+            atomic_store(&ring->reader_pid, 0);
+            goto error;
+        }
+
+        if (pirate_open_sem_wait(&ring->reader_open_wait) < 0) {
+            atomic_store(&ring->reader_pid, 0);
+            goto error;
+        }
+    } else {
+        if (!atomic_compare_exchange_strong(&ring->writer_pid, &init_pid,
+                                        (uint64_t)getpid())) {
+            errno = EBUSY;
+            goto error;
+        }
+
+        if (sem_post(&ring->reader_open_wait) < 0) {
+            atomic_store(&ring->writer_pid, 0);
+            goto error;
+        }
+
+        if (pirate_open_sem_wait(&ring->writer_open_wait) < 0) {
+            atomic_store(&ring->writer_pid, 0);
+            goto error;
+        }
+
+        if (process_vm_ptracer_get((pid_t) atomic_load(&ring->reader_pid)) < 0) {
+            // the reader is open and sees end of file
+            err = errno;
+            atomic_store(&ring->writer_pid, 0);
+            pthread_mutex_lock(&ring->mutex);
+            pthread_cond_signal(&ring->is_not_empty);
+            pthread_mutex_unlock(&ring->mutex);
+            errno = err;
+            goto error;
+        }
+        ctx->ptracer = (pid_t) atomic_load(&ring->reader_pid);
+    }
+    err = errno;
+    if (shm_unlink(param->path) == -1) {
+        if (errno == ENOENT) {
+            errno = err;
+        } else {
+            goto error;
+        }
+    }
+
+    return pirate_next_gd();
+error:
+    err = errno;
+    if (ctx->ring != NULL) {
+        munmap(ctx->ring, ring_alloc_size(ctx->ring->ring_len));
+        ctx->ring = NULL;
+    }
+    shm_unlink(param->path);
+    errno = err;
+    return -1;
+}
+
+int pirate_process_vm_close(void *_ctx) {
+    process_vm_ctx *ctx = (process_vm_ctx *)_ctx;
+    process_vm_ring_t *ring = ctx->ring;
+    const size_t alloc_size = ring_alloc_size(ring->ring_len);
+    int access = ctx->flags & O_ACCMODE;
+
+    if (access == O_RDONLY) {
+        atomic_store(&ring->reader_pid, 0);
+        pthread_mutex_lock(&ring->mutex);
+        pthread_cond_signal(&ring->is_not_full);
+        pthread_mutex_unlock(&ring->mutex);
+    } else {
+        atomic_store(&ring->writer_pid, 0);
+        pthread_mutex_lock(&ring->mutex);
+        pthread_cond_signal(&ring->is_not_empty);
+        pthread_mutex_unlock(&ring->mutex);
+        process_vm_ptracer_put(ctx->ptracer);
+        ctx->ptracer = 0;
+    }
+
+    return munmap(ring, alloc_size);
+}
+
+// Copies from the writer's address space. A partial
+// transfer is retried from the point where it stopped.
+static ssize_t process_vm_copy(pid_t pid, void *dst, uint64_t src, size_t count) {
+    size_t done = 0;
+
+    while (done < count) {
+        struct iovec local, remote;
+        local.iov_base = (uint8_t*) dst + done;
+        local.iov_len = count - done;
+        remote.iov_base = (void*)(uintptr_t)(src + done);
+        remote.iov_len = count - done;
+        ssize_t rv = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        } else if (rv == 0) {
+            errno = EFAULT;
+            return -1;
+        }
+        done += rv;
+    }
+    return done;
+}
+
+ssize_t pirate_process_vm_read(const void *_param, void *_ctx, void *buf, size_t count) {
+    (void) _param;
+    process_vm_ctx *ctx = (process_vm_ctx *)_ctx;
+    process_vm_ring_t *ring = ctx->ring;
+    process_vm_entry_t *entry;
+    uint64_t head, tail;
+    ssize_t rv = 0;
+    int err = 0, wake;
+
+    if (ring == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    tail = atomic_load(&ring->tail);
+    head = atomic_load(&ring->head);
+    for (int spin = 0; (spin < SPIN_ITERATIONS) && (head == tail); spin++) {
+        head = atomic_load(&ring->head);
+    }
+
+    if (head == tail) {
+        pthread_mutex_lock(&ring->mutex);
+        head = atomic_load(&ring->head);
+        while (head == tail) {
+            // The reader returns 0 when the writer has closed
+            // the channel and the ring is empty.
+            if (atomic_load(&ring->writer_pid) == 0) {
+                pthread_mutex_unlock(&ring->mutex);
+                return 0;
+            }
+            pthread_cond_wait(&ring->is_not_empty, &ring->mutex);
+            head = atomic_load(&ring->head);
+        }
+        pthread_mutex_unlock(&ring->mutex);
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    entry = &ring_entries(ring)[tail % ring->ring_len];
+    count = MIN(count, entry->len);
+    if (entry->inline_data) {
+        memcpy(buf, entry->data, count);
+    } else {
+        rv = process_vm_copy(atomic_load(&ring->writer_pid), buf, entry->addr, count);
+        err = errno;
+    }
+
+    // The writer of an out of line entry is waiting for it
+    // to be consumed. Otherwise wake the writer on a full ring.
+    wake = !entry->inline_data;
+    atomic_store(&ring->tail, tail + 1);
+    if (wake || ((atomic_load(&ring->head) - tail) == ring->ring_len)) {
+        pthread_mutex_lock(&ring->mutex);
+        pthread_cond_signal(&ring->is_not_full);
+        pthread_mutex_unlock(&ring->mutex);
+    }
+
+    if (rv < 0) {
+        errno = err;
+        return -1;
+    }
+    return count;
+}
+
+ssize_t pirate_process_vm_write_mtu(const void *_param, void *_ctx) {
+    (void) _ctx;
+    const pirate_process_vm_param_t *param = (const pirate_process_vm_param_t *)_param;
+    return param->mtu;
+}
+
+static int process_vm_wait(process_vm_ring_t *ring, uint64_t tail) {
+    for (int spin = 0; (spin < SPIN_ITERATIONS) && (atomic_load(&ring->tail) < tail); spin++) {
+        ;
+    }
+    if (atomic_load(&ring->tail) < tail) {
+        pthread_mutex_lock(&ring->mutex);
+        while (atomic_load(&ring->tail) < tail) {
+            if (atomic_load(&ring->reader_pid) == 0) {
+                pthread_mutex_unlock(&ring->mutex);
+                kill(getpid(), SIGPIPE);
+                errno = EPIPE;
+                return -1;
+            }
+            pthread_cond_wait(&ring->is_not_full, &ring->mutex);
+        }
+        pthread_mutex_unlock(&ring->mutex);
+    }
+    return 0;
+}
+
+ssize_t pirate_process_vm_write(const void *_param, void *_ctx, const void *buf, size_t count) {
+    (void) _param;
+    process_vm_ctx *ctx = (process_vm_ctx *)_ctx;
+    process_vm_ring_t *ring = ctx->ring;
+    process_vm_entry_t *entry;
+    uint64_t head;
+    int inline_data;
+
+    if (ring == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (count > UINT32_MAX) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    head = atomic_load(&ring->head);
+    if ((head >= ring->ring_len) &&
+        (process_vm_wait(ring, head + 1 - ring->ring_len) < 0)) {
+        return -1;
+    }
+
+    // The writer returns -1 when the reader has closed the channel.
+    // The reader returns 0 when the writer has closed the channel AND
+    // the channel is empty.
+    if (atomic_load(&ring->reader_pid) == 0) {
+        kill(getpid(), SIGPIPE);
+        errno = EPIPE;
+        return -1;
+    }
+
+    entry = &ring_entries(ring)[head % ring->ring_len];
+    entry->len = count;
+    inline_data = (count <= PIRATE_PROCESS_VM_INLINE_LEN);
+    if (inline_data) {
+        entry->inline_data = 1;
+        entry->addr = 0;
+        memcpy(entry->data, buf, count);
+    } else {
+        entry->inline_data = 0;
+        entry->addr = (uintptr_t) buf;
+    }
+
+    atomic_thread_fence(memory_order_release);
+    atomic_store(&ring->head, head + 1);
+    if (atomic_load(&ring->tail) == head) {
+        pthread_mutex_lock(&ring->mutex);
+        pthread_cond_signal(&ring->is_not_empty);
+        pthread_mutex_unlock(&ring->mutex);
+    }
+
+    // The reader copies from buf. Wait for the copy
+    // to complete before returning buf to the caller.
+    if (!inline_data) {
+        if (process_vm_wait(ring, head + 1) < 0) {
+            return -1;
+        }
+    }
+
+    return count;
+}
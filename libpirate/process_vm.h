@@ -0,0 +1,77 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_CHANNEL_PROCESS_VM_H
+#define __PIRATE_CHANNEL_PROCESS_VM_H
+
+#include "libpirate.h"
+#include "shmem_buffer.h"
+
+// The control ring lives in POSIX shared memory. Each entry
+// either carries a small message inline or describes a region
+// of the writer's address space. The reader copies described
+// regions with process_vm_readv() directly into its buffer.
+// The writer waits until the reader has consumed a described
+// region before it returns from the write.
+
+#define PIRATE_PROCESS_VM_INLINE_LEN 240u
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint32_t inline_data;
+    uint8_t  data[PIRATE_PROCESS_VM_INLINE_LEN];
+} process_vm_entry_t;
+
+typedef struct {
+    pirate_atomic_uint64    init;
+    pirate_atomic_uint64    reader_pid;
+    pirate_atomic_uint64    writer_pid;
+    pirate_atomic_uint64    head;
+    pirate_atomic_uint64    tail;
+    sem_t                   reader_open_wait;
+    sem_t                   writer_open_wait;
+    pthread_mutex_t         mutex;
+    pthread_cond_t          is_not_empty;
+    pthread_cond_t          is_not_full;
+    unsigned                ring_len;
+} process_vm_ring_t;
+
+typedef struct {
+    int flags;
+    process_vm_ring_t *ring;
+    // reader granted ptrace access by a writer, or 0
+    pid_t ptracer;
+} process_vm_ctx;
+
+#ifdef PIRATE_SHMEM_FEATURE
+
+int pirate_process_vm_parse_param(char *str, void *_param);
+int pirate_process_vm_get_channel_description(const void *_param, char *desc, int len);
+int pirate_process_vm_open(void *_param, void *_ctx);
+int pirate_process_vm_close(void *_ctx);
+ssize_t pirate_process_vm_read(const void *_param, void *_ctx, void *buf, size_t count);
+ssize_t pirate_process_vm_write(const void *_param, void *_ctx, const void *buf, size_t count);
+ssize_t pirate_process_vm_write_mtu(const void *_param, void *_ctx);
+
+#define PIRATE_PROCESS_VM_CHANNEL_FUNCS { pirate_process_vm_parse_param, pirate_process_vm_get_channel_description, pirate_process_vm_open, pirate_process_vm_close, pirate_process_vm_read, pirate_process_vm_write, pirate_process_vm_write_mtu }
+
+#else
+
+#define PIRATE_PROCESS_VM_CHANNEL_FUNCS { NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+
+#endif
+
+#endif /* __PIRATE_CHANNEL_PROCESS_VM_H */
@@ -24,9 +24,18 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include "crc32c.h"
 #include "pirate_common.h"
 #include "serial.h"
 
+// Encoded frames are delimited by zero bytes on both sides.
+// The last 4 bytes of a decoded frame are the little-endian
+// CRC-32C of the payload.
+#define SERIAL_COBS_DELIM       0
+#define SERIAL_COBS_CRC_LEN     sizeof(uint32_t)
+#define SERIAL_COBS_RX_BUF_LEN  4096u
+#define SERIAL_COBS_MAX_ENCODED(N) ((N) + ((N) / 254) + 1)
+
 static void pirate_serial_init_param(pirate_serial_param_t *param) {
     if (param->baud == 0) {
         param->baud = PIRATE_SERIAL_DEFAULT_BAUD;
@@ -86,6 +95,10 @@ int pirate_serial_parse_param(char *str, void *_param) {
             param->mtu = strtol(val, NULL, 10);
         } else if (strncmp("max_tx_size", key, strlen("max_tx_size")) == 0) {
             param->max_tx = strtol(val, NULL, 10);
+        } else if (strncmp("drain", key, strlen("drain")) == 0) {
+            param->drain = strtol(val, NULL, 10);
+        } else if (strncmp("cobs", key, strlen("cobs")) == 0) {
+            param->cobs = strtol(val, NULL, 10);
         } else {
             errno = EINVAL;
             return -1;
@@ -99,6 +112,8 @@ int pirate_serial_get_channel_description(const void *_param, char *desc, int le
     char baud_str[32];
     char mtu_str[32];
     char max_tx_str[32];
+    char drain_str[32];
+    char cobs_str[32];
     const char *baud_val = NULL;
     
     switch (param->baud) {
@@ -117,6 +132,8 @@ int pirate_serial_get_channel_description(const void *_param, char *desc, int le
     baud_str[0] = 0;
     mtu_str[0] = 0;
     max_tx_str[0] = 0;
+    drain_str[0] = 0;
+    cobs_str[0] = 0;
     if ((param->baud != 0) && (param->baud != PIRATE_SERIAL_DEFAULT_BAUD)) {
         snprintf(baud_str, 32, ",baud=%s", baud_val);
     }
@@ -126,46 +143,117 @@ int pirate_serial_get_channel_description(const void *_param, char *desc, int le
     if ((param->max_tx != 0) && (param->max_tx != PIRATE_SERIAL_DEFAULT_MAX_TX)) {
         snprintf(max_tx_str, 32, ",max_tx_size=%u", param->max_tx);
     }
-    return snprintf(desc, len, "serial,%s%s%s%s", param->path, baud_str, mtu_str, max_tx_str);
+    if (param->drain != 0) {
+        snprintf(drain_str, 32, ",drain=%u", param->drain);
+    }
+    if (param->cobs != 0) {
+        snprintf(cobs_str, 32, ",cobs=%u", param->cobs);
+    }
+    return snprintf(desc, len, "serial,%s%s%s%s%s%s", param->path, baud_str, mtu_str, max_tx_str,
+        drain_str, cobs_str);
 }
 
 int pirate_serial_open(void *_param, void *_ctx) {
     pirate_serial_param_t *param = (pirate_serial_param_t *)_param;
     serial_ctx *ctx = (serial_ctx *)_ctx;
     struct termios attr;
+    int err;
 
     pirate_serial_init_param(param);
+    ctx->tx_buf = NULL;
+    ctx->tx_bytes = 0;
+    ctx->frame_buf = NULL;
+    ctx->frame_len = 0;
+    ctx->frame_discard = 0;
+    ctx->rx_buf = NULL;
+    ctx->rx_head = 0;
+    ctx->rx_tail = 0;
+    ctx->rx_dropped = 0;
     if (strnlen(param->path, 1) == 0) {
         errno = EINVAL;
         return -1;
     }
+    if (param->max_tx <= sizeof(pirate_header_t)) {
+        errno = EINVAL;
+        return -1;
+    }
     ctx->fd = open(param->path, ctx->flags | O_NOCTTY);
     if (ctx->fd < 0) {
         return -1;
     }
 
     if (tcgetattr(ctx->fd, &attr) != 0) {
-        return -1;
+        goto error;
     }
 
     if (cfsetispeed(&attr, param->baud) ||
         cfsetospeed(&attr, param->baud)) {
-        return -1;
+        goto error;
     }
 
     cfmakeraw(&attr);
 
     if (tcsetattr(ctx->fd, TCSANOW, &attr)) {
-        return -1;
+        goto error;
+    }
+
+    if ((ctx->flags & O_ACCMODE) == O_WRONLY) {
+        if ((ctx->tx_buf = malloc(param->max_tx)) == NULL) {
+            goto error;
+        }
+    }
+
+    if (param->cobs) {
+        ssize_t mtu = pirate_serial_write_mtu(param, ctx);
+        if (mtu < 0) {
+            goto error;
+        }
+        // the encoded frame with the crc and both delimiters
+        ctx->frame_cap = SERIAL_COBS_MAX_ENCODED(mtu + SERIAL_COBS_CRC_LEN) + 2;
+        if ((ctx->frame_buf = malloc(ctx->frame_cap)) == NULL) {
+            goto error;
+        }
+        if ((ctx->flags & O_ACCMODE) == O_RDONLY) {
+            if ((ctx->rx_buf = malloc(SERIAL_COBS_RX_BUF_LEN)) == NULL) {
+                goto error;
+            }
+        }
     }
 
     return ctx->fd;
+error:
+    err = errno;
+    free(ctx->tx_buf);
+    ctx->tx_buf = NULL;
+    free(ctx->frame_buf);
+    ctx->frame_buf = NULL;
+    free(ctx->rx_buf);
+    ctx->rx_buf = NULL;
+    close(ctx->fd);
+    ctx->fd = -1;
+    errno = err;
+    return -1;
 }
 
 int pirate_serial_close(void *_ctx) {
     serial_ctx *ctx = (serial_ctx *)_ctx;
     int rv = -1;
 
+    if (ctx->tx_buf != NULL) {
+        free(ctx->tx_buf);
+        ctx->tx_buf = NULL;
+    }
+
+    if (ctx->frame_buf != NULL) {
+        free(ctx->frame_buf);
+        ctx->frame_buf = NULL;
+    }
+
+    if (ctx->rx_buf != NULL) {
+        free(ctx->rx_buf);
+        ctx->rx_buf = NULL;
+    }
+
     if (ctx->fd <= 0) {
         errno = ENODEV;
         return -1;
@@ -191,47 +279,194 @@ static ssize_t serial_do_read(serial_ctx *ctx, uint8_t *buf, size_t count) {
     return rx;
 }
 
-static ssize_t serial_do_write(const pirate_serial_param_t *param, serial_ctx *ctx, const void *buf, size_t count) {
-    const uint8_t *wr_buf = (const uint8_t *) buf;
-    size_t remain = count;
-    do {
-        int rv;
-        uint32_t tx_buf_bytes = 0;
-        size_t wr_len = MIN(remain, param->max_tx);
-        rv = write(ctx->fd, wr_buf, wr_len);
+// Writes are not paced. A blocking write() returns as soon as
+// the line discipline has accepted the bytes, and blocks while the
+// driver output queue is full, which keeps the transmitter busy.
+static ssize_t serial_do_write(const pirate_serial_param_t *param, serial_ctx *ctx, const uint8_t *buf, size_t count) {
+    size_t tx = 0;
+    ssize_t rv;
+
+    while (tx < count) {
+        rv = write(ctx->fd, buf + tx, MIN(count - tx, param->max_tx));
         if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             return -1;
         }
+        tx += rv;
+    }
+    return count;
+}
 
-        do {
-            if (ioctl(ctx->fd, TIOCOUTQ, &tx_buf_bytes)) {
-                return -1;
-            }
+typedef struct {
+    uint8_t *dst;
+    size_t len;
+    size_t code_idx;
+    uint8_t code;
+} serial_cobs_encoder_t;
+
+static void serial_cobs_encode_begin(serial_cobs_encoder_t *enc, uint8_t *dst) {
+    enc->dst = dst;
+    enc->code_idx = 0;
+    enc->len = 1;
+    enc->code = 1;
+}
 
-            if (tx_buf_bytes) {
-                const struct timespec one_ms = {
-                    .tv_sec = 0,
-                    .tv_nsec = 1000000
-                };
-                nanosleep(&one_ms, NULL);
+static void serial_cobs_encode(serial_cobs_encoder_t *enc, const uint8_t *src, size_t len) {
+    uint8_t *dst = enc->dst;
+
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            dst[enc->code_idx] = enc->code;
+            enc->code_idx = enc->len++;
+            enc->code = 1;
+        } else {
+            dst[enc->len++] = src[i];
+            if (++enc->code == 0xFF) {
+                dst[enc->code_idx] = enc->code;
+                enc->code_idx = enc->len++;
+                enc->code = 1;
             }
+        }
+    }
+}
+
+static size_t serial_cobs_encode_end(serial_cobs_encoder_t *enc) {
+    enc->dst[enc->code_idx] = enc->code;
+    return enc->len;
+}
+
+// Decodes a frame in place. Returns the decoded length
+// or -1 if the frame is malformed.
+static ssize_t serial_cobs_decode(uint8_t *buf, size_t len) {
+    size_t in = 0, out = 0;
+
+    while (in < len) {
+        uint8_t code = buf[in++];
+        if ((code == 0) || ((in + code - 1) > len)) {
+            return -1;
+        }
+        memmove(buf + out, buf + in, code - 1);
+        out += code - 1;
+        in += code - 1;
+        if ((code != 0xFF) && (in < len)) {
+            buf[out++] = 0;
+        }
+    }
+    return out;
+}
+
+static ssize_t serial_cobs_write(const pirate_serial_param_t *param, serial_ctx *ctx, const void *buf, size_t count) {
+    serial_cobs_encoder_t enc;
+    uint8_t crc_le[SERIAL_COBS_CRC_LEN];
+    uint32_t crc = pirate_crc32c(0, buf, count);
+    size_t len;
+    ssize_t rv;
 
-        } while(tx_buf_bytes > 0);
+    crc_le[0] = crc & 0xFF;
+    crc_le[1] = (crc >> 8) & 0xFF;
+    crc_le[2] = (crc >> 16) & 0xFF;
+    crc_le[3] = crc >> 24;
 
-        remain -= rv;
-        wr_buf += rv;
-    } while(remain > 0);
+    ctx->frame_buf[0] = SERIAL_COBS_DELIM;
+    serial_cobs_encode_begin(&enc, ctx->frame_buf + 1);
+    serial_cobs_encode(&enc, (const uint8_t*) buf, count);
+    serial_cobs_encode(&enc, crc_le, sizeof(crc_le));
+    len = serial_cobs_encode_end(&enc) + 1;
+    ctx->frame_buf[len++] = SERIAL_COBS_DELIM;
 
+    rv = serial_do_write(param, ctx, ctx->frame_buf, len);
+    if (rv < 0) {
+        return rv;
+    }
+    ctx->tx_bytes += rv;
     return count;
 }
 
+// Returns the next frame that decodes and passes the crc check.
+// Frames that are malformed, too long, or fail the crc check are
+// dropped, and the reader resynchronizes at the next delimiter.
+static ssize_t serial_cobs_read(serial_ctx *ctx, void *buf, size_t count) {
+    const size_t frame_max = ctx->frame_cap - 2;
+    uint8_t *start, *delim;
+    size_t avail, seg, len;
+    uint32_t crc;
+    ssize_t rv;
+
+    for (;;) {
+        if (ctx->rx_head == ctx->rx_tail) {
+            rv = read(ctx->fd, ctx->rx_buf, SERIAL_COBS_RX_BUF_LEN);
+            if (rv < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            } else if (rv == 0) {
+                return 0;
+            }
+            ctx->rx_head = 0;
+            ctx->rx_tail = rv;
+        }
+        start = ctx->rx_buf + ctx->rx_head;
+        avail = ctx->rx_tail - ctx->rx_head;
+        delim = memchr(start, SERIAL_COBS_DELIM, avail);
+        seg = (delim != NULL) ? (size_t) (delim - start) : avail;
+        if (!ctx->frame_discard) {
+            if ((ctx->frame_len + seg) > frame_max) {
+                ctx->frame_discard = 1;
+            } else {
+                memcpy(ctx->frame_buf + ctx->frame_len, start, seg);
+                ctx->frame_len += seg;
+            }
+        }
+        ctx->rx_head += seg;
+        if (delim == NULL) {
+            continue;
+        }
+        ctx->rx_head++;
+        len = ctx->frame_len;
+        ctx->frame_len = 0;
+        if (ctx->frame_discard) {
+            ctx->frame_discard = 0;
+            ctx->rx_dropped++;
+            continue;
+        }
+        if (len == 0) {
+            // adjacent delimiters
+            continue;
+        }
+        rv = serial_cobs_decode(ctx->frame_buf, len);
+        if (rv < (ssize_t) SERIAL_COBS_CRC_LEN) {
+            ctx->rx_dropped++;
+            continue;
+        }
+        len = rv - SERIAL_COBS_CRC_LEN;
+        crc = ctx->frame_buf[len] |
+            (ctx->frame_buf[len + 1] << 8) |
+            (ctx->frame_buf[len + 2] << 16) |
+            ((uint32_t) ctx->frame_buf[len + 3] << 24);
+        if (crc != pirate_crc32c(0, ctx->frame_buf, len)) {
+            ctx->rx_dropped++;
+            continue;
+        }
+        count = MIN(count, len);
+        memcpy(buf, ctx->frame_buf, count);
+        return count;
+    }
+}
+
 ssize_t pirate_serial_read(const void *_param, void *_ctx, void *buf, size_t count) {
+    const pirate_serial_param_t *param = (const pirate_serial_param_t *)_param;
     serial_ctx *ctx = (serial_ctx *)_ctx;
-    (void) _param;
     pirate_header_t header;
     ssize_t rv;
     size_t packet_count;
 
+    if (param->cobs) {
+        return serial_cobs_read(ctx, buf, count);
+    }
+
     rv = serial_do_read(ctx, (uint8_t*) &header, sizeof(header));
     if (rv < 0) {
         return rv;
@@ -258,6 +493,10 @@ ssize_t pirate_serial_write_mtu(const void *_param, void *_ctx) {
     (void) _ctx;
     const pirate_serial_param_t *param = (const pirate_serial_param_t *)_param;
     size_t mtu = param->mtu;
+    if ((mtu == 0) && param->cobs) {
+        // the reader must bound the length of a frame
+        mtu = PIRATE_SERIAL_COBS_DEFAULT_MTU;
+    }
     if (mtu == 0) {
         return 0;
     }
@@ -268,11 +507,33 @@ ssize_t pirate_serial_write_mtu(const void *_param, void *_ctx) {
     return mtu - sizeof(pirate_header_t);
 }
 
+static ssize_t serial_header_write(const pirate_serial_param_t *param, serial_ctx *ctx, const void *buf, size_t count) {
+    pirate_header_t header;
+    ssize_t rv;
+    size_t head;
+
+    header.count = htonl(count);
+
+    // The header and the start of the payload share one write()
+    head = MIN(count, param->max_tx - sizeof(header));
+    memcpy(ctx->tx_buf, &header, sizeof(header));
+    memcpy(ctx->tx_buf + sizeof(header), buf, head);
+    rv = serial_do_write(param, ctx, ctx->tx_buf, sizeof(header) + head);
+    if (rv < 0) {
+        return rv;
+    }
+    ctx->tx_bytes += rv;
+    rv = serial_do_write(param, ctx, ((const uint8_t*) buf) + head, count - head);
+    if (rv < 0) {
+        return rv;
+    }
+    ctx->tx_bytes += rv;
+    return count;
+}
+
 ssize_t pirate_serial_write(const void *_param, void *_ctx, const void *buf, size_t count) {
     const pirate_serial_param_t *param = (const pirate_serial_param_t *)_param;
     serial_ctx *ctx = (serial_ctx *)_ctx;
-    pirate_header_t header;
-    header.count = htonl(count);
     ssize_t rv;
     size_t mtu = pirate_serial_write_mtu(param, ctx);
 
@@ -280,14 +541,70 @@ ssize_t pirate_serial_write(const void *_param, void *_ctx, const void *buf, siz
         errno = EMSGSIZE;
         return -1;
     }
+    if (ctx->tx_bytes == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &ctx->tx_start);
+    }
 
-    rv = serial_do_write(param, ctx, &header, sizeof(header));
-    if (rv < 0) {
-        return rv;
+    if (param->cobs) {
+        rv = serial_cobs_write(param, ctx, buf, count);
+    } else {
+        rv = serial_header_write(param, ctx, buf, count);
     }
-    rv = serial_do_write(param, ctx, buf, count);
     if (rv < 0) {
         return rv;
     }
+    if (param->drain && (tcdrain(ctx->fd) < 0)) {
+        return -1;
+    }
     return count;
 }
+
+static unsigned serial_baud_bps(speed_t baud) {
+    switch (baud) {
+    case B4800:   return 4800;
+    case B9600:   return 9600;
+    case B19200:  return 19200;
+    case B38400:  return 38400;
+    case B57600:  return 57600;
+    case B115200: return 115200;
+    case B230400: return 230400;
+    case B460800: return 460800;
+    default:      return 0;
+    }
+}
+
+uint64_t pirate_serial_dropped(const void *_ctx) {
+    const serial_ctx *ctx = (const serial_ctx *)_ctx;
+    return ctx->rx_dropped;
+}
+
+double pirate_serial_utilization(const void *_param, void *_ctx) {
+    const pirate_serial_param_t *param = (const pirate_serial_param_t *)_param;
+    serial_ctx *ctx = (serial_ctx *)_ctx;
+    unsigned bps = serial_baud_bps(param->baud);
+    uint32_t queued = 0;
+    struct timespec now;
+    double elapsed;
+
+    if ((ctx->flags & O_ACCMODE) != O_WRONLY) {
+        errno = EBADF;
+        return -1;
+    }
+    if (bps == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (ctx->tx_bytes == 0) {
+        return 0;
+    }
+    if (ioctl(ctx->fd, TIOCOUTQ, &queued) < 0) {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - ctx->tx_start.tv_sec) +
+        (now.tv_nsec - ctx->tx_start.tv_nsec) / 1e9;
+    if (elapsed <= 0) {
+        return 0;
+    }
+    return ((ctx->tx_bytes - MIN(queued, ctx->tx_bytes)) * 10.0) / (bps * elapsed);
+}
@@ -18,9 +18,23 @@
 
 #include "libpirate.h"
 
+#include <time.h>
+
 typedef struct {
     int flags;
     int fd;
+    uint8_t *tx_buf;
+    uint64_t tx_bytes;
+    struct timespec tx_start;
+    // COBS framing state
+    uint8_t *frame_buf;
+    size_t frame_cap;
+    size_t frame_len;
+    int frame_discard;
+    uint8_t *rx_buf;
+    size_t rx_head;
+    size_t rx_tail;
+    uint64_t rx_dropped;
 } serial_ctx;
 
 int pirate_serial_parse_param(char *str, void *_param);
@@ -30,6 +44,8 @@ int pirate_serial_close(void *_ctx);
 ssize_t pirate_serial_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t pirate_serial_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t pirate_serial_write_mtu(const void *_param, void *_ctx);
+double pirate_serial_utilization(const void *_param, void *_ctx);
+uint64_t pirate_serial_dropped(const void *_ctx);
 
 #define PIRATE_SERIAL_CHANNEL_FUNCS { pirate_serial_parse_param, pirate_serial_get_channel_description, pirate_serial_open, pirate_serial_close, pirate_serial_read, pirate_serial_write, pirate_serial_write_mtu }
 
@@ -51,7 +51,8 @@ static inline uint64_t create_position(uint32_t write, uint32_t read,
     uint8_t status = 1;
 
     if (writer) {
-        if (((write - read + bufsize) % bufsize) <= sizeof(pirate_header_t)) {
+        // full when the free space cannot hold a header and one byte
+        if (((read - write + bufsize) % bufsize) <= sizeof(pirate_header_t)) {
             status = 2;
         }
     } else {
@@ -70,6 +71,16 @@ static inline int is_full(uint64_t value) {
     return get_status(value) == 2;
 }
 
+// Bytes in the ring
+static inline uint32_t get_queued(uint64_t value, int bufsize) {
+    uint32_t read = get_read(value), write = get_write(value);
+
+    if (is_full(value) && (read == write)) {
+        return bufsize;
+    }
+    return (write - read + bufsize) % bufsize;
+}
+
 static inline unsigned char* shared_buffer(shmem_buffer_t *shmem_buffer) {
     return (unsigned char*)(shmem_buffer + 1);
 }
@@ -279,7 +290,7 @@ int shmem_buffer_open(void *_param, void *_ctx) {
             goto error;
         }
 
-        if (sem_wait(&buf->reader_open_wait) < 0) {
+        if (pirate_open_sem_wait(&buf->reader_open_wait) < 0) {
             atomic_store(&buf->reader_pid, 0);
             goto error;
         }
@@ -295,7 +306,7 @@ int shmem_buffer_open(void *_param, void *_ctx) {
             goto error;
         }
 
-        if (sem_wait(&buf->writer_open_wait) < 0) {
+        if (pirate_open_sem_wait(&buf->writer_open_wait) < 0) {
             atomic_store(&buf->writer_pid, 0);
             goto error;
         }
@@ -375,28 +386,38 @@ ssize_t shmem_buffer_read(const void *_param, void *_ctx, void *buffer, size_t c
         errno = EBADF;
         return -1;
     }
+    pirate_ring_side_stats_t *stats = &buf->reader_stats;
 
     position = atomic_load(&buf->position);
-    for (int spin = 0; (spin < SPIN_ITERATIONS) && is_empty(position); spin++) {
-        position = atomic_load(&buf->position);
-    }
-
     if (is_empty(position)) {
-        pthread_mutex_lock(&buf->mutex);
-        position = atomic_load(&buf->position);
-        while (is_empty(position)) {
-            // The reader returns 0 when the writer has closed
-            // the channel and the channel is empty. If the writer
-            // has closed the channel and the buffer has content
-            // then return the contents of the buffer.
-            if (atomic_load(&buf->writer_pid) == 0) {
-                pthread_mutex_unlock(&buf->mutex);
-                return 0;
-            }
-            pthread_cond_wait(&buf->is_not_empty, &buf->mutex);
+        uint64_t start = pirate_monotonic_ns();
+        int spin;
+
+        for (spin = 0; (spin < SPIN_ITERATIONS) && is_empty(position); spin++) {
             position = atomic_load(&buf->position);
         }
-        pthread_mutex_unlock(&buf->mutex);
+        stats->spins += spin;
+
+        if (is_empty(position)) {
+            pthread_mutex_lock(&buf->mutex);
+            position = atomic_load(&buf->position);
+            while (is_empty(position)) {
+                // The reader returns 0 when the writer has closed
+                // the channel and the channel is empty. If the writer
+                // has closed the channel and the buffer has content
+                // then return the contents of the buffer.
+                if (atomic_load(&buf->writer_pid) == 0) {
+                    pthread_mutex_unlock(&buf->mutex);
+                    stats->blocked_ns += pirate_monotonic_ns() - start;
+                    return 0;
+                }
+                stats->sleeps++;
+                pthread_cond_wait(&buf->is_not_empty, &buf->mutex);
+                position = atomic_load(&buf->position);
+            }
+            pthread_mutex_unlock(&buf->mutex);
+        }
+        stats->blocked_ns += pirate_monotonic_ns() - start;
     }
 
     reader = get_read(position);
@@ -431,7 +452,9 @@ ssize_t shmem_buffer_read(const void *_param, void *_ctx, void *buffer, size_t c
         pthread_mutex_lock(&buf->mutex);
         pthread_cond_signal(&buf->is_not_full);
         pthread_mutex_unlock(&buf->mutex);
+        stats->wakeups++;
     }
+    stats->operations++;
 
     return MIN(count, packet_count);
 }
@@ -470,6 +493,24 @@ ssize_t shmem_buffer_write_mtu(const void *_param, void *_ctx) {
     return mtu - sizeof(pirate_header_t);
 }
 
+void shmem_buffer_occupancy(const void *_ctx, uint64_t *queued, uint64_t *capacity) {
+    const shmem_ctx *ctx = (const shmem_ctx *)_ctx;
+    shmem_buffer_t *buf = ctx->buf;
+
+    *queued = get_queued(atomic_load(&buf->position), buf->size);
+    *capacity = buf->size;
+}
+
+void shmem_buffer_ring_stats(const void *_ctx, pirate_ring_stats_t *stats) {
+    const shmem_ctx *ctx = (const shmem_ctx *)_ctx;
+    shmem_buffer_t *buf = ctx->buf;
+
+    shmem_buffer_occupancy(_ctx, &stats->queued, &stats->capacity);
+    stats->high_water = buf->high_water;
+    memcpy(&stats->reader, &buf->reader_stats, sizeof(stats->reader));
+    memcpy(&stats->writer, &buf->writer_stats, sizeof(stats->writer));
+}
+
 ssize_t shmem_buffer_write(const void *_param, void *_ctx, const void *buffer,
                             size_t count) {
     const pirate_shmem_param_t *param = (const pirate_shmem_param_t *)_param;
@@ -477,7 +518,7 @@ ssize_t shmem_buffer_write(const void *_param, void *_ctx, const void *buffer,
     uint64_t position;
     int was_empty;
     size_t nbytes;
-    uint32_t reader, writer;
+    uint32_t reader, writer, queued = 0;
     pirate_header_t header;
 
     shmem_buffer_t* buf = ctx->buf;
@@ -485,27 +526,37 @@ ssize_t shmem_buffer_write(const void *_param, void *_ctx, const void *buffer,
         errno = EBADF;
         return -1;
     }
+    pirate_ring_side_stats_t *stats = &buf->writer_stats;
 
     position = atomic_load(&buf->position);
-    for (int spin = 0; (spin < SPIN_ITERATIONS) && is_full(position); spin++) {
-        position = atomic_load(&buf->position);
-    }
-
     if (is_full(position)) {
-        pthread_mutex_lock(&buf->mutex);
-        position = atomic_load(&buf->position);
-        while (is_full(position)) {
-            if (atomic_load(&buf->reader_pid) == 0) {
-                pthread_mutex_unlock(&buf->mutex);
-                kill(getpid(), SIGPIPE);
-                errno = EPIPE;
-                return -1;
-            }
-            pthread_cond_wait(&buf->is_not_full, &buf->mutex);
+        uint64_t start = pirate_monotonic_ns();
+        int spin;
+
+        for (spin = 0; (spin < SPIN_ITERATIONS) && is_full(position); spin++) {
             position = atomic_load(&buf->position);
         }
+        stats->spins += spin;
 
-        pthread_mutex_unlock(&buf->mutex);
+        if (is_full(position)) {
+            pthread_mutex_lock(&buf->mutex);
+            position = atomic_load(&buf->position);
+            while (is_full(position)) {
+                if (atomic_load(&buf->reader_pid) == 0) {
+                    pthread_mutex_unlock(&buf->mutex);
+                    stats->blocked_ns += pirate_monotonic_ns() - start;
+                    kill(getpid(), SIGPIPE);
+                    errno = EPIPE;
+                    return -1;
+                }
+                stats->sleeps++;
+                pthread_cond_wait(&buf->is_not_full, &buf->mutex);
+                position = atomic_load(&buf->position);
+            }
+
+            pthread_mutex_unlock(&buf->mutex);
+        }
+        stats->blocked_ns += pirate_monotonic_ns() - start;
     }
 
     // The writer returns -1 when the reader has closed the channel.
@@ -539,6 +590,7 @@ ssize_t shmem_buffer_write(const void *_param, void *_ctx, const void *buffer,
         if (atomic_compare_exchange_weak(&buf->position, &position,
                                             update)) {
             was_empty = is_empty(position);
+            queued = get_queued(update, buf->size);
             break;
         }
         reader = get_read(position);
@@ -548,7 +600,12 @@ ssize_t shmem_buffer_write(const void *_param, void *_ctx, const void *buffer,
         pthread_mutex_lock(&buf->mutex);
         pthread_cond_signal(&buf->is_not_empty);
         pthread_mutex_unlock(&buf->mutex);
+        stats->wakeups++;
+    }
+    if (queued > buf->high_water) {
+        buf->high_water = queued;
     }
+    stats->operations++;
 
     return count;
 }
@@ -21,6 +21,8 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include "libpirate.h"
+
 #ifdef __cplusplus
 #include <atomic>
 typedef std::atomic_uint_fast64_t pirate_atomic_uint64;
@@ -46,6 +48,12 @@ typedef struct {
     int                     size;
     size_t                  packet_size;
     size_t                  packet_count;
+    // Backpressure telemetry. Each end only updates its own
+    // counters, which are kept on separate cache lines. The
+    // writer also updates high_water.
+    pirate_ring_side_stats_t reader_stats __attribute__((aligned(64)));
+    pirate_ring_side_stats_t writer_stats __attribute__((aligned(64)));
+    uint64_t                high_water;
 } shmem_buffer_t;
 
 #endif /* __PIRATE_SHMEM_BUFFER_H */
@@ -33,6 +33,8 @@ int shmem_buffer_close(void *_ctx);
 ssize_t shmem_buffer_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t shmem_buffer_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t shmem_buffer_write_mtu(const void *_param, void *_ctx);
+void shmem_buffer_occupancy(const void *_ctx, uint64_t *queued, uint64_t *capacity);
+void shmem_buffer_ring_stats(const void *_ctx, pirate_ring_stats_t *stats);
 
 #define PIRATE_SHMEM_CHANNEL_FUNCS { shmem_buffer_parse_param, shmem_buffer_get_channel_description, shmem_buffer_open, shmem_buffer_close, shmem_buffer_read, shmem_buffer_write, shmem_buffer_write_mtu }
 
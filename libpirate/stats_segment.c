@@ -0,0 +1,168 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stats_segment.h"
+
+static void pirate_stats_segment_name(pid_t pid, char *name, size_t len) {
+    snprintf(name, len, "/" PIRATE_STATS_SEGMENT_PREFIX "%d", (int) pid);
+}
+
+int pirate_stats_segment_stale(int fd) {
+    uint64_t magic = 0;
+
+    // the owner holds an exclusive lock until it exits
+    if (flock(fd, LOCK_SH | LOCK_NB) != 0) {
+        return 0;
+    }
+    // a segment without magic is still being created
+    if (pread(fd, &magic, sizeof(magic), 0) != sizeof(magic)) {
+        magic = 0;
+    }
+    flock(fd, LOCK_UN);
+    return magic == PIRATE_STATS_SEGMENT_MAGIC;
+}
+
+// Removes the segment of the given name if its owner has exited
+static int pirate_stats_segment_collect_one(const char *name) {
+    int fd, stale;
+
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+        return 0;
+    }
+    stale = pirate_stats_segment_stale(fd);
+    close(fd);
+    if (stale) {
+        shm_unlink(name);
+    }
+    return stale;
+}
+
+// Removes the segments of processes that exited without
+// running the exit handlers
+static void pirate_stats_segment_collect(void) {
+    const size_t prefix_len = strlen(PIRATE_STATS_SEGMENT_PREFIX);
+    struct dirent *entry;
+    char name[NAME_MAX + 2];
+    DIR *dir;
+
+    if ((dir = opendir("/dev/shm")) == NULL) {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, PIRATE_STATS_SEGMENT_PREFIX, prefix_len) != 0) {
+            continue;
+        }
+        snprintf(name, sizeof(name), "/%s", entry->d_name);
+        pirate_stats_segment_collect_one(name);
+    }
+    closedir(dir);
+}
+
+pirate_stats_segment_t *pirate_stats_segment_create(const pirate_stats_t *stats,
+    int *lock_fd) {
+    pirate_stats_segment_t *segment;
+    pid_t pid = getpid();
+    char name[64];
+    int fd, err;
+
+    pirate_stats_segment_collect();
+    pirate_stats_segment_name(pid, name, sizeof(name));
+    // other users may read the segment but only the owner writes it
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0444);
+    if ((fd < 0) && (errno == EEXIST)) {
+        // left behind by an earlier process with the same pid, or
+        // published by a process with the same pid in another pid
+        // namespace, which keeps it
+        if (!pirate_stats_segment_collect_one(name)) {
+            errno = EEXIST;
+            return NULL;
+        }
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0444);
+    }
+    if (fd < 0) {
+        return NULL;
+    }
+    if (flock(fd, LOCK_EX) != 0) {
+        goto error;
+    }
+    if (ftruncate(fd, sizeof(pirate_stats_segment_t)) != 0) {
+        goto error;
+    }
+    segment = mmap(NULL, sizeof(pirate_stats_segment_t), PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    if (segment == MAP_FAILED) {
+        goto error;
+    }
+
+    segment->version = PIRATE_STATS_SEGMENT_VERSION;
+    segment->slots = PIRATE_STATS_SEGMENT_SLOTS;
+    segment->pid = pid;
+    prctl(PR_GET_NAME, segment->comm, 0, 0, 0);
+    memcpy(segment->stats, stats, sizeof(segment->stats));
+    for (unsigned i = 0; i < PIRATE_STATS_SEGMENT_SLOTS; i++) {
+        segment->slot[i].gd = -1;
+    }
+    __atomic_store_n(&segment->magic, PIRATE_STATS_SEGMENT_MAGIC, __ATOMIC_RELEASE);
+    *lock_fd = fd;
+    return segment;
+error:
+    err = errno;
+    close(fd);
+    shm_unlink(name);
+    errno = err;
+    return NULL;
+}
+
+void pirate_stats_segment_unlink(const pirate_stats_segment_t *segment) {
+    char name[64];
+
+    if (segment->pid == getpid()) {
+        pirate_stats_segment_name(segment->pid, name, sizeof(name));
+        shm_unlink(name);
+    }
+}
+
+void pirate_stats_segment_update(pirate_stats_segment_t *segment, int gd, int flags,
+    const char *description) {
+    pirate_stats_slot_t *slot = &segment->slot[pirate_stats_segment_index(gd)];
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (description != NULL) {
+        slot->gd = gd;
+        slot->flags = flags;
+        strncpy(slot->description, description, PIRATE_STATS_DESCRIPTION_LEN - 1);
+        slot->description[PIRATE_STATS_DESCRIPTION_LEN - 1] = '\0';
+    } else {
+        slot->gd = -1;
+    }
+    slot->queued = 0;
+    slot->capacity = 0;
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,94 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_STATS_SEGMENT_H
+#define __PIRATE_STATS_SEGMENT_H
+
+#include <stdint.h>
+
+#include "libpirate.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Layout of the shared memory segment /pirate_stats.<pid> that
+// a process publishes its channel statistics into. The process
+// updates the statistics in place with plain stores, so a
+// reader may observe a counter that is one request behind the
+// others. Slot i holds gaps descriptor i for i < PIRATE_NUM_CHANNELS
+// and gaps descriptor -(i - PIRATE_NUM_CHANNELS) - 2 otherwise.
+
+#define PIRATE_STATS_SEGMENT_MAGIC      0x5354415453524950ull // "PIRSTATS"
+#define PIRATE_STATS_SEGMENT_VERSION    1
+#define PIRATE_STATS_SEGMENT_PREFIX     "pirate_stats."
+#define PIRATE_STATS_SEGMENT_SLOTS      (2 * PIRATE_NUM_CHANNELS)
+#define PIRATE_STATS_DESCRIPTION_LEN    128
+
+typedef struct {
+    // Odd while the process is changing the fields below. A reader
+    // copies the slot and retries if seq was odd or has changed.
+    uint64_t seq;
+    int32_t gd;                 // -1 when the slot is not open
+    int32_t flags;              // flags given to pirate_open()
+    char description[PIRATE_STATS_DESCRIPTION_LEN];
+    // Fill level of a shared memory ring, refreshed on every
+    // read and write. Bytes for SHMEM and UIO_DEVICE, packets
+    // for UDP_SHMEM. capacity is zero for the other channel types.
+    uint64_t queued;
+    uint64_t capacity;
+} pirate_stats_slot_t;
+
+typedef struct {
+    uint64_t magic;             // stored last, once the segment is initialized
+    uint32_t version;
+    uint32_t slots;
+    int64_t pid;
+    char comm[16];
+    pirate_stats_t stats[PIRATE_STATS_SEGMENT_SLOTS];
+    pirate_stats_slot_t slot[PIRATE_STATS_SEGMENT_SLOTS];
+} pirate_stats_segment_t;
+
+static inline unsigned pirate_stats_segment_index(int gd) {
+    return (gd >= 0) ? (unsigned) gd : (unsigned) (PIRATE_NUM_CHANNELS - gd - 2);
+}
+
+// Creates and maps the segment of the calling process with a
+// copy of stats. The segment is live while lock_fd is open, and
+// the caller must keep it open until the segment is unlinked.
+// Returns NULL and sets errno on error.
+pirate_stats_segment_t *pirate_stats_segment_create(const pirate_stats_t *stats,
+    int *lock_fd);
+
+// Removes the name of the segment if it belongs to the calling
+// process. The mapping stays valid.
+void pirate_stats_segment_unlink(const pirate_stats_segment_t *segment);
+
+// Returns 1 if the segment open on fd was left behind by a
+// process that exited without unlinking it, and 0 otherwise.
+// The owner of a live segment holds an exclusive flock() on it,
+// which does not depend on the pid namespace of the caller.
+int pirate_stats_segment_stale(int fd);
+
+// Describes the channel of gaps descriptor gd, or marks the
+// slot as closed if description is NULL.
+void pirate_stats_segment_update(pirate_stats_segment_t *segment, int gd, int flags,
+    const char *description);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIRATE_STATS_SEGMENT_H */
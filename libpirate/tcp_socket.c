@@ -142,7 +142,7 @@ static int tcp_socket_match_ipv4(int server_fd, tcp_socket_ctx *ctx, struct sock
     int err;
     struct sockaddr_in ip4_addr;
     socklen_t addrlen = sizeof(struct sockaddr_in);
-    ctx->sock = accept(server_fd, (struct sockaddr *) &ip4_addr, &addrlen);
+    ctx->sock = pirate_open_accept(server_fd, (struct sockaddr *) &ip4_addr, &addrlen, 0);
     if (ctx->sock < 0) {
         err = errno;
         close(server_fd);
@@ -163,7 +163,7 @@ static int tcp_socket_match_ipv6(int server_fd, tcp_socket_ctx *ctx, struct sock
     int err;
     struct sockaddr_in6 ip6_addr;
     socklen_t addrlen = sizeof(struct sockaddr_in6);
-    ctx->sock = accept(server_fd, (struct sockaddr *) &ip6_addr, &addrlen);
+    ctx->sock = pirate_open_accept(server_fd, (struct sockaddr *) &ip6_addr, &addrlen, 0);
     if (ctx->sock < 0) {
         err = errno;
         close(server_fd);
@@ -382,21 +382,18 @@ end:
     return ctx->sock;
 }
 
-static int tcp_socket_writer_connect(tcp_socket_ctx *ctx, struct addrinfo* dest_addr) {
+static int tcp_socket_writer_connect(tcp_socket_ctx *ctx, struct addrinfo* dest_addr, long *backoff) {
     int err, rv;
 
     err = errno;
     rv = connect(ctx->sock, dest_addr->ai_addr, dest_addr->ai_addrlen);
     if (rv < 0) {
         // ECONNREFUSED: the reader is not ready for connections
-        // ECONNRESET: either scenario (1) or (2) from above has occurred
-        if ((errno == ECONNREFUSED) || (errno = ECONNRESET)) {
-            struct timespec req;
+        // ECONNRESET, EPIPE: either scenario (1) or (2) from above has occurred
+        if ((errno == ECONNREFUSED) || (errno == ECONNRESET) || (errno == EPIPE)) {
             close(ctx->sock);
             errno = err;
-            req.tv_sec = 0;
-            req.tv_nsec = (rand() % 10) * 1e7;
-            rv = nanosleep(&req, NULL);
+            rv = pirate_open_backoff(backoff, 1);
             if (rv == 0) {
                 return 0;
             }
@@ -409,7 +406,7 @@ static int tcp_socket_writer_connect(tcp_socket_ctx *ctx, struct addrinfo* dest_
     return 1;
 }
 
-static int tcp_socket_writer_test(tcp_socket_ctx *ctx) {
+static int tcp_socket_writer_test(tcp_socket_ctx *ctx, long *backoff) {
     int err, rv;
     char zero = 0;
 
@@ -418,12 +415,9 @@ static int tcp_socket_writer_test(tcp_socket_ctx *ctx) {
     if (rv <= 0) {
         // ECONNRESET: either scenario (1) or (2) from above has occurred
         if ((rv == 0) || (errno == ECONNRESET) || (errno == EPIPE)) {
-            struct timespec req;
             close(ctx->sock);
             errno = err;
-            req.tv_sec = 0;
-            req.tv_nsec = (rand() % 10) * 1e7;
-            rv = nanosleep(&req, NULL);
+            rv = pirate_open_backoff(backoff, 1);
             if (rv == 0) {
                 return 0;
             }
@@ -439,12 +433,9 @@ static int tcp_socket_writer_test(tcp_socket_ctx *ctx) {
     if (rv <= 0) {
         // ECONNRESET: either scenario (1) or (2) from above has occurred
         if ((rv == 0) || (errno == ECONNRESET)) {
-            struct timespec req;
             close(ctx->sock);
             errno = err;
-            req.tv_sec = 0;
-            req.tv_nsec = (rand() % 10) * 1e7;
-            rv = nanosleep(&req, NULL);
+            rv = pirate_open_backoff(backoff, 1);
             if (rv == 0) {
                 return 0;
             }
@@ -458,6 +449,7 @@ static int tcp_socket_writer_test(tcp_socket_ctx *ctx) {
 }
 
 static int tcp_socket_writer_open(pirate_tcp_socket_param_t *param, tcp_socket_ctx *ctx) {
+    long backoff = 0;
     int err, rv;
     struct addrinfo hints, *src_addr = NULL, *dest_addr = NULL;
 
@@ -528,7 +520,7 @@ static int tcp_socket_writer_open(pirate_tcp_socket_param_t *param, tcp_socket_c
             goto end;
         }
 
-        rv = tcp_socket_writer_connect(ctx, dest_addr);
+        rv = tcp_socket_writer_connect(ctx, dest_addr, &backoff);
         if (rv < 0) {
             ctx->sock = -1;
             goto end;
@@ -537,7 +529,7 @@ static int tcp_socket_writer_open(pirate_tcp_socket_param_t *param, tcp_socket_c
         }
         // See comment in tcp_socket_reader_open()
         // on testing the connection.
-        rv = tcp_socket_writer_test(ctx);
+        rv = tcp_socket_writer_test(ctx, &backoff);
         if (rv < 0) {
             ctx->sock = -1;
             goto end;
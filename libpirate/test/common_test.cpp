@@ -13,11 +13,25 @@
  * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <gtest/gtest.h>
 #include "libpirate.h"
 #include "libpirate_internal.h"
+#include "stats_segment.h"
 #include "channel_test.hpp"
 
 // Channel-type agnostic tests
@@ -156,6 +170,301 @@ TEST(CommonChannel, Stats)
     ASSERT_EQ(rv, 0);
 }
 
+static size_t CountOccurrences(const std::string &str, const std::string &sub)
+{
+    size_t count = 0;
+    for (size_t pos = str.find(sub); pos != std::string::npos; pos = str.find(sub, pos + 1)) {
+        count++;
+    }
+    return count;
+}
+
+TEST(CommonChannel, Trace)
+{
+    int rv, read_gd, write_gd;
+    char temp[80];
+    ssize_t nbytes;
+    std::stringstream path, trace;
+    std::ifstream file;
+    errno = 0;
+
+    // ring of 8 events
+    rv = pirate_trace_enable("/tmp/gaps_trace_test", 5);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    read_gd = pirate_open_parse("udp_socket,127.0.0.1,26264,0.0.0.0,0", O_RDONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(read_gd, -1);
+
+    write_gd = pirate_open_parse("udp_socket,127.0.0.1,26264,0.0.0.0,0", O_WRONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(write_gd, -1);
+
+    for (int i = 0; i < 3; i++) {
+        nbytes = pirate_write(write_gd, "hello world", 12);
+        ASSERT_EQ(errno, 0);
+        ASSERT_EQ(nbytes, 12);
+        nbytes = pirate_read(read_gd, temp, sizeof(temp));
+        ASSERT_EQ(errno, 0);
+        ASSERT_EQ(nbytes, 12);
+    }
+
+    // errors are recorded and errno is preserved
+    nbytes = pirate_read(write_gd, temp, sizeof(temp));
+    ASSERT_EQ(errno, EBADF);
+    ASSERT_EQ(nbytes, -1);
+    errno = 0;
+
+    rv = pirate_trace_dump();
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    rv = pirate_trace_enable(NULL, 0);
+    ASSERT_EQ(rv, 0);
+    rv = pirate_trace_dump();
+    ASSERT_EQ(errno, ENOTCONN);
+    ASSERT_EQ(rv, -1);
+    errno = 0;
+
+    path << "/tmp/gaps_trace_test." << getpid() << ".json";
+    file.open(path.str());
+    ASSERT_TRUE(file.is_open());
+    trace << file.rdbuf();
+    file.close();
+    unlink(path.str().c_str());
+
+    // the open of the reader was overwritten
+    std::string str = trace.str();
+    ASSERT_EQ(0u, str.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+    ASSERT_EQ(1u, CountOccurrences(str, "\"name\":\"pirate_open\""));
+    ASSERT_EQ(1u, CountOccurrences(str, "\"channel\":\"udp_socket,127.0.0.1,26264,0.0.0.0,0"));
+    ASSERT_EQ(3u, CountOccurrences(str, "\"name\":\"pirate_write\""));
+    ASSERT_EQ(4u, CountOccurrences(str, "\"name\":\"pirate_read\""));
+    ASSERT_EQ(7u, CountOccurrences(str, "\"count\":"));
+    ASSERT_EQ(1u, CountOccurrences(str, "\"rv\":-1,\"errno\":9}"));
+    ASSERT_EQ(str.size() - 4, str.rfind("\n]}\n"));
+
+    rv = pirate_close(read_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    rv = pirate_close(write_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+}
+
+TEST(CommonChannel, TraceThreadExit)
+{
+    const int gd = 4321;
+    int rv;
+    std::stringstream path, trace;
+    std::ifstream file;
+    errno = 0;
+
+    rv = pirate_trace_enable("/tmp/gaps_trace_thread_test", 5);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    // each thread takes over the ring of the thread before it
+    for (int i = 0; i < 3; i++) {
+        std::thread t([gd] {
+            char temp[8];
+            pirate_read(gd, temp, sizeof(temp));
+        });
+        t.join();
+    }
+    errno = 0;
+
+    rv = pirate_trace_dump();
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    rv = pirate_trace_enable(NULL, 0);
+    ASSERT_EQ(rv, 0);
+
+    path << "/tmp/gaps_trace_thread_test." << getpid() << ".json";
+    file.open(path.str());
+    ASSERT_TRUE(file.is_open());
+    trace << file.rdbuf();
+    file.close();
+    unlink(path.str().c_str());
+
+    ASSERT_EQ(1u, CountOccurrences(trace.str(), "\"gd\":4321,"));
+}
+
+TEST(CommonChannel, StatsPublish)
+{
+    int rv, fd, read_gd, write_gd;
+    char temp[80];
+    ssize_t nbytes;
+    std::stringstream path;
+    const pirate_stats_t *stats;
+    const pirate_stats_segment_t *segment;
+    const pirate_stats_slot_t *slot;
+    errno = 0;
+
+    pirate_reset_stats();
+
+    // opened before the statistics are published
+    read_gd = pirate_open_parse("udp_socket,127.0.0.1,26265,0.0.0.0,0", O_RDONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(read_gd, -1);
+
+    rv = pirate_stats_publish(1);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    write_gd = pirate_open_parse("udp_socket,127.0.0.1,26265,0.0.0.0,0", O_WRONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(write_gd, -1);
+
+    for (int i = 0; i < 3; i++) {
+        nbytes = pirate_write(write_gd, "hello world", 12);
+        ASSERT_EQ(errno, 0);
+        ASSERT_EQ(nbytes, 12);
+        nbytes = pirate_read(read_gd, temp, sizeof(temp));
+        ASSERT_EQ(errno, 0);
+        ASSERT_EQ(nbytes, 12);
+    }
+
+    path << "/dev/shm/pirate_stats." << getpid();
+    fd = open(path.str().c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    segment = (const pirate_stats_segment_t*) mmap(NULL, sizeof(pirate_stats_segment_t),
+        PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    ASSERT_NE(MAP_FAILED, segment);
+    ASSERT_EQ(PIRATE_STATS_SEGMENT_MAGIC, segment->magic);
+    ASSERT_EQ((unsigned) PIRATE_STATS_SEGMENT_SLOTS, segment->slots);
+    ASSERT_EQ(getpid(), segment->pid);
+
+    slot = &segment->slot[pirate_stats_segment_index(read_gd)];
+    ASSERT_EQ(read_gd, slot->gd);
+    ASSERT_EQ(O_RDONLY, slot->flags);
+    ASSERT_STREQ("udp_socket,127.0.0.1,26265,0.0.0.0,0", slot->description);
+    ASSERT_EQ(0u, slot->capacity);
+    stats = &segment->stats[pirate_stats_segment_index(read_gd)];
+    ASSERT_EQ(3u, pirate_get_stats(read_gd)->success);
+    ASSERT_EQ(3u, stats->success);
+    ASSERT_EQ(36u, stats->bytes);
+
+    slot = &segment->slot[pirate_stats_segment_index(write_gd)];
+    ASSERT_EQ(write_gd, slot->gd);
+    ASSERT_EQ(O_WRONLY, slot->flags);
+    ASSERT_EQ(3u, segment->stats[pirate_stats_segment_index(write_gd)].success);
+
+    rv = pirate_close(write_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+    ASSERT_EQ(-1, slot->gd);
+    ASSERT_EQ(0u, slot->seq % 2);
+
+    // the statistics are kept when publishing stops
+    rv = pirate_stats_publish(0);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+    munmap((void*) segment, sizeof(pirate_stats_segment_t));
+    ASSERT_NE(0, access(path.str().c_str(), F_OK));
+    errno = 0;
+    stats = pirate_get_stats(read_gd);
+    ASSERT_EQ(3u, stats->success);
+    ASSERT_EQ(36u, stats->bytes);
+
+    rv = pirate_close(read_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+}
+
+TEST(CommonChannel, StatsUnpublishBlockedRead)
+{
+    int rv, read_gd, write_gd;
+    ssize_t nbytes, nread = -1;
+    errno = 0;
+
+    pirate_reset_stats();
+
+    rv = pirate_stats_publish(1);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    read_gd = pirate_open_parse("udp_socket,127.0.0.1,26266,0.0.0.0,0", O_RDONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(read_gd, -1);
+
+    write_gd = pirate_open_parse("udp_socket,127.0.0.1,26266,0.0.0.0,0", O_WRONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(write_gd, -1);
+
+    // the reader updates the statistics after publishing stops
+    std::thread reader([&] {
+        char temp[80];
+        nread = pirate_read(read_gd, temp, sizeof(temp));
+    });
+    usleep(100000);
+    rv = pirate_stats_publish(0);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    nbytes = pirate_write(write_gd, "hello world", 12);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(nbytes, 12);
+    reader.join();
+    ASSERT_EQ(nread, 12);
+    ASSERT_EQ(1u, pirate_get_stats(read_gd)->success);
+    ASSERT_EQ(1u, pirate_get_stats(write_gd)->success);
+
+    // publishing again keeps the counters
+    rv = pirate_stats_publish(1);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+    ASSERT_EQ(1u, pirate_get_stats(read_gd)->success);
+    rv = pirate_stats_publish(0);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    rv = pirate_close(read_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    rv = pirate_close(write_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+}
+
+TEST(CommonChannel, StatsStaleSegment)
+{
+    int rv, status;
+    pid_t pid;
+    std::stringstream path, own;
+    errno = 0;
+
+    // the child exits without running the exit handlers
+    pid = fork();
+    ASSERT_NE(pid, -1);
+    if (pid == 0) {
+        _exit(pirate_stats_publish(1) == 0 ? 0 : 1);
+    }
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+    path << "/dev/shm/pirate_stats." << pid;
+    ASSERT_EQ(0, access(path.str().c_str(), F_OK));
+
+    // the next process that publishes removes it
+    rv = pirate_stats_publish(1);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+    ASSERT_NE(0, access(path.str().c_str(), F_OK));
+    own << "/dev/shm/pirate_stats." << getpid();
+    ASSERT_EQ(0, access(own.str().c_str(), F_OK));
+    errno = 0;
+
+    rv = pirate_stats_publish(0);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+}
+
 TEST(CommonChannel, Drop)
 {
     int rv, read_gd, write_gd;
@@ -214,4 +523,342 @@ TEST(CommonChannel, Drop)
 
 }
 
+TEST(CommonChannel, OpenAll)
+{
+    int rv, gds[8];
+    char temp[80];
+    ssize_t nbytes;
+    const char *params[8] = {
+        "unix_seqpacket,/tmp/gaps.channel.test.open_all.1",
+        "unix_seqpacket,/tmp/gaps.channel.test.open_all.1",
+        "unix_socket,/tmp/gaps.channel.test.open_all.2",
+        "unix_socket,/tmp/gaps.channel.test.open_all.2",
+        "tcp_socket,127.0.0.1,26262,0.0.0.0,0",
+        "tcp_socket,127.0.0.1,26262,0.0.0.0,0",
+        "udp_socket,127.0.0.1,26263,0.0.0.0,0",
+        "udp_socket,127.0.0.1,26263,0.0.0.0,0",
+    };
+    // writers are listed before readers for some of the channels
+    const int flags[8] = {
+        O_WRONLY, O_RDONLY,
+        O_RDONLY, O_WRONLY,
+        O_WRONLY, O_RDONLY,
+        O_RDONLY, O_WRONLY,
+    };
+
+    unlink(params[0] + strlen("unix_seqpacket,"));
+    unlink(params[2] + strlen("unix_socket,"));
+    errno = 0;
+
+    rv = pirate_open_parse_all(params, flags, gds, 8);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    for (int i = 0; i < 8; i += 2) {
+        int write_gd = (flags[i] == O_WRONLY) ? gds[i] : gds[i + 1];
+        int read_gd = (flags[i] == O_WRONLY) ? gds[i + 1] : gds[i];
+
+        ASSERT_NE(-1, write_gd);
+        ASSERT_NE(-1, read_gd);
+
+        nbytes = pirate_write(write_gd, "hello world", 12);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(12, nbytes);
+
+        nbytes = pirate_read(read_gd, temp, sizeof(temp));
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(12, nbytes);
+        ASSERT_STREQ("hello world", temp);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        rv = pirate_close(gds[i]);
+        ASSERT_EQ(0, rv);
+    }
+    errno = 0;
+}
+
+TEST(CommonChannel, OpenAllInvalid)
+{
+    int rv, gds[2];
+    const char *params[2] = {
+        "udp_socket,127.0.0.1,26264,0.0.0.0,0",
+        "udp_socket,127.0.0.1,0,0.0.0.0,0",
+    };
+    const int flags[2] = { O_RDONLY, O_WRONLY };
+    errno = 0;
+
+    rv = pirate_open_parse_all(params, flags, gds, 2);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    ASSERT_EQ(-1, gds[0]);
+    ASSERT_EQ(-1, gds[1]);
+    errno = 0;
+
+    rv = pirate_open_parse_all(params, flags, gds, -1);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+}
+
+TEST(CommonChannel, OpenAllAbort)
+{
+    int rv, gds[5];
+    // the peers of the first four channels are never opened
+    const char *params[5] = {
+        "tcp_socket,127.0.0.1,26268,0.0.0.0,0",
+        "tcp_socket,127.0.0.1,26269,0.0.0.0,0",
+        "unix_socket,/tmp/gaps.channel.test.open_abort.1",
+        "unix_seqpacket,/tmp/gaps.channel.test.open_abort.2",
+        "udp_socket,127.0.0.1,0,0.0.0.0,0",
+    };
+    const int flags[5] = { O_RDONLY, O_WRONLY, O_RDONLY, O_WRONLY, O_WRONLY };
+
+    unlink(params[2] + strlen("unix_socket,"));
+    unlink(params[3] + strlen("unix_seqpacket,"));
+    errno = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    rv = pirate_open_parse_all(params, flags, gds, 5);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    for (int i = 0; i < 5; i++) {
+        ASSERT_EQ(-1, gds[i]);
+    }
+    ASSERT_LT(elapsed, std::chrono::seconds(5));
+    errno = 0;
+
+    unlink(params[2] + strlen("unix_socket,"));
+}
+
+TEST(CommonChannel, Fragment)
+{
+    int rv, gds[10];
+    ssize_t nbytes;
+    const size_t max_len = 65536;
+    const size_t lengths[] = { 0, 1, 1000, 1008, 1009, 4096, max_len };
+    std::vector<uint8_t> wbuf(max_len + 1), rbuf(max_len + 1);
+    // fragments are sent with sendmmsg() on the udp channel
+    // and one at a time on the unix_seqpacket channel
+    // and through forward error correction on the third channel
+    // and with segmentation offload on the last two channels
+    const char *params[10] = {
+        "udp_socket,127.0.0.1,26265,0.0.0.0,0,mtu=1044,fragment=65536",
+        "udp_socket,127.0.0.1,26265,0.0.0.0,0,mtu=1044,fragment=65536",
+        "unix_seqpacket,/tmp/gaps.channel.test.fragment,mtu=1024,fragment=65536",
+        "unix_seqpacket,/tmp/gaps.channel.test.fragment,mtu=1024,fragment=65536",
+        "udp_socket,127.0.0.1,26267,0.0.0.0,0,mtu=1054,fragment=65536,fec_k=8,fec_m=2",
+        "udp_socket,127.0.0.1,26267,0.0.0.0,0,mtu=1054,fragment=65536,fec_k=8,fec_m=2",
+        "udp_socket,127.0.0.1,26270,0.0.0.0,0,mtu=1044,fragment=65536,gso=1",
+        "udp_socket,127.0.0.1,26270,0.0.0.0,0,mtu=1044,fragment=65536,gso=1",
+        "ge_eth,127.0.0.1,26271,0.0.0.0,0,1,mtu=1024,fragment=65536,gso=1",
+        "ge_eth,127.0.0.1,26271,0.0.0.0,0,1,mtu=1024,fragment=65536,gso=1",
+    };
+    const int flags[10] = { O_RDONLY, O_WRONLY, O_RDONLY, O_WRONLY, O_RDONLY, O_WRONLY,
+        O_RDONLY, O_WRONLY, O_RDONLY, O_WRONLY };
+
+    unlink(params[2] + strlen("unix_seqpacket,"));
+    errno = 0;
+
+    rv = pirate_open_parse_all(params, flags, gds, 10);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    for (size_t i = 0; i < wbuf.size(); i++) {
+        wbuf[i] = i & 0xFF;
+    }
+
+    for (int i = 0; i < 10; i += 2) {
+        int read_gd = gds[i];
+        int write_gd = gds[i + 1];
+
+        ASSERT_EQ((ssize_t) max_len, pirate_write_mtu(write_gd));
+
+        for (size_t len : lengths) {
+            nbytes = pirate_write(write_gd, wbuf.data(), len);
+            ASSERT_EQ(0, errno);
+            ASSERT_EQ((ssize_t) len, nbytes);
+
+            memset(rbuf.data(), 0, rbuf.size());
+            nbytes = pirate_read(read_gd, rbuf.data(), rbuf.size());
+            ASSERT_EQ(0, errno);
+            ASSERT_EQ((ssize_t) len, nbytes);
+            ASSERT_EQ(0, memcmp(wbuf.data(), rbuf.data(), len));
+        }
+
+        nbytes = pirate_write(write_gd, wbuf.data(), max_len + 1);
+        ASSERT_EQ(EMSGSIZE, errno);
+        ASSERT_EQ(-1, nbytes);
+        errno = 0;
+    }
+
+    for (int i = 0; i < 10; i++) {
+        rv = pirate_close(gds[i]);
+        ASSERT_EQ(0, rv);
+    }
+    errno = 0;
+}
+
+// Reassembly of fragments that arrive out of order
+// while an incomplete message is outstanding
+TEST(CommonChannel, FragmentReassembly)
+{
+    int rv, read_gd, write_gd;
+    ssize_t nbytes;
+    char temp[80];
+    struct {
+        uint32_t msg_id;
+        uint32_t total_len;
+        uint32_t offset;
+        uint16_t index;
+        uint16_t count;
+        char data[8];
+    } frame;
+    struct {
+        uint32_t msg_id;
+        uint32_t offset;
+        uint16_t index;
+        const char *data;
+    } frames[] = {
+        { 1, 0, 0, "lost mes" },    // second fragment is never sent
+        { 2, 8, 1, " world" },
+        { 2, 0, 0, "hello, w" },
+        { 2, 8, 1, " world" },      // duplicate
+    };
+
+    read_gd = pirate_open_parse("udp_socket,127.0.0.1,26266,0.0.0.0,0,fragment=64", O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, read_gd);
+
+    write_gd = pirate_open_parse("udp_socket,127.0.0.1,26266,0.0.0.0,0", O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, write_gd);
+
+    for (auto &f : frames) {
+        size_t len = strlen(f.data);
+        frame.msg_id = htonl(f.msg_id);
+        frame.total_len = htonl(14);
+        frame.offset = htonl(f.offset);
+        frame.index = htons(f.index);
+        frame.count = htons(2);
+        memcpy(frame.data, f.data, len);
+        nbytes = pirate_write(write_gd, &frame, offsetof(decltype(frame), data) + len);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ((ssize_t) (offsetof(decltype(frame), data) + len), nbytes);
+    }
+
+    memset(temp, 0, sizeof(temp));
+    nbytes = pirate_read(read_gd, temp, sizeof(temp));
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(14, nbytes);
+    ASSERT_STREQ("hello, w world", temp);
+
+    rv = pirate_close(read_gd);
+    ASSERT_EQ(0, rv);
+    rv = pirate_close(write_gd);
+    ASSERT_EQ(0, rv);
+}
+
+// Forward error correction symbols are relayed through
+// channels without error correction and some are dropped
+TEST(CommonChannel, ForwardErrorCorrection)
+{
+    int rv, gds[4];
+    ssize_t nbytes;
+    uint8_t buf[512];
+    std::vector<std::vector<uint8_t>> written, received;
+    // fec writer -> relay reader, relay writer -> fec reader
+    const char *params[4] = {
+        "udp_socket,127.0.0.1,26268,0.0.0.0,0,mtu=512,fec_k=4,fec_m=2",
+        "udp_socket,127.0.0.1,26268,0.0.0.0,0",
+        "udp_socket,127.0.0.1,26269,0.0.0.0,0",
+        "udp_socket,127.0.0.1,26269,0.0.0.0,0,mtu=512,fec_k=4,fec_m=2",
+    };
+    const int flags[4] = { O_WRONLY, O_RDONLY, O_WRONLY, O_RDONLY };
+    // symbol index within each block of 4 data and 2 parity symbols
+    const std::vector<std::vector<int>> drops = {
+        { 1, 3 },       // two data symbols recovered from two parity symbols
+        { 0, 4 },       // one data symbol recovered from the second parity symbol
+        { 5 },          // no data symbol lost
+    };
+
+    errno = 0;
+    rv = pirate_open_parse_all(params, flags, gds, 4);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    ASSERT_EQ(474, pirate_write_mtu(gds[0]));
+    nbytes = pirate_write(gds[0], buf, 475);
+    ASSERT_EQ(EMSGSIZE, errno);
+    ASSERT_EQ(-1, nbytes);
+    errno = 0;
+
+    for (size_t block = 0; block < drops.size(); block++) {
+        for (int i = 0; i < 4; i++) {
+            size_t len = 1 + (block * 4 + i) * 37;
+            std::vector<uint8_t> msg(len);
+            for (size_t j = 0; j < len; j++) {
+                msg[j] = (block * 4 + i + j) & 0xFF;
+            }
+            nbytes = pirate_write(gds[0], msg.data(), msg.size());
+            ASSERT_EQ(0, errno);
+            ASSERT_EQ((ssize_t) len, nbytes);
+            written.push_back(msg);
+        }
+        for (int i = 0; i < 6; i++) {
+            nbytes = pirate_read(gds[1], buf, sizeof(buf));
+            ASSERT_EQ(0, errno);
+            ASSERT_GT(nbytes, 0);
+            if (std::find(drops[block].begin(), drops[block].end(), i) != drops[block].end()) {
+                continue;
+            }
+            rv = pirate_write(gds[2], buf, nbytes);
+            ASSERT_EQ(0, errno);
+            ASSERT_EQ(nbytes, rv);
+        }
+    }
+
+    for (size_t i = 0; i < written.size(); i++) {
+        nbytes = pirate_read(gds[3], buf, sizeof(buf));
+        ASSERT_EQ(0, errno);
+        ASSERT_GT(nbytes, 0);
+        received.push_back(std::vector<uint8_t>(buf, buf + nbytes));
+    }
+    std::sort(received.begin(), received.end(),
+        [](const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) { return a.size() < b.size(); });
+    ASSERT_EQ(written, received);
+
+    for (int i = 0; i < 4; i++) {
+        rv = pirate_close(gds[i]);
+        ASSERT_EQ(0, rv);
+    }
+}
+
+// The block size must fit in a byte and the channel
+// must keep the boundaries of each symbol
+TEST(CommonChannel, ForwardErrorCorrectionParam)
+{
+    pirate_channel_param_t param;
+    const char *invalid[] = {
+        "udp_socket,127.0.0.1,26270,0.0.0.0,0,mtu=512,fec_k=0,fec_m=2",
+        "udp_socket,127.0.0.1,26270,0.0.0.0,0,mtu=512,fec_k=4,fec_m=0",
+        "udp_socket,127.0.0.1,26270,0.0.0.0,0,mtu=512,fec_k=200,fec_m=100",
+        "pipe,/tmp/gaps.fec_pipe,mtu=512,fec_k=4,fec_m=2",
+        "tcp_socket,127.0.0.1,26270,0.0.0.0,0,mtu=512,fec_k=4,fec_m=2",
+        "unix_socket,/tmp/gaps.fec_unix,mtu=512,fec_k=4,fec_m=2",
+    };
+
+    ASSERT_EQ(-1, pirate_parse_channel_param(
+        "udp_socket,127.0.0.1,26270,0.0.0.0,0,mtu=512,fec_k=256,fec_m=2", &param));
+    ASSERT_EQ(EINVAL, errno);
+    errno = 0;
+
+    for (const char *config : invalid) {
+        ASSERT_EQ(-1, pirate_open_parse(config, O_WRONLY)) << config;
+        ASSERT_EQ(EINVAL, errno) << config;
+        errno = 0;
+    }
+}
+
 } // namespace
@@ -13,6 +13,8 @@
  * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
  */
 
+#include <thread>
+#include <vector>
 #ifdef _WIN32
 #include "windows/libpirate.h"
 #else
@@ -23,6 +25,7 @@
 
 extern "C" {
     uint16_t pirate_ge_eth_crc16(const uint8_t *data, uint16_t len);
+    uint16_t pirate_crc16(uint16_t crc, const void *buf, size_t len);
 }
 
 namespace GAPS
@@ -39,6 +42,202 @@ TEST(ChannelGeEthTest, CRC16X25)
     ASSERT_EQ(0xE5CB, crc);
 }
 
+// Compare the table and carry-less multiplication
+// implementations with a bitwise implementation
+TEST(ChannelGeEthTest, CRC16Implementations)
+{
+    std::vector<uint8_t> data(4096 + 7);
+    unsigned seed = 1;
+
+    for (size_t i = 0; i < data.size(); i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+    for (size_t len = 0; len < data.size(); len += (len < 300) ? 1 : 97) {
+        for (size_t offset = 0; offset < 8; offset += 3) {
+            if ((offset + len) > data.size()) {
+                continue;
+            }
+            uint16_t expected = 0xFFFF;
+            for (size_t i = 0; i < len; i++) {
+                expected ^= data[offset + i];
+                for (int j = 0; j < 8; j++) {
+                    expected = (expected >> 1) ^ ((expected & 1) ? 0x8408 : 0);
+                }
+            }
+            expected ^= 0xFFFF;
+            ASSERT_EQ(expected, pirate_crc16(0, &data[offset], len)) << "len " << len;
+            size_t half = len / 2;
+            uint16_t crc = pirate_crc16(0, &data[offset], half);
+            ASSERT_EQ(expected, pirate_crc16(crc, &data[offset + half], len - half)) << "len " << len;
+        }
+    }
+}
+
+// Messages with a bad crc are discarded and counted
+TEST(ChannelGeEthTest, CRC16Verify)
+{
+#ifndef _WIN32
+    int rv, gd_r, gd_w, gd_raw;
+    uint8_t frame[32];
+    char buf[32];
+    uint64_t dropped;
+
+    gd_r = pirate_open_parse("ge_eth,127.0.0.1,26432,0.0.0.0,0,7,payload_crc=1", O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_r);
+    gd_w = pirate_open_parse("ge_eth,127.0.0.1,26432,0.0.0.0,0,7,payload_crc=1", O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_w);
+    gd_raw = pirate_open_parse("udp_socket,127.0.0.1,26432,0.0.0.0,0", O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_raw);
+    dropped = pirate_get_stats(gd_r)->dropped;
+
+    // message id 7, length 5, header crc only, "hello"
+    memset(frame, 0, sizeof(frame));
+    frame[3] = 7;
+    frame[5] = 5;
+    uint16_t crc = pirate_ge_eth_crc16(frame, 6);
+    frame[6] = crc >> 8;
+    frame[7] = crc & 0xFF;
+    memcpy(frame + 8, "hello", 5);
+    rv = pirate_write(gd_raw, frame, 13);
+    ASSERT_EQ(13, rv);
+    // truncated
+    rv = pirate_write(gd_raw, frame, 10);
+    ASSERT_EQ(10, rv);
+
+    rv = pirate_write(gd_w, "world", 6);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(6, rv);
+
+    rv = pirate_read(gd_r, buf, sizeof(buf));
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(6, rv);
+    ASSERT_STREQ("world", buf);
+    ASSERT_EQ(dropped + 2, pirate_get_stats(gd_r)->dropped);
+
+    pirate_close(gd_r);
+    pirate_close(gd_w);
+    pirate_close(gd_raw);
+#endif
+}
+
+TEST(ChannelGeEthTest, MessageIdDemux)
+{
+#ifndef _WIN32
+    const int ids = 3;
+    int rv, gd_r[ids], gd_w[ids], gd_unrouted, gd_nonblock;
+    char param[128], buf[4096], msg[4096];
+
+    for (int i = 0; i < ids; i++) {
+        // the last channel is fragmented to send batches of frames
+        snprintf(param, sizeof(param), "ge_eth,127.0.0.1,26433,0.0.0.0,0,%d,demux=1%s",
+            i + 1, (i == ids - 1) ? ",fragment=4096" : "");
+        gd_r[i] = pirate_open_parse(param, O_RDONLY);
+        ASSERT_EQ(0, errno);
+        ASSERT_NE(-1, gd_r[i]);
+        gd_w[i] = pirate_open_parse(param, O_WRONLY);
+        ASSERT_EQ(0, errno);
+        ASSERT_NE(-1, gd_w[i]);
+    }
+    // channels share the socket and use gaps descriptors
+    ASSERT_LT(gd_r[0], -1);
+    ASSERT_NE(gd_r[0], gd_r[1]);
+
+    rv = pirate_open_parse("ge_eth,127.0.0.1,26433,0.0.0.0,0,2,demux=1", O_RDONLY);
+    ASSERT_EQ(-1, rv);
+    ASSERT_EQ(EADDRINUSE, errno);
+    errno = 0;
+
+    gd_nonblock = pirate_open_parse("ge_eth,127.0.0.1,26433,0.0.0.0,0,4,demux=1", O_RDONLY | O_NONBLOCK);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_nonblock);
+    gd_unrouted = pirate_open_parse("ge_eth,127.0.0.1,26433,0.0.0.0,0,9,demux=1", O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_unrouted);
+
+    for (int i = 0; i < (int) sizeof(msg); i++) {
+        msg[i] = i & 0xFF;
+    }
+    for (int j = 0; j < 4; j++) {
+        rv = pirate_write(gd_unrouted, "unrouted", 9);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(9, rv);
+        for (int i = 0; i < ids; i++) {
+            msg[0] = i;
+            msg[1] = j;
+            rv = pirate_write(gd_w[i], msg, (i == ids - 1) ? sizeof(msg) : 16);
+            ASSERT_EQ(0, errno);
+        }
+    }
+    // read the channels in the reverse order of the writes
+    for (int i = ids - 1; i >= 0; i--) {
+        for (int j = 0; j < 4; j++) {
+            rv = pirate_read(gd_r[i], buf, sizeof(buf));
+            ASSERT_EQ(0, errno);
+            ASSERT_EQ((i == ids - 1) ? (int) sizeof(msg) : 16, rv);
+            ASSERT_EQ(i, buf[0]);
+            ASSERT_EQ(j, buf[1]);
+            ASSERT_EQ(0, memcmp(buf + 2, msg + 2, rv - 2));
+        }
+    }
+    rv = pirate_read(gd_nonblock, buf, sizeof(buf));
+    ASSERT_EQ(-1, rv);
+    ASSERT_EQ(EAGAIN, errno);
+    errno = 0;
+
+    for (int i = 0; i < ids; i++) {
+        ASSERT_EQ(0, pirate_close(gd_r[i]));
+        ASSERT_EQ(0, pirate_close(gd_w[i]));
+    }
+    ASSERT_EQ(0, pirate_close(gd_nonblock));
+    ASSERT_EQ(0, pirate_close(gd_unrouted));
+
+    // the last close releases the socket
+    gd_r[0] = pirate_open_parse("ge_eth,127.0.0.1,26433,0.0.0.0,0,1,demux=1,mtu=512", O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_r[0]);
+    // a reused gaps descriptor starts with cleared statistics
+    const pirate_stats_t *stats = pirate_get_stats(gd_r[0]);
+    ASSERT_NE(nullptr, stats);
+    ASSERT_EQ(0u, stats->requests);
+    ASSERT_EQ(0u, stats->success);
+    ASSERT_EQ(0, pirate_close(gd_r[0]));
+#endif
+}
+
+TEST(ChannelGeEthTest, DemuxCloseWhileBlocked)
+{
+#ifndef _WIN32
+    int gd_r, gd_other;
+    ssize_t nread = 0;
+    int nerrno = 0;
+
+    gd_r = pirate_open_parse("ge_eth,127.0.0.1,26434,0.0.0.0,0,1,demux=1", O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_r);
+    // keeps the endpoint and its receive thread alive
+    gd_other = pirate_open_parse("ge_eth,127.0.0.1,26434,0.0.0.0,0,2,demux=1", O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_other);
+
+    std::thread reader([&] {
+        char buf[128];
+        nread = pirate_read(gd_r, buf, sizeof(buf));
+        nerrno = errno;
+    });
+    usleep(100000);
+    ASSERT_EQ(0, pirate_close(gd_r));
+    reader.join();
+    ASSERT_EQ(-1, nread);
+    ASSERT_EQ(EBADF, nerrno);
+
+    ASSERT_EQ(0, pirate_close(gd_other));
+#endif
+}
+
 TEST(ChannelGeEthTest, ConfigurationParser) {
     int rv;
     pirate_channel_param_t param;
@@ -111,6 +310,15 @@ TEST(ChannelGeEthTest, ConfigurationParser) {
     ASSERT_EQ(port2, ge_eth_param->writer_port);
     ASSERT_EQ(message_id, ge_eth_param->message_id);
     ASSERT_EQ(mtu, ge_eth_param->mtu);
+
+#ifndef _WIN32
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%d,%s,%d,%u,rate=1Gbps,burst=16KiB", name, addr1, port1, addr2, port2, message_id);
+    rv  = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(1000000000u, ge_eth_param->rate);
+    ASSERT_EQ(16384u, ge_eth_param->burst);
+#endif
 }
 
 class GeEthTest : public ChannelTest, public WithParamInterface<unsigned>
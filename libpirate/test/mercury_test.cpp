@@ -14,6 +14,8 @@
  */
 
 #include <cstring>
+#include <thread>
+#include <vector>
 #include "libpirate.h"
 #include "mercury_cntl.h"
 #include "channel_test.hpp"
@@ -104,6 +106,15 @@ TEST(ChannelMercuryTest, ConfigurationParser) {
     expParam.channel.mercury.session.message_count = 3;
     expParam.channel.mercury.session.messages[2] = msg_ids[2];
     EXPECT_TRUE(0 == std::memcmp(&expParam, &rdParam, sizeof(rdParam)));
+
+    pirate_init_channel_param(MERCURY, &rdParam);
+    snprintf(opt, sizeof(opt) - 1, "%s,%u,%u,%u,batch=8,flush=500", name, level, src_id, dst_id);
+    rv = pirate_parse_channel_param(opt, &rdParam);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(8u, rdParam.channel.mercury.batch);
+    ASSERT_EQ(500u, rdParam.channel.mercury.flush);
+    ASSERT_EQ(0u, rdParam.channel.mercury.session.message_count);
 }
 
 TEST(ChannelMercuryTest, UnparseChannelParam)
@@ -129,6 +140,16 @@ TEST(ChannelMercuryTest, UnparseChannelParam)
     ASSERT_EQ(0, errno);
     ASSERT_STREQ("mer", output);
     free(output);
+
+    rv = pirate_parse_channel_param("mercury,0,1,2,3,batch=8,flush=500", &param);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(0, errno);
+
+    output = (char*) calloc(64, sizeof(char));
+    rv = pirate_unparse_channel_param(&param, output, 64);
+    ASSERT_EQ(0, errno);
+    ASSERT_STREQ("mercury,0,1,2,batch=8,flush=500,3", output);
+    free(output);
 }
 
 TEST(ChannelMercuryTest, DefaultSession) {
@@ -218,6 +239,151 @@ TEST(ChannelMercuryTest, DefaultSession) {
     ASSERT_EQ(0, rv);
 }
 
+TEST(ChannelMercuryTest, ConcurrentSessionOpen) {
+    const unsigned nthreads = 8;
+    const uint32_t session_id = 0xECA51756;
+    std::vector<std::thread> threads;
+    int gds[nthreads];
+    uint32_t ids[nthreads];
+
+    if (access(PIRATE_MERCURY_ROOT_DEV, R_OK | W_OK) != 0) {
+        ASSERT_EQ(ENOENT, errno);
+        errno = 0;
+        return;
+    }
+
+    for (unsigned i = 0; i < nthreads; i++) {
+        threads.emplace_back([&gds, &ids, i] {
+            pirate_channel_param_t param;
+            pirate_init_channel_param(MERCURY, &param);
+            param.channel.mercury.session.level = 1;
+            param.channel.mercury.session.source_id = 1;
+            param.channel.mercury.session.destination_id = 2;
+            param.channel.mercury.session.message_count = 5;
+            param.channel.mercury.session.messages[0] = 1;
+            param.channel.mercury.session.messages[1] = 3;
+            gds[i] = pirate_open_param(&param, (i % 2) ? O_RDONLY : O_WRONLY);
+            ids[i] = 0;
+            if ((gds[i] >= 0) && (pirate_get_channel_param(gds[i], &param) == 0)) {
+                ids[i] = param.channel.mercury.session.id;
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    for (unsigned i = 0; i < nthreads; i++) {
+        ASSERT_GE(gds[i], 0);
+        ASSERT_EQ(session_id, ids[i]);
+        ASSERT_EQ(0, pirate_close(gds[i]));
+    }
+    ASSERT_EQ(0, errno);
+}
+
+TEST(ChannelMercuryTest, BatchFrame) {
+    const uint32_t batch = 4;
+    const uint32_t flush_us = 100000;
+    int rv, rchannel, wchannel;
+    pirate_channel_param_t param;
+    uint32_t session_id;
+    uint8_t wr_data[batch], rd_data[batch];
+    ssize_t io_size;
+    mercury_dev_stat_t stats;
+    struct timespec start, now;
+    uint64_t elapsed_us;
+
+    if (access(PIRATE_MERCURY_ROOT_DEV, R_OK | W_OK) != 0) {
+        ASSERT_EQ(ENOENT, errno);
+        errno = 0;
+        return;
+    }
+
+    pirate_init_channel_param(MERCURY, &param);
+    param.channel.mercury.batch = batch;
+    param.channel.mercury.flush = flush_us;
+    wchannel = pirate_open_param(&param, O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_GE(wchannel, 0);
+    rchannel = pirate_open_param(&param, O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_GE(rchannel, 0);
+
+    rv = pirate_get_channel_param(wchannel, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    session_id = param.channel.mercury.session.id;
+    rv = mercury_cmd_stat_clear(session_id);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    // message i is i + 1 bytes long, so the reader must find
+    // each message boundary from its length prefix
+    for (uint32_t i = 0; i < batch; i++) {
+        memset(wr_data, i, sizeof(wr_data));
+        io_size = pirate_write(wchannel, wr_data, i + 1);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ((ssize_t) i + 1, io_size);
+    }
+
+    // the frame is sent when it holds batch messages
+    rv = mercury_cmd_stat(session_id, &stats);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(1u, stats.send_count);
+    ASSERT_EQ(0u, stats.send_reject_count);
+
+    for (uint32_t i = 0; i < batch; i++) {
+        memset(wr_data, i, sizeof(wr_data));
+        memset(rd_data, 0xFF, sizeof(rd_data));
+        io_size = pirate_read(rchannel, rd_data, sizeof(rd_data));
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ((ssize_t) i + 1, io_size);
+        EXPECT_TRUE(0 == std::memcmp(wr_data, rd_data, i + 1));
+    }
+
+    rv = mercury_cmd_stat(session_id, &stats);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(1u, stats.receive_count);
+    ASSERT_EQ(0u, stats.receive_reject_count);
+
+    // a partial frame is sent at the flush deadline
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < batch / 2; i++) {
+        memset(wr_data, i, sizeof(wr_data));
+        io_size = pirate_write(wchannel, wr_data, sizeof(wr_data));
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ((ssize_t) sizeof(wr_data), io_size);
+    }
+
+    for (uint32_t i = 0; i < batch / 2; i++) {
+        memset(wr_data, i, sizeof(wr_data));
+        io_size = pirate_read(rchannel, rd_data, sizeof(rd_data));
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ((ssize_t) sizeof(wr_data), io_size);
+        EXPECT_TRUE(0 == std::memcmp(wr_data, rd_data, sizeof(wr_data)));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed_us = (now.tv_sec - start.tv_sec) * 1000000ul +
+        (now.tv_nsec - start.tv_nsec) / 1000l;
+    ASSERT_GE(elapsed_us, flush_us);
+
+    rv = mercury_cmd_stat(session_id, &stats);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(2u, stats.send_count);
+    ASSERT_EQ(2u, stats.receive_count);
+
+    rv = pirate_close(wchannel);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    rv = pirate_close(rchannel);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+}
+
 
 typedef struct {
     uint32_t    level;
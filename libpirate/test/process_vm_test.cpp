@@ -0,0 +1,219 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "libpirate.h"
+#include "channel_test.hpp"
+
+namespace GAPS
+{
+
+using ::testing::WithParamInterface;
+using ::testing::TestWithParam;
+using ::testing::Values;
+
+TEST(ChannelProcessVmTest, ConfigurationParser) {
+    int rv;
+    pirate_channel_param_t param;
+
+    char opt[128];
+    const char *name = "process_vm";
+    const char *path = "/tmp/test_process_vm";
+    const uint32_t ring_len = 42;
+    const uint32_t mtu = 4096;
+
+#if PIRATE_SHMEM_FEATURE
+    const pirate_process_vm_param_t *process_vm_param = &param.channel.process_vm;
+    snprintf(opt, sizeof(opt) - 1, "%s", name);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s", name, path);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(PROCESS_VM, param.channel_type);
+    ASSERT_STREQ(path, process_vm_param->path);
+    ASSERT_EQ(0u, process_vm_param->ring_len);
+    ASSERT_EQ(0u, process_vm_param->mtu);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,ring_len=%u,mtu=%u", name, path, ring_len, mtu);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(PROCESS_VM, param.channel_type);
+    ASSERT_STREQ(path, process_vm_param->path);
+    ASSERT_EQ(ring_len, process_vm_param->ring_len);
+    ASSERT_EQ(mtu, process_vm_param->mtu);
+
+    char desc[128];
+    rv = pirate_unparse_channel_param(&param, desc, sizeof(desc));
+    ASSERT_GT(rv, 0);
+    ASSERT_STREQ(opt, desc);
+#else
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,ring_len=%u", name, path, ring_len);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(-1, rv);
+    ASSERT_EQ(ESOCKTNOSUPPORT, errno);
+    errno = 0;
+#endif
+}
+
+#if PIRATE_SHMEM_FEATURE
+class ProcessVmTest : public ChannelTest, public WithParamInterface<int>
+{
+public:
+    void ChannelInit()
+    {
+        pirate_process_vm_param_t *param = &Reader.param.channel.process_vm;
+
+        const char *testPath = "/gaps.process_vm_test";
+        pirate_init_channel_param(PROCESS_VM, &Reader.param);
+        strncpy(param->path, testPath, PIRATE_LEN_NAME - 1);
+        param->ring_len = GetParam();
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_P(ProcessVmTest, Run)
+{
+    Run();
+}
+
+// default ring length and a ring that fills
+INSTANTIATE_TEST_SUITE_P(ProcessVmFunctionalTest, ProcessVmTest,
+    Values(0, 2));
+
+// Messages that do not fit in a ring entry are copied from the
+// address space of a writer in a different process.
+TEST(ChannelProcessVmTest, CrossProcess)
+{
+    const char *config = "process_vm,/gaps.process_vm_cross_test,ring_len=4";
+    const size_t lengths[] = { 1, 240, 241, 4096, 1 << 20 };
+    const size_t count = sizeof(lengths) / sizeof(lengths[0]);
+    std::vector<uint8_t> buf(1 << 20);
+    int status;
+
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        int gd = pirate_open_parse(config, O_WRONLY);
+        if (gd == -1) {
+            _exit(1);
+        }
+        for (size_t i = 0; i < count; i++) {
+            for (size_t j = 0; j < lengths[i]; j++) {
+                buf[j] = (i + j) & 0xFF;
+            }
+            if (pirate_write(gd, buf.data(), lengths[i]) != (ssize_t) lengths[i]) {
+                _exit(2);
+            }
+        }
+        pirate_close(gd);
+        _exit(0);
+    }
+
+    int gd = pirate_open_parse(config, O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd);
+    for (size_t i = 0; i < count; i++) {
+        ssize_t rv = pirate_read(gd, buf.data(), buf.size());
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ((ssize_t) lengths[i], rv);
+        for (size_t j = 0; j < lengths[i]; j++) {
+            ASSERT_EQ((i + j) & 0xFF, buf[j]);
+        }
+    }
+    ASSERT_EQ(0, pirate_read(gd, buf.data(), buf.size()));
+    ASSERT_EQ(0, pirate_close(gd));
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+}
+
+// The writers of a process grant ptrace access to one reader process
+TEST(ChannelProcessVmTest, OneReaderProcess)
+{
+    const char *config[2] = {
+        "process_vm,/gaps.process_vm_ptracer.1",
+        "process_vm,/gaps.process_vm_ptracer.2",
+    };
+    pid_t pid[2];
+    int gd[2], status;
+
+    for (int i = 0; i < 2; i++) {
+        pid[i] = fork();
+        ASSERT_GE(pid[i], 0);
+        if (pid[i] == 0) {
+            uint8_t buf[16];
+            int reader_gd = pirate_open_parse(config[i], O_RDONLY);
+            if (reader_gd == -1) {
+                _exit(1);
+            }
+            // end of file once the writer is closed or rejected
+            if (pirate_read(reader_gd, buf, sizeof(buf)) != 0) {
+                _exit(2);
+            }
+            pirate_close(reader_gd);
+            _exit(0);
+        }
+    }
+
+    gd[0] = pirate_open_parse(config[0], O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd[0]);
+    gd[1] = pirate_open_parse(config[1], O_WRONLY);
+    ASSERT_EQ(EBUSY, errno);
+    ASSERT_EQ(-1, gd[1]);
+    errno = 0;
+    ASSERT_EQ(0, pirate_close(gd[0]));
+
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(pid[i], waitpid(pid[i], &status, 0));
+        ASSERT_TRUE(WIFEXITED(status));
+        ASSERT_EQ(0, WEXITSTATUS(status));
+    }
+
+    // the reader of the second channel may be served once
+    // the first writer is closed
+    pid[1] = fork();
+    ASSERT_GE(pid[1], 0);
+    if (pid[1] == 0) {
+        uint8_t buf[16];
+        int reader_gd = pirate_open_parse(config[1], O_RDONLY);
+        if (reader_gd == -1) {
+            _exit(1);
+        }
+        if (pirate_read(reader_gd, buf, sizeof(buf)) != 0) {
+            _exit(2);
+        }
+        pirate_close(reader_gd);
+        _exit(0);
+    }
+    gd[1] = pirate_open_parse(config[1], O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd[1]);
+    ASSERT_EQ(0, pirate_close(gd[1]));
+    ASSERT_EQ(pid[1], waitpid(pid[1], &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+}
+#endif
+
+} // namespace
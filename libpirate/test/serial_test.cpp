@@ -13,6 +13,12 @@
  * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
  */
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
 #include "libpirate.h"
 #include "channel_test.hpp"
 
@@ -70,6 +76,22 @@ TEST(ChannelSerialTest, ConfigurationParser) {
     ASSERT_EQ(baud, serial_param->baud);
     ASSERT_EQ(mtu, serial_param->mtu);
 
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,baud=%s,mtu=%u,drain=1", name, path, baud_str, mtu);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(SERIAL, param.channel_type);
+    ASSERT_EQ(mtu, serial_param->mtu);
+    ASSERT_EQ(1u, serial_param->drain);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,mtu=%u,cobs=1", name, path, mtu);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(SERIAL, param.channel_type);
+    ASSERT_EQ(mtu, serial_param->mtu);
+    ASSERT_EQ(1u, serial_param->cobs);
+
     snprintf(opt, sizeof(opt) - 1, "%s,%s,baud=%s,mtu=%u", name, path,
                 invalid_baud_str, mtu);
     rv = pirate_parse_channel_param(opt, &param);
@@ -135,4 +157,194 @@ INSTANTIATE_TEST_SUITE_P(SerialFunctionalTest, SerialTest,
     Combine(Values(0, SerialTest::TEST_BAUD),
             Values(0, SerialTest::TEST_MAX_TX)));
 
+static void OpenPty(int *master, char *path, size_t len)
+{
+    struct termios attr;
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    ASSERT_GE(*master, 0);
+    ASSERT_EQ(0, grantpt(*master));
+    ASSERT_EQ(0, unlockpt(*master));
+    ASSERT_EQ(0, ptsname_r(*master, path, len));
+    ASSERT_EQ(0, tcgetattr(*master, &attr));
+    cfmakeraw(&attr);
+    ASSERT_EQ(0, tcsetattr(*master, TCSANOW, &attr));
+}
+
+// Two pseudoterminal pairs joined by a relay thread. The writer
+// opens the slave of the first pair and the reader opens the slave
+// of the second pair. The relay copies from the first master to
+// the second master.
+class SerialPtyTest : public ChannelTest,
+    public WithParamInterface<std::tuple<int, int, int>>
+{
+public:
+    void SetUp() override
+    {
+        ChannelTest::SetUp();
+        for (int i = 0; i < 2; i++) {
+            OpenPty(&master[i], slavePath[i], sizeof(slavePath[i]));
+            // Hold the slave open so that the master does
+            // not observe a hangup between test cases.
+            slave[i] = open(slavePath[i], O_RDWR | O_NOCTTY);
+            ASSERT_GE(slave[i], 0);
+        }
+        ASSERT_EQ(0, pthread_create(&relay, NULL, RelayThread, this));
+    }
+
+    void TearDown() override
+    {
+        // closing the last slave of the first pair ends the relay
+        close(slave[0]);
+        pthread_join(relay, NULL);
+        close(slave[1]);
+        close(master[0]);
+        close(master[1]);
+        ChannelTest::TearDown();
+        errno = 0;
+    }
+
+    static void *RelayThread(void *arg)
+    {
+        SerialPtyTest *inst = static_cast<SerialPtyTest*>(arg);
+        uint8_t buf[256];
+        for (;;) {
+            ssize_t rv = read(inst->master[0], buf, sizeof(buf));
+            if (rv <= 0) {
+                return NULL;
+            }
+            for (ssize_t tx = 0; tx < rv;) {
+                ssize_t wr = write(inst->master[1], buf + tx, rv - tx);
+                if (wr < 0) {
+                    return NULL;
+                }
+                tx += wr;
+            }
+        }
+    }
+
+    void ChannelInit()
+    {
+        pirate_serial_param_t *param = &Reader.param.channel.serial;
+        auto test_param = GetParam();
+
+        pirate_init_channel_param(SERIAL, &Reader.param);
+        param->baud = PIRATE_SERIAL_DEFAULT_BAUD;
+        param->max_tx = std::get<0>(test_param);
+        param->drain = std::get<1>(test_param);
+        param->cobs = std::get<2>(test_param);
+        strncpy(param->path, slavePath[1], PIRATE_LEN_NAME - 1);
+        Writer.param = Reader.param;
+        strncpy(Writer.param.channel.serial.path, slavePath[0], PIRATE_LEN_NAME - 1);
+    }
+
+    void WriterChannelPreClose() override
+    {
+        double utilization = pirate_serial_link_utilization(Writer.gd);
+        ASSERT_EQ(0, errno);
+        ASSERT_GT(utilization, 0.0);
+    }
+
+    int master[2];
+    int slave[2];
+    char slavePath[2][PIRATE_LEN_NAME / 2];
+    pthread_t relay;
+};
+
+TEST_P(SerialPtyTest, Run)
+{
+    Run();
+}
+
+// max_tx smaller and larger than the test messages, with and without drain,
+// with length header and COBS framing
+INSTANTIATE_TEST_SUITE_P(SerialPtyFunctionalTest, SerialPtyTest,
+    Combine(Values(8, PIRATE_SERIAL_DEFAULT_MAX_TX), Values(0, 1), Values(0, 1)));
+
+// Reads one COBS frame, including both delimiters, from the master
+static std::vector<uint8_t> ReadFrame(int fd)
+{
+    std::vector<uint8_t> frame;
+    uint8_t c;
+    while (read(fd, &c, 1) == 1) {
+        frame.push_back(c);
+        if ((c == 0) && (frame.size() > 1)) {
+            break;
+        }
+    }
+    return frame;
+}
+
+// Corrupted frames, line noise, and an unterminated run of bytes
+// longer than the largest frame are dropped by the reader. The reader
+// resynchronizes on the next delimiter and receives the intact frame.
+TEST(ChannelSerialTest, CobsResynchronize)
+{
+    int rv;
+    int masterW, masterR;
+    char pathW[PIRATE_LEN_NAME / 2], pathR[PIRATE_LEN_NAME / 2];
+    char opt[PIRATE_LEN_NAME];
+    const char *msg[2] = { "corrupted message", "intact message" };
+    std::vector<uint8_t> frame[2];
+    std::vector<uint8_t> stream;
+    char buf[64];
+    char big[sizeof(buf) + 1];
+
+    OpenPty(&masterW, pathW, sizeof(pathW));
+    OpenPty(&masterR, pathR, sizeof(pathR));
+
+    snprintf(opt, sizeof(opt), "serial,%s,mtu=64,cobs=1", pathW);
+    int writer = pirate_open_parse(opt, O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_GE(writer, 0);
+    snprintf(opt, sizeof(opt), "serial,%s,mtu=64,cobs=1", pathR);
+    int reader = pirate_open_parse(opt, O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_GE(reader, 0);
+
+    for (int i = 0; i < 2; i++) {
+        rv = pirate_write(writer, msg[i], strlen(msg[i]));
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ((int) strlen(msg[i]), rv);
+        frame[i] = ReadFrame(masterW);
+        ASSERT_GT(frame[i].size(), strlen(msg[i]) + 2);
+        ASSERT_EQ(0, frame[i].front());
+        ASSERT_EQ(0, frame[i].back());
+    }
+
+    // line noise ahead of the first frame
+    const char *noise = "\x13\x37noise";
+    stream.insert(stream.end(), noise, noise + strlen(noise));
+    // single bit error inside the first frame
+    uint8_t *flip = &frame[0][frame[0].size() / 2];
+    *flip ^= ((*flip ^ 0x40) == 0) ? 0x20 : 0x40;
+    stream.insert(stream.end(), frame[0].begin(), frame[0].end());
+    // lost delimiters
+    stream.insert(stream.end(), 256, 0xAA);
+    stream.insert(stream.end(), frame[1].begin(), frame[1].end());
+
+    for (size_t tx = 0; tx < stream.size();) {
+        rv = write(masterR, stream.data() + tx, stream.size() - tx);
+        ASSERT_GT(rv, 0);
+        tx += rv;
+    }
+
+    memset(buf, 0, sizeof(buf));
+    rv = pirate_read(reader, buf, sizeof(buf));
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ((int) strlen(msg[1]), rv);
+    ASSERT_STREQ(msg[1], buf);
+
+    // message larger than the mtu
+    memset(big, 'x', sizeof(big));
+    rv = pirate_write(writer, big, sizeof(big));
+    ASSERT_EQ(EMSGSIZE, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    ASSERT_EQ(0, pirate_close(writer));
+    ASSERT_EQ(0, pirate_close(reader));
+    close(masterW);
+    close(masterR);
+}
+
 } // namespace
@@ -13,6 +13,7 @@
  * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
  */
 
+#include <thread>
 #include "libpirate.h"
 #include "channel_test.hpp"
 
@@ -95,6 +96,91 @@ TEST_P(ShmemTest, Run)
     Run();
 }
 
+// The writer must block when the free space cannot hold
+// a header and at least one byte of data
+TEST(ChannelShmemTest, NearlyFullBuffer)
+{
+    const char *config = "shmem,/gaps.shmem_full,buffer_size=72";
+    uint8_t wbuf[64], rbuf[64];
+    int reader_gd = -1;
+    ssize_t first = -1, second = -1;
+
+    memset(wbuf, 0xA5, sizeof(wbuf));
+    std::thread reader([&] {
+        reader_gd = pirate_open_parse(config, O_RDONLY);
+        if (reader_gd == -1) {
+            return;
+        }
+        // let the writer fill the buffer before the first read
+        usleep(10000);
+        first = pirate_read(reader_gd, rbuf, sizeof(rbuf));
+        second = pirate_read(reader_gd, rbuf, sizeof(rbuf));
+    });
+    int writer_gd = pirate_open_parse(config, O_WRONLY);
+    ASSERT_NE(-1, writer_gd);
+    // only a header fits after the header and 64 bytes of data
+    ASSERT_EQ(64, pirate_write(writer_gd, wbuf, 64));
+    ASSERT_EQ(16, pirate_write(writer_gd, wbuf, 16));
+    reader.join();
+    ASSERT_NE(-1, reader_gd);
+    ASSERT_EQ(64, first);
+    ASSERT_EQ(16, second);
+    ASSERT_EQ(0, pirate_close(writer_gd));
+    ASSERT_EQ(0, pirate_close(reader_gd));
+}
+
+// The writer blocks on the full ring until the reader wakes up.
+// Both ends see the counters of both ends.
+TEST(ChannelShmemTest, RingStats)
+{
+    const char *config = "shmem,/gaps.shmem_ring_stats,buffer_size=72";
+    uint8_t wbuf[64], rbuf[64];
+    int reader_gd = -1;
+    ssize_t first = -1, second = -1;
+    pirate_ring_stats_t reader_stats, writer_stats;
+
+    memset(wbuf, 0xA5, sizeof(wbuf));
+    std::thread reader([&] {
+        reader_gd = pirate_open_parse(config, O_RDONLY);
+        if (reader_gd == -1) {
+            return;
+        }
+        usleep(10000);
+        first = pirate_read(reader_gd, rbuf, sizeof(rbuf));
+        second = pirate_read(reader_gd, rbuf, sizeof(rbuf));
+    });
+    int writer_gd = pirate_open_parse(config, O_WRONLY);
+    ASSERT_NE(-1, writer_gd);
+    ASSERT_EQ(64, pirate_write(writer_gd, wbuf, 64));
+    ASSERT_EQ(16, pirate_write(writer_gd, wbuf, 16));
+    reader.join();
+    ASSERT_NE(-1, reader_gd);
+    ASSERT_EQ(64, first);
+    ASSERT_EQ(16, second);
+
+    ASSERT_EQ(0, pirate_get_ring_stats(writer_gd, &writer_stats));
+    ASSERT_EQ(0, pirate_get_ring_stats(reader_gd, &reader_stats));
+    ASSERT_EQ(0, memcmp(&writer_stats, &reader_stats, sizeof(pirate_ring_stats_t)));
+    ASSERT_EQ(72u, writer_stats.capacity);
+    ASSERT_EQ(0u, writer_stats.queued);
+    // a header and 64 bytes of data
+    ASSERT_EQ(68u, writer_stats.high_water);
+    ASSERT_EQ(2u, writer_stats.writer.operations);
+    ASSERT_EQ(2u, writer_stats.reader.operations);
+    ASSERT_GT(writer_stats.writer.spins, 0u);
+    ASSERT_GT(writer_stats.writer.blocked_ns, 0u);
+    // each write found the ring empty and the first read found it full
+    ASSERT_EQ(2u, writer_stats.writer.wakeups);
+    ASSERT_EQ(1u, writer_stats.reader.wakeups);
+
+    ASSERT_EQ(0, pirate_close(writer_gd));
+    ASSERT_EQ(0, pirate_close(reader_gd));
+
+    ASSERT_EQ(-1, pirate_get_ring_stats(writer_gd, &writer_stats));
+    ASSERT_EQ(EBADF, errno);
+    errno = 0;
+}
+
 static const int TEST_BUF_LEN = PIRATE_DEFAULT_SMEM_BUF_LEN / 2;
 static const int TEST_MAX_TX_LEN = 16;
 
@@ -92,6 +92,33 @@ TEST(ChannelUdpSocketTest, ConfigurationParser) {
     ASSERT_STREQ(addr2, udp_socket_param->writer_addr);
     ASSERT_EQ(port2, udp_socket_param->writer_port);
     ASSERT_EQ(buffer_size, udp_socket_param->buffer_size);
+
+#ifndef _WIN32
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%u,%s,%u,rate=800Mbps,burst=64KiB", name, addr1, port1, addr2, port2);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(800000000u, udp_socket_param->rate);
+    ASSERT_EQ(65536u, udp_socket_param->burst);
+
+    rv = pirate_unparse_channel_param(&param, opt, sizeof(opt));
+    ASSERT_EQ(0, errno);
+    ASSERT_GT(rv, 0);
+    ASSERT_STREQ("udp_socket,1.2.3.4,16962,5.6.7.8,16963,rate=800Mbps,burst=65536", opt);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%u,%s,%u,rate=10MBps,burst=1500", name, addr1, port1, addr2, port2);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(80000000u, udp_socket_param->rate);
+    ASSERT_EQ(1500u, udp_socket_param->burst);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%u,%s,%u,rate=10furlongs", name, addr1, port1, addr2, port2);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+#endif
 }
 
 class UdpSocketTest : public ChannelTest,
@@ -281,4 +308,95 @@ TEST(ChannelUdpSocketTest, WriterAddressAndPortIPv6) {
 #endif
 }
 
+TEST(ChannelUdpSocketTest, Pacing) {
+#ifndef _WIN32
+    int rv, gd_r, gd_w;
+    struct timespec start, end;
+    char buf[1000];
+    double elapsed;
+    // 1000 byte datagrams at 8 Mbps with a 10 datagram burst
+    const int count = 60;
+    const double expected = (count - 10) * 1e-3;
+
+    gd_r = pirate_open_parse("udp_socket,127.0.0.1,26430,0.0.0.0,0,buffer_size=262144", O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_r);
+    gd_w = pirate_open_parse("udp_socket,127.0.0.1,26430,0.0.0.0,0,rate=8Mbps,burst=10KB", O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_w);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < count; i++) {
+        rv = pirate_write(gd_w, buf, sizeof(buf) - 28);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ((int) sizeof(buf) - 28, rv);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    ASSERT_GE(elapsed, expected * 0.95);
+
+    for (int i = 0; i < count; i++) {
+        rv = pirate_read(gd_r, buf, sizeof(buf));
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ((int) sizeof(buf) - 28, rv);
+    }
+
+    pirate_close(gd_r);
+    pirate_close(gd_w);
+#endif
+}
+
+TEST(ChannelUdpSocketTest, ReaderGroup) {
+#ifndef _WIN32
+    int rv, gd_w, gds[4];
+    uint32_t msg[4];
+    char desc[128];
+    const int shards = 4, count = 32;
+    const char *param = "udp_socket,127.0.0.1,26431,0.0.0.0,0,steer=msg_id";
+
+    rv = pirate_open_parse_reader_group("udp_socket,127.0.0.1,26431,0.0.0.0,0,steer=bogus", gds, shards);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    ASSERT_EQ(-1, gds[0]);
+    errno = 0;
+
+    rv = pirate_open_parse_reader_group(param, gds, shards);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    rv = pirate_get_channel_description(gds[0], desc, sizeof(desc));
+    ASSERT_GT(rv, 0);
+    ASSERT_STREQ("udp_socket,127.0.0.1,26431,0.0.0.0,0,shards=4,steer=msg_id", desc);
+
+    gd_w = pirate_open_parse(param, O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_w);
+
+    for (int i = 0; i < count; i++) {
+        msg[0] = htonl(i);
+        rv = pirate_write(gd_w, msg, sizeof(msg));
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ((int) sizeof(msg), rv);
+    }
+
+    // each shard receives the messages with its index
+    for (int i = 0; i < shards; i++) {
+        for (int j = 0; j < (count / shards); j++) {
+            rv = pirate_read(gds[i], msg, sizeof(msg));
+            ASSERT_EQ(0, errno);
+            ASSERT_EQ((int) sizeof(msg), rv);
+            ASSERT_EQ(i, (int) (ntohl(msg[0]) % shards));
+        }
+        const pirate_stats_t *stats = pirate_get_stats(gds[i]);
+        ASSERT_NE(nullptr, stats);
+        ASSERT_EQ((uint64_t) (count / shards), stats->success);
+    }
+
+    for (int i = 0; i < shards; i++) {
+        pirate_close(gds[i]);
+    }
+    pirate_close(gd_w);
+#endif
+}
+
 } // namespace
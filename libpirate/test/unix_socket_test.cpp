@@ -34,6 +34,7 @@ TEST(ChannelUnixSocketTest, ConfigurationParser) {
     const char *path = "/tmp/test_unix_socket";
     const unsigned min_tx = 42;
     const unsigned buffer_size = 42 * 42;
+    const unsigned memfd_threshold = 4096;
 
     snprintf(opt, sizeof(opt) - 1, "%s", name);
     rv = pirate_parse_channel_param(opt, &param);
@@ -67,6 +68,14 @@ TEST(ChannelUnixSocketTest, ConfigurationParser) {
     ASSERT_STREQ(path, unix_socket_param->path);
     ASSERT_EQ(buffer_size, unix_socket_param->buffer_size);
     ASSERT_EQ(min_tx, unix_socket_param->min_tx);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,memfd_threshold=%u", name, path, memfd_threshold);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(UNIX_SOCKET, param.channel_type);
+    ASSERT_STREQ(path, unix_socket_param->path);
+    ASSERT_EQ(memfd_threshold, unix_socket_param->memfd_threshold);
 }
 
 class UnixSocketTest : public ChannelTest,
@@ -97,6 +106,85 @@ INSTANTIATE_TEST_SUITE_P(UnixSocketFunctionalTest, UnixSocketTest,
     Values(std::make_tuple(0, 0),
         std::make_tuple(TEST_BUF_LEN, TEST_MIN_TX_LEN)));
 
+class UnixSocketMemfdTest : public ChannelTest,
+    public WithParamInterface<std::tuple<int, int>>
+{
+public:
+    void ChannelInit()
+    {
+        pirate_unix_socket_param_t *param = &Reader.param.channel.unix_socket;
+
+        pirate_init_channel_param(UNIX_SOCKET, &Reader.param);
+        strncpy(param->path, "/tmp/gaps.channel.test.sock", PIRATE_LEN_NAME);
+        auto test_param = GetParam();
+        param->memfd_threshold = std::get<0>(test_param);
+        param->min_tx = std::get<1>(test_param);
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_P(UnixSocketMemfdTest, Run)
+{
+    Run();
+}
+
+// Memfd thresholds below, within, and at the end of the test lengths
+INSTANTIATE_TEST_SUITE_P(UnixSocketMemfdFunctionalTest, UnixSocketMemfdTest,
+    Combine(Values(1, 8, 32), Values(0, TEST_MIN_TX_LEN)));
+
+static const size_t MEMFD_LARGE_LEN = 1 << 20;
+static const int MEMFD_LARGE_COUNT = 16;
+
+static void* UnixSocketMemfdLargeWriter(void *arg)
+{
+    int gd = *((int*) arg);
+    uint8_t *buf = (uint8_t*) malloc(MEMFD_LARGE_LEN);
+    for (int i = 0; i < MEMFD_LARGE_COUNT; i++) {
+        memset(buf, i, MEMFD_LARGE_LEN);
+        EXPECT_EQ((ssize_t) MEMFD_LARGE_LEN, pirate_write(gd, buf, MEMFD_LARGE_LEN));
+    }
+    free(buf);
+    return NULL;
+}
+
+TEST(ChannelUnixSocketTest, MemfdLargeMessage)
+{
+    int rv, gds[2];
+    pthread_t writer;
+    const char *params[2] = {
+        "unix_socket,/tmp/gaps.channel.test.sock.memfd,memfd_threshold=65536",
+        "unix_socket,/tmp/gaps.channel.test.sock.memfd,memfd_threshold=65536",
+    };
+    const int flags[2] = { O_RDONLY, O_WRONLY };
+    uint8_t *buf = (uint8_t*) malloc(MEMFD_LARGE_LEN);
+    ASSERT_NE(nullptr, buf);
+
+    rv = pirate_open_parse_all(params, flags, gds, 2);
+    ASSERT_EQ(0, rv);
+    errno = 0;
+
+    // more messages than memfds in the pool
+    rv = pthread_create(&writer, NULL, UnixSocketMemfdLargeWriter, &gds[1]);
+    ASSERT_EQ(0, rv);
+    for (int i = 0; i < MEMFD_LARGE_COUNT; i++) {
+        ASSERT_EQ((ssize_t) MEMFD_LARGE_LEN, pirate_read(gds[0], buf, MEMFD_LARGE_LEN));
+        ASSERT_EQ(i, buf[0]);
+        ASSERT_EQ(i, buf[MEMFD_LARGE_LEN - 1]);
+    }
+    ASSERT_EQ(0, pthread_join(writer, NULL));
+
+    // a short read of a memfd message discards the remainder
+    memset(buf, 0xFF, MEMFD_LARGE_LEN);
+    ASSERT_EQ((ssize_t) MEMFD_LARGE_LEN, pirate_write(gds[1], buf, MEMFD_LARGE_LEN));
+    ASSERT_EQ(16, pirate_read(gds[0], buf, 16));
+    ASSERT_EQ(0xFF, buf[15]);
+    ASSERT_EQ(0, errno);
+
+    ASSERT_EQ(0, pirate_close(gds[0]));
+    ASSERT_EQ(0, pirate_close(gds[1]));
+    free(buf);
+}
+
 class UnixSocketCloseWriterTest : public ClosedWriterTest
 {
 public:
@@ -0,0 +1,349 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#define _GNU_SOURCE
+
+#include <argp.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libpirate.h"
+#include "stats_segment.h"
+
+// Live view of the channel statistics that processes publish with
+// pirate_stats_publish() or PIRATE_STATS_PUBLISH=1. Every interval
+// the segments in /dev/shm are scanned, new segments are mapped
+// read-only and the rates are computed from the difference to the
+// previous sample of the same channel.
+
+#define PIRATE_TOP_SHM_DIR          "/dev/shm"
+#define PIRATE_TOP_MAX_PROCESSES    256
+#define PIRATE_TOP_SEQ_RETRIES      100
+
+typedef struct {
+    double delay_s;
+    unsigned iterations;
+    int batch;
+    pid_t pid;
+} pirate_top_opts_t;
+
+typedef struct {
+    pirate_stats_slot_t slot;
+    pirate_stats_t stats;
+    int valid;
+} pirate_top_sample_t;
+
+typedef struct {
+    pid_t pid;
+    int seen;
+    int fd;
+    const pirate_stats_segment_t *segment;
+    pirate_top_sample_t prev[PIRATE_STATS_SEGMENT_SLOTS];
+} pirate_top_process_t;
+
+static pirate_top_process_t processes[PIRATE_TOP_MAX_PROCESSES];
+static unsigned nprocesses = 0;
+
+static struct argp_option options[] = {
+    { "delay",      'd', "SEC",   0, "Interval between updates (default 1)", 0 },
+    { "iterations", 'n', "COUNT", 0, "Number of updates before exiting (default unlimited)", 0 },
+    { "batch",      'b', NULL,    0, "Append each update instead of redrawing the screen", 0 },
+    { "pid",        'p', "PID",   0, "Only show the channels of the process", 0 },
+    { NULL,          0,  NULL,    0, 0, 0 }
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    pirate_top_opts_t *opts = (pirate_top_opts_t *) state->input;
+    char *endptr = NULL;
+
+    switch (key) {
+
+    case 'd':
+        opts->delay_s = strtod(arg, &endptr);
+        if ((*endptr != '\0') || (opts->delay_s <= 0.0)) {
+            argp_error(state, "Unable to parse numeric value from \"%s\"\n", arg);
+        }
+        break;
+
+    case 'n':
+        opts->iterations = strtoul(arg, &endptr, 10);
+        if ((*endptr != '\0') || (opts->iterations == 0)) {
+            argp_error(state, "Unable to parse numeric value from \"%s\"\n", arg);
+        }
+        break;
+
+    case 'b':
+        opts->batch = 1;
+        break;
+
+    case 'p':
+        opts->pid = strtol(arg, &endptr, 10);
+        if ((*endptr != '\0') || (opts->pid <= 0)) {
+            argp_error(state, "Unable to parse numeric value from \"%s\"\n", arg);
+        }
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static void parse_args(int argc, char *argv[], pirate_top_opts_t *opts) {
+    struct argp argp = {
+        .options = options,
+        .parser = parse_opt,
+        .args_doc = NULL,
+        .doc = "Live statistics of the libpirate channels of all processes",
+        .children = NULL,
+        .help_filter = NULL,
+        .argp_domain = NULL
+    };
+
+    memset(opts, 0, sizeof(*opts));
+    opts->delay_s = 1.0;
+    argp_parse(&argp, argc, argv, 0, 0, opts);
+}
+
+static uint64_t pirate_top_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static const pirate_stats_segment_t *pirate_top_attach(const char *name, int *seg_fd) {
+    const pirate_stats_segment_t *segment;
+    char path[PATH_MAX];
+    struct stat st;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", PIRATE_TOP_SHM_DIR, name);
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return NULL;
+    }
+    // segments of processes that were killed are never removed
+    if ((fstat(fd, &st) != 0) || (st.st_size != sizeof(pirate_stats_segment_t)) ||
+        pirate_stats_segment_stale(fd)) {
+        close(fd);
+        return NULL;
+    }
+    segment = mmap(NULL, sizeof(pirate_stats_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+    if (segment == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    if ((__atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) != PIRATE_STATS_SEGMENT_MAGIC) ||
+        (segment->version != PIRATE_STATS_SEGMENT_VERSION) ||
+        (segment->slots != PIRATE_STATS_SEGMENT_SLOTS)) {
+        munmap((void *) segment, sizeof(pirate_stats_segment_t));
+        close(fd);
+        return NULL;
+    }
+    *seg_fd = fd;
+    return segment;
+}
+
+static void pirate_top_detach(pirate_top_process_t *process) {
+    munmap((void *) process->segment, sizeof(pirate_stats_segment_t));
+    close(process->fd);
+    *process = processes[--nprocesses];
+}
+
+// Maps the segments that appeared since the last scan and
+// unmaps the segments that were removed or whose owner exited
+static void pirate_top_scan(const pirate_top_opts_t *opts) {
+    const size_t prefix_len = strlen(PIRATE_STATS_SEGMENT_PREFIX);
+    struct dirent *entry;
+    DIR *dir;
+
+    for (unsigned i = 0; i < nprocesses; i++) {
+        processes[i].seen = 0;
+    }
+    if ((dir = opendir(PIRATE_TOP_SHM_DIR)) == NULL) {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        pirate_top_process_t *process = NULL;
+        char *endptr = NULL;
+        pid_t pid;
+
+        if (strncmp(entry->d_name, PIRATE_STATS_SEGMENT_PREFIX, prefix_len) != 0) {
+            continue;
+        }
+        pid = strtol(entry->d_name + prefix_len, &endptr, 10);
+        if ((*endptr != '\0') || (pid <= 0) || ((opts->pid != 0) && (pid != opts->pid))) {
+            continue;
+        }
+        for (unsigned i = 0; i < nprocesses; i++) {
+            if (processes[i].pid == pid) {
+                process = &processes[i];
+                break;
+            }
+        }
+        if ((process != NULL) && pirate_stats_segment_stale(process->fd)) {
+            // the name may now belong to a new process with the same pid
+            pirate_top_detach(process);
+            process = NULL;
+        }
+        if ((process == NULL) && (nprocesses < PIRATE_TOP_MAX_PROCESSES)) {
+            int fd = -1;
+            const pirate_stats_segment_t *segment = pirate_top_attach(entry->d_name, &fd);
+            if (segment != NULL) {
+                process = &processes[nprocesses++];
+                memset(process, 0, sizeof(*process));
+                process->pid = pid;
+                process->fd = fd;
+                process->segment = segment;
+            }
+        }
+        if (process != NULL) {
+            process->seen = 1;
+        }
+    }
+    closedir(dir);
+    for (unsigned i = 0; i < nprocesses;) {
+        if (!processes[i].seen) {
+            pirate_top_detach(&processes[i]);
+        } else {
+            i++;
+        }
+    }
+}
+
+// Copies a consistent description of the slot
+static int pirate_top_read_slot(const pirate_stats_segment_t *segment, unsigned index,
+    pirate_top_sample_t *sample) {
+    const pirate_stats_slot_t *slot = &segment->slot[index];
+
+    for (int retry = 0; retry < PIRATE_TOP_SEQ_RETRIES; retry++) {
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        memcpy(&sample->slot, (const void *) slot, sizeof(sample->slot));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) {
+            sample->slot.seq = seq;
+            memcpy(&sample->stats, (const void *) &segment->stats[index], sizeof(sample->stats));
+            sample->valid = sample->slot.gd != -1;
+            return sample->valid;
+        }
+    }
+    sample->valid = 0;
+    return 0;
+}
+
+static void pirate_top_rate(char *buf, size_t len, uint64_t cur, uint64_t prev, double elapsed_s) {
+    double rate = (cur - prev) / elapsed_s;
+
+    if (rate >= 1e9) {
+        snprintf(buf, len, "%.1fG", rate / 1e9);
+    } else if (rate >= 1e6) {
+        snprintf(buf, len, "%.1fM", rate / 1e6);
+    } else if (rate >= 1e3) {
+        snprintf(buf, len, "%.1fK", rate / 1e3);
+    } else {
+        snprintf(buf, len, "%.0f", rate);
+    }
+}
+
+static void pirate_top_print(const pirate_top_opts_t *opts, double elapsed_s) {
+    unsigned nchannels = 0;
+    time_t now = time(NULL);
+    char timestr[32];
+
+    if (!opts->batch) {
+        // clear the screen and move the cursor home
+        printf("\033[H\033[2J");
+    }
+    strftime(timestr, sizeof(timestr), "%H:%M:%S", localtime(&now));
+    printf("pirate-top - %s, %u process%s\n\n", timestr, nprocesses,
+        (nprocesses == 1) ? "" : "es");
+    printf("%7s %-15s %4s %2s %9s %9s %9s %9s %19s  %s\n", "PID", "COMMAND", "GD", "IO",
+        "MSGS/S", "BYTES/S", "ERRORS", "DROPS", "RING", "CHANNEL");
+    for (unsigned i = 0; i < nprocesses; i++) {
+        pirate_top_process_t *process = &processes[i];
+        char comm[sizeof(process->segment->comm) + 1];
+
+        memcpy(comm, process->segment->comm, sizeof(process->segment->comm));
+        comm[sizeof(process->segment->comm)] = '\0';
+        for (unsigned index = 0; index < PIRATE_STATS_SEGMENT_SLOTS; index++) {
+            pirate_top_sample_t cur, *prev = &process->prev[index];
+            char msgs[16] = "-", bytes[16] = "-", ring[32] = "-";
+
+            if (!pirate_top_read_slot(process->segment, index, &cur)) {
+                prev->valid = 0;
+                continue;
+            }
+            // rates are only computed for the same open of the channel
+            if (prev->valid && (prev->slot.seq == cur.slot.seq) && (elapsed_s > 0.0)) {
+                pirate_top_rate(msgs, sizeof(msgs), cur.stats.success, prev->stats.success, elapsed_s);
+                pirate_top_rate(bytes, sizeof(bytes), cur.stats.bytes, prev->stats.bytes, elapsed_s);
+            }
+            if (cur.slot.capacity > 0) {
+                snprintf(ring, sizeof(ring), "%" PRIu64 "/%" PRIu64 " %3.0f%%",
+                    cur.slot.queued, cur.slot.capacity,
+                    100.0 * cur.slot.queued / cur.slot.capacity);
+            }
+            printf("%7d %-15s %4d %2s %9s %9s %9" PRIu64 " %9" PRIu64 " %19s  %s\n",
+                (int) process->pid, comm, cur.slot.gd,
+                ((cur.slot.flags & O_ACCMODE) == O_RDONLY) ? "r" : "w",
+                msgs, bytes, cur.stats.errs, cur.stats.dropped + cur.stats.fuzzed,
+                ring, cur.slot.description);
+            *prev = cur;
+            nchannels++;
+        }
+    }
+    if (nchannels == 0) {
+        printf("\nno channels are published, set PIRATE_STATS_PUBLISH=1\n");
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    pirate_top_opts_t opts;
+    uint64_t last = 0;
+    struct timespec delay;
+
+    parse_args(argc, argv, &opts);
+    delay.tv_sec = (time_t) opts.delay_s;
+    delay.tv_nsec = (long) ((opts.delay_s - delay.tv_sec) * 1e9);
+
+    for (unsigned iteration = 0; (opts.iterations == 0) || (iteration < opts.iterations); iteration++) {
+        uint64_t now;
+
+        if (iteration > 0) {
+            nanosleep(&delay, NULL);
+        }
+        now = pirate_top_now();
+        pirate_top_scan(&opts);
+        pirate_top_print(&opts, (last > 0) ? (now - last) / 1e9 : 0.0);
+        if (opts.batch) {
+            printf("\n");
+        }
+        last = now;
+    }
+    return 0;
+}
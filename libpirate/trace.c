@@ -0,0 +1,467 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define PIRATE_TRACE_CHANNELS       64
+#define PIRATE_TRACE_CHANNEL_LEN    128
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    int32_t gd;
+    uint32_t count;         // bytes requested, or the channel slot of an open
+    int32_t rv;
+    uint16_t op;
+    uint16_t err;
+} pirate_trace_event_t;
+
+// Only the owning thread writes to a ring. The dump reads
+// the events below head, which is published with release order.
+// Rings are never freed. The ring of an exited thread is dumped
+// until a new thread of the same ring size takes it over.
+typedef struct pirate_trace_ring {
+    struct pirate_trace_ring *next;
+    pid_t pid;
+    pid_t tid;
+    int free;
+    uint64_t head;
+    uint64_t mask;
+    pirate_trace_event_t events[];
+} pirate_trace_ring_t;
+
+int pirate_trace_enabled = 0;
+
+static pthread_once_t pirate_trace_once = PTHREAD_ONCE_INIT;
+static int pirate_trace_registered = 0;
+static pthread_key_t pirate_trace_key;
+static char pirate_trace_prefix[PATH_MAX];
+static uint32_t pirate_trace_events = PIRATE_TRACE_DEFAULT_EVENTS;
+static uint64_t pirate_trace_clock0;
+static uint64_t pirate_trace_mono0;
+static pirate_trace_ring_t *pirate_trace_rings = NULL;
+static __thread pirate_trace_ring_t *pirate_trace_ring __attribute__((tls_model("initial-exec"))) = NULL;
+static char pirate_trace_channels[PIRATE_TRACE_CHANNELS][PIRATE_TRACE_CHANNEL_LEN];
+static uint32_t pirate_trace_nchannels = 0;
+
+static uint64_t pirate_trace_monotonic(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Runs at thread exit and hands the ring to the next new thread
+static void pirate_trace_ring_release(void *arg) {
+    pirate_trace_ring_t *ring = (pirate_trace_ring_t *) arg;
+
+    pirate_trace_ring = NULL;
+    __atomic_store_n(&ring->free, 1, __ATOMIC_RELEASE);
+}
+
+static pirate_trace_ring_t *pirate_trace_ring_claim(uint64_t mask) {
+    for (pirate_trace_ring_t *ring = __atomic_load_n(&pirate_trace_rings, __ATOMIC_ACQUIRE);
+        ring != NULL; ring = ring->next) {
+        int expected = 1;
+
+        if ((ring->mask == mask) &&
+            __atomic_compare_exchange_n(&ring->free, &expected, 0, 0,
+                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            // drop the events of the previous thread before it is renamed
+            __atomic_store_n(&ring->head, 0, __ATOMIC_RELEASE);
+            ring->tid = syscall(SYS_gettid);
+            return ring;
+        }
+    }
+    return NULL;
+}
+
+static pirate_trace_ring_t *pirate_trace_ring_create(void) {
+    uint32_t events = __atomic_load_n(&pirate_trace_events, __ATOMIC_RELAXED);
+    pirate_trace_ring_t *ring;
+
+    ring = pirate_trace_ring_claim(events - 1);
+    if (ring == NULL) {
+        ring = malloc(sizeof(pirate_trace_ring_t) + events * sizeof(pirate_trace_event_t));
+        if (ring == NULL) {
+            return NULL;
+        }
+        ring->pid = getpid();
+        ring->tid = syscall(SYS_gettid);
+        ring->free = 0;
+        ring->head = 0;
+        ring->mask = events - 1;
+        ring->next = __atomic_load_n(&pirate_trace_rings, __ATOMIC_ACQUIRE);
+        while (!__atomic_compare_exchange_n(&pirate_trace_rings, &ring->next, ring,
+            0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+    }
+    pthread_setspecific(pirate_trace_key, ring);
+    pirate_trace_ring = ring;
+    return ring;
+}
+
+void pirate_trace_record(int op, int gd, size_t count, ssize_t rv, uint64_t start) {
+    uint64_t end = pirate_trace_clock();
+    int err = errno;
+    pirate_trace_ring_t *ring = pirate_trace_ring;
+    pirate_trace_event_t *event;
+    uint64_t head;
+
+    if ((ring == NULL) && ((ring = pirate_trace_ring_create()) == NULL)) {
+        errno = err;
+        return;
+    }
+    head = ring->head;
+    event = &ring->events[head & ring->mask];
+    event->start = start;
+    event->end = end;
+    event->gd = gd;
+    event->count = (count > UINT32_MAX) ? UINT32_MAX : count;
+    event->rv = (rv > INT32_MAX) ? INT32_MAX : rv;
+    event->op = op;
+    event->err = (rv < 0) ? err : 0;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    errno = err;
+}
+
+// The dump only uses async-signal-safe functions
+// so that it can run in a signal handler.
+
+typedef struct {
+    int fd;
+    int err;
+    size_t len;
+    char data[4096];
+} pirate_trace_buf_t;
+
+static void pirate_trace_flush(pirate_trace_buf_t *buf) {
+    size_t off = 0;
+
+    while ((off < buf->len) && (buf->err == 0)) {
+        ssize_t rv = write(buf->fd, buf->data + off, buf->len - off);
+        if (rv < 0) {
+            if (errno != EINTR) {
+                buf->err = errno;
+            }
+            continue;
+        }
+        off += rv;
+    }
+    buf->len = 0;
+}
+
+static void pirate_trace_putc(pirate_trace_buf_t *buf, char c) {
+    if (buf->len == sizeof(buf->data)) {
+        pirate_trace_flush(buf);
+    }
+    buf->data[buf->len++] = c;
+}
+
+static void pirate_trace_puts(pirate_trace_buf_t *buf, const char *str) {
+    while (*str != '\0') {
+        pirate_trace_putc(buf, *str++);
+    }
+}
+
+// Returns the number of digits written to out
+static size_t pirate_trace_utoa(char *out, uint64_t val) {
+    char digits[20];
+    size_t n = 0, len;
+
+    do {
+        digits[n++] = '0' + (val % 10);
+        val /= 10;
+    } while (val > 0);
+    for (len = n; n > 0; out++) {
+        *out = digits[--n];
+    }
+    return len;
+}
+
+static void pirate_trace_putu(pirate_trace_buf_t *buf, uint64_t val) {
+    char digits[20];
+    size_t len = pirate_trace_utoa(digits, val);
+
+    for (size_t i = 0; i < len; i++) {
+        pirate_trace_putc(buf, digits[i]);
+    }
+}
+
+static void pirate_trace_puti(pirate_trace_buf_t *buf, int64_t val) {
+    if (val < 0) {
+        pirate_trace_putc(buf, '-');
+        pirate_trace_putu(buf, -(uint64_t) val);
+    } else {
+        pirate_trace_putu(buf, val);
+    }
+}
+
+// Nanoseconds as microseconds with three decimals
+static void pirate_trace_putus(pirate_trace_buf_t *buf, uint64_t ns) {
+    pirate_trace_putu(buf, ns / 1000);
+    pirate_trace_putc(buf, '.');
+    pirate_trace_putc(buf, '0' + (ns / 100) % 10);
+    pirate_trace_putc(buf, '0' + (ns / 10) % 10);
+    pirate_trace_putc(buf, '0' + ns % 10);
+}
+
+static void pirate_trace_putjson(pirate_trace_buf_t *buf, const char *str) {
+    static const char hex[] = "0123456789abcdef";
+
+    pirate_trace_putc(buf, '"');
+    for (; *str != '\0'; str++) {
+        unsigned char c = *str;
+        if ((c == '"') || (c == '\\')) {
+            pirate_trace_putc(buf, '\\');
+            pirate_trace_putc(buf, c);
+        } else if (c < 0x20) {
+            pirate_trace_puts(buf, "\\u00");
+            pirate_trace_putc(buf, hex[c >> 4]);
+            pirate_trace_putc(buf, hex[c & 0xf]);
+        } else {
+            pirate_trace_putc(buf, c);
+        }
+    }
+    pirate_trace_putc(buf, '"');
+}
+
+static void pirate_trace_put_event(pirate_trace_buf_t *buf, const pirate_trace_ring_t *ring,
+    const pirate_trace_event_t *event, uint64_t start_ns, uint64_t end_ns) {
+
+    pirate_trace_puts(buf, ",\n{\"name\":");
+    switch (event->op) {
+    case PIRATE_TRACE_OPEN:
+        pirate_trace_puts(buf, "\"pirate_open\",\"ph\":\"i\",\"s\":\"t\"");
+        break;
+    case PIRATE_TRACE_READ:
+        pirate_trace_puts(buf, "\"pirate_read\",\"ph\":\"X\",\"dur\":");
+        pirate_trace_putus(buf, end_ns - start_ns);
+        break;
+    default:
+        pirate_trace_puts(buf, "\"pirate_write\",\"ph\":\"X\",\"dur\":");
+        pirate_trace_putus(buf, end_ns - start_ns);
+        break;
+    }
+    pirate_trace_puts(buf, ",\"cat\":\"libpirate\",\"ts\":");
+    pirate_trace_putus(buf, start_ns);
+    pirate_trace_puts(buf, ",\"pid\":");
+    pirate_trace_putu(buf, ring->pid);
+    pirate_trace_puts(buf, ",\"tid\":");
+    pirate_trace_putu(buf, ring->tid);
+    pirate_trace_puts(buf, ",\"args\":{\"gd\":");
+    pirate_trace_puti(buf, event->gd);
+    if (event->op == PIRATE_TRACE_OPEN) {
+        if (event->count < PIRATE_TRACE_CHANNELS) {
+            pirate_trace_puts(buf, ",\"channel\":");
+            pirate_trace_putjson(buf, pirate_trace_channels[event->count]);
+        }
+    } else {
+        pirate_trace_puts(buf, ",\"count\":");
+        pirate_trace_putu(buf, event->count);
+        pirate_trace_puts(buf, ",\"rv\":");
+        pirate_trace_puti(buf, event->rv);
+        if (event->err != 0) {
+            pirate_trace_puts(buf, ",\"errno\":");
+            pirate_trace_putu(buf, event->err);
+        }
+    }
+    pirate_trace_puts(buf, "}}");
+}
+
+int pirate_trace_dump(void) {
+    char path[PATH_MAX + 32];
+    pirate_trace_buf_t buf;
+    pid_t pid = getpid();
+    uint64_t clock1 = pirate_trace_clock();
+    uint64_t mono1 = pirate_trace_monotonic();
+    double scale = 1.0;
+    size_t len;
+
+    if (!pirate_trace_active()) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    if (clock1 > pirate_trace_clock0) {
+        scale = (double) (mono1 - pirate_trace_mono0) / (clock1 - pirate_trace_clock0);
+    }
+
+    // <prefix>.<pid>.json
+    len = strlen(pirate_trace_prefix);
+    memcpy(path, pirate_trace_prefix, len);
+    path[len++] = '.';
+    len += pirate_trace_utoa(path + len, pid);
+    memcpy(path + len, ".json", sizeof(".json"));
+
+    buf.len = 0;
+    buf.err = 0;
+    buf.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (buf.fd < 0) {
+        return -1;
+    }
+    pirate_trace_puts(&buf, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    pirate_trace_puts(&buf, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+    pirate_trace_putu(&buf, pid);
+    pirate_trace_puts(&buf, ",\"args\":{\"name\":");
+    pirate_trace_putjson(&buf, program_invocation_short_name);
+    pirate_trace_puts(&buf, "}}");
+    for (pirate_trace_ring_t *ring = __atomic_load_n(&pirate_trace_rings, __ATOMIC_ACQUIRE);
+        ring != NULL; ring = ring->next) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t first = (head > ring->mask) ? (head - ring->mask - 1) : 0;
+
+        if (ring->pid != pid) {
+            continue;
+        }
+        for (uint64_t i = first; i < head; i++) {
+            const pirate_trace_event_t *event = &ring->events[i & ring->mask];
+            int64_t start = (int64_t) ((int64_t) (event->start - pirate_trace_clock0) * scale);
+            int64_t end = (int64_t) ((int64_t) (event->end - pirate_trace_clock0) * scale);
+            pirate_trace_put_event(&buf, ring, event, pirate_trace_mono0 + start, pirate_trace_mono0 + end);
+        }
+    }
+    pirate_trace_puts(&buf, "\n]}\n");
+    pirate_trace_flush(&buf);
+    close(buf.fd);
+    if (buf.err != 0) {
+        errno = buf.err;
+        return -1;
+    }
+    return 0;
+}
+
+static void pirate_trace_atexit(void) {
+    if (pirate_trace_active()) {
+        pirate_trace_dump();
+    }
+}
+
+static void pirate_trace_signal(int sig) {
+    int err = errno;
+    (void) sig;
+    pirate_trace_dump();
+    errno = err;
+}
+
+// The child keeps the ring of the forking thread and
+// starts it over. The other rings belong to the parent.
+static void pirate_trace_atfork_child(void) {
+    pirate_trace_ring_t *ring = pirate_trace_ring;
+
+    pirate_trace_rings = NULL;
+    if (ring != NULL) {
+        ring->next = NULL;
+        ring->pid = getpid();
+        ring->tid = syscall(SYS_gettid);
+        ring->head = 0;
+        pirate_trace_rings = ring;
+    }
+}
+
+static int pirate_trace_start(const char *prefix, uint32_t events) {
+    uint32_t size = 1;
+
+    if (prefix == NULL) {
+        __atomic_store_n(&pirate_trace_enabled, 0, __ATOMIC_RELEASE);
+        return 0;
+    }
+    if (strlen(prefix) >= sizeof(pirate_trace_prefix)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (events == 0) {
+        events = PIRATE_TRACE_DEFAULT_EVENTS;
+    }
+    if (events > PIRATE_TRACE_MAX_EVENTS) {
+        events = PIRATE_TRACE_MAX_EVENTS;
+    }
+    while (size < events) {
+        size <<= 1;
+    }
+    if (!pirate_trace_registered) {
+        int rv = pthread_key_create(&pirate_trace_key, pirate_trace_ring_release);
+        if (rv != 0) {
+            errno = rv;
+            return -1;
+        }
+        if ((atexit(pirate_trace_atexit) != 0) ||
+            (pthread_atfork(NULL, NULL, pirate_trace_atfork_child) != 0)) {
+            pthread_key_delete(pirate_trace_key);
+            errno = ENOMEM;
+            return -1;
+        }
+        pirate_trace_registered = 1;
+    }
+    strcpy(pirate_trace_prefix, prefix);
+    __atomic_store_n(&pirate_trace_events, size, __ATOMIC_RELAXED);
+    pirate_trace_mono0 = pirate_trace_monotonic();
+    pirate_trace_clock0 = pirate_trace_clock();
+    __atomic_store_n(&pirate_trace_enabled, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void pirate_trace_env(void) {
+    const char *prefix = getenv("PIRATE_TRACE");
+    const char *events = getenv("PIRATE_TRACE_EVENTS");
+    const char *signum = getenv("PIRATE_TRACE_SIGNAL");
+    struct sigaction sa;
+
+    if ((prefix == NULL) || (*prefix == '\0')) {
+        return;
+    }
+    if (pirate_trace_start(prefix, (events != NULL) ? strtoul(events, NULL, 10) : 0) < 0) {
+        return;
+    }
+    if (signum != NULL) {
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = pirate_trace_signal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(atoi(signum), &sa, NULL);
+    }
+}
+
+int pirate_trace_enable(const char *prefix, uint32_t events) {
+    pthread_once(&pirate_trace_once, pirate_trace_env);
+    return pirate_trace_start(prefix, events);
+}
+
+void pirate_trace_open(int gd, const pirate_channel_param_t *param) {
+    uint32_t slot;
+    uint64_t now;
+
+    pthread_once(&pirate_trace_once, pirate_trace_env);
+    if (!pirate_trace_active()) {
+        return;
+    }
+    now = pirate_trace_clock();
+    slot = __atomic_fetch_add(&pirate_trace_nchannels, 1, __ATOMIC_RELAXED);
+    if (slot < PIRATE_TRACE_CHANNELS) {
+        pirate_unparse_channel_param(param, pirate_trace_channels[slot], PIRATE_TRACE_CHANNEL_LEN);
+    } else {
+        slot = UINT32_MAX;
+    }
+    pirate_trace_record(PIRATE_TRACE_OPEN, gd, slot, gd, now);
+}
@@ -0,0 +1,76 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_TRACE_H
+#define __PIRATE_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "libpirate.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Tracing of pirate_open(), pirate_read() and pirate_write().
+// Each thread records fixed size events into its own ring, so
+// recording takes no lock. The newest events of every ring are
+// written in the Chrome trace event format at exit, on a signal
+// or by pirate_trace_dump(). Timestamps are taken from the time
+// stamp counter and converted to CLOCK_MONOTONIC in the dump, so
+// the traces of processes on the same host share a timeline.
+
+#define PIRATE_TRACE_OPEN           1
+#define PIRATE_TRACE_READ           2
+#define PIRATE_TRACE_WRITE          3
+
+#define PIRATE_TRACE_DEFAULT_EVENTS (1u << 16)
+#define PIRATE_TRACE_MAX_EVENTS     (1u << 24)
+
+extern int pirate_trace_enabled;
+
+static inline int pirate_trace_active(void) {
+    return __atomic_load_n(&pirate_trace_enabled, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t pirate_trace_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// Records a call that started at start. errno is preserved.
+void pirate_trace_record(int op, int gd, size_t count, ssize_t rv, uint64_t start);
+
+// Records an opened channel. The first call reads the
+// PIRATE_TRACE environment variables.
+void pirate_trace_open(int gd, const pirate_channel_param_t *param);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIRATE_TRACE_H */
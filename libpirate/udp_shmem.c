@@ -98,6 +98,14 @@ static inline int is_empty(uint64_t value) {
 
 static inline int is_full(uint64_t value) { return get_status(value) == 2; }
 
+// Packets in the ring
+static inline uint32_t get_queued(uint64_t value, uint32_t packet_count) {
+    if (is_full(value)) {
+        return packet_count;
+    }
+    return (get_write(value) - get_read(value) + packet_count) % packet_count;
+}
+
 static inline unsigned char* shared_buffer(shmem_buffer_t *shmem_buffer) {
     return (unsigned char *)shmem_buffer + sizeof(shmem_buffer_t);
 }
@@ -325,7 +333,7 @@ int udp_shmem_buffer_open(void *_param, void *_ctx) {
             goto error;
         }
 
-        if (sem_wait(&buf->reader_open_wait) < 0) {
+        if (pirate_open_sem_wait(&buf->reader_open_wait) < 0) {
             atomic_store(&buf->reader_pid, 0);
             goto error;
         }
@@ -341,7 +349,7 @@ int udp_shmem_buffer_open(void *_param, void *_ctx) {
             goto error;
         }
 
-        if (sem_wait(&buf->writer_open_wait) < 0) {
+        if (pirate_open_sem_wait(&buf->writer_open_wait) < 0) {
             atomic_store(&buf->writer_pid, 0);
             goto error;
         }
@@ -405,28 +413,38 @@ ssize_t udp_shmem_buffer_read(const void *_param, void *_ctx, void *buffer, size
 
     const size_t packet_size = buf->packet_size;
     const size_t packet_count = buf->packet_count;
+    pirate_ring_side_stats_t *stats = &buf->reader_stats;
 
     position = atomic_load(&buf->position);
-    for (int spin = 0; (spin < SPIN_ITERATIONS) && is_empty(position); spin++) {
-        position = atomic_load(&buf->position);
-    }
-
     if (is_empty(position)) {
-        pthread_mutex_lock(&buf->mutex);
-        position = atomic_load(&buf->position);
-        while (is_empty(position)) {
-            // The reader returns 0 when the writer has closed
-            // the channel and the channel is empty. If the writer
-            // has closed the channel and the buffer has content
-            // then return the contents of the buffer.
-            if (atomic_load(&buf->writer_pid) == 0) {
-                pthread_mutex_unlock(&buf->mutex);
-                return 0;
-            }
-            pthread_cond_wait(&buf->is_not_empty, &buf->mutex);
+        uint64_t start = pirate_monotonic_ns();
+        int spin;
+
+        for (spin = 0; (spin < SPIN_ITERATIONS) && is_empty(position); spin++) {
             position = atomic_load(&buf->position);
         }
-        pthread_mutex_unlock(&buf->mutex);
+        stats->spins += spin;
+
+        if (is_empty(position)) {
+            pthread_mutex_lock(&buf->mutex);
+            position = atomic_load(&buf->position);
+            while (is_empty(position)) {
+                // The reader returns 0 when the writer has closed
+                // the channel and the channel is empty. If the writer
+                // has closed the channel and the buffer has content
+                // then return the contents of the buffer.
+                if (atomic_load(&buf->writer_pid) == 0) {
+                    pthread_mutex_unlock(&buf->mutex);
+                    stats->blocked_ns += pirate_monotonic_ns() - start;
+                    return 0;
+                }
+                stats->sleeps++;
+                pthread_cond_wait(&buf->is_not_empty, &buf->mutex);
+                position = atomic_load(&buf->position);
+            }
+            pthread_mutex_unlock(&buf->mutex);
+        }
+        stats->blocked_ns += pirate_monotonic_ns() - start;
     }
 
     reader = get_read(position);
@@ -476,7 +494,9 @@ ssize_t udp_shmem_buffer_read(const void *_param, void *_ctx, void *buffer, size
         pthread_mutex_lock(&buf->mutex);
         pthread_cond_signal(&buf->is_not_full);
         pthread_mutex_unlock(&buf->mutex);
+        stats->wakeups++;
     }
+    stats->operations++;
 
     if (exp_csum != obs_csum) {
         errno = EL2HLT;
@@ -505,11 +525,29 @@ ssize_t udp_shmem_buffer_write_mtu(const void *_param, void *_ctx) {
     return mtu - sizeof(pirate_header_t);
 }
 
+void udp_shmem_buffer_occupancy(const void *_ctx, uint64_t *queued, uint64_t *capacity) {
+    const udp_shmem_ctx *ctx = (const udp_shmem_ctx *)_ctx;
+    shmem_buffer_t *buf = ctx->buf;
+
+    *queued = get_queued(atomic_load(&buf->position), buf->packet_count);
+    *capacity = buf->packet_count;
+}
+
+void udp_shmem_buffer_ring_stats(const void *_ctx, pirate_ring_stats_t *stats) {
+    const udp_shmem_ctx *ctx = (const udp_shmem_ctx *)_ctx;
+    shmem_buffer_t *buf = ctx->buf;
+
+    udp_shmem_buffer_occupancy(_ctx, &stats->queued, &stats->capacity);
+    stats->high_water = buf->high_water;
+    memcpy(&stats->reader, &buf->reader_stats, sizeof(stats->reader));
+    memcpy(&stats->writer, &buf->writer_stats, sizeof(stats->writer));
+}
+
 ssize_t udp_shmem_buffer_write(const void *_param, void *_ctx, const void *buffer, size_t count) {
     (void)_param;
     udp_shmem_ctx *ctx = (udp_shmem_ctx *)_ctx;
     int was_empty;
-    uint32_t reader, writer;
+    uint32_t reader, writer, queued = 0;
     uint64_t position;
     uint16_t csum;
     struct ip_hdr ip_header;
@@ -524,6 +562,7 @@ ssize_t udp_shmem_buffer_write(const void *_param, void *_ctx, const void *buffe
 
     const size_t packet_size = buf->packet_size;
     const size_t packet_count = buf->packet_count;
+    pirate_ring_side_stats_t *stats = &buf->writer_stats;
 
     if (count > (packet_size - UDP_HEADER_SIZE)) {
         count = packet_size - UDP_HEADER_SIZE;
@@ -560,24 +599,33 @@ ssize_t udp_shmem_buffer_write(const void *_param, void *_ctx, const void *buffe
     udp_header.csum = csum;
 
     position = atomic_load(&buf->position);
-    for (int spin = 0; (spin < SPIN_ITERATIONS) && is_full(position); spin++) {
-        position = atomic_load(&buf->position);
-    }
-
     if (is_full(position)) {
-        pthread_mutex_lock(&buf->mutex);
-        position = atomic_load(&buf->position);
-        while (is_full(position)) {
-            if (atomic_load(&buf->reader_pid) == 0) {
-                pthread_mutex_unlock(&buf->mutex);
-                kill(getpid(), SIGPIPE);
-                errno = EPIPE;
-                return -1;
-            }
-            pthread_cond_wait(&buf->is_not_full, &buf->mutex);
+        uint64_t start = pirate_monotonic_ns();
+        int spin;
+
+        for (spin = 0; (spin < SPIN_ITERATIONS) && is_full(position); spin++) {
             position = atomic_load(&buf->position);
         }
-        pthread_mutex_unlock(&buf->mutex);
+        stats->spins += spin;
+
+        if (is_full(position)) {
+            pthread_mutex_lock(&buf->mutex);
+            position = atomic_load(&buf->position);
+            while (is_full(position)) {
+                if (atomic_load(&buf->reader_pid) == 0) {
+                    pthread_mutex_unlock(&buf->mutex);
+                    stats->blocked_ns += pirate_monotonic_ns() - start;
+                    kill(getpid(), SIGPIPE);
+                    errno = EPIPE;
+                    return -1;
+                }
+                stats->sleeps++;
+                pthread_cond_wait(&buf->is_not_full, &buf->mutex);
+                position = atomic_load(&buf->position);
+            }
+            pthread_mutex_unlock(&buf->mutex);
+        }
+        stats->blocked_ns += pirate_monotonic_ns() - start;
     }
 
     // The writer returns -1 when the reader has closed the channel.
@@ -605,6 +653,7 @@ ssize_t udp_shmem_buffer_write(const void *_param, void *_ctx, const void *buffe
         if (atomic_compare_exchange_weak(&buf->position, &position,
                                             update)) {
             was_empty = is_empty(position);
+            queued = get_queued(update, packet_count);
             break;
         }
         reader = get_read(position);
@@ -614,7 +663,12 @@ ssize_t udp_shmem_buffer_write(const void *_param, void *_ctx, const void *buffe
         pthread_mutex_lock(&buf->mutex);
         pthread_cond_signal(&buf->is_not_empty);
         pthread_mutex_unlock(&buf->mutex);
+        stats->wakeups++;
+    }
+    if (queued > buf->high_water) {
+        buf->high_water = queued;
     }
+    stats->operations++;
 
     return count;
 }
@@ -33,6 +33,8 @@ int udp_shmem_buffer_close(void *_ctx);
 ssize_t udp_shmem_buffer_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t udp_shmem_buffer_write(const void *_param, void *_ctx, const void *buf,  size_t count);
 ssize_t udp_shmem_buffer_write_mtu(const void *_param, void *_ctx);
+void udp_shmem_buffer_occupancy(const void *_ctx, uint64_t *queued, uint64_t *capacity);
+void udp_shmem_buffer_ring_stats(const void *_ctx, pirate_ring_stats_t *stats);
 
 #define PIRATE_UDP_SHMEM_CHANNEL_FUNCS { udp_shmem_buffer_parse_param, udp_shmem_buffer_get_channel_description, udp_shmem_buffer_open, udp_shmem_buffer_close, udp_shmem_buffer_read, udp_shmem_buffer_write, udp_shmem_buffer_write_mtu }
 
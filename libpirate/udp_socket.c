@@ -20,8 +20,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "pirate_common.h"
@@ -84,6 +88,27 @@ int pirate_udp_socket_parse_param(char *str, void *_param) {
             param->buffer_size = strtol(val, NULL, 10);
         } else if (strncmp("mtu", key, strlen("mtu")) == 0) {
             param->mtu = strtol(val, NULL, 10);
+        } else if (strncmp("rate", key, strlen("rate")) == 0) {
+            if (pirate_parse_rate(val, &param->rate) < 0) {
+                return -1;
+            }
+        } else if (strncmp("burst", key, strlen("burst")) == 0) {
+            if (pirate_parse_size(val, &param->burst) < 0) {
+                return -1;
+            }
+        } else if (strncmp("gso", key, strlen("gso")) == 0) {
+            param->gso = strtol(val, NULL, 10);
+        } else if (strncmp("shards", key, strlen("shards")) == 0) {
+            param->shards = strtol(val, NULL, 10);
+        } else if (strncmp("steer", key, strlen("steer")) == 0) {
+            if (strcmp(val, "flow") == 0) {
+                param->steer = PIRATE_UDP_STEER_FLOW;
+            } else if (strcmp(val, "msg_id") == 0) {
+                param->steer = PIRATE_UDP_STEER_MSG_ID;
+            } else {
+                errno = EINVAL;
+                return -1;
+            }
         } else {
             errno = EINVAL;
             return -1;
@@ -96,19 +121,33 @@ int pirate_udp_socket_get_channel_description(const void *_param, char *desc, in
     const pirate_udp_socket_param_t *param = (const pirate_udp_socket_param_t *)_param;
     char buffer_size_str[32];
     char mtu_str[32];
+    char rate_str[64];
+    char shards_str[48];
 
     buffer_size_str[0] = 0;
     mtu_str[0] = 0;
+    rate_str[0] = 0;
+    shards_str[0] = 0;
     if ((param->mtu != 0) && (param->mtu != PIRATE_DEFAULT_UDP_PACKET_SIZE)) {
         snprintf(mtu_str, 32, ",mtu=%u", param->mtu);
     }
     if (param->buffer_size != 0) {
         snprintf(buffer_size_str, 32, ",buffer_size=%u", param->buffer_size);
     }
-    return snprintf(desc, len, "udp_socket,%s,%u,%s,%u%s%s",
+    if (param->rate != 0) {
+        char rate[32];
+        pirate_unparse_rate(rate, sizeof(rate), param->rate);
+        snprintf(rate_str, 64, ",rate=%s,burst=%u", rate, param->burst);
+    }
+    if (param->shards != 0) {
+        snprintf(shards_str, 48, ",shards=%u%s", param->shards,
+            (param->steer == PIRATE_UDP_STEER_MSG_ID) ? ",steer=msg_id" : "");
+    }
+    return snprintf(desc, len, "udp_socket,%s,%u,%s,%u%s%s%s%s%s",
         param->reader_addr, param->reader_port,
         param->writer_addr, param->writer_port,
-        buffer_size_str, mtu_str);
+        buffer_size_str, mtu_str, rate_str,
+        param->gso ? ",gso=1" : "", shards_str);
 }
 
 static int populate_address(struct addrinfo *addr, int port, int *addr_any) {
@@ -191,6 +230,17 @@ int pirate_udp_socket_reader_open(pirate_udp_socket_param_t *param, common_ctx *
         goto end;
     }
 
+    if (param->shards > 0) {
+        rv = setsockopt(ctx->fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int));
+        if (rv < 0) {
+            err = errno;
+            close(ctx->fd);
+            ctx->fd = -1;
+            errno = err;
+            goto end;
+        }
+    }
+
     if (param->buffer_size > 0) {
         rv = setsockopt(ctx->fd, SOL_SOCKET, SO_RCVBUF,
                         &param->buffer_size,
@@ -212,6 +262,27 @@ int pirate_udp_socket_reader_open(pirate_udp_socket_param_t *param, common_ctx *
         errno = err;
         goto end;
     }
+
+    if ((param->shards > 0) && (param->steer == PIRATE_UDP_STEER_MSG_ID)) {
+        // The program runs on the UDP payload and returns the
+        // index of the socket in the group. Datagrams shorter
+        // than 4 bytes go to the first shard.
+        struct sock_filter code[] = {
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0),
+            BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, param->shards),
+            BPF_STMT(BPF_RET | BPF_A, 0),
+        };
+        struct sock_fprog prog = { sizeof(code) / sizeof(code[0]), code };
+        rv = setsockopt(ctx->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+        if (rv < 0) {
+            err = errno;
+            close(ctx->fd);
+            ctx->fd = -1;
+            errno = err;
+            goto end;
+        }
+    }
+
     if (!dest_addr_any) {
         rv = connect(ctx->fd, dest_addr->ai_addr, dest_addr->ai_addrlen);
         if (rv < 0) {
@@ -344,10 +415,22 @@ int pirate_udp_socket_open(void *_param, void *_ctx) {
         errno = EINVAL;
         return -1;
     }
+    pirate_pacer_init(&ctx->pacer, param->rate, param->burst);
+    memset(&ctx->gro, 0, sizeof(ctx->gro));
     if (access == O_RDONLY) {
         rv = pirate_udp_socket_reader_open(param, (common_ctx*) ctx);
     } else {
         rv = pirate_udp_socket_writer_open(param, (common_ctx*) ctx);
+        if (rv >= 0) {
+            pirate_pacer_socket(&ctx->pacer, ctx->sock);
+        }
+    }
+    if ((rv >= 0) && param->gso && (pirate_udp_gso_open(ctx->sock, access, &ctx->gro) < 0)) {
+        int err = errno;
+        close(ctx->sock);
+        ctx->sock = -1;
+        errno = err;
+        return -1;
     }
 
     return rv;
@@ -357,6 +440,7 @@ int pirate_udp_socket_close(void *_ctx) {
     udp_socket_ctx *ctx = (udp_socket_ctx *)_ctx;
     int err, rv = -1;
 
+    pirate_udp_gro_close(&ctx->gro);
     if (ctx->sock <= 0) {
         errno = ENODEV;
         return -1;
@@ -379,6 +463,9 @@ ssize_t pirate_udp_socket_read(const void *_param, void *_ctx, void *buf, size_t
         return -1;
     }
 
+    if (ctx->gro.buf != NULL) {
+        return pirate_udp_gro_read(&ctx->gro, ctx->sock, buf, count);
+    }
     return recv(ctx->sock, buf, count, 0);
 }
 
@@ -416,6 +503,10 @@ ssize_t pirate_udp_socket_write(const void *_param, void *_ctx, const void *buf,
         errno = EMSGSIZE;
         return -1;
     }
+    // 8 byte UDP header and 20 byte IP header
+    if (pirate_pacer_wait(&ctx->pacer, count + 28, ctx->flags & O_NONBLOCK) < 0) {
+        return -1;
+    }
     err = errno;
     rv = send(ctx->sock, buf, count, 0);
     if ((rv < 0) && (errno == ECONNREFUSED)) {
@@ -425,3 +516,157 @@ ssize_t pirate_udp_socket_write(const void *_param, void *_ctx, const void *buf,
     }
     return rv;
 }
+
+ssize_t pirate_udp_socket_write_batch(const void *_param, void *_ctx, const struct iovec *iov, size_t iovlen, size_t count) {
+    pirate_udp_socket_param_t *param = (pirate_udp_socket_param_t *)_param;
+    udp_socket_ctx *ctx = (udp_socket_ctx *)_ctx;
+    struct mmsghdr msgs[PIRATE_UDP_BATCH_LEN];
+    size_t write_mtu = pirate_udp_socket_write_mtu(param, ctx);
+    size_t segment = 0, prev = 0, total = 0;
+    int err;
+    int rv;
+
+    if (ctx->sock <= 0) {
+        errno = EBADF;
+        return -1;
+    }
+    count = MIN(count, PIRATE_UDP_BATCH_LEN);
+    memset(msgs, 0, count * sizeof(struct mmsghdr));
+    for (size_t i = 0; i < count; i++) {
+        size_t len = 0;
+        msgs[i].msg_hdr.msg_iov = (struct iovec*) &iov[i * iovlen];
+        msgs[i].msg_hdr.msg_iovlen = iovlen;
+        for (size_t j = 0; j < iovlen; j++) {
+            len += iov[i * iovlen + j].iov_len;
+        }
+        if ((write_mtu > 0) && (len > write_mtu)) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        // A segmentation offload send is a run of datagrams
+        // of equal length. The last datagram may be shorter.
+        if (param->gso) {
+            if (i == 0) {
+                segment = len;
+            } else if ((len > segment) || (prev != segment) ||
+                ((total + len) > PIRATE_UDP_GSO_MAX_LEN)) {
+                count = i;
+                break;
+            }
+            prev = len;
+            total += len;
+        }
+        // Wait for the first datagram. The batch ends at the
+        // first datagram that exceeds the burst allowance.
+        if (i == 0) {
+            if (pirate_pacer_wait(&ctx->pacer, len + 28, ctx->flags & O_NONBLOCK) < 0) {
+                return -1;
+            }
+        } else if (!pirate_pacer_try(&ctx->pacer, len + 28)) {
+            count = i;
+            break;
+        }
+    }
+    err = errno;
+    if (param->gso && (count > 1)) {
+        rv = pirate_udp_gso_send(ctx->sock, iov, count * iovlen, segment, 0);
+        if ((rv < 0) && (errno == ECONNREFUSED)) {
+            errno = err;
+            rv = pirate_udp_gso_send(ctx->sock, iov, count * iovlen, segment, 0);
+        }
+        return (rv < 0) ? rv : (ssize_t) count;
+    }
+    rv = sendmmsg(ctx->sock, msgs, count, 0);
+    if ((rv < 0) && (errno == ECONNREFUSED)) {
+        errno = err;
+        rv = sendmmsg(ctx->sock, msgs, count, 0);
+    }
+    return rv;
+}
+
+int pirate_udp_gso_open(int sock, int access, pirate_udp_gro_t *gro) {
+    int enable = 1;
+
+    memset(gro, 0, sizeof(pirate_udp_gro_t));
+    if (access == O_WRONLY) {
+        // Segmentation is requested on each send. Fail
+        // at open if the kernel does not support it.
+        int segment = 0;
+        return setsockopt(sock, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment));
+    }
+    if (setsockopt(sock, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) < 0) {
+        return -1;
+    }
+    if ((gro->buf = malloc(PIRATE_UDP_GSO_MAX_LEN)) == NULL) {
+        return -1;
+    }
+    return 0;
+}
+
+void pirate_udp_gro_close(pirate_udp_gro_t *gro) {
+    free(gro->buf);
+    memset(gro, 0, sizeof(pirate_udp_gro_t));
+}
+
+ssize_t pirate_udp_gro_read(pirate_udp_gro_t *gro, int sock, void *buf, size_t count) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { gro->buf, PIRATE_UDP_GSO_MAX_LEN };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    size_t len;
+    ssize_t rv;
+
+    if (gro->offset >= gro->len) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        rv = recvmsg(sock, &msg, 0);
+        if (rv <= 0) {
+            return rv;
+        }
+        gro->len = rv;
+        gro->offset = 0;
+        gro->segment = rv;
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if ((cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO)) {
+                int segment;
+                memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+                if (segment > 0) {
+                    gro->segment = segment;
+                }
+            }
+        }
+    }
+    len = MIN(gro->segment, gro->len - gro->offset);
+    memcpy(buf, gro->buf + gro->offset, MIN(len, count));
+    gro->offset += len;
+    return MIN(len, count);
+}
+
+ssize_t pirate_udp_gso_send(int sock, const struct iovec *iov, size_t iovlen, size_t segment, int flags) {
+    union {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    uint16_t gso_size = segment;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = (struct iovec*) iov;
+    msg.msg_iovlen = iovlen;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+    return sendmsg(sock, &msg, flags);
+}
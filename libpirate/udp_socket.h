@@ -18,10 +18,29 @@
 
 #include "libpirate.h"
 #include "pirate_common.h"
+#include "pacing.h"
+
+struct iovec;
+
+#define PIRATE_UDP_BATCH_LEN 64u
+
+// Largest UDP payload of a segmentation offload send
+// or a coalesced receive
+#define PIRATE_UDP_GSO_MAX_LEN 65507u
+
+// Datagrams coalesced by UDP_GRO that have not been read
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t offset;
+    size_t segment;
+} pirate_udp_gro_t;
 
 typedef struct {
     int flags;
     int sock;
+    pirate_pacer_t pacer;
+    pirate_udp_gro_t gro;
 } udp_socket_ctx;
 
 int pirate_udp_socket_parse_param(char *str, void *_param);
@@ -31,10 +50,17 @@ int pirate_udp_socket_close(void *_ctx);
 ssize_t pirate_udp_socket_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t pirate_udp_socket_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t pirate_udp_socket_write_mtu(const void *_param, void *_ctx);
+ssize_t pirate_udp_socket_write_batch(const void *_param, void *_ctx, const struct iovec *iov, size_t iovlen, size_t count);
 
 int pirate_udp_socket_reader_open(pirate_udp_socket_param_t *param, common_ctx *ctx);
 int pirate_udp_socket_writer_open(pirate_udp_socket_param_t *param, common_ctx *ctx);
 
+// Shared with the GE_ETH channel type
+int pirate_udp_gso_open(int sock, int access, pirate_udp_gro_t *gro);
+void pirate_udp_gro_close(pirate_udp_gro_t *gro);
+ssize_t pirate_udp_gro_read(pirate_udp_gro_t *gro, int sock, void *buf, size_t count);
+ssize_t pirate_udp_gso_send(int sock, const struct iovec *iov, size_t iovlen, size_t segment, int flags);
+
 #define PIRATE_UDP_SOCKET_CHANNEL_FUNCS { pirate_udp_socket_parse_param, pirate_udp_socket_get_channel_description, pirate_udp_socket_open, pirate_udp_socket_close, pirate_udp_socket_read, pirate_udp_socket_write, pirate_udp_socket_write_mtu }
 
 #endif /* __PIRATE_CHANNEL_UDP_SOCKET_H */
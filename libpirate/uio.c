@@ -69,6 +69,14 @@ static inline int is_full(uint64_t value) {
     return get_status(value) == 2;
 }
 
+// Bytes in the ring
+static inline uint32_t get_queued(uint64_t value, uint32_t bufsize) {
+    if (is_full(value)) {
+        return bufsize;
+    }
+    return (get_write(value) - get_read(value) + bufsize) % bufsize;
+}
+
 static void pirate_uio_init_param(pirate_uio_param_t *param) {
     if (strnlen(param->path, 1) == 0) {
         snprintf(param->path, PIRATE_LEN_NAME - 1, PIRATE_UIO_DEFAULT_PATH);
@@ -160,6 +168,9 @@ int pirate_internal_uio_open(void *_param, void *_ctx) {
             goto error;
         }
 
+        // device memory is not cleared between sessions
+        memset(&buf->reader_stats, 0, sizeof(buf->reader_stats));
+
         do {
             init_pid = atomic_load(&buf->writer_pid);
         } while (!init_pid);
@@ -170,6 +181,9 @@ int pirate_internal_uio_open(void *_param, void *_ctx) {
             goto error;
         }
 
+        memset(&buf->writer_stats, 0, sizeof(buf->writer_stats));
+        buf->high_water = 0;
+
         do {
             init_pid = atomic_load(&buf->reader_pid);
         } while (!init_pid);
@@ -216,20 +230,32 @@ ssize_t pirate_internal_uio_read(const void *_param, void *_ctx, void *buffer, s
     uint32_t reader, writer;
     size_t nbytes, nbytes1, nbytes2;
     int buffer_size;
+    uint64_t spins = 0, start = 0;
 
     shmem_buffer_t* buf = ctx->buf;
     if (buf == NULL) {
         errno = EBADF;
         return -1;
     }
+    pirate_ring_side_stats_t *stats = &buf->reader_stats;
 
     for (;;) {
         position = atomic_load(&buf->position);
         if (!is_empty(position)) {
             break;
         }
+        if (spins++ == 0) {
+            start = pirate_monotonic_ns();
+        }
 
         if (atomic_load(&buf->writer_pid) == 0) {
+            break;
+        }
+    }
+    if (spins > 0) {
+        stats->spins += spins;
+        stats->blocked_ns += pirate_monotonic_ns() - start;
+        if (is_empty(position)) {
             return 0;
         }
     }
@@ -264,10 +290,29 @@ ssize_t pirate_internal_uio_read(const void *_param, void *_ctx, void *buffer, s
         }
         writer = get_write(position);
     }
+    stats->operations++;
 
     return nbytes;
 }
 
+void pirate_internal_uio_occupancy(const void *_ctx, uint64_t *queued, uint64_t *capacity) {
+    const uio_ctx *ctx = (const uio_ctx *)_ctx;
+    shmem_buffer_t *buf = ctx->buf;
+
+    *queued = get_queued(atomic_load(&buf->position), buf->size);
+    *capacity = buf->size;
+}
+
+void pirate_internal_uio_ring_stats(const void *_ctx, pirate_ring_stats_t *stats) {
+    const uio_ctx *ctx = (const uio_ctx *)_ctx;
+    shmem_buffer_t *buf = ctx->buf;
+
+    pirate_internal_uio_occupancy(_ctx, &stats->queued, &stats->capacity);
+    stats->high_water = buf->high_water;
+    memcpy(&stats->reader, &buf->reader_stats, sizeof(stats->reader));
+    memcpy(&stats->writer, &buf->writer_stats, sizeof(stats->writer));
+}
+
 ssize_t pirate_internal_uio_write_mtu(const void *_param, void *_ctx) {
     (void) _ctx;
     const pirate_uio_param_t *param = (const pirate_uio_param_t *)_param;
@@ -287,24 +332,40 @@ ssize_t pirate_internal_uio_write(const void *_param, void *_ctx, const void *bu
     uio_ctx *ctx = (uio_ctx *)_ctx;
     int buffer_size;
     size_t nbytes, nbytes1, nbytes2;
-    uint64_t position;
-    uint32_t reader, writer;
+    uint64_t position, spins = 0, start = 0;
+    uint32_t reader, writer, queued = 0;
+    int closed = 0;
 
     shmem_buffer_t* buf = ctx->buf;
     if (buf == NULL) {
         errno = EBADF;
         return -1;
     }
+    pirate_ring_side_stats_t *stats = &buf->writer_stats;
 
     // The writer returns -1 when the reader has closed the channel.
     // The reader returns 0 when the writer has closed the channel AND
     // the channel is empty.
-    do {
+    for (;;) {
         if (atomic_load(&buf->reader_pid) == 0) {
-            return -1;
+            closed = 1;
+            break;
         }
         position = atomic_load(&buf->position);
-    } while (is_full(position));
+        if (!is_full(position)) {
+            break;
+        }
+        if (spins++ == 0) {
+            start = pirate_monotonic_ns();
+        }
+    }
+    if (spins > 0) {
+        stats->spins += spins;
+        stats->blocked_ns += pirate_monotonic_ns() - start;
+    }
+    if (closed) {
+        return -1;
+    }
 
     do {
         position = atomic_load(&buf->position);
@@ -336,9 +397,14 @@ ssize_t pirate_internal_uio_write(const void *_param, void *_ctx, const void *bu
                                             reader, 1);
         if (atomic_compare_exchange_weak(&buf->position, &position,
                                             update)) {
+            queued = get_queued(update, buffer_size);
             break;
         }
         reader = get_read(position);
     }
+    if (queued > buf->high_water) {
+        buf->high_water = queued;
+    }
+    stats->operations++;
     return nbytes;
 }
@@ -34,6 +34,8 @@ int pirate_internal_uio_close(void *_ctx);
 ssize_t pirate_internal_uio_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t pirate_internal_uio_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t pirate_internal_uio_write_mtu(const void *_param, void *_ctx);
+void pirate_internal_uio_occupancy(const void *_ctx, uint64_t *queued, uint64_t *capacity);
+void pirate_internal_uio_ring_stats(const void *_ctx, pirate_ring_stats_t *stats);
 
 #define PIRATE_UIO_CHANNEL_FUNCS { pirate_internal_uio_parse_param, pirate_internal_uio_get_channel_description, pirate_internal_uio_open, pirate_internal_uio_close, pirate_internal_uio_read, pirate_internal_uio_write, pirate_internal_uio_write_mtu }
 
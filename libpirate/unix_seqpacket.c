@@ -24,6 +24,7 @@
 #include <string.h>
 #include <sys/un.h>
 #include <sys/socket.h>
+#include "memfd.h"
 #include "pirate_common.h"
 #include "unix_seqpacket.h"
 
@@ -60,6 +61,10 @@ int pirate_unix_seqpacket_parse_param(char *str, void *_param) {
             param->buffer_size = strtol(val, NULL, 10);
         } else if (strncmp("min_tx_size", key, strlen("min_tx_size")) == 0) {
             param->min_tx = strtol(val, NULL, 10);
+        } else if (strncmp("mtu", key, strlen("mtu")) == 0) {
+            param->mtu = strtol(val, NULL, 10);
+        } else if (strncmp("memfd_threshold", key, strlen("memfd_threshold")) == 0) {
+            param->memfd_threshold = strtol(val, NULL, 10);
         } else {
             errno = EINVAL;
             return -1;
@@ -73,10 +78,12 @@ int pirate_unix_seqpacket_get_channel_description(const void *_param, char *desc
     char min_tx_str[32];
     char buffer_size_str[32];
     char mtu_str[32];
+    char memfd_str[32];
 
     min_tx_str[0] = 0;
     buffer_size_str[0] = 0;
     mtu_str[0] = 0;
+    memfd_str[0] = 0;
     if (param->min_tx != 0) {
         snprintf(min_tx_str, 32, ",min_tx_size=%u", param->min_tx);
     }
@@ -86,8 +93,11 @@ int pirate_unix_seqpacket_get_channel_description(const void *_param, char *desc
     if (param->buffer_size != 0) {
         snprintf(buffer_size_str, 32, ",buffer_size=%u", param->buffer_size);
     }
-    return snprintf(desc, len, "unix_seqpacket,%s%s%s%s", param->path,
-        buffer_size_str, min_tx_str, mtu_str);
+    if (param->memfd_threshold != 0) {
+        snprintf(memfd_str, 32, ",memfd_threshold=%u", param->memfd_threshold);
+    }
+    return snprintf(desc, len, "unix_seqpacket,%s%s%s%s%s", param->path,
+        buffer_size_str, min_tx_str, mtu_str, memfd_str);
 }
 
 static int unix_seqpacket_reader_open(pirate_unix_seqpacket_param_t *param, unix_seqpacket_ctx *ctx) {
@@ -136,7 +146,7 @@ static int unix_seqpacket_reader_open(pirate_unix_seqpacket_param_t *param, unix
         return -1;
     }
 
-    ctx->sock = accept4(server_fd, NULL, NULL, nonblock);
+    ctx->sock = pirate_open_accept(server_fd, NULL, NULL, nonblock);
 
     if (ctx->sock < 0) {
         err = errno;
@@ -153,6 +163,7 @@ static int unix_seqpacket_reader_open(pirate_unix_seqpacket_param_t *param, unix
 
 static int unix_seqpacket_writer_open(pirate_unix_seqpacket_param_t *param, unix_seqpacket_ctx *ctx) {
     struct sockaddr_un addr;
+    long backoff = 0;
     int err, rv;
     int nonblock = ctx->flags & O_NONBLOCK;
 
@@ -180,12 +191,17 @@ static int unix_seqpacket_writer_open(pirate_unix_seqpacket_param_t *param, unix
         err = errno;
         rv = connect(ctx->sock, (struct sockaddr *)&addr, sizeof(addr));
         if (rv < 0) {
-            if ((errno == ENOENT) || (errno == ECONNREFUSED)) {
-                struct timespec req;
+            if (errno == ENOENT) {
+                // the reader has not yet bound the socket path
+                errno = err;
+                rv = pirate_open_wait_path(param->path, &backoff);
+                if (rv == 0) {
+                    continue;
+                }
+            } else if (errno == ECONNREFUSED) {
+                // the reader has bound the socket path but is not listening
                 errno = err;
-                req.tv_sec = 0;
-                req.tv_nsec = 1e8;
-                rv = nanosleep(&req, NULL);
+                rv = pirate_open_backoff(&backoff, 0);
                 if (rv == 0) {
                     continue;
                 }
@@ -205,10 +221,11 @@ static int unix_seqpacket_writer_open(pirate_unix_seqpacket_param_t *param, unix
 int pirate_unix_seqpacket_open(void *_param, void *_ctx) {
     pirate_unix_seqpacket_param_t *param = (pirate_unix_seqpacket_param_t *)_param;
     unix_seqpacket_ctx *ctx = (unix_seqpacket_ctx *)_ctx;
-    int rv = -1;
+    int err, rv = -1;
     int access = ctx->flags & O_ACCMODE;
 
     pirate_unix_seqpacket_init_param(param);
+    ctx->memfd_pool = NULL;
 
     if (strnlen(param->path, 1) == 0) {
         errno = EINVAL;
@@ -219,12 +236,29 @@ int pirate_unix_seqpacket_open(void *_param, void *_ctx) {
     } else {
         rv = unix_seqpacket_writer_open(param, ctx);
     }
+    if (rv < 0) {
+        return -1;
+    }
 
     if ((ctx->min_tx_buf = calloc(param->min_tx, 1)) == NULL) {
-        return -1;
+        goto error;
+    }
+
+    if ((access == O_WRONLY) && (param->memfd_threshold > 0)) {
+        if ((ctx->memfd_pool = pirate_memfd_pool_create()) == NULL) {
+            goto error;
+        }
     }
 
     return rv;
+error:
+    err = errno;
+    free(ctx->min_tx_buf);
+    ctx->min_tx_buf = NULL;
+    close(ctx->sock);
+    ctx->sock = -1;
+    errno = err;
+    return -1;
 }
 
 
@@ -237,6 +271,11 @@ int pirate_unix_seqpacket_close(void *_ctx) {
         ctx->min_tx_buf = NULL;
     }
 
+    if (ctx->memfd_pool != NULL) {
+        pirate_memfd_pool_destroy(ctx->memfd_pool);
+        ctx->memfd_pool = NULL;
+    }
+
     if (ctx->sock <= 0) {
         errno = ENODEV;
         return -1;
@@ -247,13 +286,49 @@ int pirate_unix_seqpacket_close(void *_ctx) {
     return rv;
 }
 
+static ssize_t unix_seqpacket_memfd_read(unix_seqpacket_ctx *ctx, void *buf, size_t count) {
+    uint8_t scratch[sizeof(uint32_t)];
+    struct iovec iov[2];
+    uint32_t packet_count;
+    size_t prefix;
+    ssize_t rv;
+    int fd = -1;
+
+    // The memfd descriptor may be split between
+    // the caller's buffer and the scratch buffer.
+    iov[0].iov_base = buf;
+    iov[0].iov_len = count;
+    iov[1].iov_base = scratch;
+    iov[1].iov_len = sizeof(scratch);
+    rv = pirate_memfd_recvmsg(ctx->sock, iov, 2, &fd);
+    if (rv < 0) {
+        return rv;
+    }
+    if (fd < 0) {
+        return MIN((size_t) rv, count);
+    }
+    if (rv != sizeof(packet_count)) {
+        close(fd);
+        errno = EBADMSG;
+        return -1;
+    }
+    prefix = MIN(count, sizeof(packet_count));
+    memcpy(&packet_count, buf, prefix);
+    memcpy(((uint8_t*) &packet_count) + prefix, scratch, sizeof(packet_count) - prefix);
+    packet_count = ntohl(packet_count) & ~PIRATE_MEMFD_FLAG;
+    return pirate_memfd_consume(ctx->sock, fd, buf, MIN(count, packet_count));
+}
+
 ssize_t pirate_unix_seqpacket_read(const void *_param, void *_ctx, void *buf, size_t count) {
-    (void) _param;
+    const pirate_unix_seqpacket_param_t *param = (const pirate_unix_seqpacket_param_t *)_param;
     unix_seqpacket_ctx *ctx = (unix_seqpacket_ctx *)_ctx;
     if (ctx->sock <= 0) {
         errno = EBADF;
         return -1;
     }
+    if (param->memfd_threshold > 0) {
+        return unix_seqpacket_memfd_read(ctx, buf, count);
+    }
     return recv(ctx->sock, buf, count, 0);
 }
 
@@ -263,6 +338,29 @@ ssize_t pirate_unix_seqpacket_write_mtu(const void *_param, void *_ctx) {
     return param->mtu;
 }
 
+static ssize_t unix_seqpacket_memfd_write(unix_seqpacket_ctx *ctx, const void *buf, size_t count) {
+    pirate_memfd_slot_t *slot;
+    uint32_t packet_count;
+    ssize_t rv;
+
+    if (count >= PIRATE_MEMFD_FLAG) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    slot = pirate_memfd_pool_acquire(ctx->memfd_pool, ctx->sock, count);
+    if (slot == NULL) {
+        return -1;
+    }
+    memcpy(slot->addr, buf, count);
+    packet_count = htonl(count | PIRATE_MEMFD_FLAG);
+    rv = pirate_memfd_sendmsg(ctx->sock, &packet_count, sizeof(packet_count), slot->fd);
+    if (rv < 0) {
+        return rv;
+    }
+    pirate_memfd_pool_commit(ctx->memfd_pool);
+    return count;
+}
+
 ssize_t pirate_unix_seqpacket_write(const void *_param, void *_ctx, const void *buf, size_t count) {
     const pirate_unix_seqpacket_param_t *param = (const pirate_unix_seqpacket_param_t *)_param;
     unix_seqpacket_ctx *ctx = (unix_seqpacket_ctx *)_ctx;
@@ -276,5 +374,8 @@ ssize_t pirate_unix_seqpacket_write(const void *_param, void *_ctx, const void *
         errno = EMSGSIZE;
         return -1;
     }
+    if ((param->memfd_threshold > 0) && (count >= param->memfd_threshold)) {
+        return unix_seqpacket_memfd_write(ctx, buf, count);
+    }
     return send(ctx->sock, buf, count, 0);
 }
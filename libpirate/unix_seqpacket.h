@@ -17,11 +17,13 @@
 #define __PIRATE_CHANNEL_UNIX_SEQPACKET_H
 
 #include "libpirate.h"
+#include "memfd.h"
 
 typedef struct {
     int flags;
     int sock;
     uint8_t *min_tx_buf;
+    pirate_memfd_pool_t *memfd_pool;
 } unix_seqpacket_ctx;
 
 int pirate_unix_seqpacket_parse_param(char *str, void *_param);
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <sys/un.h>
 #include <sys/socket.h>
+#include "memfd.h"
 #include "pirate_common.h"
 #include "unix_socket.h"
 
@@ -58,6 +59,10 @@ int pirate_unix_socket_parse_param(char *str, void *_param) {
             param->buffer_size = strtol(val, NULL, 10);
         } else if (strncmp("min_tx_size", key, strlen("min_tx_size")) == 0) {
             param->min_tx = strtol(val, NULL, 10);
+        } else if (strncmp("mtu", key, strlen("mtu")) == 0) {
+            param->mtu = strtol(val, NULL, 10);
+        } else if (strncmp("memfd_threshold", key, strlen("memfd_threshold")) == 0) {
+            param->memfd_threshold = strtol(val, NULL, 10);
         } else {
             errno = EINVAL;
             return -1;
@@ -71,10 +76,12 @@ int pirate_unix_socket_get_channel_description(const void *_param, char *desc, i
     char min_tx_str[32];
     char buffer_size_str[32];
     char mtu_str[32];
+    char memfd_str[32];
 
     min_tx_str[0] = 0;
     buffer_size_str[0] = 0;
     mtu_str[0] = 0;
+    memfd_str[0] = 0;
     if (param->min_tx != 0) {
         snprintf(min_tx_str, 32, ",min_tx_size=%u", param->min_tx);
     }
@@ -84,8 +91,11 @@ int pirate_unix_socket_get_channel_description(const void *_param, char *desc, i
     if (param->buffer_size != 0) {
         snprintf(buffer_size_str, 32, ",buffer_size=%u", param->buffer_size);
     }
-    return snprintf(desc, len, "unix_socket,%s%s%s%s", param->path,
-        buffer_size_str, min_tx_str, mtu_str);
+    if (param->memfd_threshold != 0) {
+        snprintf(memfd_str, 32, ",memfd_threshold=%u", param->memfd_threshold);
+    }
+    return snprintf(desc, len, "unix_socket,%s%s%s%s%s", param->path,
+        buffer_size_str, min_tx_str, mtu_str, memfd_str);
 }
 
 static int unix_socket_reader_open(pirate_unix_socket_param_t *param, unix_socket_ctx *ctx) {
@@ -132,7 +142,7 @@ static int unix_socket_reader_open(pirate_unix_socket_param_t *param, unix_socke
         return -1;
     }
 
-    ctx->sock = accept(server_fd, NULL, NULL);
+    ctx->sock = pirate_open_accept(server_fd, NULL, NULL, 0);
 
     if (ctx->sock < 0) {
         err = errno;
@@ -149,6 +159,7 @@ static int unix_socket_reader_open(pirate_unix_socket_param_t *param, unix_socke
 
 static int unix_socket_writer_open(pirate_unix_socket_param_t *param, unix_socket_ctx *ctx) {
     struct sockaddr_un addr;
+    long backoff = 0;
     int err, rv;
 
     ctx->sock = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -175,12 +186,17 @@ static int unix_socket_writer_open(pirate_unix_socket_param_t *param, unix_socke
         err = errno;
         rv = connect(ctx->sock, (struct sockaddr *)&addr, sizeof(addr));
         if (rv < 0) {
-            if ((errno == ENOENT) || (errno == ECONNREFUSED)) {
-                struct timespec req;
+            if (errno == ENOENT) {
+                // the reader has not yet bound the socket path
                 errno = err;
-                req.tv_sec = 0;
-                req.tv_nsec = 1e8;
-                rv = nanosleep(&req, NULL);
+                rv = pirate_open_wait_path(param->path, &backoff);
+                if (rv == 0) {
+                    continue;
+                }
+            } else if (errno == ECONNREFUSED) {
+                // the reader has bound the socket path but is not listening
+                errno = err;
+                rv = pirate_open_backoff(&backoff, 0);
                 if (rv == 0) {
                     continue;
                 }
@@ -200,10 +216,11 @@ static int unix_socket_writer_open(pirate_unix_socket_param_t *param, unix_socke
 int pirate_unix_socket_open(void *_param, void *_ctx) {
     pirate_unix_socket_param_t *param = (pirate_unix_socket_param_t *)_param;
     unix_socket_ctx *ctx = (unix_socket_ctx *)_ctx;
-    int rv = -1;
+    int err, rv = -1;
     int access = ctx->flags & O_ACCMODE;
 
     pirate_unix_socket_init_param(param);
+    ctx->memfd_pool = NULL;
 
     if (strnlen(param->path, 1) == 0) {
         errno = EINVAL;
@@ -214,12 +231,29 @@ int pirate_unix_socket_open(void *_param, void *_ctx) {
     } else {
         rv = unix_socket_writer_open(param, ctx);
     }
+    if (rv < 0) {
+        return -1;
+    }
 
     if ((ctx->min_tx_buf = calloc(param->min_tx, 1)) == NULL) {
-        return -1;
+        goto error;
+    }
+
+    if ((access == O_WRONLY) && (param->memfd_threshold > 0)) {
+        if ((ctx->memfd_pool = pirate_memfd_pool_create()) == NULL) {
+            goto error;
+        }
     }
 
     return rv;
+error:
+    err = errno;
+    free(ctx->min_tx_buf);
+    ctx->min_tx_buf = NULL;
+    close(ctx->sock);
+    ctx->sock = -1;
+    errno = err;
+    return -1;
 }
 
 
@@ -232,6 +266,11 @@ int pirate_unix_socket_close(void *_ctx) {
         ctx->min_tx_buf = NULL;
     }
 
+    if (ctx->memfd_pool != NULL) {
+        pirate_memfd_pool_destroy(ctx->memfd_pool);
+        ctx->memfd_pool = NULL;
+    }
+
     if (ctx->sock <= 0) {
         errno = ENODEV;
         return -1;
@@ -242,8 +281,51 @@ int pirate_unix_socket_close(void *_ctx) {
     return rv;
 }
 
+static ssize_t unix_socket_memfd_read(const pirate_unix_socket_param_t *param, unix_socket_ctx *ctx, void *buf, size_t count) {
+    pirate_header_t *header = (pirate_header_t*) ctx->min_tx_buf;
+    struct iovec iov;
+    uint32_t packet_count;
+    size_t rx = 0;
+    ssize_t rv;
+    int fd = -1;
+
+    if (ctx->sock < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    while (rx < param->min_tx) {
+        iov.iov_base = ctx->min_tx_buf + rx;
+        iov.iov_len = param->min_tx - rx;
+        rv = pirate_memfd_recvmsg(ctx->sock, &iov, 1, &fd);
+        if (rv <= 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            return rv;
+        }
+        rx += rv;
+    }
+    packet_count = ntohl(header->count);
+    if ((packet_count & PIRATE_MEMFD_FLAG) == 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return pirate_stream_read_body((common_ctx*) ctx, param->min_tx, buf, count);
+    }
+    if (fd < 0) {
+        errno = EBADMSG;
+        return -1;
+    }
+    packet_count &= ~PIRATE_MEMFD_FLAG;
+    return pirate_memfd_consume(ctx->sock, fd, buf, MIN(count, packet_count));
+}
+
 ssize_t pirate_unix_socket_read(const void *_param, void *_ctx, void *buf, size_t count) {
     const pirate_unix_socket_param_t *param = (const pirate_unix_socket_param_t *)_param;
+    if (param->memfd_threshold > 0) {
+        return unix_socket_memfd_read(param, (unix_socket_ctx*) _ctx, buf, count);
+    }
     return pirate_stream_read((common_ctx*) _ctx, param->min_tx, buf, count);
 }
 
@@ -261,8 +343,51 @@ ssize_t pirate_unix_socket_write_mtu(const void *_param, void *_ctx) {
     return mtu - sizeof(pirate_header_t);
 }
 
+static ssize_t unix_socket_memfd_write(const pirate_unix_socket_param_t *param, unix_socket_ctx *ctx, const void *buf, size_t count) {
+    pirate_header_t *header = (pirate_header_t*) ctx->min_tx_buf;
+    pirate_memfd_slot_t *slot;
+    size_t tx;
+    ssize_t rv;
+
+    if (ctx->sock < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    if (count >= PIRATE_MEMFD_FLAG) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    slot = pirate_memfd_pool_acquire(ctx->memfd_pool, ctx->sock, count);
+    if (slot == NULL) {
+        return -1;
+    }
+    memcpy(slot->addr, buf, count);
+    header->count = htonl(count | PIRATE_MEMFD_FLAG);
+    rv = pirate_memfd_sendmsg(ctx->sock, ctx->min_tx_buf, param->min_tx, slot->fd);
+    if (rv < 0) {
+        return rv;
+    }
+    pirate_memfd_pool_commit(ctx->memfd_pool);
+    tx = rv;
+    while (tx < param->min_tx) {
+        rv = write(ctx->sock, ctx->min_tx_buf + tx, param->min_tx - tx);
+        if (rv < 0) {
+            return rv;
+        }
+        tx += rv;
+    }
+    return count;
+}
+
 ssize_t pirate_unix_socket_write(const void *_param, void *_ctx, const void *buf, size_t count) {
     const pirate_unix_socket_param_t *param = (const pirate_unix_socket_param_t *)_param;
     ssize_t mtu = pirate_unix_socket_write_mtu(param, _ctx);
+    if ((param->memfd_threshold > 0) && (count >= param->memfd_threshold)) {
+        if ((mtu > 0) && (count > (size_t) mtu)) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        return unix_socket_memfd_write(param, (unix_socket_ctx*) _ctx, buf, count);
+    }
     return pirate_stream_write((common_ctx*)_ctx, param->min_tx, mtu, buf, count);
 }
@@ -214,6 +214,15 @@ int pirate_channel_resource_handler(pal_env_t *env,
             params.channel.ge_eth.message_id
                     = rsc->r_contents.cc_message_id;
             break;
+        case PROCESS_VM:
+            if(rsc->r_contents.cc_path)
+                strncpy(params.channel.process_vm.path,
+                        rsc->r_contents.cc_path, PIRATE_LEN_NAME);
+            params.channel.process_vm.mtu
+                    = rsc->r_contents.cc_mtu;
+            params.channel.process_vm.ring_len
+                    = rsc->r_contents.cc_ring_len;
+            break;
         default:
             fatal("Pirate channel %s has unknown channel type: %d",
                     rsc->r_name, params.channel_type);
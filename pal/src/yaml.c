@@ -43,6 +43,7 @@ static const cyaml_strval_t channel_type_strings[] = {
     {"serial",      SERIAL},
     {"mercury",     MERCURY},
     {"ge_eth",      GE_ETH},
+    {"process_vm",  PROCESS_VM},
 };
 
 static const cyaml_schema_field_t __attribute__((unused))
@@ -139,6 +140,8 @@ static const cyaml_schema_field_t rsc_contents_field_schema[] = {
             struct rsc_contents, cc_session, session_field_schema),
     CYAML_FIELD_UINT("message_id", CYAML_FLAG_OPTIONAL,
             struct rsc_contents, cc_message_id),
+    CYAML_FIELD_UINT("ring_len", CYAML_FLAG_OPTIONAL,
+            struct rsc_contents, cc_ring_len),
 
     /* Trivial resources
      */
@@ -43,7 +43,7 @@ struct rsc_contents {
     /* pirate_ and fd_channel
      */
     channel_enum_t cc_channel_type;
-    char *cc_path;              // device, pipe, unix_socket, shmem, udp_shmem, uio, serial
+    char *cc_path;              // device, pipe, unix_socket, shmem, udp_shmem, uio, serial, process_vm
     uint32_t cc_min_tx_size;    // device, pipe, unix_socket, tcp_socket
     uint32_t cc_mtu;            // ALL
     uint32_t cc_buffer_size;    // unix_socket, tcp_socket, udp_socket, shmem, udp_shmem
@@ -58,6 +58,7 @@ struct rsc_contents {
     speed_t cc_baud;            // serial
     struct session *cc_session; // mercury
     uint32_t cc_message_id;     // ge_eth
+    uint32_t cc_ring_len;       // process_vm
 
     /* Trivial resources
      */
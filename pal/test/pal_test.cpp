@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "handlers.h"
+#include "yaml.h"
+}
+
+namespace {
+
+static const char process_vm_yaml[] =
+    "enclaves:\n"
+    "    - name: app\n"
+    "resources:\n"
+    "    - name: channel\n"
+    "      ids: [ \"app/channel\" ]\n"
+    "      type: pirate_channel\n"
+    "      contents:\n"
+    "          channel_type: process_vm\n"
+    "          path: /gaps.pal_process_vm\n"
+    "          ring_len: 16\n"
+    "          mtu: 1024\n";
+
+static struct top_level *load_yaml_string(const char *yaml)
+{
+    char path[] = "/tmp/pal_test.XXXXXX";
+    struct top_level *tl;
+    ssize_t len = strlen(yaml);
+    int fd;
+
+    if((fd = mkstemp(path)) < 0)
+        return NULL;
+    if(write(fd, yaml, len) != len) {
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+    close(fd);
+
+    tl = load_yaml(path);
+    unlink(path);
+    return tl;
+}
+
+static resource_handler_t *find_handler(const char *type)
+{
+    for(struct handler_table_entry *e = handler_table; e->type; ++e)
+        if(!strcmp(e->type, type))
+            return e->handler;
+    return NULL;
+}
+
+TEST(PalResourceTest, ProcessVmChannel)
+{
+    struct top_level *tl = load_yaml_string(process_vm_yaml);
+    ASSERT_NE(nullptr, tl);
+    ASSERT_EQ(1u, tl->tl_rscs_count);
+
+    const struct resource *rsc = &tl->tl_rscs[0];
+    EXPECT_EQ(PROCESS_VM, rsc->r_contents.cc_channel_type);
+    EXPECT_STREQ("/gaps.pal_process_vm", rsc->r_contents.cc_path);
+    EXPECT_EQ(16u, rsc->r_contents.cc_ring_len);
+    EXPECT_EQ(1024u, rsc->r_contents.cc_mtu);
+
+    resource_handler_t *handler = find_handler(rsc->r_type);
+    ASSERT_NE(nullptr, handler);
+
+    pal_env_t env = EMPTY_PAL_ENV(PAL_RESOURCE);
+    ASSERT_EQ(0, handler(&env, NULL, rsc));
+
+    pal_env_iterator_t it = pal_env_iterator_start(&env);
+    ASSERT_LT(it, pal_env_iterator_end(&env));
+    std::string desc((const char *)pal_env_iterator_data(it),
+            pal_env_iterator_size(it));
+    EXPECT_EQ("process_vm,/gaps.pal_process_vm,ring_len=16,mtu=1024", desc);
+
+    pirate_channel_param_t param;
+    ASSERT_EQ(0, pirate_parse_channel_param(desc.c_str(), &param));
+    EXPECT_EQ(PROCESS_VM, param.channel_type);
+    EXPECT_STREQ("/gaps.pal_process_vm", param.channel.process_vm.path);
+    EXPECT_EQ(16u, param.channel.process_vm.ring_len);
+    EXPECT_EQ(1024u, param.channel.process_vm.mtu);
+
+    pal_free_env(&env);
+    free_yaml(tl);
+}
+
+} // namespace